@@ -71,6 +71,7 @@ PDFViewer::PDFViewer(const QString & pdf_doc, QWidget *parent, Qt::WindowFlags f
 #endif
   _toolBar->addWidget(_search);
   connect(_search, SIGNAL(searchRequested(QString)), docWidget, SLOT(search(QString)));
+  connect(_search, SIGNAL(textEdited(QString)), docWidget, SLOT(incrementalSearch(QString)));
   connect(_search, SIGNAL(gotoNextResult()), docWidget, SLOT(nextSearchResult()));
   connect(_search, SIGNAL(gotoPreviousResult()), docWidget, SLOT(previousSearchResult()));
   connect(_search, SIGNAL(searchCleared()), docWidget, SLOT(clearSearchResults()));
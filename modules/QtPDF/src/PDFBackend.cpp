@@ -13,14 +13,31 @@
  */
 
 #include "PDFBackend.h"
+#include "PDFGrayScale.h"
+#include "PDFSearchIndex.h"
 
 #include <QApplication>
+#include <QAtomicInt>
+#include <QBitArray>
 #include <QElapsedTimer>
+#include <QFile>
 #include <QPainter>
 #include <QPainterPath>
+#include <QRegularExpression>
 #include <algorithm>
+#include <limits>
 #include <memory>
 #include <list>
+#include <utility>
+#include <vector>
+
+// Comparison operator for QSizeF needed to use QSizeF as keys in a QMap
+// NB: Must be in the global namespace
+inline bool operator<(const QSizeF & a, const QSizeF & b) {
+    qreal areaA = a.width() * a.height();
+    qreal areaB = b.width() * b.height();
+    return (areaA < areaB || (areaA == areaB && a.width() < b.width()));
+}
 
 namespace QtPDF {
 
@@ -155,11 +172,11 @@ QDateTime fromPDFDate(QString pdfDate)
 }
 
 #ifdef DEBUG
-void PDFPageProcessingThread::dumpWorkStack(const QStack<PageProcessingRequest*> & ws)
+void PDFPageProcessingThread::dumpWorkQueue(const QList<PageProcessingRequest*> & wq)
 {
   QStringList strList;
-  for (int i = 0; i < ws.size(); ++i) {
-    PageProcessingRequest * request = ws[i];
+  for (int i = 0; i < wq.size(); ++i) {
+    PageProcessingRequest * request = wq[i];
     if (!request)
       strList << QString::fromUtf8("NULL");
     else {
@@ -174,16 +191,80 @@ void PDFPageProcessingThread::dumpWorkStack(const QStack<PageProcessingRequest*>
 // Backend Rendering
 // =================
 
+// The worker threads of a `PDFPageProcessingThread` pool. Each worker simply
+// runs the main loop of its pool.
+class PDFPageProcessingWorker : public QThread
+{
+public:
+  PDFPageProcessingWorker(PDFPageProcessingThread * pool, const int index) : _pool(pool), _index(index) { }
+
+protected:
+  void run() override { _pool->processRequests(_index); }
+
+private:
+  PDFPageProcessingThread * _pool;
+  const int _index;
+};
+
+static int defaultProcessingWorkerCount = 0;
+
 PDFPageProcessingThread::~PDFPageProcessingThread()
 {
   _mutex.lock();
   _quit = true;
   _waitCondition.wakeAll();
   _mutex.unlock();
-  wait();
+  foreach(PDFPageProcessingWorker * worker, _workers) {
+    worker->wait();
+    delete worker;
+  }
 }
 
-void PDFPageProcessingThread::addPageProcessingRequest(PageProcessingRequest * request)
+//static
+int PDFPageProcessingThread::defaultWorkerCount()
+{
+  if (defaultProcessingWorkerCount > 0)
+    return defaultProcessingWorkerCount;
+  return qMax(1, QThread::idealThreadCount());
+}
+
+//static
+void PDFPageProcessingThread::setDefaultWorkerCount(const int count)
+{
+  // Values < 1 reset to the default of QThread::idealThreadCount()
+  defaultProcessingWorkerCount = qMax(0, count);
+}
+
+int PDFPageProcessingThread::workerCount() const
+{
+  QMutexLocker locker(&_mutex);
+  return _workerCount;
+}
+
+void PDFPageProcessingThread::setWorkerCount(const int count)
+{
+  QMutexLocker locker(&_mutex);
+  _workerCount = qMax(1, count);
+  // Workers that are not used anymore simply go to sleep (see
+  // processRequests()); if we can use more workers now, they are started
+  // on demand in addPageProcessingRequest()
+  _waitCondition.wakeAll();
+}
+
+bool PDFPageProcessingThread::isSerialized() const
+{
+  QMutexLocker locker(&_mutex);
+  return _serialized;
+}
+
+void PDFPageProcessingThread::setSerialized(const bool serialized)
+{
+  QMutexLocker locker(&_mutex);
+  _serialized = serialized;
+  _waitCondition.wakeAll();
+}
+
+void PDFPageProcessingThread::addPageProcessingRequest(PageProcessingRequest * request, const bool takeOverOnly /* = false */)
 {
 
   if (!request)
@@ -194,51 +275,198 @@ void PDFPageProcessingThread::addPageProcessingRequest(PageProcessingRequest * r
   Q_ASSERT(request->thread() == QApplication::instance()->thread());
 
   QMutexLocker locker(&(this->_mutex));
-  // Note: Commenting the "remove identical requests in the stack" code for now.
-  // This should be handled by the caching routine elsewhere automatically. If
-  // in doubt, it's better to render a tile twice than to not render it at all
-  // (thereby leaving the dummy image in the cache indefinitely)
-/*
-  // remove any instances of the given request type before adding the new one to
-  // avoid processing it several times
-  // **TODO:** Could it be that we require several concurrent versions of the
-  //           same page?
-  int i;
-  for (i = _workStack.size() - 1; i >= 0; --i) {
-    if (*(_workStack[i]) == *request) {
-      // Using deleteLater() doesn't work because we have no event queue in this
-      // thread. However, since the object is still on the stack, it is still
-      // sleeping and directly deleting it should therefore be safe.
-      delete _workStack[i];
-      _workStack.remove(i);
-    }
+
+  // Coalesce identical requests. Note that we keep the request that is already
+  // queued (and only adjust its priority) rather than replacing it. That way,
+  // it is guaranteed that the tile is still rendered eventually (otherwise we
+  // could leave the dummy image in the cache indefinitely).
+  const PageProcessingRequest::Key key = request->key();
+  PageProcessingRequest * queued = findQueuedRequest(key, request->listener);
+  if (queued) {
+#ifdef DEBUG
+    qDebug() << "coalescing request:" << *request;
+#endif
+    queued->merge(*request);
+    coalesce(queued, request->listener, request->priority);
+    // `request` has never been seen by any other thread, so it is safe to
+    // delete it right away
+    delete request;
+    return;
+  }
+  if (request->listener && takeOverActiveRequest(key, request->listener)) {
+#ifdef DEBUG
+    qDebug() << "taking over request:" << *request;
+#endif
+    delete request;
+    return;
+  }
+  if (takeOverOnly) {
+    delete request;
+    return;
   }
-*/
 
-  _workStack.push(request);
+  enqueue(request);
+  _queuedRequests.insert(key, request);
 #ifdef DEBUG
   qDebug() << "new request:" << *request;
 #endif
 
-  locker.unlock();
-  if (!isRunning())
-    start();
+  // If all usable workers are busy, start another one (if we are allowed to);
+  // otherwise wake up a sleeping one
+  if (_busyWorkers >= qMin(_workers.size(), effectiveWorkerCount()) && _workers.size() < effectiveWorkerCount()) {
+    PDFPageProcessingWorker * worker = new PDFPageProcessingWorker(this, _workers.size());
+    _workers.append(worker);
+    // The new worker counts as busy until it goes to sleep for the first time
+    ++_busyWorkers;
+    worker->start();
+  }
+  // Surplus workers (see processRequests()) don't take any work, so they
+  // would swallow a single wake-up; otherwise, waking up one worker suffices
+  // as only one request was added
+  else if (_workers.size() > effectiveWorkerCount())
+    _waitCondition.wakeAll();
   else
     _waitCondition.wakeOne();
 }
 
-void PDFPageProcessingThread::run()
+bool PDFPageProcessingThread::takeOverRequest(const PageProcessingRequest::Key & key, QObject * listener, const qreal priority)
+{
+  QMutexLocker locker(&_mutex);
+  PageProcessingRequest * queued = findQueuedRequest(key, listener);
+  if (queued) {
+    coalesce(queued, listener, priority);
+    return true;
+  }
+  return (listener && takeOverActiveRequest(key, listener));
+}
+
+PageProcessingRequest * PDFPageProcessingThread::findQueuedRequest(const PageProcessingRequest::Key & key, const QObject * listener) const
+{
+  // Requests for different listeners are not coalesced as each listener needs
+  // to be notified. Requests without listener (see Page::prefetchTileImage())
+  // don't need that, so they are coalesced with any identical request.
+  for (QMultiHash<PageProcessingRequest::Key, PageProcessingRequest*>::const_iterator it = _queuedRequests.constFind(key); it != _queuedRequests.constEnd() && it.key() == key; ++it) {
+    PageProcessingRequest * queued = it.value();
+    if (queued->listener && listener && queued->listener != listener)
+      continue;
+    return queued;
+  }
+  return nullptr;
+}
+
+void PDFPageProcessingThread::coalesce(PageProcessingRequest * queued, QObject * listener, const qreal priority)
+{
+  // If the queued request has no listener, it is taken over by the new one
+  if (!queued->listener)
+    queued->listener = listener;
+  if (priority < queued->priority) {
+    dequeue(queued);
+    queued->priority = priority;
+    enqueue(queued);
+  }
+}
+
+bool PDFPageProcessingThread::takeOverActiveRequest(const PageProcessingRequest::Key & key, QObject * listener)
+{
+  // The worker picks up the new listener in finishRequest(). There are no
+  // more active requests than workers, so there is no need for an index.
+  foreach(PageProcessingRequest * active, _activeRequests) {
+    if (active->listener || !(active->key() == key))
+      continue;
+    active->listener = listener;
+    return true;
+  }
+  return false;
+}
+
+QObject * PDFPageProcessingThread::finishRequest(PageProcessingRequest * request)
+{
+  QMutexLocker locker(&_mutex);
+  _activeRequests.removeOne(request);
+  return request->listener;
+}
+
+int PDFPageProcessingThread::numPendingRequests(const qreal maxPriority /* = std::numeric_limits<qreal>::max() */) const
+{
+  QMutexLocker locker(&_mutex);
+  // _workQueue is sorted by descending priority value, so the requests in
+  // question are at the end
+  int retVal = 0;
+  for (int i = static_cast<int>(_workQueue.size()) - 1; i >= 0 && _workQueue[i]->priority < maxPriority; --i)
+    ++retVal;
+  return retVal;
+}
+
+void PDFPageProcessingThread::enqueue(PageProcessingRequest * request)
+{
+  // Keep _workQueue sorted by descending priority value so the most urgent
+  // request is always at the end. Requests of equal priority are inserted
+  // behind the existing ones to retain the LIFO behavior of the original work
+  // stack (newer requests are typically more relevant).
+  const qreal priority = request->priority;
+  QList<PageProcessingRequest*>::iterator it = std::partition_point(_workQueue.begin(), _workQueue.end(),
+    [priority](const PageProcessingRequest * r) { return r->priority >= priority; });
+  _workQueue.insert(it, request);
+}
+
+void PDFPageProcessingThread::dequeue(PageProcessingRequest * request)
+{
+  // Requests of equal priority are adjacent in _workQueue, so only those need
+  // to be searched
+  const qreal priority = request->priority;
+  QList<PageProcessingRequest*>::iterator it = std::partition_point(_workQueue.begin(), _workQueue.end(),
+    [priority](const PageProcessingRequest * r) { return r->priority > priority; });
+  while (it != _workQueue.end() && *it != request)
+    ++it;
+  if (it != _workQueue.end())
+    _workQueue.erase(it);
+}
+
+void PDFPageProcessingThread::reprioritize(const std::function<bool(PageProcessingRequest & request)> & update)
+{
+  QList<PageProcessingRequest*> cancelled;
+  {
+    QMutexLocker locker(&_mutex);
+    for (QList<PageProcessingRequest*>::iterator it = _workQueue.begin(); it != _workQueue.end(); ) {
+      if (*it && !update(**it)) {
+        cancelled << *it;
+        _queuedRequests.remove((*it)->key(), *it);
+        it = _workQueue.erase(it);
+      }
+      else
+        ++it;
+    }
+    std::stable_sort(_workQueue.begin(), _workQueue.end(),
+      [](const PageProcessingRequest * a, const PageProcessingRequest * b) { return a->priority > b->priority; });
+  }
+
+  // Clean up outside of the lock as cancel() may need to acquire other locks
+  // (which we must not do while holding _mutex; see clearWorkStack())
+  foreach(PageProcessingRequest * workItem, cancelled) {
+#ifdef DEBUG
+    qDebug() << "cancelling request:" << *workItem;
+#endif
+    Q_ASSERT(workItem->thread() == QApplication::instance()->thread());
+    workItem->cancel();
+    workItem->deleteLater();
+  }
+}
+
+void PDFPageProcessingThread::processRequests(const int workerIndex)
 {
   _mutex.lock();
-  _idle = false;
   while (!_quit) {
     // mutex must be locked at start of loop
-    if (!_workStack.empty()) {
-      PageProcessingRequest * workItem = _workStack.pop();
+    // Note: Workers with an index beyond the current effectiveWorkerCount()
+    // (e.g., after setSerialized(true)) don't take any work
+    if (!_workQueue.empty() && workerIndex < effectiveWorkerCount()) {
+      PageProcessingRequest * workItem = _workQueue.takeLast();
+      _queuedRequests.remove(workItem->key(), workItem);
+      _activeRequests << workItem;
       _mutex.unlock();
 
 #ifdef DEBUG
-      qDebug() << "processing work item" << *workItem << "; remaining items:" << _workStack.size();
+      qDebug() << "worker" << workerIndex << "processing work item" << *workItem;
       QElapsedTimer timer;
       timer.start();
 #endif
@@ -249,11 +477,14 @@ void PDFPageProcessingThread::run()
         case PageProcessingRequest::LoadLinks:
           jobDesc = QString::fromUtf8("loading links");
           break;
+        case PageProcessingRequest::LoadAnnotations:
+          jobDesc = QString::fromUtf8("loading annotations");
+          break;
         case PageProcessingRequest::PageRendering:
           jobDesc = QString::fromUtf8("rendering page");
           break;
       }
-      qDebug() << "finished " << jobDesc << "for page" << workItem->page->pageNum() << ". Time elapsed: " << timer.elapsed() << " ms.";
+      qDebug() << "worker" << workerIndex << "finished " << jobDesc << "for page" << workItem->page->pageNum() << ". Time elapsed: " << timer.elapsed() << " ms.";
 #endif
 
       // Delete the work item as it has fulfilled its purpose
@@ -261,24 +492,29 @@ void PDFPageProcessingThread::run()
       // signals are invalidated; to ensure they reach their destination, we
       // need to call deleteLater().
       // Note: workItem *must* live in the main (GUI) thread for this!
+      // Note: It must not be in _activeRequests anymore by then, as the main
+      // thread could otherwise find it there after it was deleted
+      _mutex.lock();
+      _activeRequests.removeOne(workItem);
       Q_ASSERT(workItem->thread() == QApplication::instance()->thread());
       workItem->deleteLater();
-
-      _mutex.lock();
     }
     else {
 #ifdef DEBUG
-      qDebug() << "going to sleep";
+      qDebug() << "worker" << workerIndex << "going to sleep";
 #endif
-      _idle = true;
-      _idleCondition.wakeAll();
+      --_busyWorkers;
+      if (_busyWorkers == 0)
+        _idleCondition.wakeAll();
       _waitCondition.wait(&_mutex);
-      _idle = false;
+      ++_busyWorkers;
 #ifdef DEBUG
-      qDebug() << "waking up";
+      qDebug() << "worker" << workerIndex << "waking up";
 #endif
     }
   }
+  --_busyWorkers;
+  _idleCondition.wakeAll();
   _mutex.unlock();
 }
 
@@ -286,18 +522,18 @@ void PDFPageProcessingThread::clearWorkStack()
 {
   _mutex.lock();
 
-  foreach(PageProcessingRequest * workItem, _workStack) {
+  foreach(PageProcessingRequest * workItem, _workQueue) {
     if (!workItem)
       continue;
     Q_ASSERT(workItem->thread() == QApplication::instance()->thread());
     workItem->deleteLater();
   }
-  _workStack.clear();
+  _workQueue.clear();
+  _queuedRequests.clear();
 
-  if (!_idle) {
-    // Wait until the current operation finishes
+  // Wait until all current operations finish
+  while (_busyWorkers > 0)
     _idleCondition.wait(&_mutex);
-  }
   _mutex.unlock();
 }
 
@@ -312,19 +548,18 @@ void PDFPageProcessingThread::clearWorkStack()
 // `listener` will need a custom `event` function that is capable of picking up
 // on these events.
 
-bool PageProcessingRequest::operator==(const PageProcessingRequest & r) const
+uint qHash(const PageProcessingRequest::Key & key) noexcept
 {
-  // TODO: Should we care about the listener here as well?
-  return (type() == r.type() && page == r.page);
+  // Requests for the same area of a page at different resolutions are rare
+  // (see PDFDocumentView::reprioritizeRenderRequests()), so the resolution
+  // need not be hashed
+  const uint h = ::qHash(QPair<const Page*, int>(key.page, static_cast<int>(key.type)));
+  return ::qHash(QPair< QPair<int, int>, QPair<int, int> >(QPair<int, int>(key.render_box.x(), key.render_box.y()), QPair<int, int>(key.render_box.width(), key.render_box.height())), h);
 }
 
-bool PageProcessingRenderPageRequest::operator==(const PageProcessingRequest & r) const
+void PageProcessingRenderPageRequest::merge(const PageProcessingRequest & other)
 {
-  if (!PageProcessingRequest::operator==(r))
-    return false;
-  const PageProcessingRenderPageRequest * rr = dynamic_cast<const PageProcessingRenderPageRequest*>(&r);
-  // TODO: Should we care about the listener here as well?
-  return (qFuzzyCompare(xres, rr->xres) && qFuzzyCompare(yres, rr->yres) && render_box == rr->render_box && cache == rr->cache);
+  prefetchedFor.unite(static_cast<const PageProcessingRenderPageRequest &>(other).prefetchedFor);
 }
 
 #ifdef DEBUG
@@ -338,6 +573,7 @@ PageProcessingRenderPageRequest::operator QString() const
 // These are the events posted by `execute` functions.
 const QEvent::Type PDFPageRenderedEvent::PageRenderedEvent = static_cast<QEvent::Type>( QEvent::registerEventType() );
 const QEvent::Type PDFLinksLoadedEvent::LinksLoadedEvent = static_cast<QEvent::Type>( QEvent::registerEventType() );
+const QEvent::Type PDFAnnotationsLoadedEvent::AnnotationsLoadedEvent = static_cast<QEvent::Type>( QEvent::registerEventType() );
 
 bool PageProcessingRenderPageRequest::execute()
 {
@@ -349,14 +585,31 @@ bool PageProcessingRenderPageRequest::execute()
   // the `PDFPageGraphicsItem` could have a function that indicates if the item
   // is anywhere near a viewport.
   QImage rendered_page = page->renderToImage(xres, yres, render_box, cache);
-  QCoreApplication::postEvent(listener, new PDFPageRenderedEvent(xres, yres, render_box, rendered_page));
+  // Prefetch requests have no listener; their result only goes to the cache
+  // unless a listener took them over in the meantime
+  Document * doc = page->document();
+  QObject * receiver = (doc ? doc->processingThread().finishRequest(this) : listener);
+  if (receiver)
+    QCoreApplication::postEvent(receiver, new PDFPageRenderedEvent(xres, yres, render_box, rendered_page));
 
   return true;
 }
 
+void PageProcessingRenderPageRequest::cancel()
+{
+  // If the result was to be cached, there is a placeholder image in the cache
+  // that would otherwise never be replaced
+  if (!cache)
+    return;
+  Document * doc = page->document();
+  if (!doc)
+    return;
+  doc->pageCache().discardPlaceholder(PDFPageTile(xres, yres, render_box, page->pageNum(), doc->cacheId()));
+}
+
 bool PageProcessingLoadLinksRequest::execute()
 {
-  QCoreApplication::postEvent(listener, new PDFLinksLoadedEvent(page->loadLinks()));
+  QCoreApplication::postEvent(listener, new PDFLinksLoadedEvent(page->loadLinks(), page->pageNum()));
   return true;
 }
 
@@ -367,77 +620,424 @@ PageProcessingLoadLinksRequest::operator QString() const
 }
 #endif
 
-QSharedPointer<QImage> PDFPageCache::getImage(const PDFPageTile & tile) const
+bool PageProcessingLoadAnnotationsRequest::execute()
+{
+  QList< QSharedPointer<Annotation::Link> > links;
+  QList< QSharedPointer<Annotation::AbstractAnnotation> > annotations;
+  page->loadLinksAndAnnotations(links, annotations);
+  QCoreApplication::postEvent(listener, new PDFAnnotationsLoadedEvent(links, annotations, page->pageNum()));
+  return true;
+}
+
+#ifdef DEBUG
+PageProcessingLoadAnnotationsRequest::operator QString() const
+{
+  return QString::fromUtf8("LA:%1").arg(page->pageNum());
+}
+#endif
+
+//static
+PDFPageCache & PDFPageCache::globalCache()
+{
+  // The default size (DefaultMaxSize, i.e., 1 GB) is enough for 256 RGBA
+  // tiles (1024 x 1024 pixels x 4 bytes per pixel).
+  //
+  // NOTE: The application seems to exceed 1 GB---usage plateaus at around 2GB. No idea why. Perhaps freed
+  // blocks are not garbage collected?? Perhaps my math is off??
+  static PDFPageCache cache;
+  return cache;
+}
+
+void PDFPageCache::setMaxSize(const qint64 num)
+{
+  _maxSize = num;
+  evict(num);
+}
+
+PDFPageCache::Shard & PDFPageCache::shardFor(const PDFPageTile & tile) const
+{
+  // NB: Use the high bits of the hash; the low bits determine the bucket in
+  // the shard's QHash
+  return _shards[(static_cast<uint>(qHash(tile)) >> 28) % NumShards];
+}
+
+QSharedPointer<QImage> PDFPageCache::getImage(const PDFPageTile & tile, TileStatus * status /* = nullptr */) const
 {
-  _lock.lockForRead();
-  QSharedPointer<QImage> * retVal = object(tile);
-  _lock.unlock();
+  QSharedPointer<QImage> retVal;
+  TileStatus retStatus{UNKNOWN};
+  {
+    Shard & shard = shardFor(tile);
+    QReadLocker l(&shard.lock);
+    const QSharedPointer<Entry> entry = shard.entries.value(tile);
+    if (entry) {
+      retVal = entry->image;
+      retStatus = entry->status;
+      if (retVal) {
+        QMutexLocker lruLocker(&shard.lruLock);
+        entry->lastUsed = ++_clock;
+        shard.lru.splice(shard.lru.begin(), shard.lru, entry->lruPos);
+      }
+    }
+  }
   if (retVal)
-    return *retVal;
-  return QSharedPointer<QImage>();
+    ++_hits;
+  else
+    ++_misses;
+  if (status)
+    *status = retStatus;
+  return retVal;
 }
 
 PDFPageCache::TileStatus PDFPageCache::getStatus(const PDFPageTile & tile) const
 {
-  PDFPageCache::TileStatus retVal = UNKNOWN;
-  _lock.lockForRead();
-  if (_tileStatus.contains(tile))
-    retVal = _tileStatus[tile];
-  _lock.unlock();
-  return retVal;
+  const Shard & shard = shardFor(tile);
+  QReadLocker l(&shard.lock);
+  const QSharedPointer<Entry> entry = shard.entries.value(tile);
+  return (entry ? entry->status : UNKNOWN);
 }
 
 QSharedPointer<QImage> PDFPageCache::setImage(const PDFPageTile & tile, QImage * image, const TileStatus status, const bool overwrite /* = true */)
 {
-  _lock.lockForWrite();
   QSharedPointer<QImage> retVal;
-  if (contains(tile))
-    retVal = *object(tile);
-  // If the key is not in the cache yet add it. Otherwise overwrite the cached
-  // image but leave the pointer intact as that can be held/used elsewhere
-  if (!retVal) {
-    QSharedPointer<QImage> * toInsert = new QSharedPointer<QImage>(image);
+  bool inserted = false;
+  {
+    Shard & shard = shardFor(tile);
+    QWriteLocker l(&shard.lock);
+    QSharedPointer<Entry> & entry = shard.entries[tile];
+    if (!entry)
+      entry = QSharedPointer<Entry>::create();
+    const bool hadImage = !entry->image.isNull();
+
+    // If the key is not in the cache yet (or its image was evicted) add it.
+    // Otherwise replace the cached image (if requested); the old image remains
+    // valid for whoever is still using it (e.g., for painting).
+    if (entry->image.data() == image) {
+      // Trying to overwrite an image with itself - just update the status
+      entry->status = status;
+    }
+    else if (!entry->image || overwrite) {
+      _size -= entry->cost;
+      entry->image = QSharedPointer<QImage>(image);
 #if QT_VERSION < QT_VERSION_CHECK(5, 10, 0)
-    insert(tile, toInsert, (image ? image->byteCount() : 0));
+      entry->cost = (image ? image->byteCount() : 0);
 #else
-    // No image (1024x124x4 bytes by default) should ever come even close to the
-    // 2 GB mark corresponding to INT_MAX; note that Document::Document() sets
-    // the cache's max-size to 1 GB total
-    insert(tile, toInsert, (image ? static_cast<int>(image->sizeInBytes()) : 0));
+      entry->cost = (image ? image->sizeInBytes() : 0);
 #endif
-    _tileStatus.insert(tile, status);
-    retVal = *toInsert;
-  }
-  else if (retVal.data() == image) {
-    // Trying to overwrite an image with itself - just update the status
-    _tileStatus.insert(tile, status);
-  }
-  else if (overwrite) {
-    // TODO: overwriting an image with a different one can change its size (and
-    // therefore its cost in the cache). There doesn't seem to be a method to
-    // hande that in QCache, though, and since we only use one tile size this
-    // shouldn't pose a problem.
-    if (image)
-      *retVal = *image;
-    else {
-      QSharedPointer<QImage> * toInsert = new QSharedPointer<QImage>;
-      insert(tile, toInsert, 0);
-      retVal = *toInsert;
+      _size += entry->cost;
+      entry->status = status;
+      inserted = true;
     }
-    _tileStatus.insert(tile, status);
+    entry->lastUsed = ++_clock;
+    if (entry->image && hadImage)
+      shard.lru.splice(shard.lru.begin(), shard.lru, entry->lruPos);
+    else if (entry->image)
+      entry->lruPos = shard.lru.insert(shard.lru.begin(), tile);
+    else if (hadImage)
+      shard.lru.erase(entry->lruPos);
+    retVal = entry->image;
+  }
+
+  if (inserted && status != OUTDATED && !tile.grayscale) {
+    QWriteLocker l(&_indexLock);
+    addToIndex(tile);
   }
-  _lock.unlock();
+  const qint64 maxSize = _maxSize;
+  if (_size > maxSize)
+    evict(maxSize - maxSize / EvictionSlack);
   return retVal;
 }
 
+void PDFPageCache::evict(const qint64 targetSize)
+{
+  QMutexLocker evictionLocker(&_evictionLock);
+  if (_size <= targetSize)
+    return;
+
+  // Returns when the least recently used image of `shard` was last used (or
+  // the maximum if it has none); the caller must hold a lock on the shard
+  auto leastRecentUse = [](const Shard & shard) -> quint64 {
+    if (shard.lru.empty())
+      return std::numeric_limits<quint64>::max();
+    return shard.entries.value(shard.lru.back())->lastUsed;
+  };
+  // Repeatedly evict the oldest of the shards' least recently used images.
+  // Only the shard evicted from needs to be checked again; the images of the
+  // others can only become more recently used in the meantime.
+  quint64 tails[NumShards];
+  for (int i = 0; i < NumShards; ++i) {
+    Shard & shard = _shards[i];
+    QReadLocker l(&shard.lock);
+    QMutexLocker lruLocker(&shard.lruLock);
+    tails[i] = leastRecentUse(shard);
+  }
+
+  QList<PDFPageTile> evicted;
+  while (_size > targetSize) {
+    const int i = static_cast<int>(std::min_element(tails, tails + NumShards) - tails);
+    if (tails[i] == std::numeric_limits<quint64>::max())
+      break;
+    Shard & shard = _shards[i];
+    QWriteLocker l(&shard.lock);
+    if (!shard.lru.empty()) {
+      const PDFPageTile tile = shard.lru.back();
+      shard.lru.pop_back();
+      const QSharedPointer<Entry> entry = shard.entries.value(tile);
+      _size -= entry->cost;
+      ++_evictions;
+      evicted << tile;
+      // Drop the entry altogether, unless the tile is still being rendered;
+      // its status prevents requesting it again in the meantime (the entry is
+      // replaced once rendering finishes, see discardPlaceholder())
+      if (entry->status == PLACEHOLDER) {
+        entry->image.clear();
+        entry->cost = 0;
+      }
+      else
+        shard.entries.remove(tile);
+    }
+    tails[i] = leastRecentUse(shard);
+  }
+
+  // NB: The shard locks were released in the meantime (as _indexLock must be
+  // locked first), so tiles that got a new image since are kept in the index
+  QWriteLocker indexLocker(&_indexLock);
+  foreach(const PDFPageTile & tile, evicted) {
+    const Shard & shard = shardFor(tile);
+    QReadLocker l(&shard.lock);
+    const QSharedPointer<Entry> entry = shard.entries.value(tile);
+    if (!entry || !entry->image)
+      removeFromIndex(tile);
+  }
+}
+
+void PDFPageCache::discardPlaceholder(const PDFPageTile & tile)
+{
+  Shard & shard = shardFor(tile);
+  QWriteLocker l(&shard.lock);
+  const QSharedPointer<Entry> entry = shard.entries.value(tile);
+  if (!entry || entry->status != PLACEHOLDER)
+    return;
+  // Placeholders whose image was evicted have nothing left to keep
+  if (entry->image)
+    entry->status = OUTDATED;
+  else
+    shard.entries.remove(tile);
+}
+
+void PDFPageCache::clear()
+{
+  QWriteLocker indexLocker(&_indexLock);
+  for (Shard & shard : _shards) {
+    QWriteLocker l(&shard.lock);
+    foreach(const QSharedPointer<Entry> & entry, shard.entries)
+      _size -= entry->cost;
+    shard.entries.clear();
+    shard.lru.clear();
+  }
+  _tileIndex.clear();
+}
+
 void PDFPageCache::markOutdated()
 {
-  QWriteLocker l(&_lock);
-  QMap<PDFPageTile, TileStatus>::iterator it;
-  for (it = _tileStatus.begin(); it != _tileStatus.end(); ++it)
-    it.value() = OUTDATED;
+  // Outdated tiles are only used in place of themselves until they are
+  // rendered again (see Page::getTileImage()), so they are not indexed
+  QWriteLocker indexLocker(&_indexLock);
+  for (Shard & shard : _shards) {
+    QWriteLocker l(&shard.lock);
+    foreach(const QSharedPointer<Entry> & entry, shard.entries)
+      entry->status = OUTDATED;
+  }
+  _tileIndex.clear();
+}
+
+void PDFPageCache::markOutdated(const unsigned int docId, const QSet<int> & keepPages)
+{
+  QWriteLocker indexLocker(&_indexLock);
+  for (Shard & shard : _shards) {
+    QWriteLocker l(&shard.lock);
+    for (auto it = shard.entries.begin(); it != shard.entries.end(); ++it) {
+      if (it.key().doc_id == docId && !keepPages.contains(it.key().page_num))
+        it.value()->status = OUTDATED;
+    }
+  }
+  for (auto it = _tileIndex.begin(); it != _tileIndex.end(); ) {
+    if (it.key().first == docId && !keepPages.contains(it.key().second))
+      it = _tileIndex.erase(it);
+    else
+      ++it;
+  }
+}
+
+void PDFPageCache::clear(const unsigned int docId)
+{
+  QWriteLocker indexLocker(&_indexLock);
+  for (Shard & shard : _shards) {
+    QWriteLocker l(&shard.lock);
+    for (auto it = shard.entries.begin(); it != shard.entries.end(); ) {
+      if (it.key().doc_id == docId) {
+        _size -= it.value()->cost;
+        if (it.value()->image)
+          shard.lru.erase(it.value()->lruPos);
+        it = shard.entries.erase(it);
+      }
+      else
+        ++it;
+    }
+  }
+  for (auto it = _tileIndex.begin(); it != _tileIndex.end(); ) {
+    if (it.key().first == docId)
+      it = _tileIndex.erase(it);
+    else
+      ++it;
+  }
+}
+
+QList<PDFPageTile> PDFPageCache::tiles() const
+{
+  QList<PDFPageTile> retVal;
+  for (const Shard & shard : _shards) {
+    QReadLocker l(&shard.lock);
+    for (auto it = shard.entries.constBegin(); it != shard.entries.constEnd(); ++it) {
+      if (it.value()->image)
+        retVal << it.key();
+    }
+  }
+  return retVal;
+}
+
+QList<PDFPageTile> PDFPageCache::overlappingTiles(const unsigned int docId, const int pageNum, const double xres, const double yres, const QRect & render_box) const
+{
+  QList<PDFPageTile> retVal;
+  QReadLocker l(&_indexLock);
+  const auto pageIt = _tileIndex.constFind(qMakePair(docId, pageNum));
+  if (pageIt == _tileIndex.constEnd())
+    return retVal;
+
+  // Go through the resolutions from highest to lowest
+  const QMap< QPair<double, double>, TileLevel > & levels = pageIt.value();
+  for (auto levelIt = levels.constEnd(); levelIt != levels.constBegin(); ) {
+    --levelIt;
+    const TileLevel & level = levelIt.value();
+    // The area we are looking for at the resolution of this level
+    // (with a margin to compensate for rounding)
+    const QRect area = QTransform::fromScale(levelIt.key().first / xres, levelIt.key().second / yres).mapRect(render_box).adjusted(-1, -1, 1, 1);
+    // Only tiles starting in rows from (slightly above) the top of `area` to
+    // its bottom can overlap it
+    auto it = level.tiles.lowerBound(qMakePair(area.top() - level.maxHeight, std::numeric_limits<int>::min()));
+    for (; it != level.tiles.constEnd() && it.key().first <= area.bottom(); ++it) {
+      const PDFPageTile & tile = it.value();
+      const QRect scaledRect = QTransform::fromScale(xres / tile.xres, yres / tile.yres).mapRect(tile.render_box);
+      if (!scaledRect.intersects(render_box))
+        continue;
+      // Skip tiles whose image was just evicted (see evict())
+      const Shard & shard = shardFor(tile);
+      QReadLocker shardLocker(&shard.lock);
+      const QSharedPointer<Entry> entry = shard.entries.value(tile);
+      if (entry && entry->image)
+        retVal << tile;
+    }
+  }
+  return retVal;
 }
 
+void PDFPageCache::addToIndex(const PDFPageTile & tile)
+{
+  TileLevel & level = _tileIndex[qMakePair(tile.doc_id, tile.page_num)][qMakePair(tile.xres, tile.yres)];
+  level.tiles.insert(qMakePair(tile.render_box.top(), tile.render_box.left()), tile);
+  level.maxHeight = qMax(level.maxHeight, tile.render_box.height());
+}
+
+void PDFPageCache::removeFromIndex(const PDFPageTile & tile)
+{
+  const auto pageIt = _tileIndex.find(qMakePair(tile.doc_id, tile.page_num));
+  if (pageIt == _tileIndex.end())
+    return;
+  const auto levelIt = pageIt.value().find(qMakePair(tile.xres, tile.yres));
+  if (levelIt == pageIt.value().end())
+    return;
+  // NB: maxHeight is not reduced; it remains a valid upper bound
+  TileLevel & level = levelIt.value();
+  const auto it = level.tiles.find(qMakePair(tile.render_box.top(), tile.render_box.left()));
+  if (it != level.tiles.end() && it.value() == tile)
+    level.tiles.erase(it);
+  if (level.tiles.isEmpty())
+    pageIt.value().erase(levelIt);
+  if (pageIt.value().isEmpty())
+    _tileIndex.erase(pageIt);
+}
+
+QMap<unsigned int, qint64> PDFPageCache::sizePerDocument() const
+{
+  QMap<unsigned int, qint64> retVal;
+  for (const Shard & shard : _shards) {
+    QReadLocker l(&shard.lock);
+    // Only consider tiles that are actually still in the cache
+    for (auto it = shard.entries.constBegin(); it != shard.entries.constEnd(); ++it) {
+      if (it.value()->image)
+        retVal[it.key().doc_id] += it.value()->cost;
+    }
+  }
+  return retVal;
+}
+
+PDFPageCache::Statistics PDFPageCache::statistics() const
+{
+  Statistics retVal;
+  retVal.hits = _hits;
+  retVal.misses = _misses;
+  retVal.evictions = _evictions;
+  return retVal;
+}
+
+void PDFPageCache::resetStatistics()
+{
+  _hits = 0;
+  _misses = 0;
+  _evictions = 0;
+}
+
+//static
+TextLayerCache & TextLayerCache::globalCache()
+{
+  static TextLayerCache cache;
+  return cache;
+}
+
+int TextLayerCache::maxSize() const
+{
+  QMutexLocker l(&_lock);
+  return static_cast<int>(_cache.maxCost());
+}
+
+void TextLayerCache::setMaxSize(const int num)
+{
+  QMutexLocker l(&_lock);
+  _cache.setMaxCost(num);
+}
+
+int TextLayerCache::size() const
+{
+  QMutexLocker l(&_lock);
+  return static_cast<int>(_cache.totalCost());
+}
+
+void TextLayerCache::use(const Page * page, const QSharedPointer<const Page::TextLayer> & layer)
+{
+  QMutexLocker l(&_lock);
+  // Looking the layer up marks it as most recently used
+  const QSharedPointer<const Page::TextLayer> * cached = _cache.object(page);
+  if (cached && *cached == layer)
+    return;
+  // NB: Layers with more words than maxSize() are not cached at all; like all
+  // layers, they live on as long as they are in use
+  _cache.insert(page, new QSharedPointer<const Page::TextLayer>(layer), static_cast<int>(layer->words.size()) + 1);
+}
+
+void TextLayerCache::remove(const Page * page)
+{
+  QMutexLocker l(&_lock);
+  _cache.remove(page);
+}
 
 // PDF ABCs
 // ========
@@ -447,7 +1047,12 @@ void PDFPageCache::markOutdated()
 //
 // This class is thread-safe. Data access is governed by the QReadWriteLock
 // _docLock.
+// Counter for Document::_cacheId; 0 is reserved for tiles that don't belong to
+// any document
+static QAtomicInt nextCacheId(1);
+
 Document::Document(QString fileName):
+  _cacheId(static_cast<unsigned int>(nextCacheId.fetchAndAddRelaxed(1))),
   _fileName(fileName)
 {
   Q_ASSERT(_docLock != nullptr);
@@ -456,12 +1061,9 @@ Document::Document(QString fileName):
 //  qDebug() << "Document::Document(" << fileName << ")";
 #endif
 
-  // Set cache for rendered pages to be 1GB. This is enough for 256 RGBA tiles
-  // (1024 x 1024 pixels x 4 bytes per pixel).
-  //
-  // NOTE: The application seems to exceed 1 GB---usage plateaus at around 2GB. No idea why. Perhaps freed
-  // blocks are not garbage collected?? Perhaps my math is off??
-  _pageCache.setMaxSize(1024 * 1024 * 1024);
+  // Unless the backend declares otherwise, assume it is not safe to process
+  // several requests concurrently
+  _processingThread.setSerialized(!_capabilities.testFlag(Capability_ParallelRendering));
 }
 
 // FIXME: Consider porting Document to a PIMPL design in which we could just
@@ -493,11 +1095,14 @@ Document::~Document()
 //  qDebug() << "Document::~Document()";
 #endif
   clearPages();
+  // Free the memory occupied by our tiles; as _cacheId is never reused, they
+  // could not be used by any other document, anyway
+  PDFPageCache::globalCache().clear(_cacheId);
 }
 
 int Document::numPages() const { QReadLocker docLocker(_docLock.data()); return _numPages; }
 PDFPageProcessingThread &Document::processingThread() { QReadLocker docLocker(_docLock.data()); return _processingThread; }
-PDFPageCache &Document::pageCache() { QReadLocker docLocker(_docLock.data()); return _pageCache; }
+PDFPageCache &Document::pageCache() { return PDFPageCache::globalCache(); }
 
 QWeakPointer<Page> Document::page(int at)
 {
@@ -508,6 +1113,94 @@ QWeakPointer<Page> Document::page(int at)
   return _pages[at];
 }
 
+QSizeF Document::pageSizeF(const int at, bool * isEstimate /* = nullptr */)
+{
+  if (isEstimate)
+    *isEstimate = false;
+  {
+    QReadLocker docLocker(_docLock.data());
+    if (at >= 0 && at < _pageSizes.size()) {
+      if (_pageSizes[at].isValid())
+        return _pageSizes[at];
+      // Most documents use the same size for all (or at least most) pages
+      if (isEstimate)
+        *isEstimate = true;
+      return _meta_pageSize;
+    }
+  }
+  QSharedPointer<Page> page(this->page(at).toStrongRef());
+  return (page ? page->pageSizeF() : QSizeF());
+}
+
+void Document::loadPageSizes(const int first, const int count)
+{
+  QVector<QSizeF> sizes;
+  int start{0};
+  unsigned int generation{0};
+  {
+    // Only hold a read lock while querying the backend so as not to block
+    // other threads (e.g., the GUI) in the meantime
+    QReadLocker docLocker(_docLock.data());
+    start = qBound(0, first, _pageSizes.size());
+    const int end = qBound(start, first + count, _pageSizes.size());
+    generation = _pageSizesGeneration;
+    sizes.reserve(end - start);
+    for (int i = start; i < end; ++i)
+      sizes << (_pageSizes[i].isValid() ? _pageSizes[i] : fetchPageSize(i));
+  }
+
+  QWriteLocker docLocker(_docLock.data());
+  // If the document was reloaded in the meantime, the sizes are outdated
+  if (generation != _pageSizesGeneration)
+    return;
+  for (int i = 0; i < sizes.size(); ++i)
+    _pageSizes[start + i] = sizes[i];
+  updateMetaPageSize();
+}
+
+void Document::updateMetaPageSize()
+{
+  QMap<QSizeF, int> pageSizes;
+  foreach(const QSizeF & ps, _pageSizes) {
+    if (!ps.isValid())
+      return;
+    ++pageSizes[ps];
+  }
+  int occurrences = -1;
+  for (QMap<QSizeF, int>::const_iterator it = pageSizes.constBegin(); it != pageSizes.constEnd(); ++it) {
+    if (occurrences < it.value()) {
+      _meta_pageSize = it.key();
+      occurrences = it.value();
+    }
+  }
+}
+
+bool Document::isCompleteFile(const QString & fileName)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  // The file must end with "startxref", the offset of the cross-reference
+  // table, and "%%EOF" (optionally followed by whitespace). Like most PDF
+  // readers, we only look for this in the last 1024 bytes.
+  const qint64 fileSize = file.size();
+  const qint64 tailSize = qMin(fileSize, static_cast<qint64>(1024));
+  if (!file.seek(fileSize - tailSize))
+    return false;
+  const QByteArray tail = file.read(tailSize);
+
+  const auto eofPos = tail.lastIndexOf("%%EOF");
+  if (eofPos < 0 || !tail.mid(eofPos + 5).trimmed().isEmpty())
+    return false;
+  const auto startXRefPos = tail.lastIndexOf("startxref", eofPos);
+  if (startXRefPos < 0)
+    return false;
+  bool ok{false};
+  const qint64 xrefOffset = tail.mid(startXRefPos + 9, eofPos - startXRefPos - 9).trimmed().toLongLong(&ok);
+  return (ok && xrefOffset >= 0 && xrefOffset < fileSize);
+}
+
 QList<SearchResult> Document::search(const QString & searchText, const SearchFlags & flags, const int startPage)
 {
   QReadLocker docLocker(_docLock.data());
@@ -558,6 +1251,72 @@ void Document::clearPages()
   _pages.clear();
 }
 
+void Document::clearPages(const QSet<int> & keep)
+{
+  // NB: See clearPages() regarding the order of clearWorkStack() and locking
+  _processingThread.clearWorkStack();
+
+  QWriteLocker docLocker(_docLock.data());
+  QVector< QSharedPointer<Page> > keptPages;
+  if (!keep.isEmpty() && _numPages > 0)
+    keptPages.resize(_numPages);
+
+  for (int i = 0; i < _pages.size(); ++i) {
+    if (_pages[i].isNull())
+      continue;
+    if (i < keptPages.size() && keep.contains(i))
+      keptPages[i] = _pages[i];
+    else
+      _pages[i]->detachFromParent();
+  }
+  // Note: as in clearPages(), this releases the pages that are not kept
+  _pages = keptPages;
+}
+
+QMap<int, QByteArray> Document::fingerprintCachedPages()
+{
+  QSet<int> pages;
+  foreach(const PDFPageTile & tile, pageCache().tiles()) {
+    if (tile.doc_id == _cacheId && tile.page_num >= 0 && tile.page_num < _numPages)
+      pages.insert(tile.page_num);
+  }
+
+  QMap<int, QByteArray> retVal;
+  foreach(const int n, pages) {
+    // Reuse the fingerprint from the last reload if possible; it still
+    // describes the currently loaded file
+    QByteArray fingerprint = _pageFingerprints.value(n);
+    if (fingerprint.isEmpty())
+      fingerprint = pageFingerprint(n);
+    if (!fingerprint.isEmpty())
+      retVal.insert(n, fingerprint);
+  }
+  return retVal;
+}
+
+QSet<int> Document::unchangedPages(const QMap<int, QByteArray> & oldFingerprints, const QMap<int, QByteArray> & newFingerprints)
+{
+  QSet<int> retVal;
+  _pageFingerprints.clear();
+  for (QMap<int, QByteArray>::const_iterator it = oldFingerprints.constBegin(); it != oldFingerprints.constEnd(); ++it) {
+    if (it.key() >= _numPages)
+      continue;
+    const QByteArray fingerprint = newFingerprints.value(it.key());
+    if (fingerprint.isEmpty())
+      continue;
+    _pageFingerprints.insert(it.key(), fingerprint);
+    if (fingerprint == it.value())
+      retVal.insert(it.key());
+  }
+  return retVal;
+}
+
+void Document::setCapabilities(const Capabilities capabilities)
+{
+  _capabilities = capabilities;
+  _processingThread.setSerialized(!_capabilities.testFlag(Capability_ParallelRendering));
+}
+
 void Document::clearMetaData()
 {
   QWriteLocker docLocker(_docLock.data());
@@ -573,6 +1332,8 @@ void Document::clearMetaData()
   _meta_modDate = QDateTime();
   _meta_trapped = Trapped_Unknown;
   _meta_other.clear();
+  _pageSizes.clear();
+  ++_pageSizesGeneration;
 }
 
 // Page Class
@@ -619,6 +1380,12 @@ Page::Page(Document *parent, int at, QSharedPointer<QReadWriteLock> docLock):
   }
 }
 
+Page::~Page()
+{
+  // Text layers live no longer than their pages (see textLayer())
+  TextLayerCache::globalCache().remove(this);
+}
+
 int Page::pageNum() const { QReadLocker pageLocker(_pageLock); return _n; }
 
 void Page::detachFromParent()
@@ -674,6 +1441,176 @@ QRectF Page::getContentBoundingBox() const
   return QRectF(x0 * pageSize.width() / 100., y0 * pageSize.height() / 100., (x1 - x0 + 1) * pageSize.width() / 100., (y1 - y0 + 1) * pageSize.height() / 100.);
 }
 
+// Removes whitespace from `text` and folds it like searches do (see
+// PDFSearchIndex::foldedText() and Page::TextLayer::mayContain())
+static QString normalizedSearchText(const QString & text)
+{
+  QString retVal = PDFSearchIndex::foldedText(text);
+  retVal.remove(QRegularExpression(QStringLiteral("\\s")));
+  return retVal;
+}
+
+bool Page::TextLayer::mayContain(const QString & text) const
+{
+  return _normalizedText.contains(normalizedSearchText(text));
+}
+
+QSharedPointer<const Page::TextLayer> Page::textLayer() const
+{
+  {
+    QReadLocker pageLocker(_pageLock);
+    const QSharedPointer<const TextLayer> layer = _textLayer.toStrongRef();
+    if (layer) {
+      TextLayerCache::globalCache().use(this, layer);
+      return layer;
+    }
+  }
+
+  // Extract the text without holding a lock as that can take a while
+  QSharedPointer<TextLayer> layer(new TextLayer(loadTextLayer()));
+
+  // Guess ends of lines: if a word is mostly below the previous one (with the
+  // overlap being less than 20% of the height of the larger one), we assume
+  // it's on a new line. This should work reasonably well for normal text
+  // (including RTL text), but may fail in some less common cases (e.g.,
+  // subscripts after superscripts, formulas, etc.).
+  QString text;
+  for (int i = 0; i < layer->words.size(); ++i) {
+    TextLayer::Word & word = layer->words[i];
+    if (i > 0) {
+      const QRectF & prev = layer->words[i - 1].boundingBox;
+      const bool newLine = (prev.bottom() - word.boundingBox.top() < 0.2 * qMax(prev.height(), word.boundingBox.height()));
+      word.line = layer->words[i - 1].line + (newLine ? 1 : 0);
+    }
+    text += word.text;
+  }
+  layer->lineCount = (layer->words.isEmpty() ? 0 : layer->words.last().line + 1);
+  layer->_normalizedText = normalizedSearchText(text);
+
+  QWriteLocker pageLocker(_pageLock);
+  // Another thread may have been faster
+  QSharedPointer<const TextLayer> retVal = _textLayer.toStrongRef();
+  if (!retVal) {
+    retVal = layer;
+    _textLayer = retVal;
+  }
+  TextLayerCache::globalCache().use(this, retVal);
+  return retVal;
+}
+
+QList<Page::Box> Page::boxes() const
+{
+  QList<Box> retVal;
+  foreach(const TextLayer::Word & word, textLayer()->words) {
+    Box box;
+    box.boundingBox = word.boundingBox;
+    foreach(const QRectF & charBox, word.charBoxes) {
+      Box subBox;
+      subBox.boundingBox = charBox;
+      box.subBoxes << subBox;
+    }
+    retVal << box;
+  }
+  return retVal;
+}
+
+QString Page::selectedText(const QList<QPolygonF> & selection, QMap<int, QRectF> * wordBoxes /* = nullptr */, QMap<int, QRectF> * charBoxes /* = nullptr */, const bool onlyFullyEnclosed /* = false */) const
+{
+  if (wordBoxes)
+    wordBoxes->clear();
+  if (charBoxes)
+    charBoxes->clear();
+
+  const QSharedPointer<const TextLayer> layer = textLayer();
+  // Words don't contain whitespace, so we insert spaces and newlines between
+  // them as appropriate
+  QString retVal;
+  bool insertSpace = false;
+  const TextLayer::Word * lastWord = nullptr;
+
+  for (int w = 0; w < layer->words.size(); ++w) {
+    const TextLayer::Word & word = layer->words[w];
+    // Determine which characters to include (if any)
+    const int numChars = qMin(word.text.length(), word.charBoxes.size());
+    QBitArray include(numChars);
+    for (int i = 0; i < numChars; ++i) {
+      QPolygonF remainder(word.charBoxes[i]);
+      foreach (const QPolygonF & p, selection) {
+        // Include characters if they are entirely inside the selection area or
+        // onlyFullyEnclosed == false; using "intersection only" can cause
+        // problems for overlapping char boxes (if the selection is made of
+        // entire char boxes, it would return characters that are not actually
+        // inside the selection but are just "edge cases") but is necessary if
+        // the selection comes from external sources, such as SyncTeX
+        if (p.intersected(word.charBoxes[i]).empty())
+          continue;
+        if (!onlyFullyEnclosed) {
+          include.setBit(i);
+          break;
+        }
+        remainder = remainder.subtracted(p);
+        if (remainder.empty()) {
+          include.setBit(i);
+          break;
+        }
+      }
+    }
+    if (include.count(true) == 0) continue;
+
+    // If we get here, we found a word that is at least partially selected, so
+    // we append the appropriate text
+    if (lastWord && lastWord->line != word.line) {
+      retVal += QString::fromLatin1("\n");
+
+      if (wordBoxes)
+        (*wordBoxes)[wordBoxes->count()] = lastWord->boundingBox;
+      if (charBoxes)
+        (*charBoxes)[charBoxes->count()] = lastWord->boundingBox;
+      // If we queued a space to be inserted, ignore that as we inserted a
+      // newline instead anyway
+      insertSpace = false;
+    }
+
+    if (insertSpace && lastWord) {
+      retVal += QString::fromLatin1(" ");
+
+      // As word and char Boxes, insert those of the lastWord since that was
+      // the one causing insertSpace to be true
+      if (wordBoxes)
+        (*wordBoxes)[wordBoxes->count()] = lastWord->boundingBox;
+      if (charBoxes)
+        (*charBoxes)[charBoxes->count()] = lastWord->boundingBox;
+    }
+
+    // Default to not inserting a space after this word
+    insertSpace = false;
+
+    // Insert the actual characters
+    for (int i = 0; i < numChars; ++i) {
+      if (!include.testBit(i)) continue;
+
+      retVal += word.text[i];
+
+      if (wordBoxes)
+        (*wordBoxes)[wordBoxes->count()] = word.boundingBox;
+      if (charBoxes)
+        (*charBoxes)[charBoxes->count()] = word.charBoxes[i];
+
+      // If we reached the end of the word, possibly queue a space to be
+      // inserted. By queuing this until the next word is processed, we ensure
+      // that spaces are not inserted at the end of the string or before
+      // newlines
+      if (i == numChars - 1)
+        insertSpace = word.hasSpaceAfter;
+    }
+    // Remember the last processed word (required for detecting newlines and
+    // inserting spaces)
+    lastWord = &word;
+  }
+
+  return retVal;
+}
+
 QSharedPointer<QImage> Page::getCachedImage(double xres, double yres, QRect render_box /* = QRect() */, PDFPageCache::TileStatus * status /* = nullptr */)
 {
   QReadLocker docLocker(_docLock.data());
@@ -683,29 +1620,55 @@ QSharedPointer<QImage> Page::getCachedImage(double xres, double yres, QRect rend
       *status = PDFPageCache::UNKNOWN;
     return QSharedPointer<QImage>();
   }
-  PDFPageTile tile(xres, yres, render_box, _n);
-  if (status)
-    *status = _parent->pageCache().getStatus(tile);
-  return _parent->pageCache().getImage(tile);
+  return _parent->pageCache().getImage(PDFPageTile(xres, yres, render_box, _n, _parent->cacheId()), status);
 }
 
-void Page::asyncRenderToImage(QObject *listener, double xres, double yres, QRect render_box, bool cache)
+void Page::asyncRenderToImage(QObject *listener, double xres, double yres, QRect render_box, bool cache, const qreal priority /* = 0 */)
 {
   QReadLocker docLocker(_docLock.data());
   QReadLocker pageLocker(_pageLock);
   if (!_parent)
     return;
-  _parent->processingThread().addPageProcessingRequest(new PageProcessingRenderPageRequest(this, listener, xres, yres, render_box, cache));
+  _parent->processingThread().addPageProcessingRequest(new PageProcessingRenderPageRequest(this, listener, xres, yres, render_box, cache, priority));
 }
 
-bool higherResolutionThan(const PDFPageTile & t1, const PDFPageTile & t2)
+QSharedPointer<QImage> Page::getGrayScaleImage(double xres, double yres, QRect render_box, const QSharedPointer<QImage> & colorImage)
 {
-  // Note: We silently assume that xres and yres behave the same way
-  return t1.xres > t2.xres;
+  if (!colorImage)
+    return colorImage;
+
+  QReadLocker docLocker(_docLock.data());
+  QReadLocker pageLocker(_pageLock);
+  if (!_parent)
+    return QSharedPointer<QImage>();
+
+  if (render_box.isNull())
+    render_box = QRectF(0, 0, pageSizeF().width() * xres / 72., pageSizeF().height() * yres / 72.).toAlignedRect();
+
+  // The gray scale tile is CURRENT if it was converted from a current regular
+  // tile, and OUTDATED otherwise (never PLACEHOLDER, as nothing is rendering
+  // it, so nothing would ever discard the placeholder and it could never be
+  // evicted). In particular, it is converted again once a placeholder was
+  // replaced by the actual rendering (or once the tile was marked outdated
+  // and rendered again).
+  PDFPageCache & cache = _parent->pageCache();
+  const PDFPageCache::TileStatus status = (cache.getStatus(PDFPageTile(xres, yres, render_box, _n, _parent->cacheId())) == PDFPageCache::CURRENT ? PDFPageCache::CURRENT : PDFPageCache::OUTDATED);
+  const PDFPageTile grayTile(xres, yres, render_box, _n, _parent->cacheId(), true);
+  PDFPageCache::TileStatus grayStatus{PDFPageCache::UNKNOWN};
+  QSharedPointer<QImage> retVal = cache.getImage(grayTile, &grayStatus);
+  if (retVal && grayStatus == status)
+    return retVal;
+
+  QImage * grayImage = new QImage(colorImage->depth() == 32 ? colorImage->copy() : colorImage->convertToFormat(QImage::Format_ARGB32));
+  convertToGrayScale(*grayImage);
+  return cache.setImage(grayTile, grayImage, status);
 }
 
-QSharedPointer<QImage> Page::getTileImage(QObject * listener, const double xres, const double yres, QRect render_box /* = QRect() */)
+QSharedPointer<QImage> Page::getTileImage(QObject * listener, const double xres, const double yres, QRect render_box /* = QRect() */, const qreal priority /* = 0 */, const bool grayScale /* = false */)
 {
+  if (grayScale)
+    return getGrayScaleImage(xres, yres, render_box, getTileImage(listener, xres, yres, render_box, priority));
+
   QReadLocker docLocker(_docLock.data());
   QReadLocker pageLocker(_pageLock);
 
@@ -719,8 +1682,15 @@ QSharedPointer<QImage> Page::getTileImage(QObject * listener, const double xres,
   // background and we don't need to do anything)
   PDFPageCache::TileStatus status{PDFPageCache::UNKNOWN};
   QSharedPointer<QImage> retVal = getCachedImage(xres, yres, render_box, &status);
-  if (retVal && (status == PDFPageCache::CURRENT || status == PDFPageCache::PLACEHOLDER))
+  if (retVal && status == PDFPageCache::CURRENT)
+    return retVal;
+  if (retVal && status == PDFPageCache::PLACEHOLDER) {
+    // If the tile is being prefetched (see prefetchTileImage()), nobody would
+    // be notified once it is done, so take the request over
+    if (listener)
+      _parent->processingThread().takeOverRequest({PageProcessingRequest::PageRendering, this, xres, yres, render_box, true}, listener, priority);
     return retVal;
+  }
 
   if (listener) {
     // Render asyncronously, but add a dummy image to the cache first and return
@@ -728,11 +1698,11 @@ QSharedPointer<QImage> Page::getTileImage(QObject * listener, const double xres,
     // Note: Start the rendering in the background before constructing the image
     // to take advantage of multi-core CPUs. Since we hold the write lock here
     // there's nothing to worry about
-    asyncRenderToImage(listener, xres, yres, render_box, true);
+    asyncRenderToImage(listener, xres, yres, render_box, true, priority);
 
     if (retVal && status == PDFPageCache::OUTDATED) {
       // If we have an outdated image, use that as a placeholder
-      _parent->pageCache().setImage(PDFPageTile(xres, yres, render_box, _n), retVal.data(), PDFPageCache::PLACEHOLDER, false);
+      _parent->pageCache().setImage(PDFPageTile(xres, yres, render_box, _n, _parent->cacheId()), retVal.data(), PDFPageCache::PLACEHOLDER, false);
     }
     else {
       // otherwise construct a dummy image
@@ -741,31 +1711,18 @@ QSharedPointer<QImage> Page::getTileImage(QObject * listener, const double xres,
       p.fillRect(tmpImg->rect(), *pageDummyBrush);
 
       // Look through the cache to find tiles we can reuse (by scaling) for our
-      // dummy tile
-      // TODO: Benchmark this. If it is actualy too slow (i.e., just keeping the
-      // rendered image from popping up due to the write lock we hold) disable it
+      // dummy tile. The cache keeps a spatial index of the tiles of each page,
+      // so this only considers tiles of this page that overlap render_box.
       if (_parent) {
-        QList<PDFPageTile> tiles = _parent->pageCache().tiles();
-        for (QList<PDFPageTile>::iterator it = tiles.begin(); it != tiles.end(); ) {
-          if (it->page_num != pageNum()) {
-            it = tiles.erase(it);
-            continue;
-          }
-          // See if it->render_box intersects with render_box (after proper scaling)
-          QRect scaledRect = QTransform::fromScale(xres / it->xres, yres / it->yres).mapRect(it->render_box);
-          if (!scaledRect.intersects(render_box)) {
-            it = tiles.erase(it);
-            continue;
-          }
-          ++it;
-        }
-        // Sort the remaining tiles by size, high-res first
-        std::sort(tiles.begin(), tiles.end(), higherResolutionThan);
-        // Finally, crop, scale and paint each image until the whole area is
-        // filled or no images are left in the list
+        // The tiles are sorted by resolution, high-res first
+        const QList<PDFPageTile> tiles = _parent->pageCache().overlappingTiles(_parent->cacheId(), _n, xres, yres, render_box);
+        // Crop, scale and paint each image until the whole area is filled or
+        // no images are left in the list
         QPainterPath clipPath;
         clipPath.addRect(0, 0, render_box.width(), render_box.height());
         foreach (PDFPageTile tile, tiles) {
+          if (tile.grayscale)
+            continue;
           QSharedPointer<QImage> tileImg = _parent->pageCache().getImage(tile);
           if (!tileImg)
             continue;
@@ -777,10 +1734,10 @@ QSharedPointer<QImage> Page::getTileImage(QObject * listener, const double xres,
           QRect cropRect = QTransform::fromScale(tile.xres / xres, tile.yres / yres).mapRect(render_box).intersected(tile.render_box).translated(-tile.render_box.left(), -tile.render_box.top());
           QRect paintRect = QTransform::fromScale(xres / tile.xres, yres / tile.yres).mapRect(tile.render_box).intersected(render_box).translated(-render_box.left(), -render_box.top());
 
-          // Get the actual image and paint it onto the dummy tile
-          QImage tmp(tileImg->copy(cropRect).scaled(paintRect.size()));
+          // Paint the relevant part of the actual image onto the dummy tile
+          // (without copying it first)
           p.setClipPath(clipPath);
-          p.drawImage(paintRect.topLeft(), tmp);
+          p.drawImage(paintRect, *tileImg, cropRect);
 
           // Confine the clipping path to the part we have not painted to yet.
           QPainterPath pp;
@@ -797,7 +1754,7 @@ QSharedPointer<QImage> Page::getTileImage(QObject * listener, const double xres,
       // Note: In the meantime the asynchronous rendering could have finished and
       // insert the final image in the cache---we must handle that case and delete
       // our temporary image
-      retVal = _parent->pageCache().setImage(PDFPageTile(xres, yres, render_box, _n), tmpImg, PDFPageCache::PLACEHOLDER, false);
+      retVal = _parent->pageCache().setImage(PDFPageTile(xres, yres, render_box, _n, _parent->cacheId()), tmpImg, PDFPageCache::PLACEHOLDER, false);
       if (retVal != tmpImg)
         delete tmpImg;
     }
@@ -807,6 +1764,40 @@ QSharedPointer<QImage> Page::getTileImage(QObject * listener, const double xres,
   return getCachedImage(xres, yres, render_box);
 }
 
+bool Page::prefetchTileImage(const double xres, const double yres, QRect render_box /* = QRect() */, const qreal priority /* = PageProcessingRequest::PrefetchPriority */, const QObject * prefetcher /* = nullptr */)
+{
+  QReadLocker docLocker(_docLock.data());
+  QReadLocker pageLocker(_pageLock);
+  if (!_parent)
+    return false;
+
+  if (render_box.isNull())
+    render_box = QRectF(0, 0, pageSizeF().width() * xres / 72., pageSizeF().height() * yres / 72.).toAlignedRect();
+
+  // Tiles that are cached or currently being rendered (placeholders) need no
+  // further work, except that a queued request for the tile must learn that
+  // `prefetcher` wants it as well
+  const PDFPageTile tile(xres, yres, render_box, _n, _parent->cacheId());
+  PDFPageCache::TileStatus status{PDFPageCache::UNKNOWN};
+  const QSharedPointer<QImage> image = _parent->pageCache().getImage(tile, &status);
+  const bool pending = (status == PDFPageCache::PLACEHOLDER);
+  if ((pending && !prefetcher) || (status == PDFPageCache::CURRENT && image))
+    return false;
+  PageProcessingRenderPageRequest * request = new PageProcessingRenderPageRequest(this, nullptr, xres, yres, render_box, true, priority);
+  if (prefetcher)
+    request->prefetchedFor.insert(prefetcher);
+  _parent->processingThread().addPageProcessingRequest(request, pending);
+  if (pending)
+    return false;
+
+  // Mark the tile as pending so that getTileImage() doesn't request it again.
+  // Unlike getTileImage(), don't construct a dummy image (the tile is not
+  // visible, after all); an outdated image is reused, though. If the tile was
+  // rendered in the meantime, this has no effect (see PDFPageCache::setImage()).
+  _parent->pageCache().setImage(tile, (status == PDFPageCache::OUTDATED ? image.data() : nullptr), PDFPageCache::PLACEHOLDER, false);
+  return true;
+}
+
 void Page::asyncLoadLinks(QObject *listener)
 {
   QReadLocker docLocker(_docLock.data());
@@ -816,6 +1807,21 @@ void Page::asyncLoadLinks(QObject *listener)
   _parent->processingThread().addPageProcessingRequest(new PageProcessingLoadLinksRequest(this, listener));
 }
 
+void Page::loadLinksAndAnnotations(QList< QSharedPointer<Annotation::Link> > & links, QList< QSharedPointer<Annotation::AbstractAnnotation> > & annotations)
+{
+  links = loadLinks();
+  annotations = loadAnnotations();
+}
+
+void Page::asyncLoadAnnotations(QObject *listener)
+{
+  QReadLocker docLocker(_docLock.data());
+  QReadLocker pageLocker(_pageLock);
+  if (!_parent)
+    return;
+  _parent->processingThread().addPageProcessingRequest(new PageProcessingLoadAnnotationsRequest(this, listener));
+}
+
 //static
 QList<SearchResult> Page::executeSearch(SearchRequest request)
 {
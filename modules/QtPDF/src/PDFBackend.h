@@ -23,11 +23,13 @@
 #include <QCache>
 #include <QEvent>
 #include <QFileInfo>
+#include <QHash>
 #include <QImage>
 #include <QMap>
 #include <QMutex>
 #include <QReadLocker>
 #include <QReadWriteLock>
+#include <QSet>
 #include <QSharedPointer>
 #include <QStack>
 #include <QThread>
@@ -35,6 +37,11 @@
 #include <QWeakPointer>
 #include <QWriteLocker>
 
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <list>
+
 namespace QtPDF {
 
 namespace Backend {
@@ -102,41 +109,152 @@ protected:
 };
 
 // This class is thread-safe
-class PDFPageCache : protected QCache<PDFPageTile, QSharedPointer<QImage> >
+// Tiles of all documents are kept in one application-wide instance (see
+// globalCache()) so that a single memory budget applies to all open documents;
+// when it is exceeded, the least recently used tiles are evicted regardless of
+// which document they belong to. Tiles are associated with their document by
+// PDFPageTile::doc_id.
+class PDFPageCache
 {
-  typedef QCache<PDFPageTile, QSharedPointer<QImage> > Super;
 public:
   enum TileStatus { UNKNOWN, PLACEHOLDER, CURRENT, OUTDATED };
+  // Counters of cache accesses (see statistics())
+  struct Statistics {
+    // Number of getImage() calls that did (not) find an image
+    qint64 hits{0};
+    qint64 misses{0};
+    // Number of images scrapped to stay within maxSize()
+    qint64 evictions{0};
+  };
+
+  // Default for maxSize() (in bytes)
+  static constexpr qint64 DefaultMaxSize = 1024 * 1024 * 1024;
 
   PDFPageCache() = default;
+  explicit PDFPageCache(const qint64 maxSize) : _maxSize(maxSize) { }
   virtual ~PDFPageCache() = default;
 
-  // Note: Each image has a cost of 1
-  int maxSize() const { return maxCost(); }
-  void setMaxSize(const int num) { setMaxCost(num); }
-
-  // Returns the image under the key `tile` or nullptr if it doesn't exist
-  QSharedPointer<QImage> getImage(const PDFPageTile & tile) const;
+  // The cache shared by all documents (see Document::pageCache()). It has the
+  // default size (DefaultMaxSize) unless changed with setMaxSize().
+  static PDFPageCache & globalCache();
+
+  // Note: The cost of each image is its actual size in bytes, i.e., tiles
+  // rendered for high-dpi screens (which have devicePixelRatio() times as
+  // many pixels in each direction) cost correspondingly more
+  qint64 maxSize() const { return _maxSize; }
+  void setMaxSize(const qint64 num);
+  // Total size of all cached images in bytes
+  qint64 size() const { return _size; }
+
+  // Returns the image under the key `tile` or nullptr if it doesn't exist. If
+  // `status` is given, it receives the status of the tile (see getStatus()).
+  QSharedPointer<QImage> getImage(const PDFPageTile & tile, TileStatus * status = nullptr) const;
   TileStatus getStatus(const PDFPageTile & tile) const;
   // Returns the pointer to the image in the cache under they key `tile` after
   // the insertion. If overwrite == true, this will always be image, otherwise
-  // it can be different
+  // it can be different. Cached images are never changed (only replaced), so
+  // images obtained from the cache can be used without holding any lock.
   QSharedPointer<QImage> setImage(const PDFPageTile & tile, QImage * image, const TileStatus status, const bool overwrite = true);
-
-
-  void lock() const { _lock.lockForRead(); }
-  void unlock() const { _lock.unlock(); }
-
-  void clear() { QWriteLocker l(&_lock); Super::clear(); _tileStatus.clear(); }
+  // Marks `tile` as OUTDATED if it is currently a PLACEHOLDER (e.g., because
+  // the request to render it was cancelled), or forgets it if the placeholder
+  // has no image. This ensures that rendering the tile is requested again the
+  // next time it is needed. Tiles with other statuses are not affected.
+  void discardPlaceholder(const PDFPageTile & tile);
+
+  void clear();
+  // Removes all tiles belonging to the document with the given
+  // Document::cacheId()
+  void clear(const unsigned int docId);
   // Mark all tiles outdated
   void markOutdated();
+  // Mark all tiles of the document with the given Document::cacheId() outdated
+  // except those of the pages in `keepPages`
+  void markOutdated(const unsigned int docId, const QSet<int> & keepPages = QSet<int>());
+
+  // Returns all tiles that currently have an image in the cache
+  QList<PDFPageTile> tiles() const;
+  // Returns the cached tiles of page `pageNum` of the document with the given
+  // Document::cacheId() that overlap `render_box` (which is given at the
+  // resolution `xres` x `yres`) once they are scaled to that resolution. The
+  // tiles are sorted by resolution, highest first. This uses a spatial index
+  // of the tiles of each page, so it neither depends on the number of tiles
+  // of other pages nor on the number of tiles far away from `render_box`.
+  QList<PDFPageTile> overlappingTiles(const unsigned int docId, const int pageNum, const double xres, const double yres, const QRect & render_box) const;
+
+  // Returns the total size in bytes of the cached images of each document
+  // (indexed by Document::cacheId())
+  QMap<unsigned int, qint64> sizePerDocument() const;
+
+  Statistics statistics() const;
+  void resetStatistics();
 
-  QList<PDFPageTile> tiles() const { return keys(); }
 protected:
-  mutable QReadWriteLock _lock;
-  // Map to keep track of the current status of tiles; note that the status
-  // information is not deleted when the QCache scraps images to save memory.
-  QMap<PDFPageTile, TileStatus> _tileStatus;
+  struct Entry {
+    // nullptr if the image was evicted while the tile was a placeholder;
+    // entries of all other evicted tiles are removed (see evict())
+    QSharedPointer<QImage> image;
+    TileStatus status{UNKNOWN};
+    qint64 cost{0};
+    // Value of _clock when the image was last used; it tells which of the
+    // shards' least recently used images is the oldest (see evict())
+    std::atomic<quint64> lastUsed{0};
+    // Position in Shard::lru (only valid while the entry has an image)
+    std::list<PDFPageTile>::iterator lruPos;
+  };
+  // The tiles are distributed over several independently locked shards (by
+  // their hash) so that painting (which looks up many tiles) and rendering
+  // (which inserts them) rarely block each other
+  struct Shard {
+    mutable QReadWriteLock lock;
+    QHash< PDFPageTile, QSharedPointer<Entry> > entries;
+    // The tiles that have an image, most recently used first. Readers move
+    // tiles to the front while holding `lock` for reading, so they also need
+    // to lock lruLock.
+    std::list<PDFPageTile> lru;
+    QMutex lruLock;
+  };
+  static constexpr int NumShards = 16;
+  // Once size() exceeds maxSize(), images are evicted until the cache is
+  // 1/EvictionSlack below maxSize(), so the next insertions don't have to
+  // evict again right away
+  static constexpr int EvictionSlack = 16;
+
+  Shard & shardFor(const PDFPageTile & tile) const;
+  // Evicts the least recently used images until size() <= targetSize
+  void evict(const qint64 targetSize);
+
+  mutable Shard _shards[NumShards];
+  std::atomic<qint64> _maxSize{DefaultMaxSize};
+  std::atomic<qint64> _size{0};
+  mutable std::atomic<quint64> _clock{0};
+  // Serializes evict()
+  QMutex _evictionLock;
+  mutable std::atomic<qint64> _hits{0};
+  mutable std::atomic<qint64> _misses{0};
+  std::atomic<qint64> _evictions{0};
+
+  // The tiles of one page at one resolution, ordered by the top and left edges
+  // of their render boxes (see overlappingTiles())
+  struct TileLevel {
+    QMap< QPair<int, int>, PDFPageTile > tiles;
+    // Height of the tallest tile; tiles overlapping a given rect start at most
+    // this far above it
+    int maxHeight{0};
+  };
+  // Spatial index of all tiles that have an image and are not outdated, by
+  // document id and page number, then by resolution. Empty levels and pages
+  // are removed. Gray scale tiles are not indexed; they are derived from the
+  // color tiles (see Page::getGrayScaleImage()), which they would otherwise
+  // shadow as they share their position.
+  // NB: If both are needed, _indexLock must be locked before any shard lock.
+  mutable QReadWriteLock _indexLock;
+  QHash< QPair<unsigned int, int>, QMap< QPair<double, double>, TileLevel > > _tileIndex;
+  // The caller must hold a write lock on _indexLock
+  void addToIndex(const PDFPageTile & tile);
+  void removeFromIndex(const PDFPageTile & tile);
+
+private:
+  Q_DISABLE_COPY(PDFPageCache)
 };
 
 class PageProcessingRequest : public QObject
@@ -147,51 +265,91 @@ class PageProcessingRequest : public QObject
   // Protect c'tor and execute() so we can't access them except in derived
   // classes and friends
 protected:
-  PageProcessingRequest(Page *page, QObject *listener) : page(page), listener(listener) { }
+  PageProcessingRequest(Page *page, QObject *listener, const qreal priority = 0) : page(page), listener(listener), priority(priority) { }
   // Should perform whatever processing it is designed to do
   // Returns true if finished successfully, false otherwise
   virtual bool execute() = 0;
+  // Called (in the thread that cancelled the request) if the request is
+  // dropped without being executed; can be used to clean up, e.g., placeholder
+  // images
+  virtual void cancel() { }
+  // Called when the identical request `other` is coalesced with this one (see
+  // PDFPageProcessingThread::addPageProcessingRequest()); the caller holds the
+  // work queue lock
+  virtual void merge(const PageProcessingRequest & other) { Q_UNUSED(other) }
 
 public:
-  enum Type { PageRendering, LoadLinks };
+  enum Type { PageRendering, LoadLinks, LoadAnnotations };
+
+  // Identifies the work a request does. Requests with equal keys are
+  // identical and are coalesced (see
+  // PDFPageProcessingThread::addPageProcessingRequest()).
+  struct Key {
+    Type type;
+    const Page * page;
+    double xres, yres;
+    QRect render_box;
+    bool cache;
+
+    bool operator==(const Key & o) const {
+      return (type == o.type && page == o.page && xres == o.xres && yres == o.yres && render_box == o.render_box && cache == o.cache);
+    }
+  };
 
   ~PageProcessingRequest() override = default;
   virtual Type type() const = 0;
+  virtual Key key() const { return {type(), page, 0, 0, QRect(), false}; }
 
   Page *page;
   QObject *listener;
-
-  virtual bool operator==(const PageProcessingRequest & r) const;
+  // Requests with lower values are processed first (e.g., the distance of a
+  // tile from the center of the viewport); requests of equal priority are
+  // processed in LIFO order
+  qreal priority;
+  // Priorities of requests that render tiles nobody is waiting for yet (see
+  // Page::prefetchTileImage()) start here, i.e., behind anything visible
+  static constexpr qreal PrefetchPriority = 1e9;
+
+  bool operator==(const PageProcessingRequest & r) const { return key() == r.key(); }
 #ifdef DEBUG
   virtual operator QString() const = 0;
 #endif
 };
 
+uint qHash(const PageProcessingRequest::Key & key) noexcept;
+
 class PageProcessingRenderPageRequest : public PageProcessingRequest
 {
   Q_OBJECT
   friend class PDFPageProcessingThread;
 
 public:
-  PageProcessingRenderPageRequest(Page *page, QObject *listener, double xres, double yres, QRect render_box = QRect(), bool cache = false) :
-    PageProcessingRequest(page, listener),
+  PageProcessingRenderPageRequest(Page *page, QObject *listener, double xres, double yres, QRect render_box = QRect(), bool cache = false, const qreal priority = 0) :
+    PageProcessingRequest(page, listener, priority),
     xres(xres), yres(yres),
     render_box(render_box),
     cache(cache)
   {}
   Type type() const override { return PageRendering; }
+  Key key() const override { return {PageRendering, page, xres, yres, render_box, cache}; }
 
-  bool operator==(const PageProcessingRequest & r) const override;
 #ifdef DEBUG
   operator QString() const override;
 #endif
 
-protected:
-  bool execute() override;
-
   double xres, yres;
   QRect render_box;
   bool cache;
+  // The objects (e.g., views) on whose behalf the tile is prefetched (see
+  // Page::prefetchTileImage()), so each can drop its own outdated prefetch
+  // requests without affecting those of others. The objects are only used as
+  // keys and never dereferenced.
+  QSet<const QObject*> prefetchedFor;
+
+protected:
+  bool execute() override;
+  void cancel() override;
+  void merge(const PageProcessingRequest & other) override;
 };
 
 
@@ -237,37 +395,138 @@ class PDFLinksLoadedEvent : public QEvent
 {
 
 public:
-  PDFLinksLoadedEvent(const QList< QSharedPointer<Annotation::Link> > links):
+  PDFLinksLoadedEvent(const QList< QSharedPointer<Annotation::Link> > links, const int pageNum = -1):
     QEvent(LinksLoadedEvent),
-    links(links)
+    links(links),
+    pageNum(pageNum)
   {}
 
   static const QEvent::Type LinksLoadedEvent;
 
   const QList< QSharedPointer<Annotation::Link> > links;
+  // The page the links belong to (listeners may have moved on to another page
+  // by the time the event arrives)
+  const int pageNum;
+
+};
+
+
+// Loads the links and the annotations of a page in one go (see
+// Page::loadLinksAndAnnotations()) and delivers both in one
+// PDFAnnotationsLoadedEvent
+class PageProcessingLoadAnnotationsRequest : public PageProcessingRequest
+{
+  Q_OBJECT
+  friend class PDFPageProcessingThread;
+
+public:
+  PageProcessingLoadAnnotationsRequest(Page *page, QObject *listener) : PageProcessingRequest(page, listener) { }
+  Type type() const override { return LoadAnnotations; }
+
+#ifdef DEBUG
+  operator QString() const override;
+#endif
+
+protected:
+  bool execute() override;
+};
+
+
+class PDFAnnotationsLoadedEvent : public QEvent
+{
+
+public:
+  PDFAnnotationsLoadedEvent(const QList< QSharedPointer<Annotation::Link> > links, const QList< QSharedPointer<Annotation::AbstractAnnotation> > annotations, const int pageNum = -1):
+    QEvent(AnnotationsLoadedEvent),
+    links(links),
+    annotations(annotations),
+    pageNum(pageNum)
+  {}
+
+  static const QEvent::Type AnnotationsLoadedEvent;
+
+  const QList< QSharedPointer<Annotation::Link> > links;
+  const QList< QSharedPointer<Annotation::AbstractAnnotation> > annotations;
+  // The page the links and annotations belong to (see PDFLinksLoadedEvent)
+  const int pageNum;
 
 };
 
 
+class PDFPageProcessingWorker;
+
 // Class to perform (possibly) lengthy operations on pages in the background
 // Modelled after the "Blocking Fortune Client Example" in the Qt docs
 // (http://doc.qt.nokia.com/stable/network-blockingfortuneclient.html)
 
-// The `PDFPageProcessingThread` is a thread that processes background jobs.
-// Each job is represented by a subclass of `PageProcessingRequest` and
-// contains an `execute` method that performs the actual work.
-class PDFPageProcessingThread : public QThread
+// The `PDFPageProcessingThread` manages a pool of worker threads that process
+// background jobs. Each job is represented by a subclass of
+// `PageProcessingRequest` and contains an `execute` method that performs the
+// actual work. All workers share one work queue ordered by the requests'
+// `priority`; idle workers pick up the most urgent request as soon as it
+// becomes available. Workers are started lazily (i.e., only when requests are
+// pending and all running workers are busy).
+class PDFPageProcessingThread : public QObject
 {
   Q_OBJECT
+  friend class PDFPageProcessingWorker;
 
 public:
   PDFPageProcessingThread() = default;
   ~PDFPageProcessingThread() override;
 
-  // add a processing request to the work stack
+  // Maximum number of worker threads that process requests concurrently.
+  // Defaults to defaultWorkerCount().
+  int workerCount() const;
+  void setWorkerCount(const int count);
+
+  // If serialized is true, at most one request is processed at any time,
+  // regardless of workerCount(). This is used for backends that cannot
+  // process several requests of the same document concurrently (see
+  // Document::Capability_ParallelRendering).
+  bool isSerialized() const;
+  void setSerialized(const bool serialized);
+
+  // Application-wide default for workerCount() used by newly constructed
+  // objects. Defaults to QThread::idealThreadCount().
+  static int defaultWorkerCount();
+  static void setDefaultWorkerCount(const int count);
+
+  // add a processing request to the work queue
   // Note: request must have been created on the heap and must be in the scope
-  // of this thread; use requestRenderPage() and requestLoadLinks() for that
-  void addPageProcessingRequest(PageProcessingRequest * request);
+  // of this thread; use Page::asyncRenderToImage(), Page::asyncLoadLinks(), or
+  // Page::asyncLoadAnnotations() for that
+  // If an identical request (for the same listener) is already queued, the
+  // two are coalesced (i.e., `request` is deleted and the queued one is
+  // processed with the more urgent of the two priorities). Requests without
+  // listener (e.g., prefetching) are coalesced with identical requests of any
+  // listener, which then takes them over, even while they are being processed.
+  // If `takeOverOnly` is true, `request` is only used to take over such a
+  // request and is deleted otherwise.
+  void addPageProcessingRequest(PageProcessingRequest * request, const bool takeOverOnly = false);
+  // Like addPageProcessingRequest() with `takeOverOnly`, but without the need
+  // to construct a request first (which would be wasteful, e.g., for every
+  // paint of a pending tile, see Page::getTileImage()): lets `listener` take
+  // over a pending request with `key` (if any) and processes it with
+  // `priority` if that is more urgent. Returns whether a request was found.
+  bool takeOverRequest(const PageProcessingRequest::Key & key, QObject * listener, const qreal priority);
+
+  // Called by a request that is being processed once its result is available
+  // (e.g., in the cache). Returns the listener to notify; from then on, the
+  // request can no longer be taken over (see addPageProcessingRequest()).
+  QObject * finishRequest(PageProcessingRequest * request);
+
+  // Returns the number of queued requests (not counting those that are being
+  // processed) that are more urgent than `maxPriority`
+  int numPendingRequests(const qreal maxPriority = std::numeric_limits<qreal>::max()) const;
+
+  // Calls `update` for each queued request (in the calling thread, while the
+  // work queue is locked, so `update` must not add requests or acquire any
+  // locks). `update` may change the request's `priority`; if it returns
+  // `false`, the request is cancelled (see PageProcessingRequest::cancel()).
+  // This is typically used to demote or drop requests for tiles that have left
+  // the viewport. Must be called from the main (GUI) thread.
+  void reprioritize(const std::function<bool(PageProcessingRequest & request)> & update);
 
   // drop all remaining processing requests
   // WARNING: This function *must not* be called while the calling thread holds
@@ -278,23 +537,55 @@ public:
   // finish. However, that lock is held by the caller of clearWorkStack().
   void clearWorkStack();
 
-protected:
-  void run() override;
-
 private:
-  QStack<PageProcessingRequest*> _workStack;
-  QMutex _mutex;
+  // Main loop of the worker with the index `workerIndex` in _workers; runs in
+  // that worker's thread
+  void processRequests(const int workerIndex);
+  // Inserts `request` into _workQueue according to its priority. The caller
+  // must hold _mutex
+  void enqueue(PageProcessingRequest * request);
+  // Removes `request` from _workQueue (but not from _queuedRequests). The
+  // caller must hold _mutex
+  void dequeue(PageProcessingRequest * request);
+  // Returns a queued request with `key` that may be coalesced with one for
+  // `listener`, or nullptr. The caller must hold _mutex
+  PageProcessingRequest * findQueuedRequest(const PageProcessingRequest::Key & key, const QObject * listener) const;
+  // Lets `listener` take over `queued` (if it has no listener yet) and
+  // processes it with `priority` if that is more urgent. The caller must hold
+  // _mutex
+  void coalesce(PageProcessingRequest * queued, QObject * listener, const qreal priority);
+  // Lets `listener` take over a request with `key` without listener that is
+  // being processed (if any). The caller must hold _mutex
+  bool takeOverActiveRequest(const PageProcessingRequest::Key & key, QObject * listener);
+  // The caller must hold _mutex
+  int effectiveWorkerCount() const { return (_serialized ? 1 : _workerCount); }
+
+  // Pending requests, sorted by descending priority value (i.e., the most
+  // urgent request is at the end)
+  QList<PageProcessingRequest*> _workQueue;
+  // The requests in _workQueue by key, to find identical requests without
+  // going through the whole queue
+  QMultiHash<PageProcessingRequest::Key, PageProcessingRequest*> _queuedRequests;
+  // Requests that are being processed (until they are finished, see
+  // finishRequest())
+  QList<PageProcessingRequest*> _activeRequests;
+  QList<PDFPageProcessingWorker*> _workers;
+  mutable QMutex _mutex;
   QWaitCondition _waitCondition;
-  bool _idle{true};
+  // Number of workers that are currently processing a request (or that have
+  // been started but have not gone to sleep yet)
+  int _busyWorkers{0};
   QWaitCondition _idleCondition;
+  int _workerCount{defaultWorkerCount()};
+  bool _serialized{false};
   bool _quit{false};
 #ifdef DEBUG
-  static void dumpWorkStack(const QStack<PageProcessingRequest*> & ws);
+  static void dumpWorkQueue(const QList<PageProcessingRequest*> & wq);
 #endif
 
 };
 
-enum SearchFlag { Search_WrapAround = 0x01, Search_CaseInsensitive = 0x02, Search_Backwards = 0x04};
+enum SearchFlag { Search_WrapAround = 0x01, Search_CaseInsensitive = 0x02, Search_Backwards = 0x04, Search_WholeWords = 0x08};
 Q_DECLARE_FLAGS(SearchFlags, SearchFlag)
 Q_DECLARE_OPERATORS_FOR_FLAGS(SearchFlags)
 
@@ -343,6 +634,11 @@ public:
                     Permission_PrintHighRes = 0x0800
                   };
   Q_DECLARE_FLAGS(Permissions, Permission)
+  // Capabilities of the backend implementation (as opposed to the permissions
+  // of the document)
+  enum Capability { Capability_ParallelRendering = 0x0001 // Pages can be rendered (and their links loaded) in several threads concurrently
+                  };
+  Q_DECLARE_FLAGS(Capabilities, Capability)
 
   static QSharedPointer<Backend::Document> newDocument(const QString & fileName, const QString & backend = {});
   static QStringList backends();
@@ -357,13 +653,31 @@ public:
   QString fileName() const { QReadLocker docLocker(_docLock.data()); return _fileName; }
   // Uses doc-read-lock
   PDFPageProcessingThread& processingThread();
-  // Uses doc-read-lock
+  // Returns PDFPageCache::globalCache(); tiles of this document are
+  // identified by cacheId()
   PDFPageCache& pageCache();
+  // Identifier of this document in the page cache. It is unique for the
+  // lifetime of the application (i.e., it is not reused even after this
+  // document is destroyed).
+  unsigned int cacheId() const { return _cacheId; }
 
   // Uses doc-read-lock and may use doc-write-lock
   // NB: no const variant exists as we may need to create a new Page (if it was
   // not cached in _pages), which requires a non-const `this` pointer as parent
   virtual QWeakPointer<Page> page(int at);
+  // Returns the size of page `at` (in pt). Unlike page(at)->pageSizeF(), this
+  // does not create the Page object if the backend supports determining page
+  // sizes separately. As that can take long for large documents, sizes are
+  // determined progressively (see loadPageSizes()). Until the size of the page
+  // is known, an estimate is returned and `isEstimate` (if given) is set to
+  // `true`.
+  // Uses doc-read-lock and may use doc-write-lock
+  QSizeF pageSizeF(const int at, bool * isEstimate = nullptr);
+  // Determines the sizes of (up to) `count` pages starting at `first` that are
+  // not known yet (see pageSizeF()). This is intended to be run in a background
+  // thread.
+  // Uses doc-read-lock and doc-write-lock
+  void loadPageSizes(const int first, const int count);
   virtual PDFDestination resolveDestination(const PDFDestination & namedDestination) const {
     return (namedDestination.isExplicit() ? namedDestination : PDFDestination());
   }
@@ -373,6 +687,8 @@ public:
   Permissions permissions() const { QReadLocker docLocker(_docLock.data()); return _permissions; }
   // Uses doc-read-lock
   Permissions& permissions() { QReadLocker docLocker(_docLock.data()); return _permissions; }
+  // Uses doc-read-lock
+  Capabilities capabilities() const { QReadLocker docLocker(_docLock.data()); return _capabilities; }
 
   // Uses doc-read-lock
   virtual bool isValid() const = 0;
@@ -380,6 +696,19 @@ public:
   virtual bool isLocked() const = 0;
   // Uses doc-write-lock
   virtual void reload() = 0;
+  // Does the time-consuming part of reload() in advance: opens the file again
+  // (independently of the currently loaded one, which can still be displayed
+  // in the meantime) and renders the given tiles from it. This is meant to be
+  // run in a background thread; a subsequent reload() then only swaps in the
+  // prepared file and tiles. Returns `false` if the backend does not support
+  // this or the file could not be loaded; reload() then works as usual.
+  // Uses doc-read-lock and doc-write-lock
+  virtual bool prepareReload(const QList<PDFPageTile> & tiles) { Q_UNUSED(tiles) return false; }
+  // Returns whether `fileName` looks like a completely written PDF file, i.e.,
+  // whether it ends with an end-of-file marker preceded by a valid pointer to
+  // the cross-reference table. This is used to avoid reloading files that are
+  // still being written (e.g., by a TeX run).
+  static bool isCompleteFile(const QString & fileName);
 
   // Returns `true` if unlocking was successful and `false` otherwise.
   // Uses doc-read-lock and may use doc-write-lock
@@ -420,13 +749,65 @@ protected:
   Document(const QString fileName);
 
   void clearPages();
+  // Like clearPages(), but keeps the Page objects of the pages in `keep` (and
+  // everything they have loaded, e.g., links and annotations). Pages at or
+  // beyond _numPages are never kept, so call this only after _numPages has
+  // been updated for the new file.
+  void clearPages(const QSet<int> & keep);
   virtual void clearMetaData();
+  // Returns a fingerprint of the content of page `n` of the currently loaded
+  // file (e.g., a hash of its content stream and resources). reload() uses it
+  // to find the pages that did not change so that their tiles, links, and
+  // annotations can be kept. Pages with an empty fingerprint (the default) are
+  // always considered changed. As this may take some time, it is only called
+  // from background threads (see prepareReload() and fingerprintCachedPages()).
+  // The caller must hold a doc-lock; implementations must not acquire one.
+  virtual QByteArray pageFingerprint(const int n) const { Q_UNUSED(n) return QByteArray(); }
+  // Returns the size of page `at` (in pt) without creating a Page object, or
+  // an invalid size if that is not possible. Backends that implement this
+  // should initialize _pageSizes when parsing the document (see pageSizeF()).
+  // This is called from background threads; the caller holds a doc-read-lock.
+  virtual QSizeF fetchPageSize(const int at) const { Q_UNUSED(at) return QSizeF(); }
+  // Sets _meta_pageSize to the most common size in _pageSizes once all sizes
+  // are known (until then, it remains an estimate).
+  // The caller must hold a doc-write-lock.
+  void updateMetaPageSize();
+  // Returns the fingerprints of all pages that have tiles in the page cache
+  // (other pages have nothing worth keeping across a reload). Call this before
+  // replacing the underlying file. Do not call this from the GUI thread.
+  // The caller must hold a doc-lock.
+  QMap<int, QByteArray> fingerprintCachedPages();
+  // Returns those pages of `oldFingerprints` whose fingerprint in the newly
+  // loaded file (as given by `newFingerprints`, e.g., computed by
+  // prepareReload() in the background) is still the same. Pages missing from
+  // `newFingerprints` are considered changed; fingerprints are never computed
+  // here as this is typically called from the GUI thread. Call this after the
+  // new file has been loaded (and _numPages has been updated).
+  // The caller must hold a doc-write-lock.
+  QSet<int> unchangedPages(const QMap<int, QByteArray> & oldFingerprints, const QMap<int, QByteArray> & newFingerprints);
+  // Sets _capabilities and configures _processingThread accordingly (e.g., if
+  // the backend cannot render in parallel, requests are serialized).
+  // The caller must hold a doc-write-lock.
+  void setCapabilities(const Capabilities capabilities);
 
   int _numPages{-1};
   PDFPageProcessingThread _processingThread;
-  PDFPageCache _pageCache;
+  const unsigned int _cacheId;
   QVector< QSharedPointer<Page> > _pages;
+  // Sizes of all pages (in pt); entries are invalid until the respective size
+  // is known (see loadPageSizes()). Backends that implement fetchPageSize()
+  // should resize this to _numPages while parsing the document (and may
+  // already fill in some entries); if it remains empty, pageSizeF() falls back
+  // to creating Page objects. It is reset by clearMetaData().
+  QVector<QSizeF> _pageSizes;
+  // Incremented whenever _pageSizes is reset to detect that sizes determined
+  // by loadPageSizes() belong to an outdated file
+  unsigned int _pageSizesGeneration{0};
+  // Fingerprints of (some of) the pages of the currently loaded file, as
+  // computed during the last reload; see unchangedPages()
+  QMap<int, QByteArray> _pageFingerprints;
   Permissions _permissions;
+  Capabilities _capabilities;
 
   QString _fileName;
 
@@ -467,8 +848,14 @@ protected:
   // Uses doc-read-lock and page-read-lock.
   QSharedPointer<QImage> getCachedImage(double xres, double yres, QRect render_box = QRect(), PDFPageCache::TileStatus * status = nullptr);
 
+  // Returns the gray scale version of the tile `colorImage` was obtained for
+  // (see getTileImage()). It is converted only if the regular tile changed
+  // since the last conversion and is cached otherwise.
+  // Uses doc-read-lock and page-read-lock.
+  QSharedPointer<QImage> getGrayScaleImage(double xres, double yres, QRect render_box, const QSharedPointer<QImage> & colorImage);
+
   // Uses doc-read-lock and page-read-lock.
-  virtual void asyncRenderToImage(QObject *listener, double xres, double yres, QRect render_box = QRect(), bool cache = false);
+  virtual void asyncRenderToImage(QObject *listener, double xres, double yres, QRect render_box = QRect(), bool cache = false, const qreal priority = 0);
 
 public:
   // Class to encapsulate boxes, e.g., for selecting
@@ -482,7 +869,55 @@ public:
     }
   };
 
-  virtual ~Page() = default;
+  // The text of the page, as used for selecting and copying text, for
+  // searching, and for SyncTeX (see textLayer()). All rectangles are in pdf
+  // coordinates (i.e., bp).
+  class TextLayer {
+  public:
+    class Word {
+    public:
+      QString text;
+      QRectF boundingBox;
+      // The bounding boxes of the individual characters of `text`
+      QList<QRectF> charBoxes;
+      bool hasSpaceAfter{false};
+      // Index of the line the word is on (guessed from the word geometry)
+      int line{0};
+    };
+
+    // Words in reading order (as determined by the backend)
+    QList<Word> words;
+    int lineCount{0};
+
+    // Returns `false` if `text` certainly does not occur on the page (ignoring
+    // whitespace, case, and compatibility characters such as ligatures). This
+    // is meant to skip pages quickly when searching.
+    bool mayContain(const QString & text) const;
+
+  private:
+    friend class Page;
+    // The text of all words in normalized form (see mayContain())
+    QString _normalizedText;
+  };
+
+  // Returns the text layer of the page. It is extracted by the backend (see
+  // loadTextLayer()) on first use and kept as long as it is in use or among
+  // the most recently used ones (see TextLayerCache), but at most until the
+  // page changes (see Document::reload()).
+  // Uses page-read-lock and may use page-write-lock (and whatever
+  // loadTextLayer() uses).
+  QSharedPointer<const TextLayer> textLayer() const;
+
+protected:
+  // Extracts the text of the page (see textLayer()); TextLayer::Word::line
+  // need not be set. This is called without holding any locks.
+  virtual TextLayer loadTextLayer() const { return TextLayer(); }
+  // Result of textLayer(); it is kept alive by TextLayerCache
+  mutable QWeakPointer<const TextLayer> _textLayer;
+
+public:
+
+  virtual ~Page();
 
   Document * document() { QReadLocker pageLocker(_pageLock); return _parent; }
   int pageNum() const;
@@ -500,7 +935,9 @@ public:
   // of characters) to speed up hit calculations. Only one level of subboxes is
   // currently supported. The big box boundingBox must completely encompass all
   // subBoxes' boundingBoxes.
-  virtual QList<Box> boxes() const { return QList<Box>(); }
+  // The default implementation returns the words (and characters) of
+  // textLayer().
+  virtual QList<Box> boxes() const;
   // Return selected text
   // The returned text should contain all characters inside (at least) one of
   // the `selection` polygons.
@@ -508,13 +945,8 @@ public:
   // Optionally, the function can also return wordBoxes and/or charBoxes for
   // each character (i.e., a rect enclosing the word the character is part of
   // and/or a rect enclosing the actual character)
-  virtual QString selectedText(const QList<QPolygonF> & selection, QMap<int, QRectF> * wordBoxes = nullptr, QMap<int, QRectF> * charBoxes = nullptr, const bool onlyFullyEnclosed = false) const {
-    Q_UNUSED(selection)
-    Q_UNUSED(onlyFullyEnclosed)
-    if (wordBoxes) wordBoxes->clear();
-    if (charBoxes) charBoxes->clear();
-    return QString();
-  }
+  // The default implementation is based on textLayer().
+  virtual QString selectedText(const QList<QPolygonF> & selection, QMap<int, QRectF> * wordBoxes = nullptr, QMap<int, QRectF> * charBoxes = nullptr, const bool onlyFullyEnclosed = false) const;
 
   // Uses page-read-lock and doc-read-lock.
   virtual QImage renderToImage(double xres, double yres, QRect render_box = QRect(), bool cache = false) const = 0;
@@ -523,11 +955,34 @@ public:
   // If listener != nullptr, this is an asynchronous render request and the method
   // returns a dummy image (which is added to the cache to speed up future
   // requests). Otherwise, the method renders the page synchronously and returns
-  // the result.
+  // the result. `priority` is passed on to the asynchronous render request
+  // (see PageProcessingRequest::priority). If `grayScale` is true, the tile is
+  // returned in gray scale (see convertToGrayScale()); gray scale tiles are
+  // cached as well, so they are only converted once.
+  // Uses page-read-lock and doc-read-lock.
+  QSharedPointer<QImage> getTileImage(QObject * listener, const double xres, const double yres, QRect render_box = QRect(), const qreal priority = 0, const bool grayScale = false);
+  // Requests rendering the tile in the background (unless it is cached or
+  // pending already) without waiting for the result or notifying anybody once
+  // it is done. Like for getTileImage(), the tile is marked as PLACEHOLDER in
+  // the cache until then (without an image unless an outdated one is at hand),
+  // and a later getTileImage() for the tile takes the request over rather than
+  // rendering it again. `priority` should be at least
+  // PageProcessingRequest::PrefetchPriority. If `prefetcher` is given, it is
+  // recorded in the request (see PageProcessingRenderPageRequest::prefetchedFor),
+  // even if the tile was pending already. Returns whether a request was queued.
   // Uses page-read-lock and doc-read-lock.
-  QSharedPointer<QImage> getTileImage(QObject * listener, const double xres, const double yres, QRect render_box = QRect());
+  bool prefetchTileImage(const double xres, const double yres, QRect render_box = QRect(), const qreal priority = PageProcessingRequest::PrefetchPriority, const QObject * prefetcher = nullptr);
 
   virtual QList< QSharedPointer<Annotation::AbstractAnnotation> > loadAnnotations() { return QList< QSharedPointer<Annotation::AbstractAnnotation> >(); }
+  // Loads both the links and the annotations of the page. Backends that
+  // extract both from the same data should override this to do so in a single
+  // pass; the default implementation simply calls loadLinks() and
+  // loadAnnotations().
+  virtual void loadLinksAndAnnotations(QList< QSharedPointer<Annotation::Link> > & links, QList< QSharedPointer<Annotation::AbstractAnnotation> > & annotations);
+  // Loads the links and annotations in the background and posts them to
+  // `listener` as PDFAnnotationsLoadedEvent.
+  // Uses doc-read-lock and page-read-lock.
+  virtual void asyncLoadAnnotations(QObject *listener);
 
   // Searches the page for the given text string and returns a list of boxes
   // that contain that text.
@@ -546,6 +1001,40 @@ public:
   static QList<SearchResult> executeSearch(SearchRequest request);
 };
 
+// Keeps the text layers of the most recently used pages alive (see
+// Page::textLayer()). Pages only hold weak references to their text layers, so
+// the layers of all other pages are released unless they are still in use.
+// The size is measured in words.
+// This class is thread-safe.
+class TextLayerCache
+{
+public:
+  // Default for maxSize(); this is enough for several hundred pages of text
+  static constexpr int DefaultMaxSize = 200000;
+
+  explicit TextLayerCache(const int maxSize = DefaultMaxSize) : _cache(maxSize) { }
+
+  // The cache used by all pages
+  static TextLayerCache & globalCache();
+
+  int maxSize() const;
+  void setMaxSize(const int num);
+  // Total number of words of all cached text layers
+  int size() const;
+
+  // Adds `layer` as the text layer of `page` (if it is not cached yet) and
+  // marks it as the most recently used one
+  void use(const Page * page, const QSharedPointer<const Page::TextLayer> & layer);
+  // Releases the text layer of `page` (e.g., because the page is destroyed)
+  void remove(const Page * page);
+
+private:
+  mutable QMutex _lock;
+  QCache< const Page *, QSharedPointer<const Page::TextLayer> > _cache;
+
+  Q_DISABLE_COPY(TextLayerCache)
+};
+
 } // namespace Backend
 
 class BackendInterface : public QObject
@@ -17,6 +17,8 @@
 #include "PDFGuideline.h"
 
 #include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
 
 // This has to be outside the namespace (according to Qt docs)
 static void initResources()
@@ -100,6 +102,18 @@ PDFDocumentView::PDFDocumentView(QWidget *parent /* = nullptr */):
 
   connect(&_searchResultWatcher, &QFutureWatcher< QList<Backend::SearchResult> >::resultReadyAt, this, &PDFDocumentView::searchResultReady);
   connect(&_searchResultWatcher, &QFutureWatcher< QList<Backend::SearchResult> >::progressValueChanged, this, &PDFDocumentView::searchProgressValueChanged);
+  _incrementalSearchTimer.setSingleShot(true);
+  _incrementalSearchTimer.setInterval(250);
+  connect(&_incrementalSearchTimer, &QTimer::timeout, this, &PDFDocumentView::startIncrementalSearch);
+
+  _zoomSettleTimer.setSingleShot(true);
+  _zoomSettleTimer.setInterval(250);
+  connect(&_zoomSettleTimer, &QTimer::timeout, this, &PDFDocumentView::zoomSettled);
+
+  // Prefetching waits until scrolling pauses briefly
+  _prefetchTimer.setSingleShot(true);
+  _prefetchTimer.setInterval(100);
+  connect(&_prefetchTimer, &QTimer::timeout, this, &PDFDocumentView::prefetch);
 
   showRuler(false);
   connect(&_ruler, &PDFRuler::dragStart, this, [this](QPoint pos, Qt::Edge origin) {
@@ -127,6 +141,12 @@ PDFDocumentView::~PDFDocumentView()
 {
   if (!_searchResultWatcher.isFinished())
     _searchResultWatcher.cancel();
+  // Nobody else would drop the tiles prefetched for this view
+  if (_pdf_scene) {
+    QSharedPointer<Backend::Document> doc(_pdf_scene->document().toStrongRef());
+    if (doc)
+      dropPrefetchRequests(doc->processingThread());
+  }
 }
 
 // Accessors
@@ -157,6 +177,8 @@ void PDFDocumentView::setScene(QSharedPointer<PDFDocumentScene> a_scene)
     connect(_pdf_scene.data(), &PDFDocumentScene::pageChangeRequested, this, [=](int pageNum){ this->goToPage(pageNum); });
     connect(_pdf_scene.data(), &PDFDocumentScene::pdfActionTriggered, this, &PDFDocumentView::pdfActionTriggered);
     connect(_pdf_scene.data(), &PDFDocumentScene::documentChanged, this, &PDFDocumentView::reinitializeFromScene);
+    connect(_pdf_scene.data(), &PDFDocumentScene::pageMaterialized, this, &PDFDocumentView::attachSearchResults);
+    connect(_pdf_scene.data(), &PDFDocumentScene::pageRecycled, this, &PDFDocumentView::detachSearchResults);
     // The connection PDFDocumentScene::documentChanged > PDFDocumentView::changedDocument
     // must be last in this list to ensure all internal states are updated (e.g.
     // in _lastPage in reinitializeFromScene()) before the signal is
@@ -606,6 +628,7 @@ void PDFDocumentView::zoomBy(const qreal zoomFactor, const QGraphicsView::Viewpo
   if (zoomFactor <= 0)
     return;
 
+  startZoomStep();
   _zoomLevel *= zoomFactor;
   // Set the transformation anchor to AnchorViewCenter so we always zoom out of
   // the center of the view (rather than out of the upper left corner)
@@ -613,10 +636,54 @@ void PDFDocumentView::zoomBy(const qreal zoomFactor, const QGraphicsView::Viewpo
   setTransformationAnchor(anchor);
   this->scale(zoomFactor, zoomFactor);
   setTransformationAnchor(oldAnchor);
+  visibleAreaChanged();
 
   emit changedZoom(_zoomLevel);
 }
 
+void PDFDocumentView::startZoomStep()
+{
+  // A zoom step that quickly follows another one is part of a gesture
+  if (_zoomSettleTimer.isActive())
+    _isZooming = true;
+  _zoomSettleTimer.start();
+}
+
+void PDFDocumentView::zoomSettled()
+{
+  if (!_isZooming)
+    return;
+  _isZooming = false;
+  // Repaint at the exact zoom level (the tiles of the pyramid level serve as
+  // placeholders in the meantime); requests for the pyramid level are dropped
+  reprioritizeRenderRequests();
+  viewport()->update();
+  _prefetchTimer.start();
+}
+
+//static
+qreal PDFDocumentView::pyramidLevel(const qreal zoomLevel)
+{
+  if (zoomLevel <= 0)
+    return zoomLevel;
+  return std::pow(2., qRound(2 * std::log2(zoomLevel)) / 2.);
+}
+
+//static
+bool PDFDocumentView::isCurrentResolution(const int renderWidth, const qreal displayWidth, const qreal zoomLevel, const bool zooming)
+{
+  if (renderWidth <= 0 || zoomLevel <= 0)
+    return false;
+  // If the tile was requested at the current zoom level, its size on screen
+  // (in device pixels) corresponds to the size of its render box; only while
+  // zooming, tiles of the current pyramid level are used as well (see
+  // PDFPageGraphicsItem::paint())
+  const qreal ratio = displayWidth / renderWidth;
+  if (qAbs(ratio - 1) <= 0.01)
+    return true;
+  return (zooming && qAbs(ratio * pyramidLevel(zoomLevel) / zoomLevel - 1) <= 0.01);
+}
+
 void PDFDocumentView::setZoomLevel(const qreal zoomLevel, const QGraphicsView::ViewportAnchor anchor /* = QGraphicsView::AnchorViewCenter */)
 {
   if (zoomLevel <= 0)
@@ -630,12 +697,14 @@ void PDFDocumentView::zoomOut(const QGraphicsView::ViewportAnchor anchor /* = QG
 void PDFDocumentView::zoomToRect(QRectF a_rect)
 {
   // NOTE: The argument, `a_rect`, is assumed to be in _scene coordinates_.
+  startZoomStep();
   fitInView(a_rect, Qt::KeepAspectRatio);
 
   // Since we passed `Qt::KeepAspectRatio` to `fitInView` both x and y scaling
   // factors were changed by the same amount. So we'll just take the x scale to
   // be the new `_zoomLevel`.
   _zoomLevel = transform().m11();
+  visibleAreaChanged();
   emit changedZoom(_zoomLevel);
 }
 
@@ -725,6 +794,7 @@ void PDFDocumentView::zoom100()
   if (unity.isEmpty())
       return;
 
+  startZoomStep();
   // Set the transformation anchor to AnchorViewCenter so we always zoom out of
   // the center of the view (rather than out of the upper left corner)
   QGraphicsView::ViewportAnchor anchor = transformationAnchor();
@@ -733,6 +803,7 @@ void PDFDocumentView::zoom100()
   setTransformationAnchor(anchor);
 
   _zoomLevel = transform().m11();
+  visibleAreaChanged();
   emit changedZoom(_zoomLevel);
 }
 
@@ -811,33 +882,48 @@ void PDFDocumentView::search(QString searchText, Backend::SearchFlags flags /* =
   // change the search text in that case (e.g., to something meaningless and
   // then back again to abort the previous search and restart at the new
   // location).
-  if (searchText == _searchString) {
-    // FIXME: If flags changed we need to do a full search!
+  if (searchText == _searchString && flags == _searchFlags) {
     nextSearchResult();
     return;
   }
 
-  clearSearchResults();
+  // An explicit search supersedes any pending incremental one
+  _incrementalSearchTimer.stop();
+  resetSearch(searchText, flags);
 
-  // Construct a list of requests that can be passed to QtConcurrent::mapped()
-  QList<Backend::SearchRequest> requests;
-  for (int i = _currentPage; i < _lastPage; ++i) {
-    Backend::SearchRequest request;
-    request.doc = _pdf_scene->document();
-    request.pageNum = i;
-    request.searchString = searchText;
-    request.flags = flags;
-    requests << request;
-  }
-  for (int i = 0; i < _currentPage; ++i) {
-    Backend::SearchRequest request;
-    request.doc = _pdf_scene->document();
-    request.pageNum = i;
-    request.searchString = searchText;
-    request.flags = flags;
-    requests << request;
+  // Once the document is indexed, the results are available (nearly)
+  // instantly, so there is no need to search the pages in the background
+  const Backend::PDFSearchIndex & index = _pdf_scene->searchIndex();
+  if (index.isUpToDate()) {
+    foreach(const Backend::SearchResult & result, index.search(searchText, flags | Backend::Search_WrapAround, qMax(0, _currentPage)))
+      addSearchResult(result);
+    nextSearchResult();
+    emit searchProgressChanged(100, _searchResults.count());
+    return;
   }
 
+  // Search all pages, starting at the current one
+  QList<int> pages;
+  for (int i = qMax(0, _currentPage); i < _lastPage; ++i)
+    pages << i;
+  for (int i = 0; i < _currentPage; ++i)
+    pages << i;
+  startSearch(pages);
+}
+
+void PDFDocumentView::incrementalSearch(const QString & searchText, Backend::SearchFlags flags /* = Backend::Search_CaseInsensitive */)
+{
+  _incrementalSearchString = searchText;
+  _incrementalSearchFlags = flags;
+  // Restart the timer so that searching only starts once the user stops
+  // typing
+  _incrementalSearchTimer.start();
+}
+
+void PDFDocumentView::resetSearch(const QString & searchText, const Backend::SearchFlags flags)
+{
+  clearSearchResults();
+
   // If another search is still running, cancel it---after all, the user wants
   // to perform a new search
   if (!_searchResultWatcher.isFinished()) {
@@ -847,6 +933,31 @@ void PDFDocumentView::search(QString searchText, Backend::SearchFlags flags /* =
 
   _currentSearchResult = -1;
   _searchString = searchText;
+  _searchFlags = flags;
+  _searchPages.clear();
+  _searchedPages.clear();
+  _pagesWithSearchResults.clear();
+}
+
+void PDFDocumentView::startSearch(const QList<int> & pages)
+{
+  // Construct a list of requests that can be passed to QtConcurrent::mapped()
+  QList<Backend::SearchRequest> requests;
+  foreach(const int pageNum, pages) {
+    Backend::SearchRequest request;
+    request.doc = _pdf_scene->document();
+    request.pageNum = pageNum;
+    request.searchString = _searchString;
+    request.flags = _searchFlags;
+    requests << request;
+  }
+
+  _searchPages = pages;
+  if (pages.isEmpty()) {
+    // QtConcurrent would not report any progress in this case
+    emit searchProgressChanged(100, 0);
+    return;
+  }
   _searchResultWatcher.setFuture(QtConcurrent::mapped(requests, Backend::Page::executeSearch));
 }
 
@@ -856,32 +967,10 @@ void PDFDocumentView::nextSearchResult()
     return;
 
   // Note: _currentSearchResult is initially -1 if no result is selected
-  if (_currentSearchResult >= 0 && _searchResults[_currentSearchResult])
-    dynamic_cast<QGraphicsPathItem*>(_searchResults[_currentSearchResult])->setBrush(_searchResultHighlightBrush);
-
   if ( (_currentSearchResult + 1) >= _searchResults.size() )
-    _currentSearchResult = 0;
+    setCurrentSearchResult(0);
   else
-    ++_currentSearchResult;
-
-  // FIXME: The rest of the code in this method is the same as in previousSearchResult()
-  // We should move this into its own private method
-
-  QGraphicsPathItem* highlightPath = dynamic_cast<QGraphicsPathItem*>(_searchResults[_currentSearchResult]);
-
-  if (!highlightPath)
-    return;
-
-  highlightPath->setBrush(_currentSearchResultHighlightBrush);
-  centerOn(highlightPath);
-
-  PDFPageGraphicsItem * pageItem = dynamic_cast<PDFPageGraphicsItem *>(highlightPath->parentItem());
-  if (pageItem) {
-    QSharedPointer<Backend::Page> page = pageItem->page().toStrongRef();
-    // FIXME: shape subpath coordinates seem to be in upside down pdf coordinates. We should find a better place to construct the proper transform (e.g., in PDFPageGraphicsItem)
-    if (page)
-      emit searchResultHighlighted(pageItem->pageNum(), highlightPath->shape().toSubpathPolygons(QTransform::fromTranslate(0, page->pageSizeF().height()).scale(1, -1)));
-  }
+    setCurrentSearchResult(_currentSearchResult + 1);
 }
 
 void PDFDocumentView::previousSearchResult()
@@ -889,60 +978,94 @@ void PDFDocumentView::previousSearchResult()
   if (!_pdf_scene || _searchResults.empty())
     return;
 
-  if (_currentSearchResult >= 0 && _searchResults[_currentSearchResult])
-    dynamic_cast<QGraphicsPathItem*>(_searchResults[_currentSearchResult])->setBrush(_searchResultHighlightBrush);
-
   if ( (_currentSearchResult - 1) < 0 )
-    _currentSearchResult = _searchResults.size() - 1;
+    setCurrentSearchResult(_searchResults.size() - 1);
   else
-    --_currentSearchResult;
-
-  // FIXME: The rest of the code in this method is the same as in previousSearchResult()
-  // We should move this into its own private method
+    setCurrentSearchResult(_currentSearchResult - 1);
+}
 
-  QGraphicsPathItem* highlightPath = dynamic_cast<QGraphicsPathItem*>(_searchResults[_currentSearchResult]);
+void PDFDocumentView::setCurrentSearchResult(const int idx)
+{
+  QGraphicsPathItem * oldHighlight = _searchResultItems.value(_currentSearchResult);
+  if (oldHighlight)
+    oldHighlight->setBrush(_searchResultHighlightBrush);
+  _currentSearchResult = idx;
 
-  if (!highlightPath)
+  // The page is about to be shown, so make sure it has an item (which also
+  // gets the highlights, see attachSearchResults())
+  PDFPageGraphicsItem * pageItem = dynamic_cast<PDFPageGraphicsItem *>(_pdf_scene->pageAt(static_cast<int>(_searchResults[idx].pageNum)));
+  QGraphicsPathItem * highlightPath = _searchResultItems.value(idx);
+  if (!pageItem || !highlightPath)
     return;
 
   highlightPath->setBrush(_currentSearchResultHighlightBrush);
   centerOn(highlightPath);
 
-  PDFPageGraphicsItem * pageItem = dynamic_cast<PDFPageGraphicsItem *>(highlightPath->parentItem());
-  if (pageItem) {
-    QSharedPointer<Backend::Page> page = pageItem->page().toStrongRef();
-    // FIXME: shape subpath coordinates seem to be in upside down pdf coordinates. We should find a better place to construct the proper transform (e.g., in PDFPageGraphicsItem)
-    if (page)
-      emit searchResultHighlighted(pageItem->pageNum(), highlightPath->shape().toSubpathPolygons(QTransform::fromTranslate(0, page->pageSizeF().height()).scale(1, -1)));
+  QSharedPointer<Backend::Page> page = pageItem->page().toStrongRef();
+  // FIXME: shape subpath coordinates seem to be in upside down pdf coordinates. We should find a better place to construct the proper transform (e.g., in PDFPageGraphicsItem)
+  if (page)
+    emit searchResultHighlighted(pageItem->pageNum(), highlightPath->shape().toSubpathPolygons(QTransform::fromTranslate(0, page->pageSizeF().height()).scale(1, -1)));
+}
+
+void PDFDocumentView::addSearchResult(const Backend::SearchResult & result)
+{
+  const int pageIdx = static_cast<int>(result.pageNum);
+  _searchResultsByPage[pageIdx] << _searchResults.size();
+  _searchResults << result;
+  // Only pages that have an item already get the highlight right away
+  PDFPageGraphicsItem * pageItem = (_pdf_scene ? _pdf_scene->materializedPage(pageIdx) : nullptr);
+  if (pageItem)
+    attachSearchResults(pageIdx, pageItem);
+}
+
+void PDFDocumentView::attachSearchResults(const int pageIdx, PDFPageGraphicsItem * pageItem)
+{
+  foreach(const int i, _searchResultsByPage.value(pageIdx)) {
+    if (_searchResultItems.contains(i))
+      continue;
+    QPainterPath path;
+    path.addRect(_searchResults[i].bbox);
+    QGraphicsPathItem * highlightItem = new PDFSearchResultGraphicsItem(path, pageItem);
+    highlightItem->setBrush(i == _currentSearchResult ? _currentSearchResultHighlightBrush : _searchResultHighlightBrush);
+    highlightItem->setPen(Qt::NoPen);
+    highlightItem->setTransform(pageItem->pointScale());
+    _searchResultItems.insert(i, highlightItem);
   }
 }
 
+void PDFDocumentView::detachSearchResults(const int pageIdx)
+{
+  foreach(const int i, _searchResultsByPage.value(pageIdx))
+    _searchResultItems.remove(i);
+}
+
 void PDFDocumentView::clearSearchResults()
 {
   if (!_pdf_scene || _searchResults.empty())
     return;
 
-  foreach( QGraphicsItem *item, _searchResults )
-    _pdf_scene->removeItem(item);
-
+  // The highlights belong to their page items
+  qDeleteAll(_searchResultItems);
+  _searchResultItems.clear();
+  _searchResultsByPage.clear();
   _searchResults.clear();
 }
 
 void PDFDocumentView::setSearchResultHighlightBrush(const QBrush & brush)
 {
   _searchResultHighlightBrush = brush;
-  for (int i = 0; i < _searchResults.size(); ++i) {
-    if (i == _currentSearchResult || !_searchResults[i])
-      continue;
-    dynamic_cast<QGraphicsPathItem*>(_searchResults[i])->setBrush(brush);
+  for (QHash<int, QGraphicsPathItem*>::const_iterator it = _searchResultItems.constBegin(); it != _searchResultItems.constEnd(); ++it) {
+    if (it.key() != _currentSearchResult)
+      it.value()->setBrush(brush);
   }
 }
 
 void PDFDocumentView::setCurrentSearchResultHighlightBrush(const QBrush & brush)
 {
   _currentSearchResultHighlightBrush = brush;
-  if (_currentSearchResult >= 0 && _currentSearchResult < _searchResults.size() && _searchResults[_currentSearchResult])
-    dynamic_cast<QGraphicsPathItem*>(_searchResults[_currentSearchResult])->setBrush(brush);
+  QGraphicsPathItem * highlightItem = _searchResultItems.value(_currentSearchResult);
+  if (highlightItem)
+    highlightItem->setBrush(brush);
 }
 
 
@@ -950,9 +1073,18 @@ void PDFDocumentView::setCurrentSearchResultHighlightBrush(const QBrush & brush)
 // --------------
 void PDFDocumentView::searchResultReady(int index)
 {
+  const QList<Backend::SearchResult> results = _searchResultWatcher.future().resultAt(index);
+  // Keep track of the pages that have been searched already for refining the
+  // search later on (see startIncrementalSearch())
+  if (index >= 0 && index < _searchPages.size()) {
+    _searchedPages.insert(_searchPages[index]);
+    if (!results.isEmpty())
+      _pagesWithSearchResults.insert(_searchPages[index]);
+  }
+
   // Convert the search result to highlight boxes
-  foreach( Backend::SearchResult result, _searchResultWatcher.future().resultAt(index) )
-    _searchResults << addHighlightPath(result.pageNum, result.bbox, _searchResultHighlightBrush);
+  foreach( Backend::SearchResult result, results )
+    addSearchResult(result);
 
   // If this is the first result that becomes available in a new search, center
   // on the first result
@@ -983,6 +1115,51 @@ void PDFDocumentView::searchProgressValueChanged(int progressValue)
     emit searchProgressChanged(100 * (progressValue - _searchResultWatcher.progressMinimum()) / (_searchResultWatcher.progressMaximum() - _searchResultWatcher.progressMinimum()), _searchResults.count());
 }
 
+void PDFDocumentView::startIncrementalSearch()
+{
+  if (!_pdf_scene)
+    return;
+
+  const QString searchText = _incrementalSearchString;
+  const Backend::SearchFlags flags = _incrementalSearchFlags;
+  if (searchText == _searchString && flags == _searchFlags)
+    return;
+  if (searchText.isEmpty()) {
+    resetSearch(searchText, flags);
+    emit searchProgressChanged(100, 0);
+    return;
+  }
+
+  // Pages that contain `searchText` also contain every part of it. So if
+  // `searchText` contains the previous search text, only pages that had
+  // results for it (or that had not been searched yet) can have results now.
+  // NB: This does not hold for whole words (a page containing the word
+  // "synchro" need not contain the word "synch"), and is pointless if the
+  // search index is up to date (which search() uses instead).
+  const Qt::CaseSensitivity cs = (flags.testFlag(Backend::Search_CaseInsensitive) ? Qt::CaseInsensitive : Qt::CaseSensitive);
+  const bool refine = (!_searchString.isEmpty() && flags == _searchFlags && !flags.testFlag(Backend::Search_WholeWords) && searchText.contains(_searchString, cs) && !_pdf_scene->searchIndex().isUpToDate());
+  if (!refine) {
+    search(searchText, flags);
+    return;
+  }
+
+  QList<int> pages;
+  for (int i = qMax(0, _currentPage); i < _lastPage; ++i) {
+    if (!_searchedPages.contains(i) || _pagesWithSearchResults.contains(i))
+      pages << i;
+  }
+  for (int i = 0; i < _currentPage; ++i) {
+    if (!_searchedPages.contains(i) || _pagesWithSearchResults.contains(i))
+      pages << i;
+  }
+  // The pages that are ruled out count as searched (without results) for the
+  // new search text, too, so that further refinements skip them as well
+  const QSet<int> excludedPages = _searchedPages - _pagesWithSearchResults;
+  resetSearch(searchText, flags);
+  _searchedPages = excludedPages;
+  startSearch(pages);
+}
+
 void PDFDocumentView::maybeUpdateSceneRect() {
   if (!_pdf_scene || (_pageMode != PageMode_SinglePage && _pageMode != PageMode_Presentation))
     return;
@@ -1194,6 +1371,7 @@ void PDFDocumentView::goToPage(const PDFPageGraphicsItem * page, const QRectF vi
     }
 
     if (mayZoom) {
+      startZoomStep();
       fitInView(rect, Qt::KeepAspectRatio);
       _zoomLevel = transform().m11();
       emit changedZoom(_zoomLevel);
@@ -1285,11 +1463,17 @@ void PDFDocumentView::reinitializeFromScene()
   if (!_searchResultWatcher.isFinished())
     _searchResultWatcher.cancel();
   _searchResults.clear();
+  _searchResultsByPage.clear();
+  _searchResultItems.clear();
   _currentSearchResult = -1;
+  _searchPages.clear();
+  _searchedPages.clear();
+  _pagesWithSearchResults.clear();
   // Also reset _searchString. Otherwise the next search for the same string
   // will assume the search has already been run (without results as
   // _searchResults is empty) and won't run it again on the new scene data.
   _searchString = QString();
+  visibleAreaChanged();
 }
 
 void PDFDocumentView::notifyTextSelectionChanged()
@@ -1348,7 +1532,16 @@ void PDFDocumentView::paintEvent(QPaintEvent *event)
 
     if ( nextCurrentPage != _currentPage && nextCurrentPage >= 0 && nextCurrentPage < _lastPage )
     {
+      // Keep track of how fast (and in which direction) the user moves
+      // through the document for prefetching
+      if (_currentPage >= 0) {
+        _scrollDirection = (nextCurrentPage > _currentPage ? 1 : -1);
+        const qreal elapsed = (_pageChangeTimer.isValid() ? qMax(qint64(1), _pageChangeTimer.elapsed()) / 1000. : 1.);
+        _pageChangeRate = (_pageChangeRate + qAbs(nextCurrentPage - _currentPage) / elapsed) / 2;
+      }
+      _pageChangeTimer.start();
       _currentPage = nextCurrentPage;
+      _prefetchTimer.start();
       emit changedPage(_currentPage);
     }
   }
@@ -1441,7 +1634,7 @@ void PDFDocumentView::mousePressEvent(QMouseEvent * event)
   Super::mousePressEvent(event);
 
   // Don't do anything if the event was handled elsewhere (e.g., by a
-  // PDFLinkGraphicsItem)
+  // PDFPageOverlayGraphicsItem)
   if (event->isAccepted())
     return;
 
@@ -1495,9 +1688,9 @@ void PDFDocumentView::wheelEvent(QWheelEvent * event)
     // same for all mice. delta() returns the rotation in 1/8 degrees. Here, we
     // use a zoom factor of 1.5 every 15 degrees (= delta() == 120, which seems
     // to be a widespread default resolution).
-    // TODO: for high-resolution mice, this may trigger many small zooms,
-    // resulting in the rendering of many intermediate resolutions. This can
-    // cause a lagging display and can potentially fill the pdf cache.
+    // NB: For high-resolution mice, this triggers many small zooms; these are
+    // treated as one gesture, so intermediate zoom levels are not rendered
+    // (see isZooming()).
     zoomBy(pow(1.5, deltaY / 120.), QGraphicsView::AnchorUnderMouse);
     event->accept();
     return;
@@ -1553,6 +1746,173 @@ void PDFDocumentView::resizeEvent(QResizeEvent * event)
 {
   _ruler.resize(size());
   Super::resizeEvent(event);
+  visibleAreaChanged();
+}
+
+void PDFDocumentView::scrollContentsBy(int dx, int dy)
+{
+  Super::scrollContentsBy(dx, dy);
+  visibleAreaChanged();
+}
+
+void PDFDocumentView::visibleAreaChanged()
+{
+  if (!_pdf_scene)
+    return;
+  // Make sure the pages within one screen of the viewport have items (which
+  // is also where render requests are kept; see reprioritizeRenderRequests())
+  const QRect viewRect(viewport()->rect());
+  const QRect nearRect(viewRect.adjusted(-viewRect.width(), -viewRect.height(), viewRect.width(), viewRect.height()));
+  _pdf_scene->materializePages(mapToScene(nearRect).boundingRect());
+  reprioritizeRenderRequests();
+
+  // Scrolling within a page also indicates where the user is heading
+  const QPointF viewCenter = mapToScene(viewRect.center());
+  const QPointF delta = viewCenter - _lastViewCenter;
+  const qreal distance = (qAbs(delta.y()) >= qAbs(delta.x()) ? delta.y() : delta.x());
+  if (distance != 0 && !_lastViewCenter.isNull())
+    _scrollDirection = (distance > 0 ? 1 : -1);
+  _lastViewCenter = viewCenter;
+  _prefetchTimer.start();
+}
+
+void PDFDocumentView::prefetch()
+{
+  // Tiles for the zoom level of an ongoing zoom gesture would be outdated by
+  // the time they are needed (see zoomSettled())
+  if (!_pdf_scene || _isZooming)
+    return;
+  QSharedPointer<Backend::Document> doc(_pdf_scene->document().toStrongRef());
+  if (!doc || !doc->isValid() || doc->isLocked())
+    return;
+  Backend::PDFPageProcessingThread & processingThread = doc->processingThread();
+
+  // Visible tiles come first; try again once they have all been picked up
+  if (processingThread.numPendingRequests(Backend::PageProcessingRequest::PrefetchPriority) > 0) {
+    _prefetchTimer.start();
+    return;
+  }
+  dropPrefetchRequests(processingThread);
+  if (_prefetchPageCount <= 0)
+    return;
+
+  const PDFPageLayout & layout = _pdf_scene->pageLayout();
+  int first = _currentPage, last = _currentPage;
+  if (_pageMode != PageMode_SinglePage && _pageMode != PageMode_Presentation) {
+    const QList<int> visiblePages = layout.pagesIn(mapToScene(viewport()->rect()).boundingRect());
+    if (!visiblePages.isEmpty()) {
+      first = visiblePages.first();
+      last = visiblePages.last();
+    }
+  }
+  if (first < 0)
+    return;
+
+  // The rate decays if the current page has not changed for a while
+  qreal rate = _pageChangeRate;
+  if (_pageChangeTimer.isValid())
+    rate = qMin(rate, 1000. / qMax(qint64(1), _pageChangeTimer.elapsed()));
+  // Look ahead further when moving fast (up to the pages we would reach within
+  // the next second), and keep only the page right behind when moving at all
+  const int ahead = qBound(_prefetchPageCount, qCeil(rate), 4 * _prefetchPageCount);
+  const int behind = (_scrollDirection == 0 ? _prefetchPageCount : 1);
+
+  // Prefetched tiles must not crowd out those on screen, so only a fraction
+  // of the cache is used for them
+  const qint64 budget = doc->pageCache().maxSize() / 4;
+  qint64 cost = 0;
+  const qreal scaleFactor = transform().m11();
+  const qreal dpr = viewport()->devicePixelRatio();
+  const bool wholePage = (_pageMode == PageMode_Presentation);
+  for (int k = 1; k <= qMax(ahead, behind); ++k) {
+    QList<int> pageIdxs;
+    if (k <= ahead)
+      pageIdxs << (_scrollDirection < 0 ? first - k : last + k);
+    if (k <= behind)
+      pageIdxs << (_scrollDirection < 0 ? last + k : first - k);
+    foreach(const int idx, pageIdxs) {
+      if (idx < 0 || idx >= layout.pageCount())
+        continue;
+      QSharedPointer<Backend::Page> page(doc->page(idx).toStrongRef());
+      if (!page)
+        continue;
+      const QSizeF pageSize = layout.pageRect(idx).size() * scaleFactor * (wholePage ? 1 : dpr);
+      const QRect pageRect = QRectF(QPointF(0, 0), pageSize).toAlignedRect();
+      foreach(const Backend::PDFPageTile & tile, _pdf_scene->pageTiles(idx, scaleFactor, dpr, wholePage)) {
+        const QRect tileRect = (tile.render_box.isNull() ? pageRect : tile.render_box & pageRect);
+        cost += 4 * static_cast<qint64>(tileRect.width()) * tileRect.height();
+        if (cost > budget)
+          return;
+        page->prefetchTileImage(tile.xres, tile.yres, tile.render_box, Backend::PageProcessingRequest::PrefetchPriority + k, this);
+      }
+    }
+  }
+}
+
+void PDFDocumentView::dropPrefetchRequests(Backend::PDFPageProcessingThread & processingThread) const
+{
+  // Those that are still relevant are requested again by prefetch(). Requests
+  // that were taken over by page items have a listener by now and are left
+  // alone, and so are those that other views (sharing the document) still
+  // want.
+  processingThread.reprioritize([this](Backend::PageProcessingRequest & request) {
+    if (request.listener != nullptr || request.type() != Backend::PageProcessingRequest::PageRendering)
+      return true;
+    Backend::PageProcessingRenderPageRequest & renderRequest = static_cast<Backend::PageProcessingRenderPageRequest&>(request);
+    if (!renderRequest.prefetchedFor.remove(this))
+      return true;
+    return !renderRequest.prefetchedFor.isEmpty();
+  });
+}
+
+void PDFDocumentView::reprioritizeRenderRequests()
+{
+  if (!_pdf_scene)
+    return;
+  QSharedPointer<Backend::Document> doc(_pdf_scene->document().toStrongRef());
+  if (!doc)
+    return;
+
+  // Collect the page items of our scene to identify the requests that belong
+  // to us. Note that the listeners of queued requests may have been destroyed
+  // in the meantime, so we must not dereference them unless we know they are
+  // still alive. Only pages that have an item can have requests, so there is
+  // no need to go through all pages.
+  QSet<QObject*> pageItems;
+  foreach(PDFPageGraphicsItem * item, _pdf_scene->materializedPages())
+    pageItems.insert(item);
+  if (pageItems.isEmpty())
+    return;
+
+  const QRectF viewRect(viewport()->rect());
+  const QPointF viewCenter(viewRect.center());
+  // Tiles within one screen of the viewport are kept as they are likely to be
+  // needed again soon; everything else is cancelled
+  const QRectF keepRect(viewRect.adjusted(-viewRect.width(), -viewRect.height(), viewRect.width(), viewRect.height()));
+  // So are requests for a different zoom level (e.g., after zooming in), as
+  // they will never be displayed (see isCurrentResolution())
+  const qreal scaleFactor = transform().m11();
+  const qreal dpr = viewport()->devicePixelRatio();
+  const QTransform viewT(viewportTransform());
+
+  doc->processingThread().reprioritize([&](Backend::PageProcessingRequest & request) {
+    if (request.type() != Backend::PageProcessingRequest::PageRendering || !pageItems.contains(request.listener))
+      return true;
+    Backend::PageProcessingRenderPageRequest & renderRequest = static_cast<Backend::PageProcessingRenderPageRequest&>(request);
+    if (renderRequest.render_box.isEmpty())
+      return true;
+    const PDFPageGraphicsItem * pageItem = static_cast<PDFPageGraphicsItem*>(request.listener);
+
+    const QRectF tileRect = viewT.mapRect(pageItem->sceneTransform().mapRect(pageItem->mapRectFromTile(renderRequest.render_box, renderRequest.xres, renderRequest.yres)));
+    if (!tileRect.intersects(keepRect))
+      return false;
+
+    if (!isCurrentResolution(renderRequest.render_box.width(), tileRect.width() * dpr, scaleFactor, _isZooming))
+      return false;
+
+    request.priority = QLineF(viewCenter, tileRect.center()).length();
+    return true;
+  });
 }
 
 void PDFDocumentView::armTool(const DocumentTool::AbstractTool::Type toolType)
@@ -1815,7 +2175,7 @@ QPixmap& PDFDocumentMagnifierView::dropShadow()
 //
 // A large canvas that manages the layout of QGraphicsItem subclasses. The
 // primary items we are concerned with are PDFPageGraphicsItem and
-// PDFLinkGraphicsItem.
+// PDFPageOverlayGraphicsItem.
 PDFDocumentScene::PDFDocumentScene(QSharedPointer<Backend::Document> a_doc, QObject *parent /* = nullptr */, const double dpiX /* = -1 */, const double dpiY /* = -1 */):
   Super(parent),
   _doc(a_doc),
@@ -1823,9 +2183,6 @@ PDFDocumentScene::PDFDocumentScene(QSharedPointer<Backend::Document> a_doc, QObj
   _shownPageIdx(-2)
 {
   Q_ASSERT(a_doc != nullptr);
-  // We need to register a QList<PDFLinkGraphicsItem *> meta-type so we can
-  // pass it through inter-thread (i.e., queued) connections
-  qRegisterMetaType< QList<PDFLinkGraphicsItem *> >();
 
 #if QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
   _dpiX = (dpiX > 0 ? dpiX : QApplication::desktop()->physicalDpiX());
@@ -1878,16 +2235,15 @@ PDFDocumentScene::PDFDocumentScene(QSharedPointer<Backend::Document> a_doc, QObj
     retranslateUi();
   }
 
-  // We must not respond to a QFileSystemWatcher::timeout() signal directly as
-  // file operations need not be atomic. I.e., QFileSystemWatcher could fire
-  // several times between the begging of a change to the file and its
-  // completion. Hence, we use a timer to delay the call to reloadDocument(). If
-  // the QFileSystemWatcher fires several times, the timer gets restarted every
-  // time.
+  // We must not respond to a QFileSystemWatcher::fileChanged() signal directly
+  // as file operations need not be atomic. I.e., QFileSystemWatcher could fire
+  // several times between the beginning of a change to the file and its
+  // completion. Hence, checkChangedFile() polls the file until it is complete
+  // before calling reloadDocument().
   _reloadTimer.setSingleShot(true);
-  _reloadTimer.setInterval(500);
-  connect(&_reloadTimer, &QTimer::timeout, this, &PDFDocumentScene::reloadDocument);
-  connect(&_fileWatcher, &QFileSystemWatcher::fileChanged, &_reloadTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+  connect(&_reloadTimer, &QTimer::timeout, this, &PDFDocumentScene::checkChangedFile);
+  connect(&_fileWatcher, &QFileSystemWatcher::fileChanged, this, &PDFDocumentScene::fileChanged);
+  connect(&_reloadWatcher, &QFutureWatcher<bool>::finished, this, &PDFDocumentScene::finishReload);
   setWatchForDocumentChangesOnDisk(true);
 
   reinitializeScene();
@@ -1895,6 +2251,13 @@ PDFDocumentScene::PDFDocumentScene(QSharedPointer<Backend::Document> a_doc, QObj
 
 PDFDocumentScene::~PDFDocumentScene()
 {
+  stopPageSizeLoader();
+  stopSearchIndexer();
+
+  // Recycled page items are not part of the scene and hence not destroyed
+  // automatically
+  qDeleteAll(_recycledPages);
+
   // Destroy the _unlockProxy if it is not currently attached to the scene (in
   // which case it is destroyed automatically)
   if (!_unlockProxy->scene()) {
@@ -1933,15 +2296,16 @@ void PDFDocumentScene::handleActionEvent(const PDFActionEvent * action_event)
 QWeakPointer<Backend::Document> PDFDocumentScene::document() { return _doc.toWeakRef(); }
 QList<QGraphicsItem*> PDFDocumentScene::pages() { return _pages; }
 
-// Overloaded method that returns all page objects inside a given rectangular
-// area. First, `items` is used to grab all items inside the rectangle. This
-// list is then filtered by item type so that it contains only references to
-// `PDFPageGraphicsItem` objects.
+// Overloaded method that returns all (visible) page objects inside a given
+// area. As not all pages have an item, the pages are looked up in the
+// `_pageLayout` (not with `items`) and their items are created as needed. Like
+// `items`, the list is in descending stacking order, i.e., later pages first.
 QList<QGraphicsItem*> PDFDocumentScene::pages(const QPolygonF &polygon)
 {
-  QList<QGraphicsItem*> pageList = items(polygon);
-  QtConcurrent::blockingFilter(pageList, isPageItem);
-
+  QList<QGraphicsItem*> pageList;
+  QList<int> pageIdxs = shownPagesIn(polygon.boundingRect());
+  for (int i = pageIdxs.size() - 1; i >= 0; --i)
+    pageList << materializePage(pageIdxs[i]);
   return pageList;
 }
 
@@ -1949,22 +2313,129 @@ QList<QGraphicsItem*> PDFDocumentScene::pages(const QPolygonF &polygon)
 // between functions if only one page is needed
 QGraphicsItem* PDFDocumentScene::pageAt(const int idx) const
 {
-  if (idx < 0 || idx >= _pages.size())
-    return nullptr;
-  return _pages[idx];
+  // Page items merely cache what is in `_pageLayout` and `_doc`, so creating
+  // them on demand does not change the (logical) state of the scene
+  return const_cast<PDFDocumentScene *>(this)->materializePage(idx);
 }
 
-// Overloaded method that returns all page objects at a given point. First,
-// `items` is used to grab all items at the point. This list is then filtered by
-// item type so that it contains only references to `PDFPageGraphicsItem` objects.
+// Overloaded method that returns the (topmost visible) page object at a given
+// point. See `pages(const QPolygonF &)`.
 QGraphicsItem* PDFDocumentScene::pageAt(const QPointF &pt) const
 {
-  QList<QGraphicsItem*> pageList = items(pt);
-  QtConcurrent::blockingFilter(pageList, isPageItem);
+  QList<int> pageIdxs = shownPagesAt(pt);
+  return (pageIdxs.isEmpty() ? nullptr : pageAt(pageIdxs.last()));
+}
 
-  if (pageList.isEmpty())
+PDFPageGraphicsItem * PDFDocumentScene::materializePage(const int idx)
+{
+  if (idx < 0 || idx >= _pages.size())
     return nullptr;
-  return pageList[0];
+  if (_pages[idx])
+    return static_cast<PDFPageGraphicsItem *>(_pages[idx]);
+
+  PDFPageGraphicsItem * pageItem{nullptr};
+  if (!_recycledPages.isEmpty()) {
+    pageItem = _recycledPages.takeLast();
+    pageItem->setPage(_doc->page(idx));
+  }
+  else
+    pageItem = new PDFPageGraphicsItem(_doc->page(idx), _dpiX, _dpiY);
+  pageItem->setVisible(isPageShown(idx));
+  _pages[idx] = pageItem;
+  _materializedPages.insert(idx, pageItem);
+  addItem(pageItem);
+  _pageLayout.setPageItem(idx, pageItem);
+  // The page may have been laid out with an estimated size (see
+  // pageSizesLoaded()). As this can be called while painting, the relayout is
+  // deferred.
+  if (_pageLayout.setPageSize(idx, pageItem->pageSizeF()))
+    QMetaObject::invokeMethod(&_pageLayout, "relayout", Qt::QueuedConnection);
+  emit pageMaterialized(idx, pageItem);
+  return pageItem;
+}
+
+QList<int> PDFDocumentScene::shownPagesIn(const QRectF & rect) const
+{
+  if (_shownPageIdx == -2)
+    return _pageLayout.pagesIn(rect);
+  // In single page mode, all pages are laid out on top of each other, so
+  // only the one that is shown needs to be checked
+  QList<int> retVal;
+  if (_pageLayout.pageRect(_shownPageIdx).intersects(rect))
+    retVal << _shownPageIdx;
+  return retVal;
+}
+
+QList<int> PDFDocumentScene::shownPagesAt(const QPointF & pt) const
+{
+  if (_shownPageIdx == -2)
+    return _pageLayout.pagesAt(pt);
+  QList<int> retVal;
+  if (_pageLayout.pageRect(_shownPageIdx).contains(pt))
+    retVal << _shownPageIdx;
+  return retVal;
+}
+
+void PDFDocumentScene::materializePages(const QRectF & rect)
+{
+  // Recycle the items of pages that are far out of view first, so they can be
+  // reused for the pages coming into view right away; the margin avoids
+  // recreating items constantly when scrolling back and forth. Only the
+  // existing items need to be checked, so this does not depend on the number
+  // of pages.
+  const QRectF keepRect = rect.adjusted(-rect.width(), -rect.height(), rect.width(), rect.height());
+  QSet<QObject *> recycled;
+  foreach(const int i, _materializedPages.keys()) {
+    PDFPageGraphicsItem * pageItem = _materializedPages.value(i);
+    if (isPageShown(i) && _pageLayout.pageRect(i).intersects(keepRect))
+      continue;
+    // Other items may hold pointers to children other than links, annotations
+    // and search result highlights (e.g., the text selection)
+    bool isReferenced = false;
+    foreach(const QGraphicsItem * child, pageItem->childItems()) {
+      if (child->type() != PDFPageOverlayGraphicsItem::Type && child->type() != PDFSearchResultGraphicsItem::Type) {
+        isReferenced = true;
+        break;
+      }
+    }
+    if (isReferenced)
+      continue;
+
+    // The views forget their search result highlights, which are recreated
+    // if the page is materialized again
+    emit pageRecycled(i);
+    foreach(QGraphicsItem * child, pageItem->childItems()) {
+      if (child->type() == PDFSearchResultGraphicsItem::Type)
+        delete child;
+    }
+    removeItem(pageItem);
+    _pageLayout.setPageItem(i, nullptr);
+    _pages[i] = nullptr;
+    _materializedPages.remove(i);
+    _recycledPages << pageItem;
+    recycled.insert(pageItem);
+  }
+
+  // Pending requests of recycled items would only arrive after the items show
+  // another page
+  if (!recycled.isEmpty()) {
+    _doc->processingThread().reprioritize([&recycled](Backend::PageProcessingRequest & request) {
+      return !recycled.contains(request.listener);
+    });
+  }
+
+  foreach(const int idx, shownPagesIn(rect))
+    materializePage(idx);
+}
+
+void PDFDocumentScene::drawBackground(QPainter * painter, const QRectF & rect)
+{
+  // Views normally announce their visible area via materializePages(), but
+  // make sure nothing is missing if some other view (e.g., the magnifier)
+  // paints an area first
+  foreach(const int idx, shownPagesIn(rect))
+    materializePage(idx);
+  Super::drawBackground(painter, rect);
 }
 
 // This is a convenience function for returning the page number of the first
@@ -1972,26 +2443,30 @@ QGraphicsItem* PDFDocumentScene::pageAt(const QPointF &pt) const
 // area, -1 is returned.
 int PDFDocumentScene::pageNumAt(const QPolygonF &polygon)
 {
-  QList<QGraphicsItem*> p(pages(polygon));
-  if (p.isEmpty())
-    return -1;
-  return _pages.indexOf(p.first());
+  // Same as looking up the first item of pages(polygon), but without creating
+  // any page items
+  QList<int> pageIdxs = shownPagesIn(polygon.boundingRect());
+  return (pageIdxs.isEmpty() ? -1 : pageIdxs.last());
 }
 
 // This is a convenience function for returning the page number of the first
 // page item at a given point. If no page is in the specified area, -1 is returned.
 int PDFDocumentScene::pageNumAt(const QPointF &pt)
 {
-  return _pages.indexOf(pageAt(pt));
+  QList<int> pageIdxs = shownPagesAt(pt);
+  return (pageIdxs.isEmpty() ? -1 : pageIdxs.last());
 }
 
 int PDFDocumentScene::pageNumFor(const PDFPageGraphicsItem * const graphicsItem) const
 {
-  // Note: since we store QGraphicsItem* in _pages, we need to remove the const
-  // or else indexOf() complains during compilation. Since we don't do anything
-  // with the pointer, this should be safe to do while still remaining the
-  // const'ness of `graphicsItem`, however.
-  return _pages.indexOf(const_cast<PDFPageGraphicsItem *>(graphicsItem));
+  // Note: only pages that have an item need to be considered
+  if (!graphicsItem)
+    return -1;
+  for (QMap<int, PDFPageGraphicsItem *>::const_iterator it = _materializedPages.constBegin(); it != _materializedPages.constEnd(); ++it) {
+    if (it.value() == graphicsItem)
+      return it.key();
+  }
+  return -1;
 }
 
 int PDFDocumentScene::lastPage() { return _lastPage; }
@@ -2055,9 +2530,9 @@ void PDFDocumentScene::retranslateUi()
     if (!i)
       continue;
     switch (i->type()) {
-    case PDFLinkGraphicsItem::Type:
+    case PDFPageOverlayGraphicsItem::Type:
     {
-      PDFLinkGraphicsItem * gi = dynamic_cast<PDFLinkGraphicsItem*>(i);
+      PDFPageOverlayGraphicsItem * gi = dynamic_cast<PDFPageOverlayGraphicsItem*>(i);
       gi->retranslateUi();
     }
       break;
@@ -2075,42 +2550,171 @@ void PDFDocumentScene::pageLayoutChanged(const QRectF& sceneRect)
   emit pageLayoutChanged();
 }
 
-void PDFDocumentScene::reinitializeScene()
+void PDFDocumentScene::reinitializeScene(const bool keepUnchangedPages /* = false */)
 {
+  stopPageSizeLoader();
+  stopSearchIndexer();
+
   // Remove the _unlockProxy from the scene (if applicable) to avoid it being
   // destroyed automatically by the subsequent call to clear()
   if (_unlockProxy->scene() == this)
     removeItem(_unlockProxy);
+
+  // After a reload, the Backend::Page objects of unchanged pages are kept (see
+  // Backend::Document::reload()). Their page items can be reused as well,
+  // including the link and annotation items they already loaded.
+  QMap<int, PDFPageGraphicsItem *> keptItems;
+  if (keepUnchangedPages) {
+    for (QMap<int, PDFPageGraphicsItem *>::const_iterator it = _materializedPages.constBegin(); it != _materializedPages.constEnd(); ++it) {
+      const int i = it.key();
+      PDFPageGraphicsItem * pageItem = it.value();
+      QSharedPointer<Backend::Page> page = pageItem->page().toStrongRef();
+      if (!page || page->document() != _doc.data() || page->pageNum() != i)
+        continue;
+      // Drop all other children (e.g., search result highlights), just as
+      // clear() does for items that are not kept
+      foreach(QGraphicsItem * child, pageItem->childItems()) {
+        if (child != pageItem->overlay())
+          delete child;
+      }
+      removeItem(pageItem);
+      keptItems.insert(i, pageItem);
+    }
+  }
+
   clear();
   _pages.clear();
+  _materializedPages.clear();
   _pageLayout.clearPages();
+  // Recycled items may have been created for a different resolution
+  qDeleteAll(_recycledPages);
+  _recycledPages.clear();
 
   _lastPage = _doc->numPages();
-  if (!_doc->isValid())
+  if (!_doc->isValid()) {
+    qDeleteAll(keptItems);
     return;
+  }
   if (_doc->isLocked()) {
     // FIXME: Deactivate "normal" user interaction, e.g., zooming, panning, etc.
     addItem(_unlockProxy);
     setSceneRect(QRectF());
+    qDeleteAll(keptItems);
   }
   else {
-    // Create a `PDFPageGraphicsItem` for each page in the PDF document and let
-    // them be layed out by a `PDFPageLayout` instance.
+    // Let all pages of the PDF document be layed out by a `PDFPageLayout`
+    // instance. This only needs their sizes; `PDFPageGraphicsItem`s (and
+    // `Backend::Page`s) are only created for pages that come into view (see
+    // materializePages()), which keeps this fast even for huge documents.
     if (_shownPageIdx >= _lastPage)
       _shownPageIdx = _lastPage - 1;
 
+    // Sizes that are not known yet are estimated (so the first pages can be
+    // shown right away) and corrected in the background.
+    bool needPageSizes = false;
+    _pages.reserve(_lastPage);
     for (int i = 0; i < _lastPage; ++i)
     {
-      PDFPageGraphicsItem * pagePtr = new PDFPageGraphicsItem(_doc->page(i), _dpiX, _dpiY);
-      pagePtr->setVisible(i == _shownPageIdx || _shownPageIdx == -2);
-      _pages.append(pagePtr);
-      addItem(pagePtr);
-      _pageLayout.addPage(pagePtr);
+      bool isEstimate = false;
+      _pageLayout.addPage(pageItemSize(i, &isEstimate));
+      _pages.append(nullptr);
+      needPageSizes = needPageSizes || isEstimate;
+    }
+    for (QMap<int, PDFPageGraphicsItem *>::const_iterator it = keptItems.constBegin(); it != keptItems.constEnd(); ++it) {
+      // Only pages that still exist are kept
+      Q_ASSERT(it.key() < _lastPage);
+      it.value()->setVisible(isPageShown(it.key()));
+      _pages[it.key()] = it.value();
+      _materializedPages.insert(it.key(), it.value());
+      addItem(it.value());
+      _pageLayout.setPageItem(it.key(), it.value());
+      _pageLayout.setPageSize(it.key(), it.value()->pageSizeF());
     }
     _pageLayout.relayout();
+    if (needPageSizes)
+      startPageSizeLoader();
+    startSearchIndexer();
   }
 }
 
+QSizeF PDFDocumentScene::pageItemSize(const int idx, bool * isEstimate /* = nullptr */) const
+{
+  const QSizeF pageSize = _doc->pageSizeF(idx, isEstimate);
+  return QSizeF(pageSize.width() * _dpiX / 72.0, pageSize.height() * _dpiY / 72.0);
+}
+
+void PDFDocumentScene::startPageSizeLoader()
+{
+  stopPageSizeLoader();
+
+  const QSharedPointer<Backend::Document> doc(_doc);
+  const int numPages = _lastPage;
+  _pageSizeLoader = QtConcurrent::run([this, doc, numPages]() {
+    // Small chunks keep the layout updates frequent and aborting fast
+    const int chunkSize = 50;
+    for (int first = 0; first < numPages && !_abortPageSizeLoader; first += chunkSize) {
+      const int last = qMin(first + chunkSize, numPages);
+      doc->loadPageSizes(first, last - first);
+      QMetaObject::invokeMethod(this, "pageSizesLoaded", Qt::QueuedConnection, Q_ARG(int, first), Q_ARG(int, last));
+    }
+  });
+}
+
+void PDFDocumentScene::stopPageSizeLoader()
+{
+  _abortPageSizeLoader = true;
+  _pageSizeLoader.waitForFinished();
+  _abortPageSizeLoader = false;
+}
+
+void PDFDocumentScene::setSearchIndexingEnabled(const bool enabled /* = true */)
+{
+  if (enabled == _searchIndexingEnabled)
+    return;
+  _searchIndexingEnabled = enabled;
+  if (enabled)
+    startSearchIndexer();
+  else {
+    stopSearchIndexer();
+    _searchIndex.clear();
+  }
+}
+
+void PDFDocumentScene::startSearchIndexer()
+{
+  stopSearchIndexer();
+  if (!_searchIndexingEnabled || _searchIndex.isUpToDate())
+    return;
+
+  const QSharedPointer<Backend::Document> doc(_doc);
+  _searchIndexer = QtConcurrent::run([this, doc]() {
+    // Only pages that changed since the last update are (re)indexed
+    _searchIndex.update(*doc, &_abortSearchIndexer);
+    if (_searchIndex.isUpToDate())
+      QMetaObject::invokeMethod(this, "searchIndexUpdated", Qt::QueuedConnection);
+  });
+}
+
+void PDFDocumentScene::stopSearchIndexer()
+{
+  _abortSearchIndexer = true;
+  _searchIndexer.waitForFinished();
+  _abortSearchIndexer = false;
+}
+
+void PDFDocumentScene::pageSizesLoaded(const int first, const int last)
+{
+  bool changed = false;
+  for (int i = qMax(0, first); i < last && i < _pages.size(); ++i) {
+    // Page items know their exact size already (see materializePage())
+    if (_pages[i])
+      continue;
+    changed = _pageLayout.setPageSize(i, pageItemSize(i)) || changed;
+  }
+  if (changed)
+    _pageLayout.relayout();
+}
+
 void PDFDocumentScene::finishUnlock()
 {
   reinitializeScene();
@@ -2123,55 +2727,113 @@ void PDFDocumentScene::reloadDocument()
   if(!QFile::exists(_doc->fileName()))
     return;
 
+  if (_reloadWatcher.isRunning()) {
+    // Whatever is being prepared is outdated already; start over once that is
+    // done (see finishReload())
+    _reloadAgain = true;
+    return;
+  }
+
+  // NB: The lambda must not access `this`, which may be destroyed before the
+  // preparation finishes
+  const QSharedPointer<Backend::Document> doc(_doc);
+  const QList<Backend::PDFPageTile> tiles = visibleTiles();
+  _reloadWatcher.setFuture(QtConcurrent::run([doc, tiles]() { return doc->prepareReload(tiles); }));
+}
+
+void PDFDocumentScene::finishReload()
+{
+  if (_reloadAgain) {
+    _reloadAgain = false;
+    reloadDocument();
+    return;
+  }
+  if(!QFile::exists(_doc->fileName()))
+    return;
+
+  // The page size loader and the search indexer must not query the document
+  // while it is being replaced. NB: If preparing the reload failed (or is not
+  // supported by the backend), reload() loads the file itself.
+  stopPageSizeLoader();
+  stopSearchIndexer();
+  _searchIndex.invalidate();
   _doc->reload();
-  reinitializeScene();
+  reinitializeScene(true);
   emit documentChanged(_doc.toWeakRef());
 }
 
+QList<Backend::PDFPageTile> PDFDocumentScene::visibleTiles() const
+{
+  QList<Backend::PDFPageTile> retVal;
+  if (!_doc->isValid() || _doc->isLocked())
+    return retVal;
+
+  foreach(const QGraphicsView * view, views()) {
+    const qreal scaleFactor = view->transform().m11();
+    const qreal dpr = view->viewport()->devicePixelRatio();
+    const QRectF visibleRect = view->mapToScene(view->viewport()->rect()).boundingRect();
+    const PDFDocumentView * pdfView = qobject_cast<const PDFDocumentView *>(view);
+    const bool isPresentation = (pdfView && pdfView->pageMode() == PDFDocumentView::PageMode_Presentation);
+
+    foreach(const int idx, shownPagesIn(visibleRect)) {
+      const QRectF pageRect = _pageLayout.pageRect(idx);
+      retVal << pageTiles(idx, scaleFactor, dpr, isPresentation, (visibleRect & pageRect).translated(-pageRect.topLeft()));
+    }
+  }
+  return retVal;
+}
+
+QList<Backend::PDFPageTile> PDFDocumentScene::pageTiles(const int idx, const qreal scaleFactor, const qreal dpr, const bool wholePage, QRectF area /* = QRectF() */) const
+{
+  QList<Backend::PDFPageTile> retVal;
+  if (idx < 0 || idx >= _pageLayout.pageCount())
+    return retVal;
+
+  // In presentation mode, whole pages are rendered at screen resolution
+  if (wholePage) {
+    retVal << Backend::PDFPageTile(_dpiX * scaleFactor, _dpiY * scaleFactor, QRect(), idx, _doc->cacheId());
+    return retVal;
+  }
+  // The page and the area in rendered pixels (see PDFPageGraphicsItem::paint())
+  const QSize pageSize = QRectF(QPointF(0, 0), _pageLayout.pageRect(idx).size() * (scaleFactor * dpr)).toAlignedRect().size();
+  QRect renderRect;
+  if (!area.isNull())
+    renderRect = QTransform::fromScale(scaleFactor * dpr, scaleFactor * dpr).mapRect(area).toAlignedRect();
+  foreach(const QRect & renderBox, Backend::tileRenderBoxes(pageSize, renderRect))
+    retVal << Backend::PDFPageTile(_dpiX * scaleFactor * dpr, _dpiY * scaleFactor * dpr, renderBox, idx, _doc->cacheId());
+  return retVal;
+}
+
 
 // Other
 // -----
 void PDFDocumentScene::showOnePage(const int pageIdx)
 {
-  for (int i = 0; i < _pages.size(); ++i) {
-    if (!isPageItem(_pages[i]))
-      continue;
-    if (i == pageIdx) {
-      _pages[i]->setVisible(true);
-      _shownPageIdx = pageIdx;
-    }
-    else
-      _pages[i]->setVisible(false);
+  if (pageIdx >= 0 && pageIdx < _pages.size()) {
+    _shownPageIdx = pageIdx;
+    materializePage(pageIdx);
   }
+  for (QMap<int, PDFPageGraphicsItem *>::const_iterator it = _materializedPages.constBegin(); it != _materializedPages.constEnd(); ++it)
+    it.value()->setVisible(it.key() == pageIdx);
 }
 
 void PDFDocumentScene::showOnePage(const PDFPageGraphicsItem * page)
 {
-  for (int i = 0; i < _pages.size(); ++i) {
-    if (!isPageItem(_pages[i]))
-      continue;
-    _pages[i]->setVisible(_pages[i] == page);
-    if (_pages[i] == page) {
-      _pages[i]->setVisible(true);
-      _shownPageIdx = i;
-    }
-    else
-      _pages[i]->setVisible(false);
-  }
+  showOnePage(pageNumFor(page));
 }
 
 void PDFDocumentScene::showAllPages()
 {
-  for (int i = 0; i < _pages.size(); ++i) {
-    if (!isPageItem(_pages[i]))
-      continue;
-    _pages[i]->setVisible(true);
-  }
+  foreach(PDFPageGraphicsItem * pageItem, _materializedPages)
+    pageItem->setVisible(true);
   _shownPageIdx = -2;
 }
 
 void PDFDocumentScene::setWatchForDocumentChangesOnDisk(const bool doWatch /* = true */)
 {
+  _reloadTimer.stop();
+  _changedFileSize = -1;
+  _changedFileModified = QDateTime();
   if (!_fileWatcher.files().empty())
     _fileWatcher.removePaths(_fileWatcher.files());
   if (doWatch) {
@@ -2182,6 +2844,53 @@ void PDFDocumentScene::setWatchForDocumentChangesOnDisk(const bool doWatch /* =
   }
 }
 
+void PDFDocumentScene::setReloadCheckInterval(const int interval, const int maxInterval)
+{
+  _reloadCheckInterval = qMax(0, interval);
+  _maxReloadCheckInterval = qMax(_reloadCheckInterval, maxInterval);
+}
+
+void PDFDocumentScene::fileChanged()
+{
+  // If a check is pending already, it will notice the change
+  if (_reloadTimer.isActive())
+    return;
+  _changedFileSize = -1;
+  _changedFileModified = QDateTime();
+  checkChangedFile();
+}
+
+void PDFDocumentScene::checkChangedFile()
+{
+  const QFileInfo fileInfo(_doc->fileName());
+  const qint64 size = (fileInfo.exists() ? fileInfo.size() : -1);
+  const QDateTime modified = (fileInfo.exists() ? fileInfo.lastModified() : QDateTime());
+
+  // NB: Writers that rewrite the file in place may keep its size, but not its
+  // modification time
+  if (size >= 0 && size == _changedFileSize && modified == _changedFileModified) {
+    _changedFileSize = -1;
+    _changedFileModified = QDateTime();
+    if (Backend::Document::isCompleteFile(fileInfo.filePath()))
+      reloadDocument();
+    // Otherwise, the writer is either done (and the file is broken) or paused
+    // (e.g., TeX waiting for user input); in the latter case, fileChanged()
+    // will be triggered again once it continues.
+    return;
+  }
+
+  // Back off while the file is still being written (or was removed in the
+  // course of being replaced); otherwise, check again soon to see if its size
+  // is stable
+  if (size < 0 || (_changedFileSize >= 0 && size > _changedFileSize))
+    _reloadTimer.setInterval(qMin(2 * qMax(1, _reloadTimer.interval()), _maxReloadCheckInterval));
+  else
+    _reloadTimer.setInterval(_reloadCheckInterval);
+  _changedFileSize = size;
+  _changedFileModified = modified;
+  _reloadTimer.start();
+}
+
 void PDFDocumentScene::setResolution(const double dpiX, const double dpiY)
 {
   if (dpiX > 0)
@@ -2207,7 +2916,6 @@ PDFPageGraphicsItem::PDFPageGraphicsItem(QWeakPointer<Backend::Page> a_page, con
   _dpiX(dpiX),
   _dpiY(dpiY),
   _pageNum(-1),
-  _linksLoaded(false),
   _annotationsLoaded(false),
   _zoomLevel(0.0)
 {
@@ -2217,6 +2925,23 @@ PDFPageGraphicsItem::PDFPageGraphicsItem(QWeakPointer<Backend::Page> a_page, con
   // NOTE: This flag needs Qt 4.6 or newer.
   setFlags(QGraphicsItem::ItemUsesExtendedStyleOption);
 
+  setPage(a_page);
+}
+
+void PDFPageGraphicsItem::setPage(QWeakPointer<Backend::Page> a_page)
+{
+  prepareGeometryChange();
+
+  // Drop everything that belonged to the previous page (links, annotations)
+  foreach(QGraphicsItem * child, childItems())
+    delete child;
+  _overlay = nullptr;
+
+  _page = a_page;
+  _pageNum = -1;
+  _pageSize = QSizeF();
+  _annotationsLoaded = false;
+
   QSharedPointer<Backend::Page> page(_page.toStrongRef());
   if (page) {
     _pageNum = page->pageNum();
@@ -2234,6 +2959,7 @@ PDFPageGraphicsItem::PDFPageGraphicsItem(QWeakPointer<Backend::Page> a_page, con
     _pageScale = QTransform::fromScale(_pageSize.width(), _pageSize.height());
     _pointScale = QTransform::fromScale(_dpiX / 72.0, _dpiY / 72.0);
   }
+  update();
 }
 
 QRectF PDFPageGraphicsItem::boundingRect() const { return QRectF(QPointF(0.0, 0.0), _pageSize); }
@@ -2249,6 +2975,12 @@ QPointF PDFPageGraphicsItem::mapFromPage(const QPointF & point) const
     _pageSize.height() * (1.0 - point.y() / page->pageSizeF().height()));
 }
 
+QRectF PDFPageGraphicsItem::mapRectFromTile(const QRect & renderBox, const double xres, const double yres) const
+{
+  // item coordinates are in pixels at _dpiX x _dpiY
+  return QTransform::fromScale(_dpiX / xres, _dpiY / yres).mapRect(QRectF(renderBox));
+}
+
 QPointF PDFPageGraphicsItem::mapToPage(const QPointF & point) const
 {
   QSharedPointer<Backend::Page> page(_page.toStrongRef());
@@ -2275,16 +3007,11 @@ void PDFPageGraphicsItem::paint(QPainter *painter, const QStyleOptionGraphicsIte
     return;
 
   // If this is the first time this `PDFPageGraphicsItem` has come into view,
-  // `_linksLoaded` will be `false`. We then load all of the links on the page.
-  if (!_linksLoaded)
+  // `_annotationsLoaded` will be `false`. We then load all of the links and
+  // annotations on the page in the background (see `event()`).
+  if (!_annotationsLoaded)
   {
-    page->asyncLoadLinks(this);
-    _linksLoaded = true;
-  }
-
-  if (!_annotationsLoaded) {
-    // FIXME: Load annotations asynchronously?
-    addAnnotations(page->loadAnnotations());
+    page->asyncLoadAnnotations(this);
     _annotationsLoaded = true;
   }
 
@@ -2361,94 +3088,70 @@ void PDFPageGraphicsItem::paint(QPainter *painter, const QStyleOptionGraphicsIte
 
     QRect visibleRect = scaleT.mapRect(option->exposedRect).toAlignedRect();
 
-    // Each tile is rendered at TILE_SIZE pixels, which may be scaled (e.g. on
-    // high-dpi screens) and displayed at an effective size
-    int effectiveTileSize = TILE_SIZE / painter->device()->devicePixelRatio();
-
-    int imin = (visibleRect.left() - pageRect.left()) / effectiveTileSize;
-    int imax = (visibleRect.right() - pageRect.left());
-    if (imax % effectiveTileSize == 0)
-      imax /= effectiveTileSize;
-    else
-      imax = imax / effectiveTileSize + 1;
-
-    int jmin = (visibleRect.top() - pageRect.top()) / effectiveTileSize;
-    int jmax = (visibleRect.bottom() - pageRect.top());
-    if (jmax % effectiveTileSize == 0)
-      jmax /= effectiveTileSize;
-    else
-      jmax = jmax / effectiveTileSize + 1;
-
-    for (int j = jmin; j < jmax; ++j) {
-      for (int i = imin; i < imax; ++i) {
-        // renderTile is the rect used for rendering/retrieving tiles. It is
-        // agnostic of the painter (e.g., its devicePixelRatio)
-        QRect renderTile(i * TILE_SIZE, j * TILE_SIZE, TILE_SIZE, TILE_SIZE);
-        // displayTile is the rect used for displaying. It takes the painter's
-        // settings into account (e.g. its devicePixelRatio)
-        QRect displayTile(i * effectiveTileSize, j * effectiveTileSize, effectiveTileSize, effectiveTileSize);
-
-        bool useGrayScale = false;
-        // If we are rendering a PDFDocumentView that has `useGrayScale` set
-        // respect that setting.
+    // While the user is zooming, tiles are rendered at the nearest pyramid
+    // level rather than at the exact (and soon outdated) zoom level
+    const qreal dpr = painter->device()->devicePixelRatio();
+    const qreal tileScale = (view && view->isZooming() ? PDFDocumentView::pyramidLevel(scaleFactor) : scaleFactor);
+    const bool isScaled = !qFuzzyCompare(tileScale, scaleFactor);
+
+    // The page and the visible area in rendered pixels; the tiles are scaled
+    // down by the devicePixelRatio (e.g., on high-dpi screens) or, while
+    // zooming, by the ratio of the zoom level and the pyramid level
+    const qreal renderScale = tileScale * dpr;
+    const QSize pageSize = QRectF(QPointF(0, 0), boundingRect().size() * renderScale).toAlignedRect().size();
+    const QRect visibleRenderRect = QTransform::fromScale(renderScale / scaleFactor, renderScale / scaleFactor).mapRect(QRectF(visibleRect.translated(-pageRect.topLeft()))).toAlignedRect();
+    const QTransform displayT = QTransform::fromScale(scaleFactor / renderScale, scaleFactor / renderScale);
+
+    foreach(const QRect & renderTile, Backend::tileRenderBoxes(pageSize, visibleRenderRect)) {
+      // renderTile is the rect used for rendering/retrieving tiles. It is
+      // agnostic of the painter (e.g., its devicePixelRatio)
+      // displayTile is the rect used for displaying. It takes the painter's
+      // settings into account (e.g. its devicePixelRatio)
+      const QRectF displayTile = displayT.mapRect(QRectF(renderTile));
+
+      bool useGrayScale = false;
+      // If we are rendering a PDFDocumentView that has `useGrayScale` set
+      // respect that setting.
+      if (view && view->useGrayScale())
+        useGrayScale = true;
+      // If we are rendering a PDFDocumentMagnifierView who's parent
+      // PDFDocumentView has `useGrayScale` set respect that setting.
+      else if (widget && widget->parent() && widget->parent()->parent()) {
+        PDFDocumentView * view = (widget ? qobject_cast<PDFDocumentView*>(widget->parent()->parent()) : nullptr);
         if (view && view->useGrayScale())
           useGrayScale = true;
-        // If we are rendering a PDFDocumentMagnifierView who's parent
-        // PDFDocumentView has `useGrayScale` set respect that setting.
-        else if (widget && widget->parent() && widget->parent()->parent()) {
-          PDFDocumentView * view = (widget ? qobject_cast<PDFDocumentView*>(widget->parent()->parent()) : nullptr);
-          if (view && view->useGrayScale())
-            useGrayScale = true;
-        }
+      }
 
-        renderedPage = page->getTileImage(this, _dpiX * scaleFactor * painter->device()->devicePixelRatio(), _dpiY * scaleFactor * painter->device()->devicePixelRatio(), renderTile);
-        // we don't want a finished render thread to change our image while we
-        // draw it
-        page->document()->pageCache().lock();
-        // renderedPage as returned from getTileImage _should_ always be valid
-        if ( renderedPage ) {
-          if (useGrayScale) {
-            // In gray scale mode, we need to obtain a deep copy of the rendered
-            // page image to avoid altering the cached (color) image
-            QImage postProcessed = renderedPage->copy();
-            imageToGrayScale(postProcessed);
-            postProcessed.setDevicePixelRatio(painter->device()->devicePixelRatio());
-            painter->drawImage(displayTile.topLeft(), postProcessed);
-          }
-          else {
-            QImage img = *renderedPage;
-            img.setDevicePixelRatio(painter->device()->devicePixelRatio());
-            painter->drawImage(displayTile.topLeft(), img);
-          }
+      // Tiles closer to the center of the viewport are rendered first
+      qreal priority{0};
+      if (widget)
+        priority = QLineF(QRectF(widget->rect()).center(), displayTile.translated(pageT.dx(), pageT.dy()).center()).length();
+
+      // In gray scale mode, the gray scale tiles are cached alongside the
+      // (color) ones, so they are only converted when the latter change
+      renderedPage = page->getTileImage(this, _dpiX * tileScale * dpr, _dpiY * tileScale * dpr, renderTile, priority, useGrayScale);
+      // NB: Finished render threads replace cached images rather than
+      // changing them, so renderedPage can be drawn without locking the cache
+      // renderedPage as returned from getTileImage _should_ always be valid
+      if ( renderedPage ) {
+        if (isScaled) {
+          // Tiles of a pyramid level are stretched to the current zoom level
+          painter->drawImage(displayTile, *renderedPage);
         }
-        page->document()->pageCache().unlock();
+        else {
+          QImage img = *renderedPage;
+          img.setDevicePixelRatio(dpr);
+          painter->drawImage(displayTile.topLeft(), img);
+        }
+      }
 #ifdef DEBUG
-        painter->drawRect(displayTile);
+      painter->drawRect(displayTile);
 #endif
-      }
     }
   }
   painter->restore();
 }
 
-//static
-void PDFPageGraphicsItem::imageToGrayScale(QImage & img)
-{
-  // Casting to QRgb* only works for 32bit images
-  Q_ASSERT(img.depth() == 32);
-  QRgb * data = reinterpret_cast<QRgb*>(img.scanLine(0));
-#if QT_VERSION < QT_VERSION_CHECK(5, 10, 0)
-  for (int i = 0; i < img.byteCount() / 4; ++i) {
-#else
-  for (qsizetype i = 0; i < img.sizeInBytes() / 4; ++i) {
-#endif
-    // Qt formula (qGray()): 0.34375 * r + 0.5 * g + 0.15625 * b
-    // MuPDF formula (rgb_to_gray()): r * 0.3f + g * 0.59f + b * 0.11f;
-    int gray = qGray(data[i]);
-    data[i] = qRgba(gray, gray, gray, qAlpha(data[i]));
-  }
-}
-
 // Event Handlers
 // --------------
 bool PDFPageGraphicsItem::event(QEvent *event)
@@ -2459,10 +3162,31 @@ bool PDFPageGraphicsItem::event(QEvent *event)
 
     // Cast to a `PDFLinksLoaded` event so we can access the links.
     const Backend::PDFLinksLoadedEvent *links_loaded_event = dynamic_cast<const Backend::PDFLinksLoadedEvent*>(event);
+    // The links may have been requested before this item was recycled for
+    // another page (see PDFDocumentScene::materializePages()) or, if it was
+    // recycled for the same page again, requested twice
+    if (links_loaded_event->pageNum != _pageNum)
+      return true;
+    if (_overlay && _overlay->numLinks() > 0)
+      return true;
     addLinks(links_loaded_event->links);
 
     return true;
 
+  }
+  if( event->type() == Backend::PDFAnnotationsLoadedEvent::AnnotationsLoadedEvent ) {
+    event->accept();
+
+    const Backend::PDFAnnotationsLoadedEvent *annotations_loaded_event = dynamic_cast<const Backend::PDFAnnotationsLoadedEvent*>(event);
+    // See above
+    if (annotations_loaded_event->pageNum != _pageNum)
+      return true;
+    if (_overlay && (_overlay->numLinks() > 0 || _overlay->numAnnotations() > 0))
+      return true;
+    addLinksAndAnnotations(annotations_loaded_event->links, annotations_loaded_event->annotations);
+
+    return true;
+
   }
   if( event->type() == Backend::PDFPageRenderedEvent::PageRenderedEvent ) {
     event->accept();
@@ -2482,294 +3206,323 @@ bool PDFPageGraphicsItem::event(QEvent *event)
   return Super::event(event);
 }
 
-// This method causes the `PDFPageGraphicsItem` to create `PDFLinkGraphicsItem`
-// objects for a list of asynchronously generated `PDFLinkAnnotation` objects.
-// The page item also takes ownership the objects created.  Calling
-// `setParentItem` causes the link objects to be added to the scene that owns
-// the page object. `update` is then called to ensure all links are drawn at
-// once.
+// These methods add a list of asynchronously generated `Annotation::Link` and
+// `Annotation::AbstractAnnotation` objects to the `PDFPageOverlayGraphicsItem`
+// of this page (which is created on demand). The page item owns the overlay
+// item, so it is part of the scene that owns the page object. `update` is then
+// called to ensure all links are drawn at once.
 void PDFPageGraphicsItem::addLinks(QList< QSharedPointer<Annotation::Link> > links)
 {
-#ifdef DEBUG
-  QElapsedTimer stopwatch;
-  stopwatch.start();
-#endif
-  foreach( QSharedPointer<Annotation::Link> link, links ){
-    PDFLinkGraphicsItem * linkItem = new PDFLinkGraphicsItem(link);
-    // Map the link from pdf coordinates to scene coordinates
-    linkItem->setTransform(QTransform::fromTranslate(0, _pageSize.height()).scale(_dpiX / 72., -_dpiY / 72.));
-    linkItem->setParentItem(this);
-  }
-#ifdef DEBUG
-  qDebug() << "Added links in: " << stopwatch.elapsed() << " milliseconds";
-#endif
-
-  update();
+  addLinksAndAnnotations(links, QList< QSharedPointer<Annotation::AbstractAnnotation> >());
 }
 
 void PDFPageGraphicsItem::addAnnotations(QList< QSharedPointer<Annotation::AbstractAnnotation> > annotations)
+{
+  addLinksAndAnnotations(QList< QSharedPointer<Annotation::Link> >(), annotations);
+}
+
+void PDFPageGraphicsItem::addLinksAndAnnotations(const QList< QSharedPointer<Annotation::Link> > & links, const QList< QSharedPointer<Annotation::AbstractAnnotation> > & annotations)
 {
 #ifdef DEBUG
   QElapsedTimer stopwatch;
   stopwatch.start();
 #endif
-  foreach( QSharedPointer<Annotation::AbstractAnnotation> annot, annotations ){
-    // We currently only handle popups
-    if (!annot->isMarkup())
-      continue;
-    QSharedPointer<Annotation::Markup> markupAnnot = annot.staticCast<Annotation::Markup>();
-    PDFMarkupAnnotationGraphicsItem * markupAnnotItem = new PDFMarkupAnnotationGraphicsItem(markupAnnot);
-    // Map the link from pdf coordinates to scene coordinates
-    markupAnnotItem->setTransform(QTransform::fromTranslate(0, _pageSize.height()).scale(_dpiX / 72., -_dpiY / 72.));
-    markupAnnotItem->setParentItem(this);
+  if (!_overlay) {
+    _overlay = new PDFPageOverlayGraphicsItem(this);
+    // Map the links and annotations from pdf coordinates to scene coordinates
+    _overlay->setTransform(QTransform::fromTranslate(0, _pageSize.height()).scale(_dpiX / 72., -_dpiY / 72.));
   }
+  _overlay->addLinksAndAnnotations(links, annotations);
 #ifdef DEBUG
-  qDebug() << "Added annotations in: " << stopwatch.elapsed() << " milliseconds";
+  qDebug() << "Added links and annotations in: " << stopwatch.elapsed() << " milliseconds";
 #endif
 
   update();
 }
 
 
-// PDFLinkGraphicsItem
-// ===================
+// PDFPageOverlayGraphicsItem
+// ==========================
 
-// This class descends from `QGraphicsRectItem` and serves the following
-// functions:
+// This class descends from `QGraphicsItem` and serves the following
+// functions for all links and markup annotations of a page:
 //
-//    * Provides easy access to the on-screen geometry of a hyperlink area.
+//    * Provides easy access to the on-screen geometry of hyperlink and
+//      annotation areas (via a spatial index).
 //
-//    * Handles tasks such as cursor changes on mouse hover and link activation
-//      on mouse clicks.
-PDFLinkGraphicsItem::PDFLinkGraphicsItem(QSharedPointer<Annotation::Link> a_link, QGraphicsItem *parent /* = nullptr */):
-  Super(parent),
-  _link(a_link),
-  _activated(false)
+//    * Handles tasks such as cursor changes and tooltips on mouse hover, link
+//      activation on mouse clicks, and displaying note popups if necessary.
+PDFPageOverlayGraphicsItem::PDFPageOverlayGraphicsItem(QGraphicsItem *parent /* = nullptr */):
+  Super(parent)
 {
-  // The link area is expressed in "normalized page coordinates", i.e.  values
-  // in the range [0, 1]. The transformation matrix of this item will have to
-  // be adjusted so that links will show up correctly in a graphics view.
-  setRect(_link->rect());
-
   // Allows links to provide a context-specific cursor when the mouse is
   // hovering over them.
-  //
-  // **NOTE:** _Requires Qt 4.4 or newer._
   setAcceptHoverEvents(true);
 
-  // Only left-clicks will trigger the link.
+  // Only left-clicks will trigger links (or popups).
   setAcceptedMouseButtons(Qt::LeftButton);
 
-#ifdef DEBUG
-  // **TODO:**
-  // _Currently for debugging purposes only so that the link area can be
-  // determined visually, but might make a nice option._
-  setPen(QPen(Qt::red));
-#else
-  // Perhaps there is a way to not draw the outline at all? Might be more
-  // efficient...
-  setPen(QPen(Qt::transparent));
+#ifndef DEBUG
+  // In debug builds, the link and annotation areas are outlined so they can be
+  // determined visually (see paint())
+  setFlag(QGraphicsItem::ItemHasNoContents);
 #endif
-
-  retranslateUi();
+  setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
 }
 
-int PDFLinkGraphicsItem::type() const { return Type; }
-
-void PDFLinkGraphicsItem::retranslateUi()
-{
-  PDFAction * action = _link->actionOnActivation();
-  if (action) {
-    // Set some meaningful tooltip to inform the user what the link does
-    // Using <p>...</p> ensures the tooltip text is interpreted as rich text
-    // and thus is wrapping sensibly to avoid over-long lines.
-    // Using PDFDocumentView::tr avoids having to explicitly derive
-    // PDFLinkGraphicsItem explicily from QObject and puts all translatable
-    // strings into the same context.
-    switch(action->type()) {
-      case PDFAction::ActionTypeGoTo:
-        {
-          PDFGotoAction * actionGoto = dynamic_cast<PDFGotoAction*>(action);
-          if (actionGoto->isRemote())
-            setToolTip(QString::fromUtf8("<p>%1</p>").arg(actionGoto->filename()));
-            // FIXME: Possibly include page as well after the filename
-          else
-            setToolTip(QString::fromUtf8("<p>") + PDFDocumentView::tr("Goto page %1").arg(actionGoto->destination().page() + 1) + QString::fromUtf8("</p>"));
-        }
-        break;
-      case PDFAction::ActionTypeURI:
-        {
-          PDFURIAction * actionURI = dynamic_cast<PDFURIAction*>(action);
-          setToolTip(QString::fromUtf8("<p>%1</p>").arg(actionURI->url().toString()));
-        }
-        break;
-      case PDFAction::ActionTypeLaunch:
-        {
-          PDFLaunchAction * actionLaunch = dynamic_cast<PDFLaunchAction*>(action);
-          setToolTip(QString::fromUtf8("<p>") + PDFDocumentView::tr("Execute `%1`").arg(actionLaunch->command()) + QString::fromUtf8("</p>"));
-        }
-        break;
-      default:
-        // All other link types are currently not supported
-        break;
-    }
-  }
-}
+int PDFPageOverlayGraphicsItem::type() const { return Type; }
 
-// Event Handlers
-// --------------
+QRectF PDFPageOverlayGraphicsItem::boundingRect() const
+{
+  if (_tree.isEmpty())
+    return QRectF();
+  // Links and annotations can be degenerate (e.g., of zero height); the
+  // margin ensures they are not missed by the scene's index
+  return _tree.boundingRect().adjusted(-1, -1, 1, 1);
+}
 
-// Swap cursor during hover events.
-void PDFLinkGraphicsItem::hoverEnterEvent(QGraphicsSceneHoverEvent *event)
+QPainterPath PDFPageOverlayGraphicsItem::shape() const
 {
-  Q_UNUSED(event)
-  setCursor(Qt::PointingHandCursor);
+  return _shape;
 }
 
-void PDFLinkGraphicsItem::hoverLeaveEvent(QGraphicsSceneHoverEvent *event)
+bool PDFPageOverlayGraphicsItem::contains(const QPointF & point) const
 {
-  Q_UNUSED(event)
-  unsetCursor();
+  return entryAt(point) >= 0;
 }
 
-// Respond to clicks. Limited to left-clicks by `setAcceptedMouseButtons` in
-// this object's constructor.
-void PDFLinkGraphicsItem::mousePressEvent(QGraphicsSceneMouseEvent *event)
-{
-  // Actually opening the link is handled during a `mouseReleaseEvent` --- but
-  // only if the `_activated` flag is `true`.
-  // Only set _activated if no keyboard modifiers are currently pressed (which
-  // most likely indicates some tool or other is active)
-  if (event->modifiers() == Qt::NoModifier)
-    _activated = true;
-  else {
-    _activated = false;
-    Super::mousePressEvent(event);
+void PDFPageOverlayGraphicsItem::paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget)
+{
+  Q_UNUSED(widget)
+#ifdef DEBUG
+  // **TODO:**
+  // _Currently for debugging purposes only so that the link and annotation
+  // areas can be determined visually, but might make a nice option._
+  painter->save();
+  painter->setBrush(Qt::NoBrush);
+  foreach(const int i, _tree.intersecting(option->exposedRect)) {
+    painter->setPen(QPen(_entries[i].link ? Qt::red : Qt::blue, 0));
+    painter->drawRect(_entries[i].rect);
   }
+  painter->restore();
+#else
+  Q_UNUSED(painter)
+  Q_UNUSED(option)
+#endif
 }
 
-// The real nitty-gritty of link activation happens in here.
-void PDFLinkGraphicsItem::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
+void PDFPageOverlayGraphicsItem::addLinksAndAnnotations(const QList< QSharedPointer<Annotation::Link> > & links, const QList< QSharedPointer<Annotation::AbstractAnnotation> > & annotations)
 {
-  // Check that this link was "activated" (mouse press occurred within the link
-  // bounding box) and that the mouse release also occurred within the bounding
-  // box.
-  if (!_activated || !contains(event->pos()))
-  {
-    _activated = false;
-    Super::mouseReleaseEvent(event);
-    return;
+  // The links and annotations of a page are usually added all at once, so the
+  // (static) tree is simply rebuilt
+  foreach(const QSharedPointer<Annotation::Link> & link, links) {
+    if (!link)
+      continue;
+    Entry entry;
+    entry.rect = link->rect().normalized();
+    entry.link = link;
+    _entries << entry;
+  }
+  foreach(const QSharedPointer<Annotation::AbstractAnnotation> & annot, annotations) {
+    // We currently only handle popups
+    if (!annot || !annot->isMarkup())
+      continue;
+    Entry entry;
+    entry.rect = annot->rect().normalized();
+    entry.annotation = annot.staticCast<Annotation::Markup>();
+    _entries << entry;
   }
 
-  // Post an event to the parent scene. The scene then takes care of processing
-  // it further, notifying objects, such as `PDFDocumentView`, that may want to
-  // take action via a `SIGNAL`.
-  // **TODO:** Wouldn't a direct call be more efficient?
-  if (_link && _link->actionOnActivation())
-    QCoreApplication::postEvent(scene(), new PDFActionEvent(_link->actionOnActivation()));
-  _activated = false;
+  prepareGeometryChange();
+  QVector<QRectF> rects;
+  rects.reserve(_entries.size());
+  _shape = QPainterPath();
+  // Overlapping rects must not cancel each other out
+  _shape.setFillRule(Qt::WindingFill);
+  foreach(const Entry & entry, _entries) {
+    rects << entry.rect;
+    _shape.addRect(entry.rect);
+  }
+  _tree = PDFRTree(rects);
+  update();
 }
 
+int PDFPageOverlayGraphicsItem::numLinks() const
+{
+  return static_cast<int>(std::count_if(_entries.begin(), _entries.end(), [](const Entry & entry) { return !entry.link.isNull(); }));
+}
 
-// PDFMarkupAnnotationGraphicsItem
-// ===============================
+int PDFPageOverlayGraphicsItem::numAnnotations() const
+{
+  return static_cast<int>(_entries.size()) - numLinks();
+}
 
-// This class descends from `QGraphicsRectItem` and serves the following
-// functions:
-//
-//    * Provides easy access to the on-screen geometry of a markup annotation.
-//
-//    * Handles tasks such as cursor changes on mouse hover and link activation
-//      on mouse clicks.
-//
-//    * Displays note popups if necessary
-PDFMarkupAnnotationGraphicsItem::PDFMarkupAnnotationGraphicsItem(QSharedPointer<Annotation::Markup> annot, QGraphicsItem *parent /* = nullptr */):
-  Super(parent),
-  _annot(annot),
-  _activated(false),
-  _popup(nullptr)
+QSharedPointer<Annotation::AbstractAnnotation> PDFPageOverlayGraphicsItem::annotationAt(const QPointF & point) const
 {
-  // The area is expressed in "normalized page coordinates", i.e.  values
-  // in the range [0, 1]. The transformation matrix of this item will have to
-  // be adjusted so that links will show up correctly in a graphics view.
-  setRect(_annot->rect());
+  const int idx = entryAt(point);
+  if (idx < 0)
+    return QSharedPointer<Annotation::AbstractAnnotation>();
+  if (_entries[idx].link)
+    return _entries[idx].link;
+  return _entries[idx].annotation;
+}
 
-  // Allows annotations to provide a context-specific cursor when the mouse is
-  // hovering over them.
-  //
-  // **NOTE:** _Requires Qt 4.4 or newer._
-  setAcceptHoverEvents(true);
+int PDFPageOverlayGraphicsItem::entryAt(const QPointF & point, const bool clickable /* = false */) const
+{
+  // Annotations are added after links, so the topmost entry is the one with
+  // the highest index
+  const QVector<int> candidates = _tree.containing(point);
+  for (int i = static_cast<int>(candidates.size()) - 1; i >= 0; --i) {
+    if (!clickable || isClickable(candidates[i]))
+      return candidates[i];
+  }
+  return -1;
+}
 
-  // Only left-clicks will trigger the popup (if any).
-  setAcceptedMouseButtons(annot->popup() ? Qt::LeftButton : Qt::NoButton);
+bool PDFPageOverlayGraphicsItem::isClickable(const int idx) const
+{
+  const Entry & entry = _entries[idx];
+  return (entry.link || entry.annotation->popup());
+}
 
-#ifdef DEBUG
-  // **TODO:**
-  // _Currently for debugging purposes only so that the annotation area can be
-  // determined visually, but might make a nice option._
-  setPen(QPen(Qt::blue));
-#else
-  // Perhaps there is a way to not draw the outline at all? Might be more
-  // efficient...
-  setPen(QPen(Qt::transparent));
-#endif
+QString PDFPageOverlayGraphicsItem::toolTip(const int idx) const
+{
+  if (idx < 0 || idx >= _entries.size())
+    return QString();
+  const Entry & entry = _entries[idx];
+
+  if (entry.annotation) {
+    QString tooltip(entry.annotation->richContents());
+    // If the text is not already split into paragraphs, we do that here to
+    // ensure proper line folding in the tooltip and hence to avoid very wide
+    // tooltips.
+    if (tooltip.indexOf(QString::fromLatin1("<p>")) < 0)
+      tooltip = QString::fromLatin1("<p>%1</p>").arg(tooltip.replace(QChar::fromLatin1('\n'), QString::fromLatin1("</p>\n<p>")));
+    return tooltip;
+  }
 
-  QString tooltip(annot->richContents());
-  // If the text is not already split into paragraphs, we do that here to ensure
-  // proper line folding in the tooltip and hence to avoid very wide tooltips.
-  if (tooltip.indexOf(QString::fromLatin1("<p>")) < 0)
-    tooltip = QString::fromLatin1("<p>%1</p>").arg(tooltip.replace(QChar::fromLatin1('\n'), QString::fromLatin1("</p>\n<p>")));
-  setToolTip(tooltip);
+  PDFAction * action = entry.link->actionOnActivation();
+  if (!action)
+    return QString();
+  // Set some meaningful tooltip to inform the user what the link does
+  // Using <p>...</p> ensures the tooltip text is interpreted as rich text
+  // and thus is wrapping sensibly to avoid over-long lines.
+  // Using PDFDocumentView::tr avoids having to explicitly derive
+  // PDFPageOverlayGraphicsItem explicily from QObject and puts all translatable
+  // strings into the same context.
+  switch(action->type()) {
+    case PDFAction::ActionTypeGoTo:
+      {
+        PDFGotoAction * actionGoto = dynamic_cast<PDFGotoAction*>(action);
+        if (actionGoto->isRemote())
+          return QString::fromUtf8("<p>%1</p>").arg(actionGoto->filename());
+          // FIXME: Possibly include page as well after the filename
+        return QString::fromUtf8("<p>") + PDFDocumentView::tr("Goto page %1").arg(actionGoto->destination().page() + 1) + QString::fromUtf8("</p>");
+      }
+    case PDFAction::ActionTypeURI:
+      {
+        PDFURIAction * actionURI = dynamic_cast<PDFURIAction*>(action);
+        return QString::fromUtf8("<p>%1</p>").arg(actionURI->url().toString());
+      }
+    case PDFAction::ActionTypeLaunch:
+      {
+        PDFLaunchAction * actionLaunch = dynamic_cast<PDFLaunchAction*>(action);
+        return QString::fromUtf8("<p>") + PDFDocumentView::tr("Execute `%1`").arg(actionLaunch->command()) + QString::fromUtf8("</p>");
+      }
+    default:
+      // All other link types are currently not supported
+      return QString();
+  }
 }
 
-int PDFMarkupAnnotationGraphicsItem::type() const { return Type; }
+void PDFPageOverlayGraphicsItem::retranslateUi()
+{
+  setToolTip(toolTip(_hoveredEntry));
+}
 
 // Event Handlers
 // --------------
 
-// Swap cursor during hover events.
-void PDFMarkupAnnotationGraphicsItem::hoverEnterEvent(QGraphicsSceneHoverEvent *event)
+// The item covers all links and annotations of the page, so moving the mouse
+// from one to another does not generate new enter/leave events. Instead, the
+// entry under the mouse is tracked here to swap the cursor and the tooltip.
+void PDFPageOverlayGraphicsItem::updateHover(const QPointF & point)
 {
-  Q_UNUSED(event)
-  if (_annot->popup())
+  const int idx = entryAt(point);
+  if (idx != _hoveredEntry) {
+    _hoveredEntry = idx;
+    setToolTip(toolTip(idx));
+  }
+  if (entryAt(point, true) >= 0)
     setCursor(Qt::PointingHandCursor);
+  else if (hasCursor())
+    unsetCursor();
+}
+
+void PDFPageOverlayGraphicsItem::hoverEnterEvent(QGraphicsSceneHoverEvent *event)
+{
+  updateHover(event->pos());
 }
 
-void PDFMarkupAnnotationGraphicsItem::hoverLeaveEvent(QGraphicsSceneHoverEvent *event)
+void PDFPageOverlayGraphicsItem::hoverMoveEvent(QGraphicsSceneHoverEvent *event)
+{
+  updateHover(event->pos());
+}
+
+void PDFPageOverlayGraphicsItem::hoverLeaveEvent(QGraphicsSceneHoverEvent *event)
 {
   Q_UNUSED(event)
-  if (_annot->popup())
-    unsetCursor();
+  _hoveredEntry = -1;
+  setToolTip(QString());
+  unsetCursor();
 }
 
 // Respond to clicks. Limited to left-clicks by `setAcceptedMouseButtons` in
 // this object's constructor.
-void PDFMarkupAnnotationGraphicsItem::mousePressEvent(QGraphicsSceneMouseEvent *event)
-{
-  // Actually opening the popup is handled during a `mouseReleaseEvent` --- but
-  // only if the `_activated` flag is `true`.
-  // Only set _activated if no keyboard modifiers are currently pressed (which
-  // most likely indicates some tool or other is active)
-  if (event->modifiers() == Qt::NoModifier)
-    _activated = true;
-  else {
-    _activated = false;
+void PDFPageOverlayGraphicsItem::mousePressEvent(QGraphicsSceneMouseEvent *event)
+{
+  // Actually opening the link (or popup) is handled during a
+  // `mouseReleaseEvent` --- but only if an entry was activated here.
+  // Only activate entries if no keyboard modifiers are currently pressed (which
+  // most likely indicates some tool or other is active). Clicks on annotations
+  // without popups are passed on as well.
+  _activeEntry = (event->modifiers() == Qt::NoModifier ? entryAt(event->pos(), true) : -1);
+  if (_activeEntry < 0)
     Super::mousePressEvent(event);
-  }
 }
 
-void PDFMarkupAnnotationGraphicsItem::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
+// The real nitty-gritty of link activation happens in here.
+void PDFPageOverlayGraphicsItem::mouseReleaseEvent(QGraphicsSceneMouseEvent *event)
 {
   Q_ASSERT(event != nullptr);
 
-  if (!_activated) {
+  // Check that an entry was "activated" (mouse press occurred within its
+  // bounding box) and that the mouse release also occurred within the bounding
+  // box.
+  const int idx = _activeEntry;
+  _activeEntry = -1;
+  if (idx < 0 || idx >= _entries.size() || !PDFRTree::contains(_entries[idx].rect, event->pos())) {
     Super::mouseReleaseEvent(event);
     return;
   }
-  _activated = false;
 
-  if (!contains(event->pos()) || !_annot)
+  const Entry & entry = _entries[idx];
+  if (entry.annotation) {
+    togglePopup(idx, event);
     return;
+  }
+
+  // Post an event to the parent scene. The scene then takes care of processing
+  // it further, notifying objects, such as `PDFDocumentView`, that may want to
+  // take action via a `SIGNAL`.
+  // **TODO:** Wouldn't a direct call be more efficient?
+  if (entry.link->actionOnActivation())
+    QCoreApplication::postEvent(scene(), new PDFActionEvent(entry.link->actionOnActivation()));
+}
+
+void PDFPageOverlayGraphicsItem::togglePopup(const int idx, QGraphicsSceneMouseEvent *event)
+{
+  const QSharedPointer<Annotation::Markup> & annot = _entries[idx].annotation;
 
   // Find widget that received this mouse event in the first place
   // Note: according to the Qt docs, QApplication::widgetAt() can be slow. But
@@ -2779,23 +3532,25 @@ void PDFMarkupAnnotationGraphicsItem::mouseReleaseEvent(QGraphicsSceneMouseEvent
   if (!sender || !qobject_cast<PDFDocumentView*>(sender->parent()))
     return;
 
-  if (_popup) {
-    if (_popup->isVisible())
-      _popup->hide();
+  QWidget * popup = _popups.value(idx);
+  if (popup) {
+    if (popup->isVisible())
+      popup->hide();
     else {
-      _popup->move(sender->mapFromGlobal(event->screenPos()));
-      _popup->show();
-      _popup->raise();
-      _popup->setFocus();
+      popup->move(sender->mapFromGlobal(event->screenPos()));
+      popup->show();
+      popup->raise();
+      popup->setFocus();
     }
     return;
   }
 
-  _popup = new QWidget(sender);
+  popup = new QWidget(sender);
+  _popups.insert(idx, popup);
 
   QStringList styles;
-  if (_annot->color().isValid()) {
-    QColor c(_annot->color());
+  if (annot->color().isValid()) {
+    QColor c(annot->color());
     styles << QString::fromUtf8(".QWidget { background-color: %1; }").arg(c.name());
     if (qGray(c.rgb()) >= 100)
       styles << QString::fromUtf8(".QWidget, .QLabel { color: black; }");
@@ -2806,23 +3561,23 @@ void PDFMarkupAnnotationGraphicsItem::mouseReleaseEvent(QGraphicsSceneMouseEvent
     styles << QString::fromUtf8(".QWidget { background-color: %1; }").arg(QApplication::palette().color(QPalette::Window).name());
       styles << QString::fromUtf8(".QWidget, .QLabel { color: %1; }").arg(QApplication::palette().color(QPalette::Text).name());
   }
-  _popup->setStyleSheet(styles.join(QString::fromLatin1("\n")));
-  QGridLayout * layout = new QGridLayout(_popup);
+  popup->setStyleSheet(styles.join(QString::fromLatin1("\n")));
+  QGridLayout * layout = new QGridLayout(popup);
   layout->setContentsMargins(2, 2, 2, 5);
 
-  QLabel * subject = new QLabel(QString::fromUtf8("<b>%1</b>").arg(_annot->subject()), _popup);
+  QLabel * subject = new QLabel(QString::fromUtf8("<b>%1</b>").arg(annot->subject()), popup);
   layout->addWidget(subject, 0, 0, 1, -1);
-  QLabel * author = new QLabel(_annot->author(), _popup);
+  QLabel * author = new QLabel(annot->author(), popup);
   layout->addWidget(author, 1, 0, 1, 1);
-  QLabel * date = new QLabel(QLocale().toString(_annot->creationDate(), QLocale::LongFormat), _popup);
+  QLabel * date = new QLabel(QLocale().toString(annot->creationDate(), QLocale::LongFormat), popup);
   layout->addWidget(date, 1, 1, 1, 1, Qt::AlignRight);
-  QTextEdit * content = new QTextEdit(_annot->richContents(), _popup);
+  QTextEdit * content = new QTextEdit(annot->richContents(), popup);
   content->setEnabled(false);
   layout->addWidget(content, 2, 0, 1, -1);
 
-  _popup->setLayout(layout);
-  _popup->move(sender->mapFromGlobal(event->screenPos()));
-  _popup->show();
+  popup->setLayout(layout);
+  popup->move(sender->mapFromGlobal(event->screenPos()));
+  popup->show();
   // TODO: Make popup closable, movable; position it properly (also upon
   // zooming!), give some visible indication to which annotation it belongs.
   // (Probably turn it into a subclass of QWidget, too).
@@ -3589,12 +4344,17 @@ int PDFPageLayout::rowCount() const {
 }
 
 void PDFPageLayout::addPage(PDFPageGraphicsItem * page) {
-  LayoutItem item;
-
   if (!page)
     return;
+  addPage(page->pageSizeF());
+  _layoutItems.last().page = page;
+}
 
-  item.page = page;
+void PDFPageLayout::addPage(const QSizeF & pageSize) {
+  LayoutItem item;
+
+  item.page = nullptr;
+  item.size = pageSize;
   if (_layoutItems.isEmpty()) {
     item.row = 0;
     item.col = _firstCol;
@@ -3608,6 +4368,7 @@ void PDFPageLayout::addPage(PDFPageGraphicsItem * page) {
     item.col = 0;
   }
   _layoutItems.append(item);
+  _rowOffsets.clear();
 }
 
 void PDFPageLayout::removePage(PDFPageGraphicsItem * page) {
@@ -3617,6 +4378,8 @@ void PDFPageLayout::removePage(PDFPageGraphicsItem * page) {
   // **TODO:** Decide what to do with pages that are in the list multiple times
   // (see also insertPage())
 
+  _rowOffsets.clear();
+
   // First, find the page and remove it
   for (it = _layoutItems.begin(); it != _layoutItems.end(); ++it) {
     if (it->page == page) {
@@ -3646,11 +4409,17 @@ void PDFPageLayout::insertPage(PDFPageGraphicsItem * page, PDFPageGraphicsItem *
   int row = 0, col = 0;
   LayoutItem item;
 
+  if (!page)
+    return;
+
   item.page = page;
+  item.size = page->pageSizeF();
 
   // **TODO:** Decide what to do with pages that are in the list multiple times
   // (see also insertPage())
 
+  _rowOffsets.clear();
+
   // First, find the page to insert before and insert (row and col will be set
   // below)
   for (it = _layoutItems.begin(); it != _layoutItems.end(); ++it) {
@@ -3681,6 +4450,65 @@ void PDFPageLayout::insertPage(PDFPageGraphicsItem * page, PDFPageGraphicsItem *
   }
 }
 
+void PDFPageLayout::setPageItem(const int idx, PDFPageGraphicsItem * page) {
+  if (idx < 0 || idx >= _layoutItems.size())
+    return;
+  _layoutItems[idx].page = page;
+  if (page)
+    page->setPos(_layoutItems[idx].pos);
+}
+
+bool PDFPageLayout::setPageSize(const int idx, const QSizeF & pageSize) {
+  if (idx < 0 || idx >= _layoutItems.size() || pageSize.isEmpty() || _layoutItems[idx].size == pageSize)
+    return false;
+  _layoutItems[idx].size = pageSize;
+  return true;
+}
+
+QRectF PDFPageLayout::pageRect(const int idx) const {
+  if (idx < 0 || idx >= _layoutItems.size())
+    return QRectF();
+  return QRectF(_layoutItems[idx].pos, _layoutItems[idx].size);
+}
+
+void PDFPageLayout::candidatePages(const qreal top, const qreal bottom, int & first, int & last) const {
+  first = 0;
+  last = static_cast<int>(_layoutItems.size()) - 1;
+  if (_rowOffsets.size() < 2)
+    return;
+
+  // Row r spans [_rowOffsets[r], _rowOffsets[r + 1]) vertically
+  const int firstRow = static_cast<int>(std::lower_bound(_rowOffsets.begin() + 1, _rowOffsets.end(), top) - (_rowOffsets.begin() + 1));
+  const int lastRow = static_cast<int>(std::upper_bound(_rowOffsets.begin(), _rowOffsets.end() - 1, bottom) - _rowOffsets.begin()) - 1;
+  // Rows are assigned in ascending order (see rearrange())
+  first = static_cast<int>(std::lower_bound(_layoutItems.begin(), _layoutItems.end(), firstRow,
+    [](const LayoutItem & item, const int row) { return item.row < row; }) - _layoutItems.begin());
+  last = static_cast<int>(std::upper_bound(_layoutItems.begin(), _layoutItems.end(), lastRow,
+    [](const int row, const LayoutItem & item) { return row < item.row; }) - _layoutItems.begin()) - 1;
+}
+
+QList<int> PDFPageLayout::pagesIn(const QRectF & rect) const {
+  QList<int> retVal;
+  int first{0}, last{-1};
+  candidatePages(rect.top(), rect.bottom(), first, last);
+  for (int i = first; i <= last; ++i) {
+    if (QRectF(_layoutItems[i].pos, _layoutItems[i].size).intersects(rect))
+      retVal << i;
+  }
+  return retVal;
+}
+
+QList<int> PDFPageLayout::pagesAt(const QPointF & pt) const {
+  QList<int> retVal;
+  int first{0}, last{-1};
+  candidatePages(pt.y(), pt.y(), first, last);
+  for (int i = first; i <= last; ++i) {
+    if (QRectF(_layoutItems[i].pos, _layoutItems[i].size).contains(pt))
+      retVal << i;
+  }
+  return retVal;
+}
+
 // Relayout the pages on the canvas
 void PDFPageLayout::relayout() {
   if (_isContinuous)
@@ -3700,9 +4528,7 @@ void PDFPageLayout::continuousModeRelayout() {
 
   // First, fill the offsets with the respective widths and heights
   for (it = _layoutItems.begin(); it != _layoutItems.end(); ++it) {
-    if (!it->page)
-      continue;
-    pageSize = it->page->pageSizeF();
+    pageSize = it->size;
 
     if (colOffsets[it->col + 1] < pageSize.width())
       colOffsets[it->col + 1] = pageSize.width();
@@ -3715,19 +4541,18 @@ void PDFPageLayout::continuousModeRelayout() {
     colOffsets[i] += colOffsets[i - 1] + _xSpacing;
   for (int i = 1; i <= rowCount(); ++i)
     rowOffsets[i] += rowOffsets[i - 1] + _ySpacing;
+  _rowOffsets = rowOffsets;
 
   // Finally, position pages
   // **TODO:** Figure out why this loop causes some noticeable lag when switching
   // from SinglePage to continuous mode in a large document (but not when
   // switching between separate continuous modes)
   for (it = _layoutItems.begin(); it != _layoutItems.end(); ++it) {
-    if (!it->page)
-      continue;
     // If we have more than one column, right-align the left-most column and
     // left-align the right-most column to avoid large space between columns
     // In all other cases, center the page in allotted space (in case we
     // stumble over pages of different sizes, e.g., landscape pages, etc.)
-    pageSize = it->page->pageSizeF();
+    pageSize = it->size;
     qreal x{0};
     if (_numCols > 1 && it->col == 0)
       x = colOffsets[it->col + 1] - _xSpacing - pageSize.width();
@@ -3737,7 +4562,9 @@ void PDFPageLayout::continuousModeRelayout() {
       x = 0.5 * (colOffsets[it->col + 1] + colOffsets[it->col] - _xSpacing - pageSize.width());
     // Always center the page vertically
     qreal y = 0.5 * (rowOffsets[it->row + 1] + rowOffsets[it->row] - _ySpacing - pageSize.height());
-    it->page->setPos(x, y);
+    it->pos = QPointF(x, y);
+    if (it->page)
+      it->page->setPos(it->pos);
   }
 
   // leave some space around the pages (note that the space on the right/bottom
@@ -3755,19 +4582,22 @@ void PDFPageLayout::singlePageModeRelayout()
   QSizeF pageSize;
   QRectF sceneRect;
 
+  // All pages overlap, so there are no rows to search
+  _rowOffsets.clear();
+
   // We lay out all pages such that their center is in the origin (since only
   // one page is visible at any time, this is no problem)
   for (it = _layoutItems.begin(); it != _layoutItems.end(); ++it) {
-    if (!it->page)
-      continue;
-    pageSize = it->page->pageSizeF();
+    pageSize = it->size;
     qreal width{pageSize.width()};
     qreal height{pageSize.height()};
     if (width > maxWidth)
       maxWidth = width;
     if (height > maxHeight)
       maxHeight = height;
-    it->page->setPos(-width / 2., -height / 2.);
+    it->pos = QPointF(-width / 2., -height / 2.);
+    if (it->page)
+      it->page->setPos(it->pos);
   }
 
   sceneRect.setRect(-maxWidth / 2., -maxHeight / 2., maxWidth, maxHeight);
@@ -3775,6 +4605,7 @@ void PDFPageLayout::singlePageModeRelayout()
 }
 
 void PDFPageLayout::rearrange() {
+  _rowOffsets.clear();
   QList<LayoutItem>::iterator it;
   int row{0};
   int col{_firstCol};
@@ -16,9 +16,12 @@
 
 #include "PDFBackend.h"
 #include "PDFDocumentTools.h"
+#include "PDFRTree.h"
 #include "PDFRuler.h"
+#include "PDFSearchIndex.h"
 
 #include <QtWidgets>
+#include <atomic>
 #include <memory>
 
 namespace QtPDF {
@@ -26,14 +29,11 @@ namespace QtPDF {
 // Forward declare classes defined in this header.
 class PDFDocumentScene;
 class PDFPageGraphicsItem;
-class PDFLinkGraphicsItem;
+class PDFPageOverlayGraphicsItem;
 class PDFDocumentMagnifierView;
 class PDFActionEvent;
 class PDFDocumentView;
 
-
-const int TILE_SIZE=1024;
-
 class PDFDocumentView : public QGraphicsView {
   Q_OBJECT
   typedef QGraphicsView Super;
@@ -41,16 +41,50 @@ class PDFDocumentView : public QGraphicsView {
   QSharedPointer<PDFDocumentScene> _pdf_scene;
 
   qreal _zoomLevel{1.0};
+  // Zooming in several quick steps (e.g., with the mouse wheel) is treated as
+  // one gesture, during which pages are drawn from tiles of the nearest
+  // pyramid level (see pyramidLevel()); tiles at the exact zoom level are only
+  // requested once the zoom level has not changed for a while
+  QTimer _zoomSettleTimer;
+  bool _isZooming{false};
   int _currentPage{-1}, _lastPage{-1};
 
   QString _searchString;
-  QList<QGraphicsItem *> _searchResults;
+  Backend::SearchFlags _searchFlags;
+  QList<Backend::SearchResult> _searchResults;
+  // Indices into _searchResults by page
+  QHash< int, QList<int> > _searchResultsByPage;
+  // Highlights of those search results whose pages currently have an item,
+  // by index into _searchResults. Pages are not materialized just to show
+  // their results; the highlights are added when the pages are materialized
+  // (see attachSearchResults()) and dropped when they are recycled.
+  QHash<int, QGraphicsPathItem*> _searchResultItems;
   QFutureWatcher< QList<Backend::SearchResult> > _searchResultWatcher;
+  // Pages in the order they are searched by _searchResultWatcher
+  QList<int> _searchPages;
+  // Pages that have been searched for _searchString so far, and those of them
+  // that contain it (see incrementalSearch())
+  QSet<int> _searchedPages;
+  QSet<int> _pagesWithSearchResults;
   int _currentSearchResult{-1};
+  // Delays incremental searches until the user stops typing
+  QTimer _incrementalSearchTimer;
+  QString _incrementalSearchString;
+  Backend::SearchFlags _incrementalSearchFlags;
   QBrush _searchResultHighlightBrush;
   QBrush _currentSearchResultHighlightBrush;
   PDFRuler _ruler{this};
   bool _useGrayScale{false};
+  // Prefetching of the pages around the visible ones (see prefetch())
+  int _prefetchPageCount{2};
+  QTimer _prefetchTimer;
+  QPointF _lastViewCenter;
+  // +1 when moving towards the end of the document, -1 when moving towards
+  // its beginning, 0 if unknown
+  int _scrollDirection{0};
+  // Smoothed number of pages per second the current page changes by
+  qreal _pageChangeRate{0};
+  QElapsedTimer _pageChangeTimer;
 
   friend class DocumentTool::AbstractTool;
   friend class DocumentTool::Select;
@@ -67,6 +101,17 @@ public:
   int lastPage();
   PageMode pageMode() const { return _pageMode; }
   qreal zoomLevel() const { return _zoomLevel; }
+  // Returns whether a zoom gesture is in progress (see _zoomSettleTimer)
+  bool isZooming() const { return _isZooming; }
+  // Returns the canonical zoom level (a power of sqrt(2)) closest to
+  // `zoomLevel`. Tiles rendered at these levels are shared by all zoom levels
+  // in between while zooming, similar to mipmaps.
+  static qreal pyramidLevel(const qreal zoomLevel);
+  // Returns whether a tile that is `renderWidth` pixels wide and is displayed
+  // `displayWidth` device pixels wide was rendered for `zoomLevel` or, if
+  // `zooming` is true, for its pyramid level. Requests for tiles at other
+  // resolutions are superseded (see reprioritizeRenderRequests()).
+  static bool isCurrentResolution(const int renderWidth, const qreal displayWidth, const qreal zoomLevel, const bool zooming);
   bool useGrayScale() const { return _useGrayScale; }
   void fitInView(const QRectF & rect, Qt::AspectRatioMode aspectRatioMode = Qt::IgnoreAspectRatio);
   const QWeakPointer<QtPDF::Backend::Document> document() const;
@@ -97,6 +142,21 @@ public:
   QBrush currentSearchResultHighlightBrush() const { return _currentSearchResultHighlightBrush; }
   void setCurrentSearchResultHighlightBrush(const QBrush & brush);
 
+  // Time (in ms) incrementalSearch() waits for further changes of the search
+  // text before searching
+  int incrementalSearchDelay() const { return _incrementalSearchTimer.interval(); }
+  void setIncrementalSearchDelay(const int msec) { _incrementalSearchTimer.setInterval(msec); }
+  // Pages the current search goes through in the background (in that order);
+  // empty if the search was answered by the search index (see search())
+  const QList<int> & searchPages() const { return _searchPages; }
+
+  // Number of pages before and after the visible ones that are rendered in
+  // advance (at the current zoom level) while there is nothing else to render.
+  // The faster the user moves through the document, the more pages ahead (and
+  // the fewer behind) are rendered. 0 disables prefetching.
+  int prefetchPageCount() const { return _prefetchPageCount; }
+  void setPrefetchPageCount(const int count) { _prefetchPageCount = qMax(0, count); }
+
   bool canGoPrevViewRects() const { return !_oldViewRects.empty(); }
 
   bool isRulerVisible() const { return _ruler.isVisibleTo(this); }
@@ -144,6 +204,14 @@ public slots:
   void setZoomLevel(const qreal zoomLevel, const QGraphicsView::ViewportAnchor anchor = QGraphicsView::AnchorViewCenter);
 
   void search(QString searchText, Backend::SearchFlags flags = Backend::Search_CaseInsensitive);
+  // Like search(), but meant to be called whenever the search text changes
+  // while the user is typing it (search-as-you-type). The search only starts
+  // once the text has not changed for incrementalSearchDelay() ms. If the new
+  // text contains the previous one (e.g., "synch" -> "synchro"), only the
+  // pages that contained the previous text (or that had not been searched for
+  // it yet) are searched again. Results are reported page by page as they
+  // become available. An empty `searchText` clears the search results.
+  void incrementalSearch(const QString & searchText, Backend::SearchFlags flags = Backend::Search_CaseInsensitive);
   void nextSearchResult();
   void previousSearchResult();
   void clearSearchResults();
@@ -183,6 +251,7 @@ protected:
   void wheelEvent(QWheelEvent * event) override;
   void changeEvent(QEvent * event) override;
   void resizeEvent(QResizeEvent * event) override;
+  void scrollContentsBy(int dx, int dy) override;
 
   // Maybe this will become public later on
   // Ownership of tool is transferred to PDFDocumentView
@@ -203,8 +272,30 @@ protected slots:
   void goToPage(const PDFPageGraphicsItem * page, const QPointF anchor, const int alignment = Qt::AlignHCenter | Qt::AlignVCenter);
   void searchResultReady(int index);
   void searchProgressValueChanged(int progressValue);
+  void startIncrementalSearch();
+  // Requests the tiles of the pages around the visible ones (see
+  // prefetchPageCount()) at low priority once everything visible has been
+  // requested, and drops outdated prefetch requests
+  void prefetch();
+  // Ends a zoom gesture (see isZooming())
+  void zoomSettled();
   void reinitializeFromScene();
   void notifyTextSelectionChanged();
+  // Highlights the search results on page `pageIdx` after its item was
+  // created, and forgets the highlights once the item is recycled (which
+  // destroys them)
+  void attachSearchResults(const int pageIdx, QtPDF::PDFPageGraphicsItem * pageItem);
+  void detachSearchResults(const int pageIdx);
+  // Lets the scene create (and recycle) page items for the area around the
+  // viewport and reprioritizes render requests accordingly
+  void visibleAreaChanged();
+  // Reorders the pending render requests of the document so that tiles close
+  // to the center of the viewport are rendered first, demotes requests for an
+  // outdated zoom level, and cancels requests for tiles that are far
+  // outside the viewport
+  void reprioritizeRenderRequests();
+  // Drops the prefetch requests this view issued before (see prefetch())
+  void dropPrefetchRequests(Backend::PDFPageProcessingThread & processingThread) const;
 
 private:
   PageMode _pageMode{PageMode_OneColumnContinuous};
@@ -218,6 +309,24 @@ private:
 
   QStack<PDFDestination> _oldViewRects;
 
+  void addSearchResult(const Backend::SearchResult & result);
+  // Highlights the search result with index `idx` as the current one and
+  // centers on it
+  void setCurrentSearchResult(const int idx);
+
+  // Must be called before each change of the zoom level. Changes that quickly
+  // follow each other form a zoom gesture (see isZooming()) that ends in
+  // zoomSettled(); a single change is rendered at the new zoom level right
+  // away.
+  void startZoomStep();
+
+  // Cancels the running search (if any), clears all results, and makes
+  // `searchText` and `flags` the current search
+  void resetSearch(const QString & searchText, const Backend::SearchFlags flags);
+  // Searches the given pages (in that order) for the current search in the
+  // background
+  void startSearch(const QList<int> & pages);
+
   // Never try to set a vanilla QGraphicsScene, always use a PDFGraphicsScene.
   void setScene(QGraphicsScene *scene);
   // Parent class has no copy constructor.
@@ -400,13 +509,21 @@ protected slots:
 // works for QGraphicsLayoutItem (i.e., QGraphicsWidget)
 class PDFPageLayout : public QObject {
   Q_OBJECT
+  // Pages are laid out based on their size alone, so they need not have a
+  // graphics item (see PDFDocumentScene::pageAt())
   struct LayoutItem {
     PDFPageGraphicsItem * page;
+    QSizeF size;
+    QPointF pos;
     int row;
     int col;
   };
 
   QList<LayoutItem> _layoutItems;
+  // Top edges of all rows (and the bottom edge of the last one, including
+  // the spacing) in continuous mode, so the pages in an area can be found by
+  // binary search; empty if the rows changed since the last relayout()
+  QVector<qreal> _rowOffsets;
   int _numCols{1};
   int _firstCol{0};
   qreal _xSpacing{10}; // spacing in pixel @ zoom=1
@@ -431,9 +548,26 @@ public:
   int rowCount() const;
 
   void addPage(PDFPageGraphicsItem * page);
+  // Adds a page of the given size (in scene coordinates) that has no graphics
+  // item (yet); see setPageItem()
+  void addPage(const QSizeF & pageSize);
   void removePage(PDFPageGraphicsItem * page);
   void insertPage(PDFPageGraphicsItem * page, PDFPageGraphicsItem * before = nullptr);
-  void clearPages() { _layoutItems.clear(); }
+  void clearPages() { _layoutItems.clear(); _rowOffsets.clear(); }
+  // Sets (or, if `page` is nullptr, removes) the graphics item of the page with
+  // index `idx` and moves it to the page's position
+  void setPageItem(const int idx, PDFPageGraphicsItem * page);
+  // Sets the size (in scene coordinates) of the page with index `idx` and
+  // returns whether it changed. Call relayout() afterwards.
+  bool setPageSize(const int idx, const QSizeF & pageSize);
+
+  int pageCount() const { return _layoutItems.size(); }
+  // Returns the area the page with index `idx` occupies in the scene
+  QRectF pageRect(const int idx) const;
+  // Returns the (ascending) indices of all pages intersecting `rect`
+  QList<int> pagesIn(const QRectF & rect) const;
+  // Returns the (ascending) indices of all pages containing `pt`
+  QList<int> pagesAt(const QPointF & pt) const;
 
 public slots:
   void relayout();
@@ -442,6 +576,9 @@ signals:
   void layoutChanged(const QRectF sceneRect);
 
 private:
+  // Returns the range [first, last] of the indices of the pages that may
+  // intersect the vertical range [top, bottom]
+  void candidatePages(const qreal top, const qreal bottom, int & first, int & last) const;
   void rearrange();
   void continuousModeRelayout();
   void singlePageModeRelayout();
@@ -455,25 +592,84 @@ class PDFDocumentScene : public QGraphicsScene
 
   const QSharedPointer<Backend::Document> _doc;
 
-  // This may change to a `QSet` in the future
+  // Graphics items are only created for pages that are (nearly) visible (see
+  // materializePages()); the entries of all other pages are nullptr
   QList<QGraphicsItem*> _pages;
+  // The non-null entries of _pages by page index, so the existing items can be
+  // visited without going through all pages
+  QMap<int, PDFPageGraphicsItem*> _materializedPages;
+  // Items of pages that were scrolled far out of view; they are not part of
+  // the scene and are reused for the next pages that come into view
+  QList<PDFPageGraphicsItem*> _recycledPages;
   int _lastPage;
   PDFPageLayout _pageLayout;
   QFileSystemWatcher _fileWatcher;
+  // Triggers checkChangedFile() while waiting for a changed file to be
+  // completely written
   QTimer _reloadTimer;
+  int _reloadCheckInterval{50};
+  int _maxReloadCheckInterval{1000};
+  // Size (or -1) and modification time of the changed file at the last check
+  qint64 _changedFileSize{-1};
+  QDateTime _changedFileModified;
   double _dpiX, _dpiY;
+  // Determines the sizes of all pages in the background after (re)loading the
+  // document (see startPageSizeLoader())
+  QFuture<void> _pageSizeLoader;
+  std::atomic<bool> _abortPageSizeLoader{false};
+  // Prepares reloading the document in the background (see reloadDocument())
+  QFutureWatcher<bool> _reloadWatcher;
+  // Set if the file changed again while a reload was being prepared
+  bool _reloadAgain{false};
+  // Full-text index of the document; it is brought up to date in the
+  // background whenever the document was (re)loaded (see startSearchIndexer())
+  Backend::PDFSearchIndex _searchIndex;
+  QFuture<void> _searchIndexer;
+  std::atomic<bool> _abortSearchIndexer{false};
+  bool _searchIndexingEnabled{true};
 
   void handleActionEvent(const PDFActionEvent * action_event);
+  // Returns the size (in scene coordinates) page `idx` should be laid out with
+  // (see Backend::Document::pageSizeF())
+  QSizeF pageItemSize(const int idx, bool * isEstimate = nullptr) const;
+  void startPageSizeLoader();
+  void stopPageSizeLoader();
+  void startSearchIndexer();
+  void stopSearchIndexer();
+  // Returns the tiles the views of this scene currently display (see
+  // PDFPageGraphicsItem::paint())
+  QList<Backend::PDFPageTile> visibleTiles() const;
+  // Returns the item of the page with index `idx`, creating it if necessary
+  PDFPageGraphicsItem * materializePage(const int idx);
+  // Returns whether the page with index `idx` is visible in the current page
+  // mode (see _shownPageIdx)
+  bool isPageShown(const int idx) const { return (_shownPageIdx == -2 || idx == _shownPageIdx); }
+  // Like PDFPageLayout::pagesIn() and pagesAt(), but only for pages that are
+  // visible in the current page mode
+  QList<int> shownPagesIn(const QRectF & rect) const;
+  QList<int> shownPagesAt(const QPointF & pt) const;
 
 public:
   PDFDocumentScene(QSharedPointer<Backend::Document> a_doc, QObject *parent = nullptr, const double dpiX = -1, const double dpiY = -1);
   ~PDFDocumentScene() override;
 
   QWeakPointer<Backend::Document> document();
+  // Returns all page items; entries of pages that currently have no item (see
+  // materializePages()) are nullptr
   QList<QGraphicsItem*> pages();
   QList<QGraphicsItem*> pages(const QPolygonF &polygon);
+  // Returns the items that currently exist (in ascending page order)
+  QList<PDFPageGraphicsItem*> materializedPages() const { return _materializedPages.values(); }
+  // Returns the item of page `idx` if it has one (without creating it)
+  PDFPageGraphicsItem * materializedPage(const int idx) const { return _materializedPages.value(idx); }
   QGraphicsItem* pageAt(const int idx) const;
   QGraphicsItem* pageAt(const QPointF &pt) const;
+  // Creates the items of all pages intersecting `rect` (in scene coordinates)
+  // and recycles those of pages far away from it (except for items that
+  // carry additional data, such as the text selection; search result
+  // highlights are destroyed along with the items, see pageRecycled()). Views
+  // should call this whenever their visible area changes.
+  void materializePages(const QRectF & rect);
   int pageNumAt(const QPolygonF &polygon);
   int pageNumAt(const QPointF &pt);
   int pageNumFor(const PDFPageGraphicsItem * const graphicsItem) const;
@@ -485,6 +681,32 @@ public:
 
   bool watchForDocumentChangesOnDisk() const { return _fileWatcher.files().size() > 0; }
   void setWatchForDocumentChangesOnDisk(const bool doWatch = true);
+  int reloadCheckInterval() const { return _reloadCheckInterval; }
+  int maxReloadCheckInterval() const { return _maxReloadCheckInterval; }
+  // After the file changed on disk, it is checked every `interval` ms until it
+  // is completely written and its size and modification time are stable
+  // before it is reloaded. While the file is still growing, the interval is
+  // doubled for each check (up to `maxInterval` ms).
+  void setReloadCheckInterval(const int interval, const int maxInterval);
+  // Returns the interval (in ms) after which the changed file is checked next,
+  // or -1 if no check is pending
+  int pendingReloadCheckInterval() const { return (_reloadTimer.isActive() ? _reloadTimer.interval() : -1); }
+
+  // Returns the full-text index of the document; searches should only use it
+  // if it is up to date (see Backend::PDFSearchIndex::isUpToDate())
+  const Backend::PDFSearchIndex & searchIndex() const { return _searchIndex; }
+  bool isSearchIndexingEnabled() const { return _searchIndexingEnabled; }
+  // The index is built in the background by default. If indexing is disabled,
+  // the index is discarded (to save memory) and searches go through the pages
+  // instead.
+  void setSearchIndexingEnabled(const bool enabled = true);
+
+  // Returns the tiles PDFPageGraphicsItem::paint() uses to display `area` (in
+  // item coordinates; the whole page if it is null) of the page with index
+  // `idx` at the zoom level `scaleFactor` on a device with the pixel ratio
+  // `dpr`. If `wholePage` is true, the page is displayed in one piece (as in
+  // presentation mode).
+  QList<Backend::PDFPageTile> pageTiles(const int idx, const qreal scaleFactor, const qreal dpr, const bool wholePage, QRectF area = QRectF()) const;
 
   int lastPage();
 
@@ -495,24 +717,45 @@ public:
 signals:
   void pageChangeRequested(int pageNum);
   void pageLayoutChanged();
+  // Emitted when page `idx` got an item (see materializePages()), and when
+  // that item is about to be recycled; views can use these to decorate the
+  // items (e.g., with search result highlights)
+  void pageMaterialized(const int idx, QtPDF::PDFPageGraphicsItem * pageItem);
+  void pageRecycled(const int idx);
   void pdfActionTriggered(const QtPDF::PDFAction * action);
   void documentChanged(const QWeakPointer<QtPDF::Backend::Document> doc);
+  // Emitted when the search index has been brought up to date
+  void searchIndexUpdated();
 
 public slots:
   void doUnlockDialog();
   void retranslateUi();
+  // Reloads the document from disk. The new file is loaded (and the tiles
+  // currently on screen are rendered from it) in the background while the old
+  // one remains visible; once that is done, the scene switches to the new file
+  // in a single step (see finishReload()).
   void reloadDocument();
 
 protected slots:
   void pageLayoutChanged(const QRectF& sceneRect);
-  void reinitializeScene();
+  // If keepUnchangedPages is true, page items of pages that survived a reload
+  // of the document are reused instead of being recreated
+  void reinitializeScene(const bool keepUnchangedPages = false);
   void finishUnlock();
+  void finishReload();
+  void fileChanged();
+  void checkChangedFile();
+  // Called (from the page size loader) when the sizes of the pages with
+  // indices `first` to `last - 1` have been determined
+  void pageSizesLoaded(const int first, const int last);
 
 protected:
   // Used in non-continuous mode to keep track of currently shown page across
   // reloads. -2 is used in continuous mode. -1 indicates an invalid value.
   int _shownPageIdx;
   bool event(QEvent * event) override;
+  // Ensures that all pages in `rect` have an item before they are painted
+  void drawBackground(QPainter * painter, const QRectF & rect) override;
 
   QWidget * _unlockWidget;
   QLabel * _unlockWidgetLockText, * _unlockWidgetLockIcon;
@@ -544,8 +787,9 @@ class PDFPageGraphicsItem : public QGraphicsObject
   QSizeF _pageSize;
   int _pageNum;
 
-  bool _linksLoaded;
   bool _annotationsLoaded;
+  // Holds the links and annotations (created once they are loaded)
+  PDFPageOverlayGraphicsItem * _overlay{nullptr};
 
   QTransform _pageScale, _pointScale;
   qreal _zoomLevel;
@@ -554,11 +798,14 @@ class PDFPageGraphicsItem : public QGraphicsObject
   friend class PageProcessingLoadLinksRequest;
 //  friend class PDFPageLayout;
 
-  static void imageToGrayScale(QImage & img);
-
 public:
   PDFPageGraphicsItem(QWeakPointer<Backend::Page> a_page, const double dpiX, const double dpiY, QGraphicsItem *parent = nullptr);
 
+  // Makes this item show `a_page` instead of the current page (e.g., to reuse
+  // it after the current page was scrolled far out of view). All child items
+  // (links, annotations, etc.) are destroyed.
+  void setPage(QWeakPointer<Backend::Page> a_page);
+
   // This seems fragile as it assumes no other code declaring a custom graphics
   // item will choose the same ID for it's object types. Unfortunately, there
   // appears to be no equivalent of `registerEventType` for `QGraphicsItem`
@@ -584,9 +831,16 @@ public:
   QTransform pageScale() { return _pageScale; }
   QTransform pointScale() { return _pointScale; }
 
+  // Maps the rect `renderBox` of a tile rendered at the resolution `xres` x
+  // `yres` (in dpi) to this item's coordinate system
+  QRectF mapRectFromTile(const QRect & renderBox, const double xres, const double yres) const;
+
   // get the nominal (i.e., unmagnified) page size in pixel
   QSizeF pageSizeF() const { return _pageSize; }
   int pageNum() const { return _pageNum; }
+  // The item holding the links and annotations of the page (nullptr until
+  // they are loaded)
+  PDFPageOverlayGraphicsItem * overlay() const { return _overlay; }
 
 protected:
   bool event(QEvent * event) override;
@@ -598,59 +852,97 @@ private:
 private slots:
   void addLinks(QList< QSharedPointer<Annotation::Link> > links);
   void addAnnotations(QList< QSharedPointer<Annotation::AbstractAnnotation> > annotations);
+
+private:
+  void addLinksAndAnnotations(const QList< QSharedPointer<Annotation::Link> > & links, const QList< QSharedPointer<Annotation::AbstractAnnotation> > & annotations);
 };
 
-// TODO: Should be turned into a QGraphicsPolygonItem
-class PDFLinkGraphicsItem : public QGraphicsRectItem {
-  typedef QGraphicsRectItem Super;
+// Holds all links and markup annotations of a page in one item (a child of the
+// page's PDFPageGraphicsItem, in pdf coordinates). Pages of hyperref-heavy
+// documents can have hundreds of links, which would otherwise all become
+// separate items that the scene needs to index and hit-test. Here, they are
+// kept in an R-tree instead, which is queried for hover, mouse, and paint
+// events. Like individual items stacked in the order they were added,
+// annotations take precedence over links (and later entries over earlier
+// ones).
+class PDFPageOverlayGraphicsItem : public QGraphicsItem {
+  typedef QGraphicsItem Super;
+
+  struct Entry {
+    QRectF rect;
+    // Exactly one of the two is set
+    QSharedPointer<Annotation::Link> link;
+    QSharedPointer<Annotation::Markup> annotation;
+  };
 
-  QSharedPointer<Annotation::Link> _link;
-  bool _activated;
+  QVector<Entry> _entries;
+  PDFRTree _tree;
+  // The rects of all entries (see shape())
+  QPainterPath _shape;
+  int _hoveredEntry{-1};
+  // Entry that received the last mouse press (if any)
+  int _activeEntry{-1};
+  // Note popups of markup annotations (they belong to the view they were
+  // opened in)
+  QHash< int, QPointer<QWidget> > _popups;
 
 public:
-  PDFLinkGraphicsItem(QSharedPointer<Annotation::Link> a_link, QGraphicsItem *parent = nullptr);
+  PDFPageOverlayGraphicsItem(QGraphicsItem *parent = nullptr);
   // See concerns in `PDFPageGraphicsItem` for why this feels fragile.
   enum { Type = UserType + 2 };
   int type() const override;
+
+  QRectF boundingRect() const override;
+  // Only the links and annotations are part of the item. The scene hit-tests
+  // items with their shape (not their bounding rect), so the item does not
+  // catch any events elsewhere on the page. contains() checks the same rects
+  // (including the edges of degenerate ones, which the shape lacks).
+  QPainterPath shape() const override;
+  bool contains(const QPointF & point) const override;
+  void paint(QPainter * painter, const QStyleOptionGraphicsItem * option, QWidget * widget) override;
+
+  // Adds links and (markup) annotations; other annotations are ignored
+  void addLinksAndAnnotations(const QList< QSharedPointer<Annotation::Link> > & links, const QList< QSharedPointer<Annotation::AbstractAnnotation> > & annotations);
+  int numLinks() const;
+  int numAnnotations() const;
+
+  // Returns the topmost link or annotation at `point` (in item coordinates);
+  // a null pointer if there is none
+  QSharedPointer<Annotation::AbstractAnnotation> annotationAt(const QPointF & point) const;
+
   void retranslateUi();
 
 protected:
   void hoverEnterEvent(QGraphicsSceneHoverEvent * event) override;
+  void hoverMoveEvent(QGraphicsSceneHoverEvent * event) override;
   void hoverLeaveEvent(QGraphicsSceneHoverEvent * event) override;
 
   void mousePressEvent(QGraphicsSceneMouseEvent * event) override;
   void mouseReleaseEvent(QGraphicsSceneMouseEvent * event) override;
 
 private:
+  // Return the index of the topmost entry at `point` (or -1); if `clickable`
+  // is true, only links and annotations with popups are considered
+  int entryAt(const QPointF & point, const bool clickable = false) const;
+  bool isClickable(const int idx) const;
+  QString toolTip(const int idx) const;
+  void updateHover(const QPointF & point);
+  void togglePopup(const int idx, QGraphicsSceneMouseEvent * event);
+
   // Parent class has no copy constructor.
-  Q_DISABLE_COPY(PDFLinkGraphicsItem)
+  Q_DISABLE_COPY(PDFPageOverlayGraphicsItem)
 };
 
-
-// TODO: Should be turned into a QGraphicsPolygonItem
-class PDFMarkupAnnotationGraphicsItem : public QGraphicsRectItem {
-  typedef QGraphicsRectItem Super;
-
-  QSharedPointer<Annotation::Markup> _annot;
-  bool _activated;
-  QWidget * _popup;
-
+// Highlight of a search result on a page. Unlike other children of page items,
+// these don't keep the pages from being recycled; they are destroyed along
+// with the items, and views create them again once the pages are
+// materialized again (see PDFDocumentScene::pageMaterialized()).
+class PDFSearchResultGraphicsItem : public QGraphicsPathItem {
 public:
-  PDFMarkupAnnotationGraphicsItem(QSharedPointer<Annotation::Markup> annot, QGraphicsItem *parent = nullptr);
+  PDFSearchResultGraphicsItem(const QPainterPath & path, QGraphicsItem * parent = nullptr) : QGraphicsPathItem(path, parent) { }
   // See concerns in `PDFPageGraphicsItem` for why this feels fragile.
   enum { Type = UserType + 3 };
-  int type() const override;
-
-protected:
-  void hoverEnterEvent(QGraphicsSceneHoverEvent * event) override;
-  void hoverLeaveEvent(QGraphicsSceneHoverEvent * event) override;
-
-  void mousePressEvent(QGraphicsSceneMouseEvent * event) override;
-  void mouseReleaseEvent(QGraphicsSceneMouseEvent * event) override;
-
-private:
-  // Parent class has no copy constructor.
-  Q_DISABLE_COPY(PDFMarkupAnnotationGraphicsItem)
+  int type() const override { return Type; }
 };
 
 class PDFActionEvent : public QEvent {
@@ -667,12 +959,6 @@ public:
 // Note: Q_DECLARE_METATYPE must be specified _outside_ any namespace
 // declaration (according to Qt docs)
 
-// We need to declare a QList<PDFLinkGraphicsItem *> meta-type so we can
-// pass it through inter-thread (i.e., queued) connections
-Q_DECLARE_METATYPE(QList<QtPDF::PDFLinkGraphicsItem *>)
-// We need to declare a QList<PDFMarkupAnnotationGraphicsItem *> meta-type so we can
-// pass it through inter-thread (i.e., queued) connections
-Q_DECLARE_METATYPE(QList<QtPDF::PDFMarkupAnnotationGraphicsItem *>)
 
 
 #endif // End header include guard
@@ -0,0 +1,138 @@
+/**
+ * Copyright (C) 2022  Charlie Sharpsteen, Stefan Löffler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include "PDFGrayScale.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QTPDF_GRAYSCALE_SSE2
+#include <emmintrin.h>
+#endif
+// AVX2 is not part of any baseline we build for, so it is only compiled in
+// (for individual functions) where the compiler supports that and its
+// availability can be checked at runtime
+#if defined(QTPDF_GRAYSCALE_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define QTPDF_GRAYSCALE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace QtPDF {
+
+namespace Backend {
+
+namespace {
+
+// All kernels compute qGray() = (11 * r + 16 * g + 5 * b) / 32 exactly. The
+// vectorized ones work on the 32 bit lanes, but as the intermediate values fit
+// into 16 bits (32 * 255 < 2^13), the products are computed with 16 bit
+// multiplications (the upper halves of all lanes are zero).
+
+void grayScaleScalar(QRgb * data, const qint64 n)
+{
+  for (qint64 i = 0; i < n; ++i) {
+    // Qt formula (qGray()): 0.34375 * r + 0.5 * g + 0.15625 * b
+    // MuPDF formula (rgb_to_gray()): r * 0.3f + g * 0.59f + b * 0.11f;
+    const int gray = qGray(data[i]);
+    data[i] = qRgba(gray, gray, gray, qAlpha(data[i]));
+  }
+}
+
+#ifdef QTPDF_GRAYSCALE_SSE2
+// Returns the number of pixels processed (the rest is left for the scalar
+// kernel)
+qint64 grayScaleSSE2(QRgb * data, const qint64 n)
+{
+  const __m128i byteMask = _mm_set1_epi32(0xff);
+  const __m128i alphaMask = _mm_set1_epi32(~0x00ffffff);
+  const __m128i redFactor = _mm_set1_epi32(11);
+  const __m128i blueFactor = _mm_set1_epi32(5);
+
+  qint64 i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i * p = reinterpret_cast<__m128i *>(data + i);
+    const __m128i pixels = _mm_loadu_si128(p);
+    const __m128i b = _mm_and_si128(pixels, byteMask);
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 8), byteMask);
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(pixels, 16), byteMask);
+    __m128i gray = _mm_add_epi32(_mm_mullo_epi16(r, redFactor), _mm_slli_epi32(g, 4));
+    gray = _mm_srli_epi32(_mm_add_epi32(gray, _mm_mullo_epi16(b, blueFactor)), 5);
+    gray = _mm_or_si128(gray, _mm_or_si128(_mm_slli_epi32(gray, 8), _mm_slli_epi32(gray, 16)));
+    _mm_storeu_si128(p, _mm_or_si128(gray, _mm_and_si128(pixels, alphaMask)));
+  }
+  return i;
+}
+#endif // defined(QTPDF_GRAYSCALE_SSE2)
+
+#ifdef QTPDF_GRAYSCALE_AVX2
+// Same as grayScaleSSE2(), but for eight pixels at a time
+__attribute__((target("avx2")))
+qint64 grayScaleAVX2(QRgb * data, const qint64 n)
+{
+  const __m256i byteMask = _mm256_set1_epi32(0xff);
+  const __m256i alphaMask = _mm256_set1_epi32(~0x00ffffff);
+  const __m256i redFactor = _mm256_set1_epi32(11);
+  const __m256i blueFactor = _mm256_set1_epi32(5);
+
+  qint64 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i * p = reinterpret_cast<__m256i *>(data + i);
+    const __m256i pixels = _mm256_loadu_si256(p);
+    const __m256i b = _mm256_and_si256(pixels, byteMask);
+    const __m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 8), byteMask);
+    const __m256i r = _mm256_and_si256(_mm256_srli_epi32(pixels, 16), byteMask);
+    __m256i gray = _mm256_add_epi32(_mm256_mullo_epi16(r, redFactor), _mm256_slli_epi32(g, 4));
+    gray = _mm256_srli_epi32(_mm256_add_epi32(gray, _mm256_mullo_epi16(b, blueFactor)), 5);
+    gray = _mm256_or_si256(gray, _mm256_or_si256(_mm256_slli_epi32(gray, 8), _mm256_slli_epi32(gray, 16)));
+    _mm256_storeu_si256(p, _mm256_or_si256(gray, _mm256_and_si256(pixels, alphaMask)));
+  }
+  return i;
+}
+
+bool hasAVX2()
+{
+  static const bool retVal = __builtin_cpu_supports("avx2");
+  return retVal;
+}
+#endif // defined(QTPDF_GRAYSCALE_AVX2)
+
+} // anonymous namespace
+
+void convertToGrayScale(QImage & img)
+{
+  // Casting to QRgb* only works for 32bit images
+  Q_ASSERT(img.depth() == 32);
+  if (img.isNull())
+    return;
+  QRgb * data = reinterpret_cast<QRgb*>(img.bits());
+#if QT_VERSION < QT_VERSION_CHECK(5, 10, 0)
+  const qint64 n = img.byteCount() / 4;
+#else
+  const qint64 n = img.sizeInBytes() / 4;
+#endif
+
+  qint64 done = 0;
+#ifdef QTPDF_GRAYSCALE_AVX2
+  if (hasAVX2())
+    done = grayScaleAVX2(data, n);
+#endif
+#ifdef QTPDF_GRAYSCALE_SSE2
+  done += grayScaleSSE2(data + done, n - done);
+#endif
+  grayScaleScalar(data + done, n - done);
+}
+
+} // namespace Backend
+
+} // namespace QtPDF
+
+// vim: set sw=2 ts=2 et
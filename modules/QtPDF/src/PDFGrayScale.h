@@ -0,0 +1,35 @@
+/**
+ * Copyright (C) 2022  Charlie Sharpsteen, Stefan Löffler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+#ifndef PDFGrayScale_H
+#define PDFGrayScale_H
+
+#include <QImage>
+
+namespace QtPDF {
+
+namespace Backend {
+
+// Converts `img` (which must have 32 bits per pixel) to gray scale in place.
+// Each pixel becomes qRgba(g, g, g, a) with g = qGray() of the original pixel
+// and a its alpha value. Where available, the pixels are processed with SSE2 or
+// AVX2 instructions (chosen at runtime); the result is always identical to that
+// of the scalar formula.
+void convertToGrayScale(QImage & img);
+
+} // namespace Backend
+
+} // namespace QtPDF
+
+#endif // End header guard
+// vim: set sw=2 ts=2 et
@@ -74,7 +74,7 @@ bool PDFPageTile::operator <(const PDFPageTile &other) const
 #ifdef DEBUG
 PDFPageTile::operator QString() const
 {
-  return QString::fromUtf8("p%1,%2x%3,r%4|%5x%6|%7").arg(page_num).arg(xres).arg(yres).arg(render_box.x()).arg(render_box.y()).arg(render_box.width()).arg(render_box.height());
+  return QString::fromUtf8("p%1,%2x%3,r%4|%5x%6|%7%8").arg(page_num).arg(xres).arg(yres).arg(render_box.x()).arg(render_box.y()).arg(render_box.width()).arg(render_box.height()).arg(grayscale ? QString::fromUtf8(",gray") : QString());
 }
 #endif
 
@@ -83,7 +83,28 @@ uint qHash(const PDFPageTile &tile) noexcept
 {
   uint h1 = ::qHash(QPair<uint, uint>(::qHash(tile.xres), ::qHash(tile.yres)));
   uint h2 = ::qHash(QPair<uint,int>(::qHash(tile.render_box), tile.page_num));
-  return ::qHash(QPair<uint, uint>(h1, h2));
+  return ::qHash(QPair<uint, uint>(::qHash(QPair<uint, uint>(h1, h2)), tile.doc_id)) ^ (tile.grayscale ? 1u : 0u);
+}
+
+QList<QRect> tileRenderBoxes(const QSize & pageSize, const QRect & area /* = QRect() */)
+{
+  QList<QRect> retVal;
+  const QRect pageRect(QPoint(0, 0), pageSize);
+  const QRect visibleRect = (area.isNull() ? pageRect : area & pageRect);
+  if (visibleRect.isEmpty())
+    return retVal;
+
+  if (static_cast<qint64>(pageSize.width()) * pageSize.height() <= WholePageMaxPixels) {
+    retVal << pageRect;
+    return retVal;
+  }
+
+  const int tileSize = (qMax(pageSize.width(), pageSize.height()) > SmallTilesMinPageSize ? MinTileSize : TileSize);
+  for (int j = visibleRect.top() / tileSize; j <= visibleRect.bottom() / tileSize; ++j) {
+    for (int i = visibleRect.left() / tileSize; i <= visibleRect.right() / tileSize; ++i)
+      retVal << (QRect(i * tileSize, j * tileSize, tileSize, tileSize) & pageRect);
+  }
+  return retVal;
 }
 
 } // namespace Backend
@@ -15,6 +15,7 @@
 #ifndef PDFPageTile_H
 #define PDFPageTile_H
 
+#include <QList>
 #include <QRect>
 
 #ifdef DEBUG
@@ -28,23 +29,28 @@ namespace Backend {
 class PDFPageTile
 {
 public:
-  // TODO:
-  // We may want an application-wide cache instead of a document-specific cache
-  // to keep memory usage down. This may require an additional piece of
-  // information---the document that the page belongs to.
-  PDFPageTile(double xres, double yres, QRect render_box, int page_num):
+  // Note: Tiles of all documents are kept in one application-wide cache (see
+  // PDFPageCache::globalCache()), so `doc_id` must be set to the
+  // Document::cacheId() of the document the page belongs to.
+  // Gray scale tiles are cached separately from (and converted from) the
+  // regular tiles of the same area (see Page::getTileImage()).
+  PDFPageTile(double xres, double yres, QRect render_box, int page_num, unsigned int doc_id = 0, bool grayscale = false):
     xres(xres), yres(yres),
     render_box(render_box),
-    page_num(page_num)
+    page_num(page_num),
+    doc_id(doc_id),
+    grayscale(grayscale)
   {}
 
   double xres, yres;
   QRect render_box;
   int page_num;
+  unsigned int doc_id;
+  bool grayscale;
 
   bool operator==(const PDFPageTile &other) const
   {
-    return (xres == other.xres && yres == other.yres && render_box == other.render_box && page_num == other.page_num);
+    return (xres == other.xres && yres == other.yres && render_box == other.render_box && page_num == other.page_num && doc_id == other.doc_id && grayscale == other.grayscale);
   }
 
   bool operator <(const PDFPageTile &other) const;
@@ -57,6 +63,22 @@ public:
 // ### Cache for Rendered Images
 uint qHash(const PDFPageTile &tile) noexcept;
 
+// Returns the render boxes of the tiles that cover `area` (or the whole page if
+// `area` is null) of a page that measures `pageSize` pixels at the resolution
+// it is rendered at. Each backend render call has a considerable overhead, so
+// pages of up to WholePageMaxPixels pixels (e.g., at low zoom levels, even on
+// high-dpi screens) are rendered in one piece. Larger pages are split into
+// square tiles of TileSize pixels, or of MinTileSize pixels if a side of the
+// page exceeds SmallTilesMinPageSize pixels (at very high zoom levels, when
+// only a small fraction of the page is visible). Tiles never extend beyond the
+// page, so those at its right and bottom edges may be smaller.
+QList<QRect> tileRenderBoxes(const QSize & pageSize, const QRect & area = QRect());
+
+constexpr int WholePageMaxPixels = 2048 * 2048;
+constexpr int TileSize = 1024;
+constexpr int MinTileSize = 512;
+constexpr int SmallTilesMinPageSize = 16384;
+
 } // namespace Backend
 
 } // namespace QtPDF
@@ -0,0 +1,155 @@
+/**
+ * Copyright (C) 2022  Charlie Sharpsteen, Stefan Löffler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include "PDFRTree.h"
+
+#include <QVarLengthArray>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace QtPDF {
+
+namespace {
+
+// NB: QRectF::united() ignores null rects (i.e., rects of zero width and
+// height), which are valid entries here
+QRectF unite(const QRectF & a, const QRectF & b)
+{
+  return QRectF(QPointF(qMin(a.left(), b.left()), qMin(a.top(), b.top())), QPointF(qMax(a.right(), b.right()), qMax(a.bottom(), b.bottom())));
+}
+
+} // anonymous namespace
+
+PDFRTree::PDFRTree(const QVector<QRectF> & rects, const int nodeCapacity /* = DefaultNodeCapacity */)
+{
+  const int capacity = qMax(2, nodeCapacity);
+  _rects.reserve(rects.size());
+  foreach(const QRectF & r, rects)
+    _rects << r.normalized();
+  if (_rects.isEmpty())
+    return;
+
+  _levels << pack(_rects, capacity, _order);
+  while (_levels.last().size() > 1) {
+    const QVector<Node> & children = _levels.last();
+    QVector<QRectF> bboxes;
+    bboxes.reserve(children.size());
+    foreach(const Node & node, children)
+      bboxes << node.bbox;
+
+    // The parents reference their children by position, so the children
+    // need to be stored in the order they were grouped in
+    QVector<int> order;
+    const QVector<Node> parents = pack(bboxes, capacity, order);
+    QVector<Node> sortedChildren;
+    sortedChildren.reserve(children.size());
+    foreach(const int i, order)
+      sortedChildren << children[i];
+    _levels.last() = sortedChildren;
+    _levels << parents;
+  }
+}
+
+QRectF PDFRTree::boundingRect() const
+{
+  if (_levels.isEmpty())
+    return QRectF();
+  return _levels.last().first().bbox;
+}
+
+QVector<int> PDFRTree::containing(const QPointF & pt) const
+{
+  QVector<int> retVal;
+  query([&pt](const QRectF & r) { return contains(r, pt); }, retVal);
+  return retVal;
+}
+
+QVector<int> PDFRTree::intersecting(const QRectF & rect) const
+{
+  QVector<int> retVal;
+  const QRectF r = rect.normalized();
+  query([&r](const QRectF & other) { return intersects(other, r); }, retVal);
+  return retVal;
+}
+
+// static
+QVector<PDFRTree::Node> PDFRTree::pack(const QVector<QRectF> & rects, const int capacity, QVector<int> & order)
+{
+  const int n = static_cast<int>(rects.size());
+  order.resize(n);
+  std::iota(order.begin(), order.end(), 0);
+
+  // Sort-tile-recursive: sort by x, cut into (roughly) sqrt(#nodes) vertical
+  // slices, sort each slice by y, and fill the nodes slice by slice
+  const int numNodes = (n + capacity - 1) / capacity;
+  const int numSlices = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(numNodes))));
+  const int sliceSize = numSlices * capacity;
+
+  std::sort(order.begin(), order.end(), [&rects](const int a, const int b) {
+    return rects[a].center().x() < rects[b].center().x();
+  });
+
+  QVector<Node> nodes;
+  nodes.reserve(numNodes + numSlices);
+  for (int slice = 0; slice < n; slice += sliceSize) {
+    const int sliceEnd = qMin(slice + sliceSize, n);
+    std::sort(order.begin() + slice, order.begin() + sliceEnd, [&rects](const int a, const int b) {
+      return rects[a].center().y() < rects[b].center().y();
+    });
+    for (int first = slice; first < sliceEnd; first += capacity) {
+      Node node;
+      node.first = first;
+      node.count = qMin(capacity, sliceEnd - first);
+      node.bbox = rects[order[first]];
+      for (int i = first + 1; i < first + node.count; ++i)
+        node.bbox = unite(node.bbox, rects[order[i]]);
+      nodes << node;
+    }
+  }
+  return nodes;
+}
+
+template<typename Predicate>
+void PDFRTree::query(const Predicate & test, QVector<int> & result) const
+{
+  if (_levels.isEmpty())
+    return;
+
+  struct StackItem {
+    int level;
+    int node;
+  };
+  QVarLengthArray<StackItem, 64> stack;
+  stack.append(StackItem{static_cast<int>(_levels.size()) - 1, 0});
+  while (!stack.isEmpty()) {
+    const StackItem item = stack.last();
+    stack.removeLast();
+    const Node & node = _levels[item.level][item.node];
+    if (!test(node.bbox))
+      continue;
+    for (int i = node.first; i < node.first + node.count; ++i) {
+      if (item.level > 0)
+        stack.append(StackItem{item.level - 1, i});
+      else if (test(_rects[_order[i]]))
+        result << _order[i];
+    }
+  }
+  std::sort(result.begin(), result.end());
+}
+
+} // namespace QtPDF
+
+// vim: set sw=2 ts=2 et
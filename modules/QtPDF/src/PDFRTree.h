@@ -0,0 +1,85 @@
+/**
+ * Copyright (C) 2022  Charlie Sharpsteen, Stefan Löffler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+#ifndef PDFRTree_H
+#define PDFRTree_H
+
+#include <QPointF>
+#include <QRectF>
+#include <QVector>
+
+namespace QtPDF {
+
+// Spatial index (R-tree) of a fixed set of rectangles, e.g., the links and
+// annotations of a page. The tree is bulk-loaded with the sort-tile-recursive
+// (STR) algorithm when it is constructed and cannot be modified afterwards
+// (construct a new one instead).
+//
+// Rectangles are identified by their index in the list passed to the
+// constructor. Rectangles are treated as closed sets, i.e., their edges (and
+// degenerate rectangles of zero width or height) can be hit as well.
+class PDFRTree
+{
+public:
+  static constexpr int DefaultNodeCapacity = 16;
+
+  PDFRTree() = default;
+  explicit PDFRTree(const QVector<QRectF> & rects, const int nodeCapacity = DefaultNodeCapacity);
+
+  int size() const { return static_cast<int>(_rects.size()); }
+  bool isEmpty() const { return _rects.isEmpty(); }
+  const QRectF & rect(const int idx) const { return _rects[idx]; }
+  // The union of all rectangles
+  QRectF boundingRect() const;
+
+  // Return the indices of all rectangles that contain `pt` or intersect
+  // `rect`, respectively, in ascending order
+  QVector<int> containing(const QPointF & pt) const;
+  QVector<int> intersecting(const QRectF & rect) const;
+
+  // Rectangle tests for closed sets (QRectF's are exclusive for empty
+  // rectangles)
+  static bool contains(const QRectF & r, const QPointF & pt) {
+    return pt.x() >= r.left() && pt.x() <= r.right() && pt.y() >= r.top() && pt.y() <= r.bottom();
+  }
+  static bool intersects(const QRectF & a, const QRectF & b) {
+    return a.left() <= b.right() && b.left() <= a.right() && a.top() <= b.bottom() && b.top() <= a.bottom();
+  }
+
+private:
+  struct Node {
+    QRectF bbox;
+    // Range of the children in the level below (or, for leaves, in _order)
+    int first;
+    int count;
+  };
+
+  // Groups `rects` into nodes of at most `capacity` elements; on return,
+  // `order` holds the indices of `rects` in the order they were grouped in
+  static QVector<Node> pack(const QVector<QRectF> & rects, const int capacity, QVector<int> & order);
+
+  template<typename Predicate>
+  void query(const Predicate & test, QVector<int> & result) const;
+
+  // The rectangles (normalized) in the order they were passed in
+  QVector<QRectF> _rects;
+  // Indices into _rects in the order the leaves reference them
+  QVector<int> _order;
+  // _levels[0] are the leaves, _levels.last() holds only the root
+  QVector< QVector<Node> > _levels;
+};
+
+} // namespace QtPDF
+
+#endif // End header guard
+// vim: set sw=2 ts=2 et
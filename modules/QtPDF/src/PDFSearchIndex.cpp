@@ -0,0 +1,365 @@
+/**
+ * Copyright (C) 2022  Charlie Sharpsteen, Stefan Löffler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+
+#include "PDFSearchIndex.h"
+
+#include <QRegularExpression>
+#include <QSet>
+
+#include <algorithm>
+
+namespace QtPDF {
+
+namespace Backend {
+
+#if QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
+constexpr auto SkipEmptyParts = QString::SkipEmptyParts;
+#else
+constexpr auto SkipEmptyParts = Qt::SkipEmptyParts;
+#endif
+
+void PDFSearchIndex::update(Document & doc, const std::atomic<bool> * abort /* = nullptr */)
+{
+  if (!doc.isValid() || doc.isLocked())
+    return;
+
+  const int numPages = doc.numPages();
+  unsigned int generation{0};
+  {
+    QWriteLocker locker(&_lock);
+    generation = _generation;
+    for (int i = numPages; i < _pages.size(); ++i)
+      removePostings(i);
+    _pages.resize(numPages);
+  }
+
+  for (int i = 0; i < numPages; ++i) {
+    if (abort && *abort)
+      return;
+    const QSharedPointer<Page> page = doc.page(i).toStrongRef();
+    if (!page)
+      continue;
+    // Extracting the text layer is the expensive part. Changed pages are
+    // replaced by new objects (see Document::reload()), so pages that were
+    // indexed before and still exist need not be looked at again.
+    {
+      QReadLocker locker(&_lock);
+      if (i >= _pages.size() || (_pages[i].indexed && _pages[i].page.toStrongRef() == page))
+        continue;
+    }
+    IndexedPage indexedPage = indexPage(page->textLayer());
+    indexedPage.page = page;
+
+    QWriteLocker locker(&_lock);
+    if (i >= _pages.size())
+      continue;
+    removePostings(i);
+    _pages[i] = indexedPage;
+    addPostings(i);
+  }
+
+  QWriteLocker locker(&_lock);
+  _upToDate = (generation == _generation && _pages.size() == numPages);
+}
+
+void PDFSearchIndex::invalidate()
+{
+  QWriteLocker locker(&_lock);
+  _upToDate = false;
+  ++_generation;
+}
+
+void PDFSearchIndex::clear()
+{
+  QWriteLocker locker(&_lock);
+  _pages.clear();
+  _postings.clear();
+  _upToDate = false;
+  ++_generation;
+}
+
+bool PDFSearchIndex::isUpToDate() const
+{
+  QReadLocker locker(&_lock);
+  return _upToDate;
+}
+
+int PDFSearchIndex::numIndexedPages() const
+{
+  QReadLocker locker(&_lock);
+  int retVal = 0;
+  foreach(const IndexedPage & page, _pages) {
+    if (page.indexed)
+      ++retVal;
+  }
+  return retVal;
+}
+
+QList<SearchResult> PDFSearchIndex::search(const QString & searchText, const SearchFlags & flags, const int startPage /* = 0 */) const
+{
+  QList<SearchResult> results;
+
+  QStringList tokens, foldedTokens;
+  if (!tokenize(searchText, tokens, foldedTokens))
+    return results;
+
+  QList<Match> matches;
+  {
+    QReadLocker locker(&_lock);
+    const QString & first = foldedTokens.first();
+    if (flags.testFlag(Search_WholeWords)) {
+      foreach(const Posting & posting, _postings.value(first))
+        matchAt(_pages[posting.page], posting.page, posting.word, tokens, foldedTokens, flags, matches);
+    }
+    else {
+      // The vocabulary of a document is much smaller than its text, so
+      // scanning it for (partially) matching words is still fast
+      for (QHash< QString, QVector<Posting> >::const_iterator it = _postings.constBegin(); it != _postings.constEnd(); ++it) {
+        if (tokens.size() == 1 ? !it.key().contains(first) : !it.key().endsWith(first))
+          continue;
+        foreach(const Posting & posting, it.value())
+          matchAt(_pages[posting.page], posting.page, posting.word, tokens, foldedTokens, flags, matches);
+      }
+    }
+  }
+
+  std::sort(matches.begin(), matches.end(), [](const Match & a, const Match & b) {
+    if (a.page != b.page)
+      return a.page < b.page;
+    if (a.word != b.word)
+      return a.word < b.word;
+    return a.start < b.start;
+  });
+  const bool backwards = flags.testFlag(Search_Backwards);
+  if (backwards)
+    std::reverse(matches.begin(), matches.end());
+
+  // Results on pages before `startPage` (in search direction) are only
+  // reported when wrapping around
+  QList<SearchResult> wrappedResults;
+  foreach(const Match & match, matches) {
+    const bool wrapped = (backwards ? match.page > startPage : match.page < startPage);
+    if (wrapped && !flags.testFlag(Search_WrapAround))
+      continue;
+    SearchResult result;
+    result.pageNum = static_cast<unsigned int>(match.page);
+    foreach(const QRectF & box, match.boxes) {
+      result.bbox = box;
+      (wrapped ? wrappedResults : results) << result;
+    }
+  }
+  return results + wrappedResults;
+}
+
+// static
+QList<SearchResult> PDFSearchIndex::searchTextLayer(const QSharedPointer<const Page::TextLayer> & layer, const int pageNum, const QString & searchText, const SearchFlags & flags)
+{
+  QList<SearchResult> results;
+
+  QStringList tokens, foldedTokens;
+  if (!layer || !tokenize(searchText, tokens, foldedTokens))
+    return results;
+
+  const IndexedPage indexedPage = indexPage(layer);
+  QList<Match> matches;
+  for (int i = 0; i < indexedPage.words.size(); ++i)
+    matchAt(indexedPage, pageNum, i, tokens, foldedTokens, flags, matches);
+  // Matches are found in reading order
+  if (flags.testFlag(Search_Backwards))
+    std::reverse(matches.begin(), matches.end());
+
+  SearchResult result;
+  result.pageNum = static_cast<unsigned int>(pageNum);
+  foreach(const Match & match, matches) {
+    foreach(const QRectF & box, match.boxes) {
+      result.bbox = box;
+      results << result;
+    }
+  }
+  return results;
+}
+
+// static
+QString PDFSearchIndex::foldedText(const QString & text)
+{
+  return text.normalized(QString::NormalizationForm_KC).toCaseFolded();
+}
+
+// static
+bool PDFSearchIndex::tokenize(const QString & searchText, QStringList & tokens, QStringList & foldedTokens)
+{
+  tokens = searchText.normalized(QString::NormalizationForm_KC).split(QRegularExpression(QStringLiteral("\\s+")), SkipEmptyParts);
+  foldedTokens.clear();
+  foreach(const QString & token, tokens) {
+    foldedTokens << foldedText(token);
+    if (foldedTokens.last().isEmpty())
+      return false;
+  }
+  return !tokens.isEmpty();
+}
+
+// static
+PDFSearchIndex::IndexedPage PDFSearchIndex::indexPage(const QSharedPointer<const Page::TextLayer> & layer)
+{
+  IndexedPage retVal;
+  retVal.indexed = true;
+  retVal.words.reserve(layer->words.size());
+  foreach(const Page::TextLayer::Word & word, layer->words) {
+    // Fold the word one character at a time to keep track of which characters
+    // the folded ones originate from; ligatures, e.g., expand to several
+    // characters, but have only one bounding box
+    IndexedWord indexedWord;
+    bool sameLength = true;
+    for (int i = 0; i < word.text.length(); ) {
+      const int n = (word.text[i].isHighSurrogate() && i + 1 < word.text.length() ? 2 : 1);
+      const QString folded = foldedText(word.text.mid(i, n));
+      sameLength = sameLength && (folded.length() == n);
+      for (int j = 0; j < folded.length(); ++j)
+        indexedWord.origins << i;
+      indexedWord.folded += folded;
+      i += n;
+    }
+    if (sameLength)
+      indexedWord.origins.clear();
+    else
+      indexedWord.origins << static_cast<int>(word.text.length());
+    indexedWord.text = word.text;
+    indexedWord.boundingBox = word.boundingBox;
+    indexedWord.charBoxes = word.charBoxes;
+    indexedWord.line = word.line;
+    retVal.words << indexedWord;
+  }
+  return retVal;
+}
+
+// static
+QRectF PDFSearchIndex::wordRangeBox(const IndexedWord & word, const int start, const int end, int * origStart /* = nullptr */, int * origEnd /* = nullptr */)
+{
+  int first = start, last = end;
+  if (!word.origins.isEmpty()) {
+    first = word.origins[start];
+    // NB: If only part of an expanded character (e.g., of a ligature) is
+    // matched, the whole character is included
+    last = qMax(word.origins[end], word.origins[end - 1] + 1);
+  }
+  if (origStart)
+    *origStart = first;
+  if (origEnd)
+    *origEnd = last;
+
+  if (word.charBoxes.size() != word.text.length())
+    return word.boundingBox;
+  QRectF retVal;
+  for (int i = first; i < last; ++i)
+    retVal |= word.charBoxes[i];
+  return retVal;
+}
+
+void PDFSearchIndex::removePostings(const int page)
+{
+  // Words typically occur several times on a page, but all postings of the
+  // page can be removed from a posting list in one go
+  QSet<QString> words;
+  foreach(const IndexedWord & word, _pages[page].words)
+    words.insert(word.folded);
+  foreach(const QString & word, words) {
+    QHash< QString, QVector<Posting> >::iterator it = _postings.find(word);
+    if (it == _postings.end())
+      continue;
+    it.value().erase(std::remove_if(it.value().begin(), it.value().end(), [page](const Posting & posting) { return posting.page == page; }), it.value().end());
+    if (it.value().isEmpty())
+      _postings.erase(it);
+  }
+}
+
+void PDFSearchIndex::addPostings(const int page)
+{
+  const QVector<IndexedWord> & words = _pages[page].words;
+  for (int i = 0; i < words.size(); ++i) {
+    if (!words[i].folded.isEmpty())
+      _postings[words[i].folded].append(Posting{page, i});
+  }
+}
+
+// static
+void PDFSearchIndex::matchAt(const IndexedPage & indexedPage, const int page, const int word, const QStringList & tokens, const QStringList & foldedTokens, const SearchFlags & flags, QList<Match> & matches)
+{
+  const int numTokens = static_cast<int>(foldedTokens.size());
+  if (word + numTokens > indexedPage.words.size())
+    return;
+
+  // Finds the range [start, end) of `foldedTokens[i]` in word `word + i`. A
+  // search term consisting of several tokens must end the first word, match
+  // all intermediate ones, and start the last one.
+  auto findToken = [&](const int i, const int from, int & start, int & end) {
+    const QString & folded = indexedPage.words[word + i].folded;
+    const QString & token = foldedTokens[i];
+    if (flags.testFlag(Search_WholeWords) || (i > 0 && i < numTokens - 1))
+      start = (folded == token && from == 0 ? 0 : -1);
+    else if (numTokens == 1)
+      start = static_cast<int>(folded.indexOf(token, from));
+    else if (i == 0)
+      start = (folded.endsWith(token) && from == 0 ? static_cast<int>(folded.length() - token.length()) : -1);
+    else
+      start = (folded.startsWith(token) && from == 0 ? 0 : -1);
+    end = start + static_cast<int>(token.length());
+    return (start >= 0);
+  };
+
+  // A single token can occur several times in one word; several tokens can
+  // only match in one way
+  int from = 0, start = 0, end = 0;
+  while (findToken(0, from, start, end)) {
+    from = end;
+
+    Match match;
+    match.page = page;
+    match.word = word;
+    match.start = start;
+    QRectF lineBox;
+    int line = indexedPage.words[word].line;
+    bool ok = true;
+    for (int i = 0; i < numTokens && ok; ++i) {
+      if (i > 0)
+        ok = findToken(i, 0, start, end);
+      if (!ok)
+        break;
+      const IndexedWord & indexedWord = indexedPage.words[word + i];
+      int origStart = 0, origEnd = 0;
+      const QRectF box = wordRangeBox(indexedWord, start, end, &origStart, &origEnd);
+      // The index is case insensitive, so case sensitive matches need to be
+      // verified against the original text
+      if (!flags.testFlag(Search_CaseInsensitive))
+        ok = (indexedWord.text.mid(origStart, origEnd - origStart).normalized(QString::NormalizationForm_KC) == tokens[i]);
+      if (indexedWord.line != line) {
+        match.boxes << lineBox;
+        lineBox = QRectF();
+        line = indexedWord.line;
+      }
+      lineBox |= box;
+    }
+    if (!ok)
+      continue;
+    match.boxes << lineBox;
+    matches << match;
+    if (numTokens > 1)
+      break;
+  }
+}
+
+} // namespace Backend
+
+} // namespace QtPDF
+
+// vim: set sw=2 ts=2 et
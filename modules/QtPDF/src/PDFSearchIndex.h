@@ -0,0 +1,143 @@
+/**
+ * Copyright (C) 2022  Charlie Sharpsteen, Stefan Löffler
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ */
+#ifndef PDFSearchIndex_H
+#define PDFSearchIndex_H
+
+#include "PDFBackend.h"
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
+
+#include <atomic>
+
+namespace QtPDF {
+
+namespace Backend {
+
+// Inverted index of the text of all pages of a document. It is built from the
+// pages' text layers (see Page::textLayer()), typically in a background thread,
+// and answers searches without going through the pages (and the backend)
+// again. As the text layer of a page only changes if the page itself changed,
+// update() only needs to reindex those pages after a reload.
+//
+// Like Page::search(), search terms match anywhere inside words (unless
+// Search_WholeWords is given); whitespace in the search term matches word
+// boundaries.
+//
+// This class is thread-safe.
+class PDFSearchIndex
+{
+public:
+  PDFSearchIndex() = default;
+
+  // Brings the index up to date with `doc`, i.e., indexes all pages that are
+  // not indexed yet or whose text layer changed, and drops pages that no
+  // longer exist. This can take long for large documents, so it should be run
+  // in a background thread; it returns early (leaving the index incomplete) if
+  // `abort` becomes `true`.
+  // Uses whatever Document::page() and Page::textLayer() use.
+  void update(Document & doc, const std::atomic<bool> * abort = nullptr);
+  // Marks the index as outdated (e.g., because the document was reloaded)
+  // until the next complete update().
+  void invalidate();
+  void clear();
+
+  // Returns whether the last update() completed and the index has not been
+  // invalidated since, i.e., whether search() covers the whole document.
+  bool isUpToDate() const;
+  int numIndexedPages() const;
+
+  // Searches the index like Document::search(), i.e., starting at page
+  // `startPage` (backwards if Search_Backwards is given) and wrapping around
+  // the end of the document if Search_WrapAround is given. Matches that span
+  // several lines yield one result per line.
+  QList<SearchResult> search(const QString & searchText, const SearchFlags & flags, const int startPage = 0) const;
+
+  // Searches the text layer of page `pageNum` like search() searches the whole
+  // index (Search_WrapAround is meaningless here). This allows backends to
+  // search pages using their cached text layer (see Page::textLayer()) instead
+  // of extracting the text again.
+  static QList<SearchResult> searchTextLayer(const QSharedPointer<const Page::TextLayer> & layer, const int pageNum, const QString & searchText, const SearchFlags & flags);
+
+  // Returns `text` in case folded compatibility form (e.g., with ligatures
+  // expanded and "ß" turned into "ss"), which is what searches compare
+  static QString foldedText(const QString & text);
+
+private:
+  struct IndexedWord {
+    // The word in case folded compatibility form (see foldedText())
+    QString folded;
+    // Index of the character of the original word each character of `folded`
+    // originates from (plus the length of the original word at the end); empty
+    // if `folded` has the same length as the original word
+    QVector<int> origins;
+    // What matching needs of the original word (see Page::TextLayer::Word).
+    // NB: These are implicitly shared with the text layer while that exists.
+    QString text;
+    QRectF boundingBox;
+    QList<QRectF> charBoxes;
+    int line{0};
+  };
+  struct IndexedPage {
+    // The page that was indexed; it is only used to detect changes (see
+    // update()). The index keeps neither the pages nor their text layers
+    // alive as it only needs a fraction of the latter.
+    QWeakPointer<Page> page;
+    QVector<IndexedWord> words;
+    bool indexed{false};
+  };
+  // Position of a word in the document
+  struct Posting {
+    int page;
+    int word;
+  };
+  struct Match {
+    int page;
+    int word;
+    int start;
+    QList<QRectF> boxes;
+  };
+
+  // Splits `searchText` into `tokens` (at whitespace) and their folded forms
+  // (see foldedText()); returns `false` if there is nothing to search for
+  static bool tokenize(const QString & searchText, QStringList & tokens, QStringList & foldedTokens);
+  static IndexedPage indexPage(const QSharedPointer<const Page::TextLayer> & layer);
+  // Returns the bounding box of the characters of `word` the range
+  // [start, end) of its folded form originates from (and that range of
+  // characters in `origStart` and `origEnd`)
+  static QRectF wordRangeBox(const IndexedWord & word, const int start, const int end, int * origStart = nullptr, int * origEnd = nullptr);
+  // The caller must hold _lock and make sure `page` is valid.
+  void removePostings(const int page);
+  void addPostings(const int page);
+  static void matchAt(const IndexedPage & indexedPage, const int page, const int word, const QStringList & tokens, const QStringList & foldedTokens, const SearchFlags & flags, QList<Match> & matches);
+
+  mutable QReadWriteLock _lock;
+  QVector<IndexedPage> _pages;
+  // Maps each (folded) word to the places it occurs at
+  QHash< QString, QVector<Posting> > _postings;
+  bool _upToDate{false};
+  // Incremented by invalidate() to detect that an update() that is still
+  // running started before the invalidation
+  unsigned int _generation{0};
+};
+
+} // namespace Backend
+
+} // namespace QtPDF
+
+#endif // End header guard
+// vim: set sw=2 ts=2 et
@@ -411,7 +411,7 @@ void Document::reload()
   MuPDFLocaleResetter lr;
 
   clearPages();
-  _pageCache.markOutdated();
+  pageCache().markOutdated(_cacheId);
 
   if (_mupdf_data) {
     pdf_free_xref(_mupdf_data);
@@ -937,7 +937,7 @@ QImage Page::renderToImage(double xres, double yres, QRect render_box, bool cach
   fz_drop_pixmap(mu_image);
 
   if( cache ) {
-    PDFPageTile key(xres, yres, render_box, _n);
+    PDFPageTile key(xres, yres, render_box, _n, _parent->cacheId());
     QImage * img = new QImage(renderedPage.copy());
     if (img != _parent->pageCache().setImage(key, img, PDFPageCache::CURRENT))
       delete img;
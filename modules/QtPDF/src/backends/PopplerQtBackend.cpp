@@ -14,8 +14,12 @@
 
 // NOTE: `PopplerQtBackend.h` is included via `PDFBackend.h`
 #include "PDFBackend.h"
+#include "PDFGrayScale.h"
+#include "PDFSearchIndex.h"
 
-#include <QBitArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QFile>
 
 #if defined(HAVE_POPPLER_XPDF_HEADERS) && defined(Q_OS_DARWIN)
 #include "poppler-config.h"
@@ -25,14 +29,6 @@
 #include <memory>
 #endif
 
-// Comparison operator for QSizeF needed to use QSizeF as keys in a QMap
-// NB: Must be in the global namespace
-inline bool operator<(const QSizeF & a, const QSizeF & b) {
-    qreal areaA = a.width() * a.height();
-    qreal areaB = b.width() * b.height();
-    return (areaA < areaB || (areaA == areaB && a.width() < b.width()));
-}
-
 namespace QtPDF {
 
 namespace Backend {
@@ -139,16 +135,91 @@ void convertAnnotation(Annotation::AbstractAnnotation * dest, const ::Poppler::A
 }
 
 
+// Returns the fingerprint of page `n` of `doc` (see Document::pageFingerprint())
+// The caller must ensure that no other thread uses `doc` in the meantime.
+static QByteArray fingerprintPage(::Poppler::Document * doc, const int n)
+{
+  // Poppler does not give access to the raw content streams, and rendering
+  // the page (even at low resolution) is far too expensive for this. So we
+  // only fingerprint what is cheap to extract: the page geometry, the text,
+  // and the links. Changes that only affect graphics go unnoticed, but in
+  // typical (La)TeX documents, they are accompanied by changes of the text
+  // (e.g., of captions or references) anyway.
+  QSharedPointer< ::Poppler::Page > page(doc->page(n));
+  if (!page)
+    return QByteArray();
+
+  QByteArray data;
+  QDataStream stream(&data, QIODevice::WriteOnly);
+  stream << page->pageSizeF() << static_cast<int>(page->orientation()) << page->text(QRectF());
+
+  QList< ::Poppler::Link *> popplerLinks = page->links();
+  foreach(::Poppler::Link * popplerLink, popplerLinks) {
+    stream << static_cast<int>(popplerLink->linkType()) << popplerLink->linkArea();
+    switch (popplerLink->linkType()) {
+      case ::Poppler::Link::Goto:
+      {
+        ::Poppler::LinkGoto * popplerGoto = dynamic_cast< ::Poppler::LinkGoto *>(popplerLink);
+        stream << popplerGoto->destination().toString() << popplerGoto->fileName();
+        break;
+      }
+      case ::Poppler::Link::Execute:
+      {
+        ::Poppler::LinkExecute * popplerExecute = dynamic_cast< ::Poppler::LinkExecute *>(popplerLink);
+        stream << popplerExecute->fileName() << popplerExecute->parameters();
+        break;
+      }
+      case ::Poppler::Link::Browse:
+        stream << dynamic_cast< ::Poppler::LinkBrowse*>(popplerLink)->url();
+        break;
+      default:
+        break;
+    }
+  }
+  qDeleteAll(popplerLinks);
+
+  return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+}
+
+// Returns the contents of `fileName` (see Document::_fileData)
+static QByteArray readFile(const QString & fileName)
+{
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly))
+    return QByteArray();
+  return file.readAll();
+}
+
+// Applies the settings shared by all ::Poppler::Document instances of a
+// Document
+static void configurePopplerDocument(::Poppler::Document * doc)
+{
+  // **TODO:**
+  //
+  // _Make these configurable._
+  doc->setRenderBackend(::Poppler::Document::SplashBackend);
+  // Make things look pretty.
+  doc->setRenderHint(::Poppler::Document::Antialiasing);
+  doc->setRenderHint(::Poppler::Document::TextAntialiasing);
+}
+
+
 // Document Class
 // ==============
 Document::Document(const QString & fileName):
   Super(fileName),
-  _poppler_doc(::Poppler::Document::load(fileName))
+  _fileData(readFile(fileName)),
+  _poppler_doc(::Poppler::Document::loadFromData(_fileData))
 {
 #ifdef DEBUG
 //  qDebug() << "PopplerQt::Document::Document(" << fileName << ")";
 #endif
   parseDocument();
+
+  // Pages are rendered and searched using separate Poppler documents (see
+  // acquirePopplerDoc()); everything else is serialized by _poppler_docLock
+  QWriteLocker docLocker(_docLock.data());
+  setCapabilities(Capability_ParallelRendering);
 }
 
 Document::~Document()
@@ -160,6 +231,75 @@ Document::~Document()
   delete _poppler_docLock;
 }
 
+bool Document::prepareReload(const QList<PDFPageTile> & tiles)
+{
+  const QFileInfo fileInfo(fileName());
+
+  // The new file is loaded into a separate Poppler document that no other
+  // thread knows about, so it can be used without locking _poppler_docLock
+  PreparedReload prepared;
+  prepared.fileData = readFile(fileInfo.filePath());
+  prepared.doc = QSharedPointer< ::Poppler::Document >(::Poppler::Document::loadFromData(prepared.fileData));
+  // Encrypted files are unlocked with the password of the current file (if
+  // any), as in reload()
+  QByteArray password;
+  {
+    QReadLocker docLocker(_docLock.data());
+    password = _password;
+  }
+  if (prepared.doc && prepared.doc->isLocked() && !password.isEmpty())
+    prepared.doc->unlock(password, password);
+  if (!prepared.doc || prepared.doc->isLocked())
+    return false;
+  prepared.lastModified = fileInfo.lastModified();
+  prepared.fileSize = fileInfo.size();
+  configurePopplerDocument(prepared.doc.data());
+
+  const int numPages = prepared.doc->numPages();
+  prepared.pageSizes.resize(numPages);
+  for (int i = 0; i < numPages; ++i) {
+    QSharedPointer< ::Poppler::Page > page(prepared.doc->page(i));
+    if (page)
+      prepared.pageSizes[i] = page->pageSizeF();
+  }
+
+  {
+    QReadLocker docLocker(_docLock.data());
+    if (!_isValid() || _isLocked())
+      return false;
+    prepared.oldFingerprints = fingerprintCachedPages();
+  }
+  for (QMap<int, QByteArray>::const_iterator it = prepared.oldFingerprints.constBegin(); it != prepared.oldFingerprints.constEnd(); ++it) {
+    if (it.key() < numPages)
+      prepared.newFingerprints.insert(it.key(), fingerprintPage(prepared.doc.data(), it.key()));
+  }
+
+  foreach(const PDFPageTile & tile, tiles) {
+    if (tile.doc_id != _cacheId || tile.page_num < 0 || tile.page_num >= numPages)
+      continue;
+    QSharedPointer< ::Poppler::Page > page(prepared.doc->page(tile.page_num));
+    if (!page)
+      continue;
+    QImage img;
+    if (tile.render_box.isNull())
+      img = page->renderToImage(tile.xres, tile.yres);
+    else
+      img = page->renderToImage(tile.xres, tile.yres, tile.render_box.x(), tile.render_box.y(), tile.render_box.width(), tile.render_box.height());
+    // Gray scale tiles are derived from the rendering like in
+    // Page::getGrayScaleImage()
+    if (tile.grayscale && !img.isNull()) {
+      if (img.depth() != 32)
+        img = img.convertToFormat(QImage::Format_ARGB32);
+      convertToGrayScale(img);
+    }
+    prepared.tiles << qMakePair(tile, img);
+  }
+
+  QWriteLocker docLocker(_docLock.data());
+  _preparedReload = prepared;
+  return true;
+}
+
 void Document::reload()
 {
   // Clear the processing thread
@@ -171,18 +311,137 @@ void Document::reload()
 
   QWriteLocker docLocker(_docLock.data());
 
-  clearPages();
-  _pageCache.markOutdated();
+  PreparedReload prepared = _preparedReload;
+  _preparedReload = PreparedReload();
+  // Only use the prepared file if it was not changed again in the meantime
+  const QFileInfo fileInfo(_fileName);
+  if (prepared.doc && (fileInfo.lastModified() != prepared.lastModified || fileInfo.size() != prepared.fileSize))
+    prepared = PreparedReload();
+
+  // Fingerprinting pages takes time, so it is only done in the background by
+  // prepareReload(); without a prepared file, all pages are considered changed
+  const QMap<int, QByteArray> oldFingerprints = prepared.oldFingerprints;
+  // Keep the old document alive until all pages have been rebound to the new
+  // one
+  const QSharedPointer< ::Poppler::Document > oldDoc = _poppler_doc;
 
   {
     QMutexLocker l(_poppler_docLock);
-    _poppler_doc = QSharedPointer< ::Poppler::Document >(::Poppler::Document::load(_fileName));
+    if (prepared.doc) {
+      _fileData = prepared.fileData;
+      _poppler_doc = prepared.doc;
+    }
+    else {
+      _fileData = readFile(_fileName);
+      _poppler_doc = QSharedPointer< ::Poppler::Document >(::Poppler::Document::loadFromData(_fileData));
+    }
+    // Unlock the new file with the password of the old one (if any); it
+    // remains locked if the password changed
+    if (_poppler_doc && _poppler_doc->isLocked() && !_password.isEmpty())
+      _poppler_doc->unlock(_password, _password);
+  }
+  // The additional Poppler documents still hold the old file. No thread uses
+  // them at the moment as that requires a doc-read-lock.
+  {
+    QMutexLocker l(&_popplerDocsLock);
+    _freePopplerDocs.clear();
+    _numPopplerDocs = 0;
+    _popplerDocsFailed = false;
   }
-
-  // TODO: possibly unlock the new document again if it was previously unlocked
-  // and the password is still the same
 
   parseDocument();
+  if (prepared.doc && prepared.pageSizes.size() == _numPages) {
+    _pageSizes = prepared.pageSizes;
+    updateMetaPageSize();
+  }
+
+  // Typically, only a few pages change between two LaTeX runs. Keep the tiles
+  // and Page objects (with their links and annotations) of all others.
+  const QSet<int> unchanged = unchangedPages(oldFingerprints, prepared.newFingerprints);
+  clearPages(unchanged);
+  pageCache().markOutdated(_cacheId, unchanged);
+  // Tiles rendered in advance by prepareReload() are up to date right away
+  for (QList< QPair<PDFPageTile, QImage> >::const_iterator it = prepared.tiles.constBegin(); it != prepared.tiles.constEnd(); ++it)
+    pageCache().setImage(it->first, new QImage(it->second), PDFPageCache::CURRENT);
+
+  foreach(const int n, unchanged) {
+    // Not all pages with tiles necessarily have a Page object
+    if (n >= _pages.size() || _pages[n].isNull())
+      continue;
+    QSharedPointer<Page> page = _pages[n].staticCast<Page>();
+    QWriteLocker pageLocker(page->_pageLock);
+    QMutexLocker l(_poppler_docLock);
+    page->_poppler_page = QSharedPointer< ::Poppler::Page >(_poppler_doc->page(n));
+  }
+}
+
+QSharedPointer< ::Poppler::Document > Document::acquirePopplerDoc() const
+{
+  QMutexLocker l(&_popplerDocsLock);
+  // One Poppler document per processing thread is enough to keep all of them
+  // busy; more would only waste memory
+  const int maxDocs = qMax(1, QThread::idealThreadCount());
+  while (!_popplerDocsFailed && _freePopplerDocs.isEmpty() && _numPopplerDocs >= maxDocs)
+    _popplerDocAvailable.wait(&_popplerDocsLock);
+  if (_popplerDocsFailed)
+    return QSharedPointer< ::Poppler::Document >();
+  if (!_freePopplerDocs.isEmpty())
+    return _freePopplerDocs.takeLast();
+  ++_numPopplerDocs;
+  l.unlock();
+
+  // Loading from memory only parses the cross-reference table, so this is
+  // fast (and no file access is involved)
+  QSharedPointer< ::Poppler::Document > doc(::Poppler::Document::loadFromData(_fileData));
+  if (doc && doc->isLocked())
+    doc->unlock(_password, _password);
+  if (!doc || doc->isLocked()) {
+    // This won't work any better next time, so don't try again (until the
+    // file is reloaded or unlocked)
+    l.relock();
+    --_numPopplerDocs;
+    _popplerDocsFailed = true;
+    _popplerDocAvailable.wakeAll();
+    return QSharedPointer< ::Poppler::Document >();
+  }
+  configurePopplerDocument(doc.data());
+  return doc;
+}
+
+void Document::releasePopplerDoc(const QSharedPointer< ::Poppler::Document > & doc) const
+{
+  if (!doc)
+    return;
+  QMutexLocker l(&_popplerDocsLock);
+  _freePopplerDocs << doc;
+  _popplerDocAvailable.wakeOne();
+}
+
+QSizeF Document::fetchPageSize(const int at) const
+{
+  if (!_isValid() || _isLocked() || at < 0 || at >= _numPages)
+    return QSizeF();
+
+  QMutexLocker l(_poppler_docLock);
+  QSharedPointer< ::Poppler::Page > page(_poppler_doc->page(at));
+  return (page ? page->pageSizeF() : QSizeF());
+}
+
+QByteArray Document::pageFingerprint(const int n) const
+{
+  if (!_isValid() || _isLocked() || n < 0 || n >= _numPages)
+    return QByteArray();
+
+  // Use a separate Poppler document so that fingerprinting (in the background)
+  // does not block rendering and the like (in the GUI thread)
+  const QSharedPointer< ::Poppler::Document > doc = acquirePopplerDoc();
+  if (!doc) {
+    QMutexLocker l(_poppler_docLock);
+    return fingerprintPage(_poppler_doc.data(), n);
+  }
+  const QByteArray retVal = fingerprintPage(doc.data(), n);
+  releasePopplerDoc(doc);
+  return retVal;
 }
 
 void Document::parseDocument()
@@ -219,13 +478,7 @@ void Document::parseDocument()
   if (_poppler_doc->okToPrintHighRes())
     _permissions |= Permission_PrintHighRes;
 
-  // **TODO:**
-  //
-  // _Make these configurable._
-  _poppler_doc->setRenderBackend(::Poppler::Document::SplashBackend);
-  // Make things look pretty.
-  _poppler_doc->setRenderHint(::Poppler::Document::Antialiasing);
-  _poppler_doc->setRenderHint(::Poppler::Document::TextAntialiasing);
+  configurePopplerDocument(_poppler_doc.data());
 
   // Load meta data
   QStringList metaKeys = _poppler_doc->infoKeys();
@@ -262,20 +515,14 @@ void Document::parseDocument()
     metaKeys.removeAll(QString::fromUtf8("ModDate"));
   }
 
-  // Get the most often used page size
-  QMap<QSizeF, int> pageSizes;
-  for (int i = 0; i < _numPages; ++i) {
-    QSizeF ps = _poppler_doc->page(i)->pageSizeF();
-    if (pageSizes.contains(ps)) ++pageSizes[ps];
-    else pageSizes[ps] = 1;
-  }
-  int occurrences = -1;
+  // Enumerating all pages takes long for large documents, so page sizes are
+  // determined progressively (see loadPageSizes()). Until then, the size of
+  // the first page serves as an estimate for all others.
+  _pageSizes = QVector<QSizeF>(_numPages);
   _meta_pageSize = QSizeF();
-  Q_FOREACH(QSizeF ps, pageSizes.keys()) {
-      if (occurrences < pageSizes[ps]) {
-          _meta_pageSize = ps;
-          occurrences = pageSizes[ps];
-      }
+  if (_numPages > 0) {
+    _pageSizes[0] = fetchPageSize(0);
+    _meta_pageSize = _pageSizes[0];
   }
 
   // Note: Poppler doesn't handle the meta data key "Trapped" correctly, as that
@@ -520,11 +767,14 @@ bool Document::unlock(const QString password)
   // access is already granted.
   bool success = !_poppler_doc->unlock(password.toLatin1(), password.toLatin1());
 
-  if (success)
+  if (success) {
+    // The additional Poppler documents (see acquirePopplerDoc()) need the
+    // password as well, and so do reloaded files (see reload())
+    _password = password.toLatin1();
     parseDocument();
-
-  // FIXME: Store password for this session in case we need to reload the
-  // document later on (e.g., if it has changed on the disk)
+    QMutexLocker l(&_popplerDocsLock);
+    _popplerDocsFailed = false;
+  }
 
   return success;
 }
@@ -565,20 +815,30 @@ QImage Page::renderToImage(double xres, double yres, QRect render_box, bool cach
   QImage renderedPage;
 
   {
-    // Rendering pages is not thread safe.
-    QMutexLocker popplerDocLock(dynamic_cast<Backend::PopplerQt::Document *>(_parent)->_poppler_docLock);
+    // Rendering pages is not thread safe. To render several pages at once,
+    // each thread uses a separate Poppler document (if possible).
+    const Document * doc = dynamic_cast<const Document *>(_parent);
+    const QSharedPointer< ::Poppler::Document > popplerDoc = doc->acquirePopplerDoc();
+    QSharedPointer< ::Poppler::Page > popplerPage(popplerDoc ? popplerDoc->page(_n) : nullptr);
+    // Only the shared Poppler document needs to be locked
+    QMutexLocker popplerDocLock(popplerPage ? nullptr : doc->_poppler_docLock);
+    if (!popplerPage)
+      popplerPage = _poppler_page;
+
     if( render_box.isNull() ) {
       // A null QRect has a width and height of 0 --- we will tell Poppler to render the whole
       // page.
-      renderedPage = _poppler_page->renderToImage(xres, yres);
+      renderedPage = popplerPage->renderToImage(xres, yres);
     } else {
-      renderedPage = _poppler_page->renderToImage(xres, yres,
+      renderedPage = popplerPage->renderToImage(xres, yres,
           render_box.x(), render_box.y(), render_box.width(), render_box.height());
     }
+    popplerPage.clear();
+    doc->releasePopplerDoc(popplerDoc);
   }
 
   if( cache ) {
-    PDFPageTile key(xres, yres, render_box, _n);
+    PDFPageTile key(xres, yres, render_box, _n, _parent->cacheId());
     QImage * img = new QImage(renderedPage.copy());
     if (img != _parent->pageCache().setImage(key, img, PDFPageCache::CURRENT))
       delete img;
@@ -615,6 +875,93 @@ QList< QSharedPointer<Annotation::Link> > Page::loadLinks()
     popplerAnnots = _poppler_page->annotations();
   }
 
+  convertLinks(popplerLinks, popplerAnnots);
+  return _links;
+}
+
+QList< QSharedPointer<Annotation::AbstractAnnotation> > Page::loadAnnotations()
+{
+  {
+    QReadLocker pageLocker(_pageLock);
+
+    if (_annotationsLoaded)
+      return _annotations;
+  }
+
+  QReadLocker docLocker(_docLock.data());
+  QWriteLocker pageLocker(_pageLock);
+  // Check if the annotations were loaded in another thread in the meantime
+  if (_annotationsLoaded || !_poppler_page || !_parent)
+    return _annotations;
+
+  _annotationsLoaded = true;
+
+  QList< ::Poppler::Annotation *> popplerAnnots;
+  {
+    // Loading annotations is not thread safe.
+    QMutexLocker popplerDocLock(dynamic_cast<Document *>(_parent)->_poppler_docLock);
+    popplerAnnots = _poppler_page->annotations();
+  }
+
+  // we don't need the docLock anymore
+  docLocker.unlock();
+  convertAnnotations(popplerAnnots, pageLocker);
+  return _annotations;
+}
+
+void Page::loadLinksAndAnnotations(QList< QSharedPointer<Annotation::Link> > & links, QList< QSharedPointer<Annotation::AbstractAnnotation> > & annotations)
+{
+  {
+    QReadLocker pageLocker(_pageLock);
+    if (_linksLoaded && _annotationsLoaded) {
+      links = _links;
+      annotations = _annotations;
+      return;
+    }
+  }
+
+  QReadLocker docLocker(_docLock.data());
+  QWriteLocker pageLocker(_pageLock);
+  if (!_poppler_page || !_parent) {
+    links = _links;
+    annotations = _annotations;
+    return;
+  }
+
+  // Either may have been loaded individually (or in another thread) in the
+  // meantime
+  const bool needLinks = !_linksLoaded;
+  const bool needAnnotations = !_annotationsLoaded;
+  _linksLoaded = true;
+  _annotationsLoaded = true;
+
+  // Links and annotations are both built from Poppler's annotation list, which
+  // is comparatively expensive to extract (and can only be extracted by one
+  // thread at a time), so it is retrieved only once for both
+  QList< ::Poppler::Link *> popplerLinks;
+  QList< ::Poppler::Annotation *> popplerAnnots;
+  if (needLinks || needAnnotations) {
+    QMutexLocker popplerDocLock(dynamic_cast<Document *>(_parent)->_poppler_docLock);
+    if (needLinks)
+      popplerLinks = _poppler_page->links();
+    popplerAnnots = _poppler_page->annotations();
+  }
+
+  if (needLinks)
+    convertLinks(popplerLinks, popplerAnnots);
+  links = _links;
+
+  docLocker.unlock();
+  if (needAnnotations)
+    convertAnnotations(popplerAnnots, pageLocker);
+  annotations = _annotations;
+
+  qDeleteAll(popplerLinks);
+  qDeleteAll(popplerAnnots);
+}
+
+void Page::convertLinks(const QList< ::Poppler::Link *> & popplerLinks, const QList< ::Poppler::Annotation *> & popplerAnnots)
+{
   // Note: Poppler gives the linkArea in normalized coordinates, i.e., in the
   // range of 0..1, with y=0 at the top. We use pdf coordinates internally, so
   // we need to transform things accordingly.
@@ -693,35 +1040,10 @@ QList< QSharedPointer<Annotation::Link> > Page::loadLinks()
 
     _links << link;
   }
-  return _links;
 }
 
-QList< QSharedPointer<Annotation::AbstractAnnotation> > Page::loadAnnotations()
+void Page::convertAnnotations(const QList< ::Poppler::Annotation *> & popplerAnnots, QWriteLocker & pageLocker)
 {
-  {
-    QReadLocker pageLocker(_pageLock);
-
-    if (_annotationsLoaded)
-      return _annotations;
-  }
-
-  QReadLocker docLocker(_docLock.data());
-  QWriteLocker pageLocker(_pageLock);
-  // Check if the annotations were loaded in another thread in the meantime
-  if (_annotationsLoaded || !_poppler_page || !_parent)
-    return _annotations;
-
-  _annotationsLoaded = true;
-
-  QList< ::Poppler::Annotation *> popplerAnnots;
-  {
-    // Loading annotations is not thread safe.
-    QMutexLocker popplerDocLock(dynamic_cast<Document *>(_parent)->_poppler_docLock);
-    popplerAnnots = _poppler_page->annotations();
-  }
-
-  // we don't need the docLock anymore
-  docLocker.unlock();
   // we don't need the pageLock anymore (until we actually modify _annotations).
   // in fact, convertAnnotation tries to acquire a read lock at some point,
   // which fails while we hold a write lock here
@@ -797,45 +1119,19 @@ QList< QSharedPointer<Annotation::AbstractAnnotation> > Page::loadAnnotations()
     }
   }
   pageLocker.relock();
-  return _annotations;
 }
 
 QList<SearchResult> Page::search(const QString & searchText, const SearchFlags & flags) const
 {
-  QList<SearchResult> results;
-  SearchResult result;
-  double left{0}, right{0}, top{0}, bottom{0};
-  ::Poppler::Page::SearchDirection searchDir = (flags.testFlag(Search_Backwards) ? ::Poppler::Page::PreviousResult : ::Poppler::Page::NextResult);
-#if POPPLER_HAS_SEARCH_FLAGS
-  ::Poppler::Page::SearchFlags searchFlags = (flags.testFlag(Search_CaseInsensitive) ? ::Poppler::Page::IgnoreCase : ::Poppler::Page::SearchFlags());
-#else
-  ::Poppler::Page::SearchMode searchFlags = (flags.testFlag(Search_CaseInsensitive) ? ::Poppler::Page::CaseInsensitive : ::Poppler::Page::CaseSensitive);
-#endif
-
-  QReadLocker docLocker(_docLock.data());
-  QReadLocker pageLocker(_pageLock);
-  if (!_parent)
-    return results;
-
-  result.pageNum = static_cast<unsigned int>(_n);
-
-  QMutexLocker popplerDocLock(dynamic_cast<Document *>(_parent)->_poppler_docLock);
-
-  if (flags & Search_Backwards) {
-    left = right = pageSizeF().width();
-    top = bottom = pageSizeF().height();
-  }
-
-  // The Poppler search function that takes a QRectF has been marked as
-  // depreciated---something to do with float <-> double conversion causing
-  // infinite loops on some architectures. So, we explicitly use doubles and
-  // avoid the depreciated function.
-  while ( _poppler_page->search(searchText, left, top, right, bottom, searchDir, searchFlags) ) {
-    result.bbox = QRectF(qreal(left), qreal(top), qAbs(qreal(right) - qreal(left)), qAbs(qreal(bottom) - qreal(top)));
-    results << result;
-  }
-
-  return results;
+  // Searching the (cached) text layer is much faster than having Poppler
+  // extract the text of the page again. Most pages don't contain the search
+  // text at all; those are skipped right away.
+  // NB: This must happen without holding the page-read-lock as textLayer() may
+  // need a page-write-lock.
+  const QSharedPointer<const TextLayer> layer = textLayer();
+  if (!layer->mayContain(searchText))
+    return QList<SearchResult>();
+  return PDFSearchIndex::searchTextLayer(layer, _n, searchText, flags);
 }
 
 void Page::loadTransitionData()
@@ -925,133 +1221,44 @@ void Page::loadTransitionData()
   }
 }
 
-QList< Backend::Page::Box > Page::boxes() const
+Backend::Page::TextLayer Page::loadTextLayer() const
 {
+  TextLayer layer;
+  QReadLocker docLocker(_docLock.data());
   QReadLocker pageLocker(_pageLock);
-  Q_ASSERT(_poppler_page != nullptr);
-  QList< Backend::Page::Box > retVal;
+  if (!_parent || !_poppler_page)
+    return layer;
 
-  foreach (::Poppler::TextBox * popplerTextBox, _poppler_page->textList()) {
-    if (!popplerTextBox)
-      continue;
-    Backend::Page::Box box;
-    box.boundingBox = popplerTextBox->boundingBox();
-    for (int i = 0; i < popplerTextBox->text().length(); ++i) {
-      Backend::Page::Box subBox;
-      subBox.boundingBox = popplerTextBox->charBoundingBox(i);
-      box.subBoxes << subBox;
-    }
-    retVal << box;
+  // Like rendering, extracting the text uses a separate Poppler document (if
+  // possible) so that it does not block other pages (see renderToImage())
+  QList< ::Poppler::TextBox *> popplerBoxes;
+  {
+    const Document * doc = dynamic_cast<const Document *>(_parent);
+    const QSharedPointer< ::Poppler::Document > popplerDoc = doc->acquirePopplerDoc();
+    QSharedPointer< ::Poppler::Page > popplerPage(popplerDoc ? popplerDoc->page(_n) : nullptr);
+    // Only the shared Poppler document needs to be locked
+    QMutexLocker popplerDocLock(popplerPage ? nullptr : doc->_poppler_docLock);
+    if (!popplerPage)
+      popplerPage = _poppler_page;
+
+    popplerBoxes = popplerPage->textList();
+    popplerPage.clear();
+    doc->releasePopplerDoc(popplerDoc);
   }
-  return retVal;
-}
 
-QString Page::selectedText(const QList<QPolygonF> & selection, QMap<int, QRectF> * wordBoxes /* = nullptr */, QMap<int, QRectF> * charBoxes /* = nullptr */, const bool onlyFullyEnclosed /* = false */) const
-{
-  QReadLocker pageLocker(_pageLock);
-  Q_ASSERT(_poppler_page != nullptr);
-  // Using the bounding rects of the selection polygons is almost
-  // certainly wrong! However, poppler-qt4 doesn't offer any alternative AFAICS
-  // (except for positioning each char in the string manually).
-  // Since poppler doesn't add any space glyphs, the selection will contain a
-  // list of words. Hence, by iterating over them, we get a list of words with
-  // no whitespace inbetween
-  QString retVal;
-  bool insertSpace = false;
-
-  // Get a list of all boxes
-  QList<Poppler::TextBox*> poppler_boxes = _poppler_page->textList();
-  Poppler::TextBox * lastPopplerBox = nullptr;
-
-  // Filter boxes by selection
-  foreach (Poppler::TextBox * poppler_box, poppler_boxes) {
-    if (!poppler_box)
+  foreach (::Poppler::TextBox * popplerBox, popplerBoxes) {
+    if (!popplerBox)
       continue;
-
-    // Determine which characters to include (if any)
-    QBitArray include(poppler_box->text().length());
-    for (int i = 0; i < poppler_box->text().length(); ++i) {
-      QPolygonF remainder(poppler_box->charBoundingBox(i));
-      foreach (const QPolygonF & p, selection) {
-        // Include characters if they are entirely inside the selection area or
-        // onlyFullyEnclosed == false; using "intersection only" can cause
-        // problems for overlapping char boxes (if the selection is made of
-        // entire char boxes, it would return characters that are not actually
-        // inside the selection but are just "edge cases") but is necessary if
-        // the selection comes from external sources, such as SyncTeX
-        if (p.intersected(poppler_box->charBoundingBox(i)).empty())
-          continue;
-        if (!onlyFullyEnclosed) {
-          include.setBit(i);
-          break;
-        }
-        remainder = remainder.subtracted(p);
-        if (remainder.empty()) {
-          include.setBit(i);
-          break;
-        }
-      }
-    }
-    if (include.count(true) == 0) continue;
-
-    // If we get here, we found a box that is at least partially selected, so we
-    // append the appropriate text
-
-    // Guess ends of lines: if the new box is mostly below the old box (with the
-    // overlap being less than 20% of the height of the larger box), we assume
-    // it's a new line. This should work reasonably well for normal text
-    // (including RTL text), but may fail in some less common cases (e.g.,
-    // subscripts after superscripts, formulas, etc.).
-    if (lastPopplerBox && lastPopplerBox->boundingBox().bottom() - poppler_box->boundingBox().top() < 0.2 * qMax(lastPopplerBox->boundingBox().height(), poppler_box->boundingBox().height())) {
-      retVal += QString::fromLatin1("\n");
-
-      if (wordBoxes)
-        (*wordBoxes)[wordBoxes->count()] = lastPopplerBox->boundingBox();
-      if (charBoxes)
-        (*charBoxes)[charBoxes->count()] = lastPopplerBox->boundingBox();
-      // If we queued a space to be inserted, ignore that as we inserted a
-      // newline instead anyway
-      insertSpace = false;
-    }
-
-    if (insertSpace && lastPopplerBox) {
-      retVal += QString::fromLatin1(" ");
-
-      // As word and char Boxes, insert those of the lastPopplerBox since that
-      // was the one causing insertSpace to be true
-      if (wordBoxes)
-        (*wordBoxes)[wordBoxes->count()] = lastPopplerBox->boundingBox();
-      if (charBoxes)
-        (*charBoxes)[charBoxes->count()] = lastPopplerBox->boundingBox();
-    }
-
-    // Default to not inserting a space after this word
-    insertSpace = false;
-
-    // Insert the actual characters
-    for (int i = 0; i < poppler_box->text().length(); ++i) {
-      if (!include.testBit(i)) continue;
-
-      retVal += poppler_box->text()[i];
-
-      if (wordBoxes)
-        (*wordBoxes)[wordBoxes->count()] = poppler_box->boundingBox();
-      if (charBoxes)
-        (*charBoxes)[charBoxes->count()] = poppler_box->charBoundingBox(i);
-
-      // If we reached the end of the word, possibly queue a space to be
-      // inserted. By queuing this until the next word is processed, we ensure
-      // that spaces are not inserted at the end of the string or before
-      // newlines
-      if (i == poppler_box->text().length() - 1)
-        insertSpace = poppler_box->hasSpaceAfter();
-    }
-    // Remember the last processed box (required for detecting newlines and
-    // inserting spaces)
-    lastPopplerBox = poppler_box;
+    TextLayer::Word word;
+    word.text = popplerBox->text();
+    word.boundingBox = popplerBox->boundingBox();
+    for (int i = 0; i < word.text.length(); ++i)
+      word.charBoxes << popplerBox->charBoundingBox(i);
+    word.hasSpaceAfter = popplerBox->hasSpaceAfter();
+    layer.words << word;
   }
-
-  return retVal;
+  qDeleteAll(popplerBoxes);
+  return layer;
 }
 
 } // namespace PopplerQt
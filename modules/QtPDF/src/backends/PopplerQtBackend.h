@@ -23,6 +23,8 @@
 
 #include "PDFBackend.h"
 
+#include <QDateTime>
+
 #if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
 #include <poppler-qt6.h>
 #else
@@ -43,7 +45,12 @@ class Document: public Backend::Document
   typedef Backend::Document Super;
   friend class Page;
 
+  // The contents of the file. All Poppler documents are loaded from this so
+  // that they are identical even if the file on disk changes in the meantime.
+  QByteArray _fileData;
   QSharedPointer< ::Poppler::Document > _poppler_doc;
+  // The password the document was unlocked with (if any)
+  QByteArray _password;
 
 #if POPPLER_HAS_OUTLINE
   void recursiveConvertToC(QList<PDFToCItem> & items, const QVector<Poppler::OutlineItem> & popplerItems) const;
@@ -60,11 +67,47 @@ protected:
   mutable QList<PDFFontInfo> _fonts;
   mutable bool _fontsLoaded{false};
 
+  // Additional Poppler documents that are used exclusively by one thread at a
+  // time so that pages can be rendered and searched in parallel (see
+  // acquirePopplerDoc())
+  mutable QMutex _popplerDocsLock;
+  mutable QWaitCondition _popplerDocAvailable;
+  mutable QList< QSharedPointer< ::Poppler::Document > > _freePopplerDocs;
+  mutable int _numPopplerDocs{0};
+  // Set once creating an additional Poppler document failed (e.g., because the
+  // document is locked); from then on, acquirePopplerDoc() doesn't try again
+  mutable bool _popplerDocsFailed{false};
+
+  // Everything prepareReload() did in advance for the next reload()
+  struct PreparedReload {
+    QByteArray fileData;
+    QSharedPointer< ::Poppler::Document > doc;
+    // To detect that the file changed again before reload() was called
+    QDateTime lastModified;
+    qint64 fileSize{-1};
+    QVector<QSizeF> pageSizes;
+    QMap<int, QByteArray> oldFingerprints;
+    QMap<int, QByteArray> newFingerprints;
+    QList< QPair<PDFPageTile, QImage> > tiles;
+  };
+  PreparedReload _preparedReload;
+
   // The following two methods are not thread-safe because they don't acquire a
   // read lock. This is to enable methods that have a write lock to use them.
   bool _isValid() const { return (_poppler_doc != nullptr); }
   bool _isLocked() const { return (_poppler_doc ? _poppler_doc->isLocked() : false); }
 
+  // Returns a Poppler document for the exclusive use of the calling thread
+  // (waiting for one to become available if necessary), or nullptr if none
+  // can be created; in that case, use _poppler_doc and _poppler_docLock. The
+  // document must be returned with releasePopplerDoc() before the
+  // doc-read-lock the caller must hold is released.
+  QSharedPointer< ::Poppler::Document > acquirePopplerDoc() const;
+  void releasePopplerDoc(const QSharedPointer< ::Poppler::Document > & doc) const;
+
+  QSizeF fetchPageSize(const int at) const override;
+  QByteArray pageFingerprint(const int n) const override;
+
 public:
   Document(const QString & fileName);
   ~Document() override;
@@ -72,6 +115,7 @@ public:
   bool isValid() const override { QReadLocker docLocker(_docLock.data()); return _isValid(); }
   bool isLocked() const override { QReadLocker docLocker(_docLock.data()); return _isLocked(); }
 
+  bool prepareReload(const QList<PDFPageTile> & tiles) override;
   void reload() override;
   bool unlock(const QString password) override;
 
@@ -98,10 +142,17 @@ class Page: public Backend::Page
   bool _linksLoaded{false};
 
   void loadTransitionData();
+  // Convert the Poppler objects and append them to _links or _annotations,
+  // respectively. Both require a doc-read-lock and a page-write-lock (the
+  // latter is held by `pageLocker`, which is temporarily released).
+  void convertLinks(const QList< ::Poppler::Link *> & popplerLinks, const QList< ::Poppler::Annotation *> & popplerAnnots);
+  void convertAnnotations(const QList< ::Poppler::Annotation *> & popplerAnnots, QWriteLocker & pageLocker);
 
 protected:
   Page(Document *parent, int at, QSharedPointer<QReadWriteLock> docLock);
 
+  TextLayer loadTextLayer() const override;
+
 public:
   ~Page() override;
 
@@ -111,8 +162,7 @@ public:
 
   QList< QSharedPointer<Annotation::Link> > loadLinks() override;
   QList< QSharedPointer<Annotation::AbstractAnnotation> > loadAnnotations() override;
-  QList< Backend::Page::Box > boxes() const override;
-  QString selectedText(const QList<QPolygonF> & selection, QMap<int, QRectF> * wordBoxes = nullptr, QMap<int, QRectF> * charBoxes = nullptr, const bool onlyFullyEnclosed = false) const override;
+  void loadLinksAndAnnotations(QList< QSharedPointer<Annotation::Link> > & links, QList< QSharedPointer<Annotation::AbstractAnnotation> > & annotations) override;
 
   QList<Backend::SearchResult> search(const QString & searchText, const SearchFlags & flags) const override;
 };
@@ -22,6 +22,15 @@
 #include "PaperSizes.h"
 #include "PhysicalUnits.h"
 
+#include <QPainter>
+#include <QPdfWriter>
+#include <QRegion>
+#include <QSemaphore>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QtConcurrent>
+#include <cmath>
+
 #ifdef USE_MUPDF
   typedef QtPDF::MuPDFBackend Backend;
 #elif USE_POPPLERQT
@@ -148,6 +157,230 @@ public:
 
 GenericPage::GenericPage(GenericDocument * parent, int at, QSharedPointer<QReadWriteLock> docLock) : QtPDF::Backend::Page(parent, at, docLock) { }
 
+// Gives access to the spatial tile index of PDFPageCache
+class InspectablePageCache : public QtPDF::Backend::PDFPageCache
+{
+public:
+  explicit InspectablePageCache(const qint64 maxSize) : QtPDF::Backend::PDFPageCache(maxSize) { }
+  int numIndexedPages() const {
+    QReadLocker l(&_indexLock);
+    return static_cast<int>(_tileIndex.size());
+  }
+  int numIndexedTiles() const {
+    QReadLocker l(&_indexLock);
+    int retVal = 0;
+    foreach(const auto & levels, _tileIndex) {
+      foreach(const TileLevel & level, levels)
+        retVal += static_cast<int>(level.tiles.size());
+    }
+    return retVal;
+  }
+};
+
+// Page whose renders block until they are allowed to proceed (see `proceed`)
+// so that pending render requests can be inspected
+class BlockingPage : public GenericPage
+{
+public:
+  BlockingPage(GenericDocument * parent, QSharedPointer<QReadWriteLock> docLock) : GenericPage(parent, 0, docLock) { }
+  QSizeF pageSizeF() const override { return {72, 72}; }
+  QImage renderToImage(double xres, double yres, QRect render_box = QRect(), bool cache = false) const override {
+    started.release();
+    proceed.acquire();
+    numRenders.ref();
+    QImage img(render_box.size(), QImage::Format_ARGB32);
+    img.fill(Qt::white);
+    if (cache && _parent)
+      _parent->pageCache().setImage(QtPDF::Backend::PDFPageTile(xres, yres, render_box, _n, _parent->cacheId()), new QImage(img), QtPDF::Backend::PDFPageCache::CURRENT);
+    return img;
+  }
+
+  mutable QSemaphore started, proceed;
+  mutable QAtomicInt numRenders{0};
+};
+
+class BlockingDocument : public GenericDocument
+{
+public:
+  BlockingDocument() {
+    _pages[0] = QSharedPointer<QtPDF::Backend::Page>(new BlockingPage(this, _docLock));
+  }
+  ~BlockingDocument() override {
+    // Let pending renders finish so the workers can quit
+    blockingPage()->proceed.release(1000);
+    _processingThread.clearWorkStack();
+  }
+  BlockingPage * blockingPage() const { return static_cast<BlockingPage*>(_pages[0].data()); }
+};
+
+// Page whose text layer consists of the given words (one per line, with a
+// 10 x 10 box per character)
+class TextLayerPage : public GenericPage
+{
+public:
+  TextLayerPage(GenericDocument * parent, QSharedPointer<QReadWriteLock> docLock, const QStringList & words) : GenericPage(parent, 0, docLock), words(words) { }
+  TextLayer loadTextLayer() const override {
+    numLoads.ref();
+    TextLayer retVal;
+    for (int i = 0; i < words.size(); ++i) {
+      TextLayer::Word word;
+      word.text = words[i];
+      for (int j = 0; j < word.text.length(); ++j)
+        word.charBoxes << QRectF(10 * j, 20 * i, 10, 10);
+      word.boundingBox = QRectF(0, 20 * i, 10 * word.text.length(), 10);
+      retVal.words << word;
+    }
+    return retVal;
+  }
+
+  QStringList words;
+  mutable QAtomicInt numLoads{0};
+};
+
+class TextLayerDocument : public GenericDocument
+{
+public:
+  explicit TextLayerDocument(const QStringList & words) {
+    _pages[0] = QSharedPointer<QtPDF::Backend::Page>(new TextLayerPage(this, _docLock, words));
+  }
+  TextLayerPage * textLayerPage() const { return static_cast<TextLayerPage*>(_pages[0].data()); }
+};
+
+// Page with `numLinks` (empty) links
+class LinksPage : public GenericPage
+{
+public:
+  LinksPage(GenericDocument * parent, QSharedPointer<QReadWriteLock> docLock, const int numLinks) : GenericPage(parent, 0, docLock), numLinks(numLinks) { }
+  QList<QSharedPointer<QtPDF::Annotation::Link> > loadLinks() override {
+    QList<QSharedPointer<QtPDF::Annotation::Link> > retVal;
+    for (int i = 0; i < numLinks; ++i)
+      retVal << QSharedPointer<QtPDF::Annotation::Link>(new QtPDF::Annotation::Link());
+    return retVal;
+  }
+
+  const int numLinks;
+};
+
+class LinksDocument : public GenericDocument
+{
+public:
+  explicit LinksDocument(const int numLinks) {
+    _pages[0] = QSharedPointer<QtPDF::Backend::Page>(new LinksPage(this, _docLock, numLinks));
+  }
+};
+
+// Document that determines page sizes without Page objects (see
+// Document::fetchPageSize()); reload() switches to the sizes in `nextSizes`
+class PageSizesDocument : public GenericDocument
+{
+public:
+  explicit PageSizesDocument(const QVector<QSizeF> & sizes) { setSizes(sizes); }
+  void reload() override { setSizes(nextSizes); }
+
+  QVector<QSizeF> nextSizes;
+  // Page whose size is only returned after reloading the document (as if that
+  // happened in another thread in the meantime)
+  int reloadAt{-1};
+  mutable QAtomicInt numFetches{0};
+
+protected:
+  QSizeF fetchPageSize(const int at) const override {
+    numFetches.ref();
+    if (at == reloadAt) {
+      PageSizesDocument * self = const_cast<PageSizesDocument*>(this);
+      self->reloadAt = -1;
+      self->reload();
+    }
+    return _sizes.value(at);
+  }
+
+private:
+  void setSizes(const QVector<QSizeF> & sizes) {
+    clearMetaData();
+    _sizes = sizes;
+    _numPages = sizes.size();
+    _pageSizes = QVector<QSizeF>(_numPages);
+    _pageSizes[0] = sizes[0];
+    _meta_pageSize = sizes[0];
+  }
+
+  QVector<QSizeF> _sizes;
+};
+
+// Counts the PDFPageRenderedEvents it receives
+class RenderListener : public QObject
+{
+public:
+  bool event(QEvent * event) override {
+    if (event->type() != QtPDF::Backend::PDFPageRenderedEvent::PageRenderedEvent)
+      return QObject::event(event);
+    ++numRendered;
+    return true;
+  }
+
+  int numRendered{0};
+};
+
+// Records the number of links of each PDFLinksLoadedEvent it receives
+class LinksListener : public QObject
+{
+public:
+  bool event(QEvent * event) override {
+    if (event->type() != QtPDF::Backend::PDFLinksLoadedEvent::LinksLoadedEvent)
+      return QObject::event(event);
+    numLinks << static_cast<QtPDF::Backend::PDFLinksLoadedEvent*>(event)->links.size();
+    return true;
+  }
+
+  QList<int> numLinks;
+};
+
+// Records the PDFAnnotationsLoadedEvents it receives
+class AnnotationsListener : public QObject
+{
+public:
+  bool event(QEvent * event) override {
+    if (event->type() != QtPDF::Backend::PDFAnnotationsLoadedEvent::AnnotationsLoadedEvent)
+      return QObject::event(event);
+    const QtPDF::Backend::PDFAnnotationsLoadedEvent * loaded = static_cast<QtPDF::Backend::PDFAnnotationsLoadedEvent*>(event);
+    links = loaded->links;
+    annotations = loaded->annotations;
+    pageNum = loaded->pageNum;
+    ++numLoaded;
+    return true;
+  }
+
+  QList< QSharedPointer<QtPDF::Annotation::Link> > links;
+  QList< QSharedPointer<QtPDF::Annotation::AbstractAnnotation> > annotations;
+  int pageNum{-1};
+  int numLoaded{0};
+};
+
+// Lets tests check a changed file explicitly instead of waiting for the
+// reload timer
+class ReloadCheckingScene : public QtPDF::PDFDocumentScene
+{
+public:
+  explicit ReloadCheckingScene(QSharedPointer<QtPDF::Backend::Document> doc) : QtPDF::PDFDocumentScene(doc, nullptr, 72, 72) { }
+  using QtPDF::PDFDocumentScene::fileChanged;
+  using QtPDF::PDFDocumentScene::checkChangedFile;
+};
+
+// Records the actions of the PDFActionEvents it receives (e.g., from clicks on
+// links)
+class ActionRecordingScene : public QGraphicsScene
+{
+public:
+  bool event(QEvent * event) override {
+    if (event->type() != QtPDF::PDFActionEvent::ActionEvent)
+      return QGraphicsScene::event(event);
+    actions << static_cast<QtPDF::PDFActionEvent*>(event)->action;
+    return true;
+  }
+
+  QList<const QtPDF::PDFAction*> actions;
+};
+
 inline void sleep(int ms)
 {
 #ifdef Q_OS_MACOS
@@ -167,6 +400,36 @@ inline void sleep(int ms)
 #endif
 }
 
+// Writes a PDF with one (A6) page per entry of `pageTexts` that shows the
+// respective text
+// Pages beyond those in `pageSizes` are A6
+static bool writePDF(const QString & fileName, const QStringList & pageTexts, const QList<QPageSize> & pageSizes = QList<QPageSize>())
+{
+  QPdfWriter writer(fileName);
+  writer.setPageSize(pageSizes.value(0, QPageSize(QPageSize::A6)));
+  writer.setResolution(72);
+  QPainter painter;
+  if (!painter.begin(&writer))
+    return false;
+  for (int i = 0; i < pageTexts.size(); ++i) {
+    if (i > 0) {
+      writer.setPageSize(pageSizes.value(i, QPageSize(QPageSize::A6)));
+      writer.newPage();
+    }
+    painter.drawText(QPointF(20, 40), pageTexts[i]);
+  }
+  return painter.end();
+}
+
+// Returns all text on page `n` of `doc`
+static QString pageText(const QSharedPointer<QtPDF::Backend::Document> & doc, const int n)
+{
+  QSharedPointer<QtPDF::Backend::Page> page = doc->page(n).toStrongRef();
+  if (!page)
+    return QString();
+  return page->selectedText(QList<QPolygonF>() << QPolygonF(QRectF(QPointF(0, 0), page->pageSizeF())));
+}
+
 QTestData & TestQtPDF::newDocTest(const char * tag)
 {
   return QTest::newRow(tag) << _docs[QString::fromUtf8(tag)];
@@ -208,6 +471,7 @@ void TestQtPDF::abstractBaseClasses()
   QCOMPARE(doc.permissions(), QtPDF::Backend::Document::Permissions());
   QCOMPARE(doc.isValid(), true);
   QCOMPARE(doc.isLocked(), false);
+  QCOMPARE(doc.prepareReload(QList<QtPDF::Backend::PDFPageTile>()), false);
   doc.reload();
   QCOMPARE(doc.unlock(QStringLiteral()), true);
   QCOMPARE(doc.toc(), QtPDF::Backend::PDFToC());
@@ -340,6 +604,36 @@ void TestQtPDF::isLocked()
   QCOMPARE(doc->isLocked(), expected);
 }
 
+void TestQtPDF::isCompleteFile_data()
+{
+  QTest::addColumn<QByteArray>("data");
+  QTest::addColumn<bool>("expected");
+
+  QFile file(QStringLiteral("base14-fonts.pdf"));
+  QVERIFY(file.open(QIODevice::ReadOnly));
+  const QByteArray data = file.readAll();
+
+  QTest::newRow("complete") << data << true;
+  QTest::newRow("trailing-whitespace") << data + "\r\n\n" << true;
+  QTest::newRow("empty") << QByteArray() << false;
+  QTest::newRow("truncated") << data.left(data.size() / 2) << false;
+  QTest::newRow("no-eof") << data.left(data.lastIndexOf("%%EOF")) << false;
+  QTest::newRow("no-startxref") << QByteArray(data).replace("startxref", "xxxxxxxxx") << false;
+  QTest::newRow("invalid-xref-offset") << data.left(data.lastIndexOf("startxref")) + "startxref\n99999999\n%%EOF\n" << false;
+}
+
+void TestQtPDF::isCompleteFile()
+{
+  QFETCH(QByteArray, data);
+  QFETCH(bool, expected);
+
+  QTemporaryFile file;
+  QVERIFY(file.open());
+  QCOMPARE(file.write(data), static_cast<qint64>(data.size()));
+  file.close();
+  QCOMPARE(QtPDF::Backend::Document::isCompleteFile(file.fileName()), expected);
+}
+
 void TestQtPDF::unlock_data()
 {
   // For testing unlock(), we must freshly load the pdf files each time to
@@ -1422,6 +1716,184 @@ void TestQtPDF::page_renderToImage()
   QVERIFY(render == ref);
 }
 
+void TestQtPDF::page_renderToImageConcurrently()
+{
+  pDoc doc = _docs[QStringLiteral("poppler-data")];
+#ifdef USE_POPPLERQT
+  QVERIFY(doc->capabilities().testFlag(QtPDF::Backend::Document::Capability_ParallelRendering));
+#endif
+  if (!doc->capabilities().testFlag(QtPDF::Backend::Document::Capability_ParallelRendering))
+    QSKIP("Backend does not support parallel rendering");
+
+  QSharedPointer<QtPDF::Backend::Page> page = doc->page(0).toStrongRef();
+  QVERIFY(page);
+  const QImage ref = page->renderToImage(72, 72);
+
+  // Rendering in several threads at once must give the same result
+  QList< QFuture<QImage> > renders;
+  for (int i = 0; i < 8; ++i)
+    renders << QtConcurrent::run([page]() { return page->renderToImage(72, 72); });
+  foreach(QFuture<QImage> render, renders)
+    QCOMPARE(render.result(), ref);
+}
+
+void TestQtPDF::page_getTileImageGrayScale()
+{
+  pDoc doc = _docs[QStringLiteral("poppler-data")];
+  QSharedPointer<QtPDF::Backend::Page> page = doc->page(0).toStrongRef();
+  QVERIFY(page);
+
+  QSharedPointer<QImage> color = page->getTileImage(nullptr, 36, 36);
+  QVERIFY(color);
+  const QImage colorCopy = color->copy();
+  QSharedPointer<QImage> gray = page->getTileImage(nullptr, 36, 36, QRect(), 0, true);
+  QVERIFY(gray);
+
+  QImage ref = color->copy();
+  QtPDF::Backend::convertToGrayScale(ref);
+  QCOMPARE(*gray, ref);
+  // The cached (color) tile must not be altered by the conversion
+  QCOMPARE(*color, colorCopy);
+
+  // Gray scale tiles are cached, too
+  QCOMPARE(page->getTileImage(nullptr, 36, 36, QRect(), 0, true), gray);
+  QCOMPARE(page->getTileImage(nullptr, 36, 36), color);
+
+  // Gray scale tiles converted from placeholders are outdated rather than
+  // placeholders themselves (nothing would ever discard them), and they are
+  // converted again once the tile was rendered
+  using namespace QtPDF::Backend;
+  RenderListener listener;
+  BlockingDocument blockingDoc;
+  BlockingPage * blockingPage = blockingDoc.blockingPage();
+  const PDFPageTile colorTile(72, 72, QRect(0, 0, 72, 72), 0, blockingDoc.cacheId());
+  const PDFPageTile grayTile(72, 72, QRect(0, 0, 72, 72), 0, blockingDoc.cacheId(), true);
+  QVERIFY(blockingPage->getTileImage(&listener, 72, 72, QRect(), 0, true));
+  QCOMPARE(blockingDoc.pageCache().getStatus(colorTile), PDFPageCache::PLACEHOLDER);
+  QCOMPARE(blockingDoc.pageCache().getStatus(grayTile), PDFPageCache::OUTDATED);
+  blockingPage->proceed.release();
+  QTRY_COMPARE(listener.numRendered, 1);
+  QVERIFY(blockingPage->getTileImage(&listener, 72, 72, QRect(), 0, true));
+  QCOMPARE(blockingDoc.pageCache().getStatus(grayTile), PDFPageCache::CURRENT);
+}
+
+void TestQtPDF::page_prefetchTileImage()
+{
+  using namespace QtPDF::Backend;
+
+  pDoc doc = _docs[QStringLiteral("poppler-data")];
+  QSharedPointer<Page> page = doc->page(0).toStrongRef();
+  QVERIFY(page);
+
+  // Use a resolution no other test uses so the tile is not cached yet
+  const double res = 17;
+  const PDFPageTile tile(res, res, QRectF(QPointF(0, 0), page->pageSizeF() * res / 72.).toAlignedRect(), 0, doc->cacheId());
+  QCOMPARE(doc->pageCache().getStatus(tile), PDFPageCache::UNKNOWN);
+
+  QCOMPARE(page->prefetchTileImage(res, res), true);
+  // Prefetching marks the tile as pending (unless it was rendered already);
+  // the rendered tile replaces the placeholder once it is done
+  const PDFPageCache::TileStatus status = doc->pageCache().getStatus(tile);
+  QVERIFY(status == PDFPageCache::PLACEHOLDER || status == PDFPageCache::CURRENT);
+  QTRY_COMPARE(doc->pageCache().getStatus(tile), PDFPageCache::CURRENT);
+  QTRY_COMPARE(doc->processingThread().numPendingRequests(), 0);
+
+  // Cached tiles are not requested again, and are returned by getTileImage()
+  QCOMPARE(page->prefetchTileImage(res, res), false);
+  QSharedPointer<QImage> img = page->getTileImage(nullptr, res, res);
+  QVERIFY(img);
+  QCOMPARE(img->size(), tile.render_box.size());
+}
+
+void TestQtPDF::page_prefetchTakeOver()
+{
+  using namespace QtPDF::Backend;
+
+  RenderListener listener;
+  BlockingDocument doc;
+  BlockingPage * page = doc.blockingPage();
+  PDFPageProcessingThread & processingThread = doc.processingThread();
+  QCOMPARE(processingThread.isSerialized(), true);
+  const PDFPageTile tile(72, 72, QRect(0, 0, 72, 72), 0, doc.cacheId());
+  const PDFPageTile tile2(144, 144, QRect(0, 0, 144, 144), 0, doc.cacheId());
+  const PDFPageTile tile3(36, 36, QRect(0, 0, 36, 36), 0, doc.cacheId());
+
+  // The prefetched tile is marked as pending and not requested again
+  QCOMPARE(page->prefetchTileImage(72, 72), true);
+  QCOMPARE(doc.pageCache().getStatus(tile), PDFPageCache::PLACEHOLDER);
+  QVERIFY(!doc.pageCache().getImage(tile));
+  QCOMPARE(page->prefetchTileImage(72, 72), false);
+  QVERIFY(page->started.tryAcquire(1, 5000));
+
+  // Requesting the tile while the prefetch request is being processed takes
+  // that request over (rather than rendering the tile again)
+  QSharedPointer<QImage> img = page->getTileImage(&listener, 72, 72);
+  QVERIFY(img);
+  QCOMPARE(img->size(), tile.render_box.size());
+  QCOMPARE(doc.pageCache().getStatus(tile), PDFPageCache::PLACEHOLDER);
+  QCOMPARE(processingThread.numPendingRequests(), 0);
+
+  // Queued prefetch requests are taken over as well
+  QCOMPARE(page->prefetchTileImage(144, 144), true);
+  QCOMPARE(processingThread.numPendingRequests(), 1);
+  page->getTileImage(&listener, 144, 144);
+  QCOMPARE(processingThread.numPendingRequests(), 1);
+
+  page->proceed.release(2);
+  QTRY_COMPARE(listener.numRendered, 2);
+  QCOMPARE(page->numRenders.loadAcquire(), 2);
+  QCOMPARE(doc.pageCache().getStatus(tile), PDFPageCache::CURRENT);
+  QCOMPARE(doc.pageCache().getStatus(tile2), PDFPageCache::CURRENT);
+  QVERIFY(page->started.tryAcquire(1, 5000));
+
+  // Outdated images remain as placeholders; the listener is notified even
+  // though getTileImage() returns such a placeholder right away
+  doc.pageCache().markOutdated(doc.cacheId());
+  const QSharedPointer<QImage> outdated = doc.pageCache().getImage(tile);
+  QVERIFY(outdated);
+  QCOMPARE(page->prefetchTileImage(72, 72), true);
+  QCOMPARE(doc.pageCache().getStatus(tile), PDFPageCache::PLACEHOLDER);
+  QVERIFY(page->started.tryAcquire(1, 5000));
+  QVERIFY(page->getTileImage(&listener, 72, 72) == outdated);
+  QCOMPARE(processingThread.numPendingRequests(), 0);
+
+  // Cancelled prefetch requests don't leave their placeholders behind
+  QCOMPARE(page->prefetchTileImage(36, 36), true);
+  QCOMPARE(doc.pageCache().getStatus(tile3), PDFPageCache::PLACEHOLDER);
+  processingThread.reprioritize([](PageProcessingRequest &) { return false; });
+  QCOMPARE(processingThread.numPendingRequests(), 0);
+  QCOMPARE(doc.pageCache().getStatus(tile3), PDFPageCache::UNKNOWN);
+
+  page->proceed.release();
+  QTRY_COMPARE(listener.numRendered, 3);
+  QCOMPARE(page->numRenders.loadAcquire(), 3);
+  QCOMPARE(doc.pageCache().getStatus(tile), PDFPageCache::CURRENT);
+
+  // Prefetch requests remember all objects (e.g., views) on whose behalf they
+  // were issued, even if the tile was pending already
+  QObject view1, view2;
+  QCOMPARE(page->prefetchTileImage(18, 18), true);
+  QVERIFY(page->started.tryAcquire(1, 5000));
+  QCOMPARE(page->prefetchTileImage(36, 36, QRect(), PageProcessingRequest::PrefetchPriority, &view1), true);
+  QCOMPARE(page->prefetchTileImage(36, 36, QRect(), PageProcessingRequest::PrefetchPriority, &view2), false);
+  QCOMPARE(processingThread.numPendingRequests(), 1);
+  QSet<const QObject*> prefetchedFor;
+  processingThread.reprioritize([&prefetchedFor](PageProcessingRequest & request) {
+    prefetchedFor = static_cast<PageProcessingRenderPageRequest&>(request).prefetchedFor;
+    return true;
+  });
+  QCOMPARE(prefetchedFor, QSet<const QObject*>() << &view1 << &view2);
+  // Cancelled requests are not coalesced with new ones
+  processingThread.reprioritize([](PageProcessingRequest &) { return false; });
+  QCOMPARE(processingThread.numPendingRequests(), 0);
+  QCOMPARE(page->prefetchTileImage(36, 36, QRect(), PageProcessingRequest::PrefetchPriority, &view1), true);
+  QCOMPARE(processingThread.numPendingRequests(), 1);
+
+  page->proceed.release(2);
+  QTRY_COMPARE(page->numRenders.loadAcquire(), 5);
+  QTRY_COMPARE(doc.pageCache().getStatus(tile3), PDFPageCache::CURRENT);
+}
+
 void TestQtPDF::page_loadLinks_data()
 {
   QTest::addColumn<pPage>("page");
@@ -1576,6 +2048,75 @@ void TestQtPDF::page_loadAnnotations()
   }
 }
 
+void TestQtPDF::page_loadLinksAndAnnotations()
+{
+  // Use a separate document so nothing has been loaded yet
+  Backend backend;
+  pDoc doc = backend.newDocument(QStringLiteral("annotations.pdf"));
+  QVERIFY(doc);
+  QSharedPointer<QtPDF::Backend::Page> page = doc->page(0).toStrongRef();
+  QVERIFY(page);
+  QSharedPointer<QtPDF::Backend::Page> refPage = _docs[QStringLiteral("annotations")]->page(0).toStrongRef();
+  QVERIFY(refPage);
+
+  QList< QSharedPointer<QtPDF::Annotation::Link> > links;
+  QList< QSharedPointer<QtPDF::Annotation::AbstractAnnotation> > annotations;
+  page->loadLinksAndAnnotations(links, annotations);
+
+  const QList< QSharedPointer<QtPDF::Annotation::Link> > refLinks = refPage->loadLinks();
+  QCOMPARE(links.size(), refLinks.size());
+  for (int i = 0; i < links.size(); ++i)
+    QCOMPARE(*(links[i]), *(refLinks[i]));
+  compareAnnotations(annotations, refPage->loadAnnotations());
+  if (QTest::currentTestFailed())
+    return;
+
+  // The individual functions return what was loaded in the batch
+  QCOMPARE(page->loadLinks(), links);
+  QCOMPARE(page->loadAnnotations(), annotations);
+
+  // Loading again (e.g., for another view) yields the same objects
+  QList< QSharedPointer<QtPDF::Annotation::Link> > links2;
+  QList< QSharedPointer<QtPDF::Annotation::AbstractAnnotation> > annotations2;
+  page->loadLinksAndAnnotations(links2, annotations2);
+  QCOMPARE(links2, links);
+  QCOMPARE(annotations2, annotations);
+}
+
+void TestQtPDF::page_asyncLoadAnnotations()
+{
+  // Use a separate document so nothing has been loaded yet
+  Backend backend;
+  pDoc doc = backend.newDocument(QStringLiteral("annotations.pdf"));
+  QVERIFY(doc);
+  QSharedPointer<QtPDF::Backend::Page> page = doc->page(0).toStrongRef();
+  QVERIFY(page);
+  QSharedPointer<QtPDF::Backend::Page> refPage = _docs[QStringLiteral("annotations")]->page(0).toStrongRef();
+  QVERIFY(refPage);
+
+  // The request is processed in the background and its result is posted to
+  // the listener
+  AnnotationsListener listener;
+  page->asyncLoadAnnotations(&listener);
+  QTRY_COMPARE(listener.numLoaded, 1);
+  QCOMPARE(listener.pageNum, 0);
+  QTRY_COMPARE(doc->processingThread().numPendingRequests(), 0);
+
+  const QList< QSharedPointer<QtPDF::Annotation::Link> > refLinks = refPage->loadLinks();
+  QCOMPARE(listener.links.size(), refLinks.size());
+  for (int i = 0; i < refLinks.size(); ++i)
+    QCOMPARE(*(listener.links[i]), *(refLinks[i]));
+  compareAnnotations(listener.annotations, refPage->loadAnnotations());
+  if (QTest::currentTestFailed())
+    return;
+
+  // The page keeps what was loaded in the background
+  QCOMPARE(page->loadLinks(), listener.links);
+  QCOMPARE(page->loadAnnotations(), listener.annotations);
+  QTest::qWait(50);
+  QCOMPARE(listener.numLoaded, 1);
+}
+
 void TestQtPDF::page_boxes_data()
 {
   QTest::addColumn<pPage>("page");
@@ -1600,6 +2141,87 @@ void TestQtPDF::page_boxes()
     QCOMPARE(boxes[iBox].boundingBox, bbox);
 }
 
+void TestQtPDF::page_textLayer()
+{
+  QSharedPointer<QtPDF::Backend::Page> page = _docs[QStringLiteral("base14-fonts")]->page(0).toStrongRef();
+  QVERIFY(page);
+
+  QSharedPointer<const QtPDF::Backend::Page::TextLayer> layer = page->textLayer();
+  QVERIFY(layer);
+  // The text layer is only extracted once
+  QCOMPARE(page->textLayer(), layer);
+
+  QVERIFY(!layer->words.isEmpty());
+  QVERIFY(layer->lineCount > 1);
+  int line = 0;
+  foreach(const QtPDF::Backend::Page::TextLayer::Word & word, layer->words) {
+    QCOMPARE(word.charBoxes.size(), word.text.length());
+    QVERIFY(word.line >= line);
+    QVERIFY(word.line < layer->lineCount);
+    line = word.line;
+  }
+  QCOMPARE(page->boxes().size(), layer->words.size());
+
+  QVERIFY(layer->mayContain(QStringLiteral("quick brown fox")));
+  QVERIFY(layer->mayContain(QStringLiteral("QUICKBROWN")));
+  QVERIFY(!layer->mayContain(QStringLiteral("xyzzy")));
+
+  // Pages are only skipped if searching them would not find anything, also
+  // when case folding changes the length of the text
+  TextLayerDocument doc(QStringList() << QString::fromUtf8("Straße"));
+  const QSharedPointer<const QtPDF::Backend::Page::TextLayer> foldedLayer = doc.page(0).toStrongRef()->textLayer();
+  foreach(const QString & needle, QStringList() << QStringLiteral("STRASSE") << QStringLiteral("strasse") << QString::fromUtf8("STRAßE")) {
+    QVERIFY(foldedLayer->mayContain(needle));
+    QCOMPARE(QtPDF::Backend::PDFSearchIndex::searchTextLayer(foldedLayer, 0, needle, QtPDF::Backend::Search_CaseInsensitive).size(), 1);
+  }
+  QVERIFY(!foldedLayer->mayContain(QStringLiteral("STRASSEN")));
+}
+
+void TestQtPDF::page_textLayerCache()
+{
+  using namespace QtPDF::Backend;
+
+  TextLayerCache & cache = TextLayerCache::globalCache();
+  const int oldMaxSize = cache.maxSize();
+  // Room for the text layers of two of the pages (each layer costs its number
+  // of words plus one)
+  cache.setMaxSize(8);
+  QList< QSharedPointer<TextLayerDocument> > docs;
+  for (int i = 0; i < 3; ++i)
+    docs << QSharedPointer<TextLayerDocument>(new TextLayerDocument(QStringList() << QStringLiteral("a") << QStringLiteral("b") << QStringLiteral("c")));
+  auto textLayer = [&docs](const int i) { return docs[i]->page(0).toStrongRef()->textLayer(); };
+
+  // Only the most recently used text layers are kept when nobody uses them
+  QWeakPointer<const Page::TextLayer> layer = textLayer(0);
+  QVERIFY(!layer.isNull());
+  textLayer(1);
+  QVERIFY(!layer.isNull());
+  textLayer(2);
+  QVERIFY(layer.isNull());
+  QCOMPARE(cache.size(), 8);
+
+  // Released layers are extracted again when needed
+  QCOMPARE(docs[0]->textLayerPage()->numLoads.loadAcquire(), 1);
+  QCOMPARE(textLayer(0)->words.size(), 3);
+  QCOMPARE(docs[0]->textLayerPage()->numLoads.loadAcquire(), 2);
+
+  // Layers in use are not released
+  const QSharedPointer<const Page::TextLayer> used = textLayer(1);
+  const int numLoads = docs[1]->textLayerPage()->numLoads.loadAcquire();
+  textLayer(0);
+  textLayer(2);
+  QCOMPARE(textLayer(1), used);
+  QCOMPARE(docs[1]->textLayerPage()->numLoads.loadAcquire(), numLoads);
+
+  // Layers are released along with their pages
+  layer = textLayer(2);
+  docs.removeLast();
+  QVERIFY(layer.isNull());
+  QCOMPARE(cache.size(), 4);
+
+  cache.setMaxSize(oldMaxSize);
+}
+
 void TestQtPDF::page_selectedText_data()
 {
   QTest::addColumn<pPage>("page");
@@ -1671,6 +2293,116 @@ void TestQtPDF::page_search()
   }
 }
 
+void TestQtPDF::searchIndex_data()
+{
+  QTest::addColumn<pDoc>("doc");
+  QTest::addColumn<QString>("needle");
+  QTest::addColumn<QtPDF::Backend::SearchFlags>("flags");
+
+  newDocTest("base14-fonts") << QStringLiteral("Times-Roman") << QtPDF::Backend::SearchFlags();
+  newDocTest("base14-fonts") << QStringLiteral("times-Roman") << QtPDF::Backend::SearchFlags();
+  newDocTest("base14-fonts") << QStringLiteral("times-Roman") << QtPDF::Backend::SearchFlags(QtPDF::Backend::Search_CaseInsensitive);
+  newDocTest("base14-fonts") << QStringLiteral("quick brown") << QtPDF::Backend::SearchFlags(QtPDF::Backend::Search_CaseInsensitive);
+  newDocTest("base14-fonts") << QStringLiteral("uick bro") << QtPDF::Backend::SearchFlags();
+  newDocTest("base14-fonts") << QStringLiteral("the lazy dog") << QtPDF::Backend::SearchFlags();
+}
+
+void TestQtPDF::searchIndex()
+{
+  QFETCH(pDoc, doc);
+  QFETCH(QString, needle);
+  QFETCH(QtPDF::Backend::SearchFlags, flags);
+
+  QtPDF::Backend::PDFSearchIndex index;
+  QVERIFY(!index.isUpToDate());
+  index.update(*doc);
+  QVERIFY(index.isUpToDate());
+  QCOMPARE(index.numIndexedPages(), doc->numPages());
+  if (doc->page(0).toStrongRef()->textLayer()->words.isEmpty())
+    QSKIP("Backend does not provide a text layer");
+
+  // The index must find the same text as the backend; boxes may differ
+  // slightly as they are assembled from the boxes of individual characters
+  QList<QtPDF::Backend::SearchResult> expected;
+  for (int i = 0; i < doc->numPages(); ++i)
+    expected << doc->page(i).toStrongRef()->search(needle, flags);
+  const QList<QtPDF::Backend::SearchResult> actual = index.search(needle, flags);
+
+  QCOMPARE(actual.size(), expected.size());
+  for (int i = 0; i < actual.size(); ++i) {
+    QCOMPARE(actual[i].pageNum, expected[i].pageNum);
+    QVERIFY(qAbs(actual[i].bbox.left() - expected[i].bbox.left()) < 0.5);
+    QVERIFY(qAbs(actual[i].bbox.right() - expected[i].bbox.right()) < 0.5);
+    QVERIFY(actual[i].bbox.intersects(expected[i].bbox));
+  }
+}
+
+void TestQtPDF::searchIndex_update()
+{
+  pDoc doc = _docs[QStringLiteral("base14-fonts")];
+  QtPDF::Backend::PDFSearchIndex index;
+  index.update(*doc);
+  if (doc->page(0).toStrongRef()->textLayer()->words.isEmpty())
+    QSKIP("Backend does not provide a text layer");
+
+  const QList<QtPDF::Backend::SearchResult> dogs = index.search(QStringLiteral("dog"), QtPDF::Backend::Search_WholeWords);
+  QVERIFY(!dogs.isEmpty());
+  QCOMPARE(index.search(QStringLiteral("do"), QtPDF::Backend::Search_WholeWords).size(), 0);
+  QCOMPARE(index.search(QStringLiteral("dog"), {}), dogs);
+
+  // Outdated indices are not used for searching, but can still be updated
+  index.invalidate();
+  QVERIFY(!index.isUpToDate());
+  index.update(*doc);
+  QVERIFY(index.isUpToDate());
+  QCOMPARE(index.search(QStringLiteral("dog"), QtPDF::Backend::Search_WholeWords), dogs);
+
+  // Aborted updates leave the index outdated
+  std::atomic<bool> abort{true};
+  index.invalidate();
+  index.update(*doc, &abort);
+  QVERIFY(!index.isUpToDate());
+
+  index.clear();
+  QCOMPARE(index.numIndexedPages(), 0);
+  QCOMPARE(index.search(QStringLiteral("dog"), {}), QList<QtPDF::Backend::SearchResult>());
+}
+
+void TestQtPDF::searchIndex_reload()
+{
+  using namespace QtPDF::Backend;
+
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString fileName = dir.filePath(QStringLiteral("index.pdf"));
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("dog cat dog dog") << QStringLiteral("dog")));
+
+  Backend backend;
+  pDoc doc = backend.newDocument(fileName);
+  QVERIFY(doc->isValid());
+  PDFSearchIndex index;
+  index.update(*doc);
+  QWeakPointer<const Page::TextLayer> layer = doc->page(0).toStrongRef()->textLayer();
+  if (layer.toStrongRef()->words.isEmpty())
+    QSKIP("Backend does not provide a text layer");
+  QCOMPARE(index.numIndexedPages(), 2);
+  QCOMPARE(index.search(QStringLiteral("dog"), Search_WholeWords).size(), 4);
+
+  // The index does not keep the text layers of outdated pages alive, and
+  // removes all their words when reindexing them
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("cat") << QStringLiteral("dog")));
+  doc->reload();
+  QVERIFY(layer.isNull());
+  index.invalidate();
+  index.update(*doc);
+  QVERIFY(index.isUpToDate());
+  QCOMPARE(index.numIndexedPages(), 2);
+  const QList<SearchResult> dogs = index.search(QStringLiteral("dog"), Search_WholeWords);
+  QCOMPARE(dogs.size(), 1);
+  QCOMPARE(dogs.first().pageNum, 1u);
+  QCOMPARE(index.search(QStringLiteral("cat"), Search_WholeWords).size(), 1);
+}
+
 void TestQtPDF::paperSize_data()
 {
   QTest::addColumn<QSizeF>("requestSize");
@@ -1869,6 +2601,7 @@ void TestQtPDF::pageTile()
   tiles.append({1., 1., QRect(0, 0, 6, 1), 0});
   tiles.append({1., 1., QRect(0, 0, 1, 7), 0});
   tiles.append({1., 1., QRect(0, 0, 1, 1), 8});
+  tiles.append({1., 1., QRect(0, 0, 1, 1), 0, 9});
 
   for (int i = 0; i < tiles.size(); ++i) {
     for (int j = i + 1; j < tiles.size(); ++j) {
@@ -1893,6 +2626,1212 @@ void TestQtPDF::pageTile()
 #endif
 }
 
+void TestQtPDF::pageCache()
+{
+  using namespace QtPDF::Backend;
+
+  PDFPageCache cache;
+  PDFPageTile placeholder(1., 1., QRect(0, 0, 1, 1), 0);
+  PDFPageTile current(1., 1., QRect(0, 0, 1, 1), 1);
+
+  QCOMPARE(cache.getStatus(placeholder), PDFPageCache::UNKNOWN);
+  cache.setImage(placeholder, new QImage(1, 1, QImage::Format_ARGB32), PDFPageCache::PLACEHOLDER);
+  cache.setImage(current, new QImage(1, 1, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.getStatus(placeholder), PDFPageCache::PLACEHOLDER);
+  QCOMPARE(cache.getStatus(current), PDFPageCache::CURRENT);
+
+  // Only placeholders are affected by discardPlaceholder()
+  cache.discardPlaceholder(placeholder);
+  cache.discardPlaceholder(current);
+  QCOMPARE(cache.getStatus(placeholder), PDFPageCache::OUTDATED);
+  QCOMPARE(cache.getStatus(current), PDFPageCache::CURRENT);
+  QVERIFY(!cache.getImage(placeholder).isNull());
+
+  // Tiles of different documents are kept apart
+  PDFPageTile otherDoc(1., 1., QRect(0, 0, 1, 1), 1, 2);
+  cache.setImage(otherDoc, new QImage(2, 2, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.getStatus(otherDoc), PDFPageCache::CURRENT);
+  QCOMPARE(cache.getImage(otherDoc)->size(), QSize(2, 2));
+  QCOMPARE(cache.getImage(current)->size(), QSize(1, 1));
+
+  QMap<unsigned int, qint64> sizes = cache.sizePerDocument();
+  QCOMPARE(sizes.size(), 2);
+  QCOMPARE(sizes.value(0), static_cast<qint64>(2 * 4));
+  QCOMPARE(sizes.value(2), static_cast<qint64>(4 * 4));
+  QCOMPARE(cache.size(), static_cast<qint64>(3 * 4));
+
+  // Tiles of unchanged pages are kept when a document is reloaded
+  PDFPageTile otherDocKept(1., 1., QRect(0, 0, 1, 1), 3, 2);
+  cache.setImage(otherDocKept, new QImage(1, 1, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  cache.markOutdated(2, QSet<int>() << 3);
+  QCOMPARE(cache.getStatus(otherDoc), PDFPageCache::OUTDATED);
+  QCOMPARE(cache.getStatus(otherDocKept), PDFPageCache::CURRENT);
+  QCOMPARE(cache.getStatus(current), PDFPageCache::CURRENT);
+  cache.clear(2);
+  QCOMPARE(cache.getStatus(otherDoc), PDFPageCache::UNKNOWN);
+  QVERIFY(cache.getImage(otherDoc).isNull());
+  QVERIFY(!cache.getImage(current).isNull());
+  QCOMPARE(cache.sizePerDocument().size(), 1);
+
+  cache.markOutdated();
+  QCOMPARE(cache.getStatus(current), PDFPageCache::OUTDATED);
+  cache.clear();
+  QCOMPARE(cache.getStatus(current), PDFPageCache::UNKNOWN);
+  QVERIFY(cache.getImage(current).isNull());
+
+  // Tiles (of any resolution) overlapping a given area of a page are found
+  // (sorted by resolution, highest first)
+  PDFPageTile lowRes(1., 1., QRect(0, 0, 10, 10), 5, 3);
+  PDFPageTile highRes(2., 2., QRect(10, 10, 10, 10), 5, 3);
+  PDFPageTile farAway(2., 2., QRect(100, 100, 10, 10), 5, 3);
+  PDFPageTile otherPage(1., 1., QRect(0, 0, 10, 10), 6, 3);
+  foreach(const PDFPageTile & tile, QList<PDFPageTile>() << lowRes << highRes << farAway << otherPage)
+    cache.setImage(tile, new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.overlappingTiles(3, 5, 1., 1., QRect(6, 6, 2, 2)), QList<PDFPageTile>() << highRes << lowRes);
+  QCOMPARE(cache.overlappingTiles(3, 5, 1., 1., QRect(0, 0, 2, 2)), QList<PDFPageTile>() << lowRes);
+  QCOMPARE(cache.overlappingTiles(3, 5, 2., 2., QRect(100, 100, 1, 1)), QList<PDFPageTile>() << farAway);
+  QCOMPARE(cache.overlappingTiles(3, 7, 1., 1., QRect(0, 0, 10, 10)), QList<PDFPageTile>());
+  cache.clear(3);
+  QCOMPARE(cache.overlappingTiles(3, 5, 1., 1., QRect(0, 0, 10, 10)), QList<PDFPageTile>());
+  QCOMPARE(cache.size(), static_cast<qint64>(0));
+}
+
+void TestQtPDF::pageCache_eviction()
+{
+  using namespace QtPDF::Backend;
+
+  // Room for three 10x10 ARGB32 tiles
+  PDFPageCache cache(3 * 400);
+  QList<PDFPageTile> tiles;
+  for (int i = 0; i < 4; ++i)
+    tiles << PDFPageTile(1., 1., QRect(0, 0, 10, 10), i);
+
+  for (int i = 0; i < 3; ++i)
+    cache.setImage(tiles[i], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.size(), static_cast<qint64>(3 * 400));
+
+  // Replacing an image does not change it for those still using it
+  const QSharedPointer<QImage> oldImage = cache.getImage(tiles[0]);
+  QImage * newImage = new QImage(10, 10, QImage::Format_ARGB32);
+  QCOMPARE(cache.setImage(tiles[0], newImage, PDFPageCache::CURRENT).data(), newImage);
+  QVERIFY(oldImage.data() != newImage);
+  QCOMPARE(cache.size(), static_cast<qint64>(3 * 400));
+
+  // The cost accounts for all pixels of high-dpi tiles
+  PDFPageCache hiDpiCache;
+  QImage * hiDpiImage = new QImage(20, 20, QImage::Format_ARGB32);
+  hiDpiImage->setDevicePixelRatio(2);
+  hiDpiCache.setImage(PDFPageTile(2., 2., QRect(0, 0, 20, 20), 0), hiDpiImage, PDFPageCache::CURRENT);
+  QCOMPARE(hiDpiCache.size(), static_cast<qint64>(20 * 20 * 4));
+
+  cache.clear();
+  QCOMPARE(cache.size(), static_cast<qint64>(0));
+
+  for (int i = 0; i < 3; ++i)
+    cache.setImage(tiles[i], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  cache.resetStatistics();
+
+  // Use tile 0 so tiles 1 and 2 become the least recently used ones. Making
+  // room evicts images until the cache is somewhat below its maximum size, so
+  // the next insertion doesn't need to evict again (i.e., here it evicts both)
+  QVERIFY(cache.getImage(tiles[0]));
+  cache.setImage(tiles[3], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.size(), static_cast<qint64>(2 * 400));
+  QVERIFY(cache.getImage(tiles[0]));
+  QVERIFY(!cache.getImage(tiles[1]));
+  QVERIFY(!cache.getImage(tiles[2]));
+  QVERIFY(cache.getImage(tiles[3]));
+  // Evicted tiles are forgotten altogether
+  QCOMPARE(cache.getStatus(tiles[1]), PDFPageCache::UNKNOWN);
+  QCOMPARE(cache.tiles().size(), 2);
+
+  PDFPageCache::Statistics stats = cache.statistics();
+  QCOMPARE(stats.hits, static_cast<qint64>(3));
+  QCOMPARE(stats.misses, static_cast<qint64>(2));
+  QCOMPARE(stats.evictions, static_cast<qint64>(2));
+
+  // Shrinking the cache evicts images right away (but only as many as needed)
+  cache.setMaxSize(400);
+  QCOMPARE(cache.size(), static_cast<qint64>(400));
+  QVERIFY(!cache.getImage(tiles[0]));
+  QVERIFY(cache.getImage(tiles[3]));
+  QCOMPARE(cache.statistics().evictions, static_cast<qint64>(3));
+  cache.resetStatistics();
+  QCOMPARE(cache.statistics().hits, static_cast<qint64>(0));
+
+  // Placeholders (of tiles that are still being rendered) keep their status
+  // until rendering finishes or is cancelled
+  cache.setImage(tiles[1], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::PLACEHOLDER);
+  cache.setImage(tiles[2], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QVERIFY(!cache.getImage(tiles[1]));
+  QCOMPARE(cache.getStatus(tiles[1]), PDFPageCache::PLACEHOLDER);
+  cache.discardPlaceholder(tiles[1]);
+  QCOMPARE(cache.getStatus(tiles[1]), PDFPageCache::UNKNOWN);
+
+  // The default size agrees with that of the global cache
+  QCOMPARE(PDFPageCache().maxSize(), static_cast<qint64>(PDFPageCache::DefaultMaxSize));
+}
+
+void TestQtPDF::pageCache_index()
+{
+  using namespace QtPDF::Backend;
+
+  // Room for three 10x10 ARGB32 tiles
+  InspectablePageCache cache(3 * 400);
+  QList<PDFPageTile> tiles;
+  for (int i = 0; i < 10; ++i)
+    tiles << PDFPageTile(1., 1., QRect(0, 0, 10, 10), i);
+  // A second resolution for the last page
+  tiles << PDFPageTile(2., 2., QRect(0, 0, 10, 10), 9);
+
+  // Evicted tiles are removed from the index, along with pages that have no
+  // tiles left
+  foreach(const PDFPageTile & tile, tiles)
+    cache.setImage(tile, new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.tiles().size(), 3);
+  QCOMPARE(cache.numIndexedTiles(), 3);
+  QCOMPARE(cache.numIndexedPages(), 2);
+  QCOMPARE(cache.overlappingTiles(0, 9, 1., 1., QRect(0, 0, 10, 10)), QList<PDFPageTile>() << tiles[10] << tiles[9]);
+  QCOMPARE(cache.overlappingTiles(0, 0, 1., 1., QRect(0, 0, 10, 10)), QList<PDFPageTile>());
+
+  // Evicting one of several resolutions of a page only drops that one
+  cache.getImage(tiles[9]);
+  cache.setImage(tiles[0], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.numIndexedTiles(), 2);
+  QCOMPARE(cache.numIndexedPages(), 2);
+  QCOMPARE(cache.overlappingTiles(0, 9, 1., 1., QRect(0, 0, 10, 10)), QList<PDFPageTile>() << tiles[9]);
+
+  // Outdated tiles are not indexed
+  cache.markOutdated(0, QSet<int>() << 9);
+  QCOMPARE(cache.numIndexedTiles(), 1);
+  QCOMPARE(cache.numIndexedPages(), 1);
+  QCOMPARE(cache.overlappingTiles(0, 0, 1., 1., QRect(0, 0, 10, 10)), QList<PDFPageTile>());
+  cache.setImage(tiles[0], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.numIndexedTiles(), 2);
+  cache.markOutdated();
+  QCOMPARE(cache.numIndexedTiles(), 0);
+  QCOMPARE(cache.numIndexedPages(), 0);
+
+  cache.setImage(tiles[0], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.numIndexedTiles(), 1);
+  cache.clear(0);
+  QCOMPARE(cache.numIndexedPages(), 0);
+
+  // Gray scale versions of tiles neither replace the color tiles in the index
+  // nor take them along when they are evicted
+  const PDFPageTile color(1., 1., QRect(0, 0, 10, 10), 0);
+  const PDFPageTile gray(1., 1., QRect(0, 0, 10, 10), 0, 0, true);
+  cache.setImage(color, new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  cache.setImage(gray, new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QCOMPARE(cache.numIndexedTiles(), 1);
+  QCOMPARE(cache.overlappingTiles(0, 0, 1., 1., QRect(0, 0, 10, 10)), QList<PDFPageTile>() << color);
+  cache.setImage(tiles[1], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  cache.getImage(color);
+  cache.setImage(tiles[2], new QImage(10, 10, QImage::Format_ARGB32), PDFPageCache::CURRENT);
+  QVERIFY(cache.getImage(gray).isNull());
+  QCOMPARE(cache.overlappingTiles(0, 0, 1., 1., QRect(0, 0, 10, 10)), QList<PDFPageTile>() << color);
+}
+
+void TestQtPDF::tileRenderBoxes()
+{
+  using namespace QtPDF::Backend;
+
+  // Small pages are rendered in one piece, regardless of the area
+  QCOMPARE(tileRenderBoxes(QSize(1000, 1400)), QList<QRect>() << QRect(0, 0, 1000, 1400));
+  QCOMPARE(tileRenderBoxes(QSize(1000, 1400), QRect(10, 10, 5, 5)), QList<QRect>() << QRect(0, 0, 1000, 1400));
+  QCOMPARE(tileRenderBoxes(QSize(1000, 1400), QRect(2000, 2000, 5, 5)), QList<QRect>());
+
+  // Larger pages are split into tiles that don't extend beyond the page
+  QCOMPARE(tileRenderBoxes(QSize(2500, 3000)).size(), 9);
+  QCOMPARE(tileRenderBoxes(QSize(2500, 3000), QRect(1000, 1000, 100, 100)), QList<QRect>() << QRect(0, 0, TileSize, TileSize) << QRect(TileSize, 0, TileSize, TileSize) << QRect(0, TileSize, TileSize, TileSize) << QRect(TileSize, TileSize, TileSize, TileSize));
+  QCOMPARE(tileRenderBoxes(QSize(2500, 3000), QRect(2400, 2900, 50, 50)), QList<QRect>() << QRect(2 * TileSize, 2 * TileSize, 2500 - 2 * TileSize, 3000 - 2 * TileSize));
+
+  // At very high zoom levels, tiles get smaller
+  QCOMPARE(tileRenderBoxes(QSize(20000, 30000), QRect(0, 0, 10, 10)), QList<QRect>() << QRect(0, 0, MinTileSize, MinTileSize));
+
+  // Tiles cover the whole area
+  const QSize pageSize(5000, 7000);
+  const QRect area(100, 1500, 3000, 2000);
+  QRegion covered;
+  foreach(const QRect & box, tileRenderBoxes(pageSize, area))
+    covered += box;
+  QVERIFY(covered.contains(area));
+}
+
+void TestQtPDF::renderTiles_data()
+{
+  QTest::addColumn<double>("zoom");
+  QTest::addColumn<double>("dpr");
+  QTest::addColumn<bool>("adaptive");
+  // Number of tiles needed to cover the viewport
+  QTest::addColumn<int>("tiles");
+
+  auto newRows = [](const double zoom, const double dpr, const int fixedTiles, const int adaptiveTiles) {
+    QTest::newRow(qPrintable(QStringLiteral("%1x-dpr%2-fixed").arg(zoom).arg(dpr))) << zoom << dpr << false << fixedTiles;
+    QTest::newRow(qPrintable(QStringLiteral("%1x-dpr%2-adaptive").arg(zoom).arg(dpr))) << zoom << dpr << true << adaptiveTiles;
+  };
+  // Up to 2048 x 2048 pixels, pages are rendered in one piece
+  newRows(0.25, 1., 1, 1);
+  newRows(0.5, 1., 1, 1);
+  newRows(1., 1., 1, 1);
+  newRows(2., 1., 2, 1);
+  newRows(4., 1., 2, 2);
+  newRows(0.25, 2., 1, 1);
+  newRows(0.5, 2., 2, 1);
+  newRows(1., 2., 4, 1);
+  newRows(2., 2., 6, 6);
+  newRows(4., 2., 6, 6);
+}
+
+// Benchmarks rendering what a 1280 x 800 viewport shows of a page at various
+// zoom levels, split into fixed-size tiles (as before) or into tiles as
+// chosen by tileRenderBoxes()
+void TestQtPDF::renderTiles()
+{
+  QFETCH(double, zoom);
+  QFETCH(double, dpr);
+  QFETCH(bool, adaptive);
+  QFETCH(int, tiles);
+
+  pDoc doc = _docs[QStringLiteral("pgfmanual")];
+  QSharedPointer<QtPDF::Backend::Page> page = doc->page(0).toStrongRef();
+  QVERIFY(page);
+
+  const double res = 96 * zoom * dpr;
+  const QSize pageSize = QRectF(QPointF(0, 0), page->pageSizeF() * res / 72.).toAlignedRect().size();
+  const QRect viewport = QRect(0, 0, qRound(1280 * dpr), qRound(800 * dpr)) & QRect(QPoint(0, 0), pageSize);
+
+  auto tilesFor = [&](const QRect & area) -> QList<QRect> {
+    if (adaptive)
+      return QtPDF::Backend::tileRenderBoxes(pageSize, area);
+    QList<QRect> retVal;
+    const int size = QtPDF::Backend::TileSize;
+    const QRect rect = (area.isNull() ? QRect(QPoint(0, 0), pageSize) : area);
+    for (int j = rect.top() / size; j <= rect.bottom() / size; ++j) {
+      for (int i = rect.left() / size; i <= rect.right() / size; ++i)
+        retVal << QRect(i * size, j * size, size, size);
+    }
+    return retVal;
+  };
+  const QList<QRect> boxes = tilesFor(viewport);
+  QCOMPARE(boxes.size(), tiles);
+
+  QBENCHMARK {
+    foreach(const QRect & tile, boxes)
+      page->renderToImage(res, res, tile);
+  }
+}
+
+void TestQtPDF::convertToGrayScale_data()
+{
+  QTest::addColumn<int>("format");
+  QTest::addColumn<int>("width");
+
+  // Widths that are not multiples of the vector sizes exercise the scalar
+  // processing of the remaining pixels
+  foreach(const int width, QList<int>() << 1 << 3 << 4 << 7 << 8 << 13 << 64 << 257) {
+    QTest::newRow(qPrintable(QStringLiteral("ARGB32-%1").arg(width))) << static_cast<int>(QImage::Format_ARGB32) << width;
+    QTest::newRow(qPrintable(QStringLiteral("ARGB32_Premultiplied-%1").arg(width))) << static_cast<int>(QImage::Format_ARGB32_Premultiplied) << width;
+    QTest::newRow(qPrintable(QStringLiteral("RGB32-%1").arg(width))) << static_cast<int>(QImage::Format_RGB32) << width;
+  }
+}
+
+void TestQtPDF::convertToGrayScale()
+{
+  QFETCH(int, format);
+  QFETCH(int, width);
+
+  // Fill the image with deterministic pseudo-random pixels
+  QImage img(width, 5, static_cast<QImage::Format>(format));
+  quint32 state = 12345;
+  for (int y = 0; y < img.height(); ++y) {
+    QRgb * line = reinterpret_cast<QRgb*>(img.scanLine(y));
+    for (int x = 0; x < img.width(); ++x) {
+      state = state * 1664525u + 1013904223u;
+      line[x] = state;
+    }
+  }
+
+  // Reference: the scalar qGray() formula used before
+  QImage ref = img.copy();
+  for (int y = 0; y < ref.height(); ++y) {
+    QRgb * line = reinterpret_cast<QRgb*>(ref.scanLine(y));
+    for (int x = 0; x < ref.width(); ++x) {
+      const int gray = qGray(line[x]);
+      line[x] = qRgba(gray, gray, gray, qAlpha(line[x]));
+    }
+  }
+
+  QtPDF::Backend::convertToGrayScale(img);
+  QCOMPARE(img, ref);
+}
+
+void TestQtPDF::processingThread()
+{
+  using namespace QtPDF::Backend;
+
+  PDFPageProcessingThread pool;
+  QCOMPARE(pool.workerCount(), PDFPageProcessingThread::defaultWorkerCount());
+  QVERIFY(pool.workerCount() >= 1);
+  QCOMPARE(pool.isSerialized(), false);
+
+  pool.setWorkerCount(3);
+  QCOMPARE(pool.workerCount(), 3);
+  pool.setWorkerCount(0);
+  QCOMPARE(pool.workerCount(), 1);
+  pool.setSerialized(true);
+  QCOMPARE(pool.isSerialized(), true);
+
+  PDFPageProcessingThread::setDefaultWorkerCount(2);
+  QCOMPARE(PDFPageProcessingThread::defaultWorkerCount(), 2);
+  PDFPageProcessingThread::setDefaultWorkerCount(0);
+  QCOMPARE(PDFPageProcessingThread::defaultWorkerCount(), qMax(1, QThread::idealThreadCount()));
+
+  // Backends that don't declare Capability_ParallelRendering get serialized
+  LinksDocument doc(3);
+  QCOMPARE(doc.capabilities(), Document::Capabilities());
+  QCOMPARE(doc.processingThread().isSerialized(), true);
+
+  // Processing requests must not block (nor deadlock) with several workers,
+  // and each one delivers its result. NB: Identical requests for the same
+  // listener would be coalesced, so every request gets its own listener.
+  doc.processingThread().setSerialized(false);
+  doc.processingThread().setWorkerCount(4);
+  QSharedPointer<Page> page = doc.page(0).toStrongRef();
+  QVERIFY(page);
+  LinksListener listeners[16];
+  for (LinksListener & listener : listeners)
+    page->asyncLoadLinks(&listener);
+  for (const LinksListener & listener : listeners) {
+    QTRY_COMPARE(listener.numLinks.size(), 1);
+    QCOMPARE(listener.numLinks.first(), 3);
+  }
+  QTRY_COMPARE(doc.processingThread().numPendingRequests(), 0);
+}
+
+void TestQtPDF::rtree()
+{
+  using QtPDF::PDFRTree;
+
+  PDFRTree empty;
+  QVERIFY(empty.isEmpty());
+  QCOMPARE(empty.boundingRect(), QRectF());
+  QCOMPARE(empty.containing(QPointF()), QVector<int>());
+  QCOMPARE(empty.intersecting(QRectF(0, 0, 1, 1)), QVector<int>());
+
+  // Rects are closed sets, so degenerate rects and edges can be hit
+  PDFRTree small(QVector<QRectF>{QRectF(0, 0, 10, 10), QRectF(5, 5, 0, 0), QRectF(20, 0, -10, 10)});
+  QCOMPARE(small.size(), 3);
+  QCOMPARE(small.rect(2), QRectF(10, 0, 10, 10));
+  QCOMPARE(small.boundingRect(), QRectF(0, 0, 20, 10));
+  QCOMPARE(small.containing(QPointF(5, 5)), QVector<int>({0, 1}));
+  QCOMPARE(small.containing(QPointF(10, 0)), QVector<int>({0, 2}));
+  QCOMPARE(small.containing(QPointF(21, 0)), QVector<int>());
+  QCOMPARE(small.intersecting(QRectF(4, 4, 2, 2)), QVector<int>({0, 1}));
+
+  // Compare against brute force for larger trees (i.e., several levels)
+  quint32 state = 4711;
+  auto random = [&state](const int max) -> qreal {
+    state = state * 1664525u + 1013904223u;
+    return static_cast<qreal>(state >> 8) / static_cast<qreal>(1u << 24) * max;
+  };
+  foreach(const int n, QList<int>({17, 256, 5000})) {
+    QVector<QRectF> rects;
+    for (int i = 0; i < n; ++i)
+      rects << QRectF(random(1000), random(1000), (i % 7 == 0 ? 0 : random(40) - 20), random(20));
+    foreach(const int capacity, QList<int>({2, 4, PDFRTree::DefaultNodeCapacity})) {
+      const PDFRTree tree(rects, capacity);
+      QCOMPARE(tree.size(), n);
+      for (int j = 0; j < 200; ++j) {
+        const QPointF pt = (j % 4 == 0 ? rects[j % n].normalized().center() : QPointF(random(1000), random(1000)));
+        const QRectF r(random(1000), random(1000), random(60), random(60));
+        QVector<int> expectedPoint, expectedRect;
+        for (int i = 0; i < n; ++i) {
+          if (PDFRTree::contains(rects[i].normalized(), pt))
+            expectedPoint << i;
+          if (PDFRTree::intersects(rects[i].normalized(), r))
+            expectedRect << i;
+        }
+        QCOMPARE(tree.containing(pt), expectedPoint);
+        QCOMPARE(tree.intersecting(r), expectedRect);
+      }
+    }
+  }
+}
+
+void TestQtPDF::pageLayout()
+{
+  QtPDF::PDFPageLayout layout;
+  QCOMPARE(layout.pagesIn(QRectF(0, 0, 100, 100)), QList<int>());
+  QCOMPARE(layout.pagesAt(QPointF(0, 0)), QList<int>());
+
+  // Compare the (binary) search against brute force for pages of different
+  // sizes in different arrangements
+  quint32 state = 4711;
+  auto random = [&state](const int max) -> qreal {
+    state = state * 1664525u + 1013904223u;
+    return static_cast<qreal>(state >> 8) / static_cast<qreal>(1u << 24) * max;
+  };
+  for (int i = 0; i < 500; ++i)
+    layout.addPage(i % 7 == 0 ? QSizeF(300, 200) : QSizeF(200, 100 + random(200)));
+
+  auto check = [&]() {
+    for (int j = 0; j < 200; ++j) {
+      const QRectF r(random(1000) - 100, random(100000) - 100, random(500), random(500));
+      const QPointF pt(random(1000) - 100, random(100000) - 100);
+      QList<int> expectedRect, expectedPoint;
+      for (int i = 0; i < layout.pageCount(); ++i) {
+        if (layout.pageRect(i).intersects(r))
+          expectedRect << i;
+        if (layout.pageRect(i).contains(pt))
+          expectedPoint << i;
+      }
+      QCOMPARE(layout.pagesIn(r), expectedRect);
+      QCOMPARE(layout.pagesAt(pt), expectedPoint);
+    }
+  };
+
+  // Before the first relayout(), all pages are at the origin
+  check();
+  foreach(const int numCols, QList<int>({1, 2, 3})) {
+    layout.setColumnCount(numCols, numCols - 1);
+    layout.relayout();
+    check();
+    // Pages at the boundaries between rows
+    const QRectF pageRect = layout.pageRect(layout.pageCount() / 2);
+    QVERIFY(layout.pagesAt(pageRect.topLeft()).contains(layout.pageCount() / 2));
+    QVERIFY(layout.pagesAt(pageRect.bottomRight()).contains(layout.pageCount() / 2));
+  }
+
+  // Pages added after the last relayout() are still found
+  layout.addPage(QSizeF(50, 50));
+  check();
+  layout.relayout();
+  check();
+
+  layout.setContinuous(false);
+  layout.relayout();
+  QCOMPARE(layout.pagesAt(QPointF(0, 0)).size(), layout.pageCount());
+  check();
+}
+
+void TestQtPDF::documentScene_materializePages()
+{
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString fileName = dir.filePath(QStringLiteral("pages.pdf"));
+  QStringList pageTexts;
+  for (int i = 0; i < 300; ++i)
+    pageTexts << QStringLiteral("Page %1").arg(i + 1);
+  QVERIFY(writePDF(fileName, pageTexts));
+
+  Backend backend;
+  pDoc doc = backend.newDocument(fileName);
+  QVERIFY(doc->isValid());
+  QtPDF::PDFDocumentScene scene(doc, nullptr, 72, 72);
+  const QtPDF::PDFPageLayout & layout = scene.pageLayout();
+  QCOMPARE(layout.pageCount(), 300);
+  QCOMPARE(scene.materializedPages().size(), 0);
+
+  auto materializedIdxs = [&scene]() -> QList<int> {
+    QList<int> retVal;
+    foreach(QtPDF::PDFPageGraphicsItem * item, scene.materializedPages())
+      retVal << scene.pageNumFor(item);
+    return retVal;
+  };
+  auto keepRect = [](const QRectF & rect) -> QRectF {
+    return rect.adjusted(-rect.width(), -rect.height(), rect.width(), rect.height());
+  };
+
+  // About two pages are visible at a time
+  const QRectF firstPage = layout.pageRect(0);
+  QRectF visibleRect(firstPage.topLeft(), QSizeF(firstPage.width(), 2 * firstPage.height()));
+  scene.materializePages(visibleRect);
+  QCOMPARE(materializedIdxs(), layout.pagesIn(visibleRect));
+
+  // Scrolling a little keeps the items of the pages nearby
+  QList<int> expected = materializedIdxs();
+  visibleRect.translate(0, firstPage.height());
+  scene.materializePages(visibleRect);
+  foreach(const int idx, layout.pagesIn(visibleRect)) {
+    if (!expected.contains(idx))
+      expected << idx;
+  }
+  std::sort(expected.begin(), expected.end());
+  QCOMPARE(materializedIdxs(), expected);
+
+  // Jumping far away recycles all items, so only the pages in view have items,
+  // and those are reused
+  const QList<QtPDF::PDFPageGraphicsItem *> oldItems = scene.materializedPages();
+  visibleRect.moveTop(layout.pageRect(200).top());
+  scene.materializePages(visibleRect);
+  QCOMPARE(materializedIdxs(), layout.pagesIn(visibleRect));
+  QVERIFY(scene.materializedPages().size() <= oldItems.size());
+  foreach(QtPDF::PDFPageGraphicsItem * item, scene.materializedPages()) {
+    QVERIFY(oldItems.contains(item));
+    QCOMPARE(scene.pages()[scene.pageNumFor(item)], static_cast<QGraphicsItem *>(item));
+  }
+  foreach(const int idx, expected)
+    QVERIFY(scene.pages()[idx] == nullptr);
+
+  // Scrolling through the whole document never keeps more than the pages in
+  // view plus the margin
+  for (int i = 0; i < 300; i += 3) {
+    visibleRect.moveTop(layout.pageRect(i).top());
+    scene.materializePages(visibleRect);
+    const QList<int> idxs = materializedIdxs();
+    QVERIFY(!idxs.isEmpty());
+    foreach(const int idx, layout.pagesIn(visibleRect))
+      QVERIFY(idxs.contains(idx));
+    foreach(const int idx, idxs)
+      QVERIFY(layout.pageRect(idx).intersects(keepRect(visibleRect)));
+  }
+}
+
+void TestQtPDF::document_reloadUnchangedPages()
+{
+#ifndef USE_POPPLERQT
+  QSKIP("Only the poppler-qt backend keeps unchanged pages when reloading");
+#else
+  using namespace QtPDF::Backend;
+
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString fileName = dir.filePath(QStringLiteral("reload.pdf"));
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("Page 1") << QStringLiteral("Page 2") << QStringLiteral("Page 3")));
+
+  Backend backend;
+  pDoc doc = backend.newDocument(fileName);
+  QVERIFY(doc->isValid());
+  QCOMPARE(doc->numPages(), 3);
+
+  // Render (and cache) all pages
+  const double res = 36;
+  QList< QSharedPointer<Page> > pages;
+  QList<PDFPageTile> tiles;
+  for (int i = 0; i < doc->numPages(); ++i) {
+    QSharedPointer<Page> page = doc->page(i).toStrongRef();
+    QVERIFY(page);
+    QVERIFY(page->getTileImage(nullptr, res, res));
+    pages << page;
+    tiles << PDFPageTile(res, res, QRectF(QPointF(0, 0), page->pageSizeF() * res / 72.).toAlignedRect(), i, doc->cacheId());
+    QCOMPARE(doc->pageCache().getStatus(tiles[i]), PDFPageCache::CURRENT);
+  }
+
+  // Only change the text of the second page
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("Page 1") << QStringLiteral("Changed") << QStringLiteral("Page 3")));
+  QVERIFY(doc->prepareReload(QList<PDFPageTile>()));
+  doc->reload();
+  QCOMPARE(doc->numPages(), 3);
+
+  // Unchanged pages keep their tiles and Page objects, the changed page
+  // loses both
+  QCOMPARE(doc->pageCache().getStatus(tiles[0]), PDFPageCache::CURRENT);
+  QCOMPARE(doc->pageCache().getStatus(tiles[1]), PDFPageCache::OUTDATED);
+  QCOMPARE(doc->pageCache().getStatus(tiles[2]), PDFPageCache::CURRENT);
+  QCOMPARE(doc->page(0).toStrongRef(), pages[0]);
+  QVERIFY(doc->page(1).toStrongRef() != pages[1]);
+  QCOMPARE(doc->page(2).toStrongRef(), pages[2]);
+
+  // Without preparation, reload() does not take the time to find unchanged
+  // pages, so all tiles become outdated
+  doc->reload();
+  foreach(const PDFPageTile & tile, tiles)
+    QCOMPARE(doc->pageCache().getStatus(tile), PDFPageCache::OUTDATED);
+#endif
+}
+
+void TestQtPDF::document_loadPageSizes()
+{
+  const QSizeF a4(595, 842), letter(612, 792), landscape(842, 595);
+  PageSizesDocument doc(QVector<QSizeF>() << letter << a4 << a4 << landscape);
+  bool isEstimate{false};
+
+  // Until they are loaded, the size of the first page serves as placeholder
+  // for all others
+  QCOMPARE(doc.pageSizeF(0, &isEstimate), letter);
+  QVERIFY(!isEstimate);
+  QCOMPARE(doc.pageSizeF(2, &isEstimate), letter);
+  QVERIFY(isEstimate);
+  QCOMPARE(doc.numFetches.loadAcquire(), 0);
+
+  // Sizes are loaded incrementally
+  doc.loadPageSizes(1, 2);
+  QCOMPARE(doc.numFetches.loadAcquire(), 2);
+  QCOMPARE(doc.pageSizeF(1, &isEstimate), a4);
+  QVERIFY(!isEstimate);
+  QCOMPARE(doc.pageSizeF(2, &isEstimate), a4);
+  QVERIFY(!isEstimate);
+  QCOMPARE(doc.pageSizeF(3, &isEstimate), letter);
+  QVERIFY(isEstimate);
+  QCOMPARE(doc.pageSize(), letter);
+
+  // Known sizes are not fetched again; once all sizes are known, the most
+  // common one becomes the size of the document
+  doc.loadPageSizes(0, 10);
+  QCOMPARE(doc.numFetches.loadAcquire(), 3);
+  QCOMPARE(doc.pageSizeF(3, &isEstimate), landscape);
+  QVERIFY(!isEstimate);
+  QCOMPARE(doc.pageSize(), a4);
+
+  // Reloading starts over
+  doc.nextSizes = QVector<QSizeF>() << a4 << letter << letter << letter;
+  doc.reload();
+  QCOMPARE(doc.pageSizeF(1, &isEstimate), a4);
+  QVERIFY(isEstimate);
+
+  // Sizes that were determined for the file before a reload are discarded
+  doc.nextSizes = QVector<QSizeF>() << landscape << a4 << a4 << a4;
+  doc.reloadAt = 2;
+  doc.loadPageSizes(1, 3);
+  QCOMPARE(doc.pageSizeF(0, &isEstimate), landscape);
+  QVERIFY(!isEstimate);
+  QCOMPARE(doc.pageSizeF(1, &isEstimate), landscape);
+  QVERIFY(isEstimate);
+  QCOMPARE(doc.pageSizeF(3, &isEstimate), landscape);
+  QVERIFY(isEstimate);
+  QCOMPARE(doc.pageSize(), landscape);
+
+  // The new file's sizes are loaded as usual afterwards
+  doc.loadPageSizes(0, 4);
+  QCOMPARE(doc.pageSizeF(1, &isEstimate), a4);
+  QVERIFY(!isEstimate);
+  QCOMPARE(doc.pageSize(), a4);
+}
+
+void TestQtPDF::document_prepareReload()
+{
+#ifndef USE_POPPLERQT
+  QSKIP("Only the poppler-qt backend supports preparing reloads");
+#else
+  using namespace QtPDF::Backend;
+
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString fileName = dir.filePath(QStringLiteral("reload.pdf"));
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("First") << QStringLiteral("Second")));
+
+  Backend backend;
+  pDoc doc = backend.newDocument(fileName);
+  QVERIFY(doc->isValid());
+  QCOMPARE(doc->numPages(), 2);
+  const QSizeF pageSize = doc->pageSizeF(0);
+
+  // The old file remains in use while the new one is prepared
+  const QPageSize a5(QPageSize::A5);
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("One") << QStringLiteral("Two") << QStringLiteral("Three"), QList<QPageSize>() << QPageSize(QPageSize::A6) << a5 << a5));
+  const double res = 36;
+  const PDFPageTile tile(res, res, QRectF(QPointF(0, 0), pageSize * res / 72.).toAlignedRect(), 0, doc->cacheId());
+  const PDFPageTile grayTile(res, res, tile.render_box, 0, doc->cacheId(), true);
+  QVERIFY(doc->prepareReload(QList<PDFPageTile>() << tile << grayTile));
+  QCOMPARE(doc->numPages(), 2);
+  QCOMPARE(pageText(doc, 0), QStringLiteral("First"));
+  QCOMPARE(doc->pageCache().getStatus(tile), PDFPageCache::UNKNOWN);
+
+  // reload() swaps in the prepared file, including the tiles rendered from it
+  doc->reload();
+  QCOMPARE(doc->numPages(), 3);
+  QCOMPARE(pageText(doc, 0), QStringLiteral("One"));
+  QCOMPARE(pageText(doc, 1), QStringLiteral("Two"));
+  QCOMPARE(pageText(doc, 2), QStringLiteral("Three"));
+  // All page sizes are known from the preparation, so the document's size is
+  // the most common one (rather than that of the first page)
+  bool isEstimate{true};
+  QCOMPARE(doc->pageSizeF(2, &isEstimate), doc->page(2).toStrongRef()->pageSizeF());
+  QVERIFY(!isEstimate);
+  QCOMPARE(doc->pageSize(), doc->pageSizeF(2));
+  QVERIFY(doc->pageSize() != doc->pageSizeF(0));
+  QCOMPARE(doc->pageCache().getStatus(tile), PDFPageCache::CURRENT);
+  QSharedPointer<QImage> prepared = doc->pageCache().getImage(tile);
+  QVERIFY(prepared);
+  QCOMPARE(*prepared, doc->page(0).toStrongRef()->renderToImage(res, res, tile.render_box));
+  // Gray scale tiles are converted from the rendering
+  QSharedPointer<QImage> preparedGray = doc->pageCache().getImage(grayTile);
+  QVERIFY(preparedGray);
+  QImage expectedGray = prepared->copy();
+  convertToGrayScale(expectedGray);
+  QCOMPARE(*preparedGray, expectedGray);
+
+  // If the file changes again after the preparation, reload() loads the
+  // latest file itself instead
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("Alpha") << QStringLiteral("Beta")));
+  QVERIFY(doc->prepareReload(QList<PDFPageTile>()));
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("Gamma")));
+  doc->reload();
+  QCOMPARE(doc->numPages(), 1);
+  QCOMPARE(pageText(doc, 0), QStringLiteral("Gamma"));
+#endif
+}
+
+void TestQtPDF::document_reloadLocked()
+{
+#ifndef USE_POPPLERQT
+  QSKIP("Only the poppler-qt backend supports preparing reloads");
+#else
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString fileName = dir.filePath(QStringLiteral("locked.pdf"));
+  QVERIFY(QFile::copy(QStringLiteral("base14-fonts-locked.pdf"), fileName));
+
+  Backend backend;
+  pDoc doc = backend.newDocument(fileName);
+  QVERIFY(doc->isLocked());
+  // Locked documents can't be fingerprinted, so there is nothing to prepare
+  QCOMPARE(doc->prepareReload(QList<QtPDF::Backend::PDFPageTile>()), false);
+
+  // Once unlocked, reloaded files are unlocked with the same password, both
+  // with and without preparation
+  QVERIFY(doc->unlock(QStringLiteral("123")));
+  const int numPages = doc->numPages();
+  QVERIFY(numPages > 0);
+  doc->reload();
+  QVERIFY(!doc->isLocked());
+  QCOMPARE(doc->numPages(), numPages);
+  QVERIFY(doc->prepareReload(QList<QtPDF::Backend::PDFPageTile>()));
+  doc->reload();
+  QVERIFY(!doc->isLocked());
+  QCOMPARE(doc->numPages(), numPages);
+  QVERIFY(!doc->page(0).toStrongRef()->renderToImage(36, 36).isNull());
+#endif
+}
+
+void TestQtPDF::documentScene_reloadDuringPreparation()
+{
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString fileName = dir.filePath(QStringLiteral("reload.pdf"));
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("First") << QStringLiteral("Second")));
+
+  Backend backend;
+  pDoc doc = backend.newDocument(fileName);
+  QVERIFY(doc->isValid());
+  QtPDF::PDFDocumentScene scene(doc, nullptr, 72, 72);
+  scene.setWatchForDocumentChangesOnDisk(false);
+  QCOMPARE(scene.pageLayout().pageCount(), 2);
+  QSignalSpy spy(&scene, &QtPDF::PDFDocumentScene::documentChanged);
+
+  // Keep the (only) thread of the thread pool busy so that the preparation of
+  // the first reload cannot finish before the second one is requested
+  QThreadPool * pool = QThreadPool::globalInstance();
+  pool->waitForDone();
+  const int maxThreadCount = pool->maxThreadCount();
+  pool->setMaxThreadCount(1);
+  QSemaphore blocker;
+  QFuture<void> blocking = QtConcurrent::run([&blocker]() { blocker.acquire(); });
+
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("One") << QStringLiteral("Two") << QStringLiteral("Three")));
+  scene.reloadDocument();
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("1") << QStringLiteral("2") << QStringLiteral("3") << QStringLiteral("4")));
+  scene.reloadDocument();
+
+  blocker.release();
+  blocking.waitForFinished();
+  pool->setMaxThreadCount(maxThreadCount);
+
+  // The outdated preparation is discarded and the scene switches to the latest
+  // file only once
+  QTRY_COMPARE(spy.count(), 1);
+  QCOMPARE(doc->numPages(), 4);
+  QCOMPARE(scene.pageLayout().pageCount(), 4);
+  QCOMPARE(pageText(doc, 3), QStringLiteral("4"));
+  QTest::qWait(100);
+  QCOMPARE(spy.count(), 1);
+}
+
+void TestQtPDF::documentScene_reloadWhenStable()
+{
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString fileName = dir.filePath(QStringLiteral("reload.pdf"));
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("First")));
+  const QString newFileName = dir.filePath(QStringLiteral("new.pdf"));
+  QVERIFY(writePDF(newFileName, QStringList() << QStringLiteral("One") << QStringLiteral("Two")));
+  QFile newFile(newFileName);
+  QVERIFY(newFile.open(QIODevice::ReadOnly));
+  const QByteArray data = newFile.readAll();
+  newFile.close();
+
+  Backend backend;
+  pDoc doc = backend.newDocument(fileName);
+  QVERIFY(doc->isValid());
+  ReloadCheckingScene scene(doc);
+  scene.setWatchForDocumentChangesOnDisk(false);
+  // The timer never fires during the test; the file is checked explicitly
+  scene.setReloadCheckInterval(10000, 30000);
+  QCOMPARE(scene.pendingReloadCheckInterval(), -1);
+  QSignalSpy spy(&scene, &QtPDF::PDFDocumentScene::documentChanged);
+
+  // Writes the first `size` bytes of the new file and sets its modification
+  // time (which the file system might not change between quick writes)
+  const QDateTime start = QDateTime::currentDateTimeUtc().addSecs(-60);
+  QFile file(fileName);
+  auto writeFile = [&](const int size, const int secs) -> bool {
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+      return false;
+    const bool ok = (file.write(data.left(size)) == size && file.flush() && file.setFileTime(start.addSecs(secs), QFileDevice::FileModificationTime));
+    file.close();
+    return ok;
+  };
+
+  // While the file grows, the checks back off
+  QVERIFY(writeFile(data.size() / 3, 0));
+  scene.fileChanged();
+  QCOMPARE(scene.pendingReloadCheckInterval(), 10000);
+  QVERIFY(writeFile(2 * data.size() / 3, 1));
+  scene.checkChangedFile();
+  QCOMPARE(scene.pendingReloadCheckInterval(), 20000);
+  QVERIFY(writeFile(data.size(), 2));
+  scene.checkChangedFile();
+  QCOMPARE(scene.pendingReloadCheckInterval(), 30000);
+  // A file that was rewritten without changing its size is checked again soon
+  QVERIFY(writeFile(data.size(), 3));
+  scene.checkChangedFile();
+  QCOMPARE(scene.pendingReloadCheckInterval(), 10000);
+  QTest::qWait(100);
+  QCOMPARE(spy.count(), 0);
+  QCOMPARE(doc->numPages(), 1);
+
+  // Once the size and modification time are stable, the file is reloaded
+  scene.checkChangedFile();
+  QTRY_COMPARE(spy.count(), 1);
+  QCOMPARE(doc->numPages(), 2);
+  QCOMPARE(pageText(doc, 1), QStringLiteral("Two"));
+
+  // Files that are stable but incomplete (e.g., while TeX waits for input)
+  // are not reloaded
+  QVERIFY(writeFile(data.size() / 2, 4));
+  scene.checkChangedFile();
+  scene.checkChangedFile();
+  QTest::qWait(100);
+  QCOMPARE(spy.count(), 1);
+  QCOMPARE(doc->numPages(), 2);
+}
+
+void TestQtPDF::documentView_incrementalSearch()
+{
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString fileName = dir.filePath(QStringLiteral("search.pdf"));
+  QVERIFY(writePDF(fileName, QStringList() << QStringLiteral("apple") << QStringLiteral("apricot") << QStringLiteral("banana") << QStringLiteral("grape") << QStringLiteral("apple pie")));
+
+  Backend backend;
+  pDoc doc = backend.newDocument(fileName);
+  QVERIFY(doc->isValid());
+  if (doc->page(0).toStrongRef()->textLayer()->words.isEmpty())
+    QSKIP("Backend does not provide a text layer");
+
+  // Refining only applies while the pages are searched one by one (i.e., as
+  // long as the search index is not available)
+  QSharedPointer<QtPDF::PDFDocumentScene> scene(new QtPDF::PDFDocumentScene(doc, nullptr, 72, 72));
+  scene->setWatchForDocumentChangesOnDisk(false);
+  scene->setSearchIndexingEnabled(false);
+  QtPDF::PDFDocumentView view;
+  view.setScene(scene);
+  view.setIncrementalSearchDelay(0);
+  QSignalSpy spy(&view, &QtPDF::PDFDocumentView::searchProgressChanged);
+
+  spy.clear();
+  view.incrementalSearch(QStringLiteral("ap"));
+  QTRY_VERIFY(!spy.isEmpty() && spy.last().at(0).toInt() == 100);
+  QCOMPARE(view.searchPages(), QList<int>() << 0 << 1 << 2 << 3 << 4);
+  QCOMPARE(spy.last().at(1).toInt(), 4);
+
+  // Only pages that contained the previous search text are searched again
+  spy.clear();
+  view.incrementalSearch(QStringLiteral("app"));
+  QTRY_VERIFY(!spy.isEmpty() && spy.last().at(0).toInt() == 100);
+  QCOMPARE(view.searchPages(), QList<int>() << 0 << 1 << 3 << 4);
+  QCOMPARE(spy.last().at(1).toInt(), 2);
+
+  // Pages ruled out by earlier refinements stay ruled out
+  spy.clear();
+  view.incrementalSearch(QStringLiteral("appl"));
+  QTRY_VERIFY(!spy.isEmpty() && spy.last().at(0).toInt() == 100);
+  QCOMPARE(view.searchPages(), QList<int>() << 0 << 4);
+  QCOMPARE(spy.last().at(1).toInt(), 2);
+
+  // Searching for something else searches all pages again
+  spy.clear();
+  view.incrementalSearch(QStringLiteral("grape"));
+  QTRY_VERIFY(!spy.isEmpty() && spy.last().at(0).toInt() == 100);
+  QCOMPARE(view.searchPages(), QList<int>() << 0 << 1 << 2 << 3 << 4);
+  QCOMPARE(spy.last().at(1).toInt(), 1);
+
+  // The search flags are passed on to the pages (e.g., to only match whole
+  // words)
+  const QtPDF::Backend::SearchFlags wholeWords = QtPDF::Backend::Search_CaseInsensitive | QtPDF::Backend::Search_WholeWords;
+  spy.clear();
+  view.incrementalSearch(QStringLiteral("appl"), wholeWords);
+  QTRY_VERIFY(!spy.isEmpty() && spy.last().at(0).toInt() == 100);
+  QCOMPARE(spy.last().at(1).toInt(), 0);
+  spy.clear();
+  view.incrementalSearch(QStringLiteral("apple"), wholeWords);
+  QTRY_VERIFY(!spy.isEmpty() && spy.last().at(0).toInt() == 100);
+  QCOMPARE(view.searchPages(), QList<int>() << 0 << 1 << 2 << 3 << 4);
+  QCOMPARE(spy.last().at(1).toInt(), 2);
+  spy.clear();
+  view.search(QStringLiteral("APPLE PIE"), wholeWords);
+  QTRY_VERIFY(!spy.isEmpty() && spy.last().at(0).toInt() == 100);
+  QCOMPARE(spy.last().at(1).toInt(), 1);
+}
+
+void TestQtPDF::documentView_searchHighlights()
+{
+  QTemporaryDir dir;
+  QVERIFY(dir.isValid());
+  const QString fileName = dir.filePath(QStringLiteral("pages.pdf"));
+  QStringList pageTexts;
+  for (int i = 0; i < 300; ++i)
+    pageTexts << QStringLiteral("Page %1").arg(i + 1);
+  QVERIFY(writePDF(fileName, pageTexts));
+
+  Backend backend;
+  pDoc doc = backend.newDocument(fileName);
+  QVERIFY(doc->isValid());
+  if (doc->page(0).toStrongRef()->textLayer()->words.isEmpty())
+    QSKIP("Backend does not provide a text layer");
+
+  QSharedPointer<QtPDF::PDFDocumentScene> scene(new QtPDF::PDFDocumentScene(doc, nullptr, 72, 72));
+  scene->setWatchForDocumentChangesOnDisk(false);
+  scene->setSearchIndexingEnabled(false);
+  const QtPDF::PDFPageLayout & layout = scene->pageLayout();
+  QtPDF::PDFDocumentView view;
+  view.setScene(scene);
+  QSignalSpy spy(&view, &QtPDF::PDFDocumentView::searchProgressChanged);
+
+  // Returns the pages that have highlights, and checks that each of them has
+  // exactly one (i.e., one per search result)
+  auto highlightedPages = [&scene]() -> QList<int> {
+    QList<int> retVal;
+    foreach(QtPDF::PDFPageGraphicsItem * item, scene->materializedPages()) {
+      int numHighlights = 0;
+      foreach(const QGraphicsItem * child, item->childItems()) {
+        if (child->type() == QtPDF::PDFSearchResultGraphicsItem::Type)
+          ++numHighlights;
+      }
+      if (numHighlights > 0)
+        retVal << scene->pageNumFor(item);
+      if (numHighlights > 1)
+        retVal << -1;
+    }
+    return retVal;
+  };
+  auto materializedIdxs = [&scene]() -> QList<int> {
+    QList<int> retVal;
+    foreach(QtPDF::PDFPageGraphicsItem * item, scene->materializedPages())
+      retVal << scene->pageNumFor(item);
+    return retVal;
+  };
+
+  // Every page has a result, but only the pages with items get highlights;
+  // the search does not create items for the others
+  spy.clear();
+  view.search(QStringLiteral("Page"));
+  QTRY_VERIFY(!spy.isEmpty() && spy.last().at(0).toInt() == 100);
+  QCOMPARE(spy.last().at(1).toInt(), 300);
+  QVERIFY(scene->materializedPages().size() < 300);
+  QCOMPARE(highlightedPages(), materializedIdxs());
+
+  // Pages with highlights are recycled like any other page
+  const QRectF firstPage = layout.pageRect(0);
+  QRectF visibleRect(firstPage.topLeft(), QSizeF(firstPage.width(), 2 * firstPage.height()));
+  visibleRect.moveTop(layout.pageRect(200).top());
+  scene->materializePages(visibleRect);
+  QCOMPARE(materializedIdxs(), layout.pagesIn(visibleRect));
+  QVERIFY(!materializedIdxs().contains(0));
+  QCOMPARE(highlightedPages(), materializedIdxs());
+
+  // Going to a result materializes its page again, along with its highlight
+  QSignalSpy highlightSpy(&view, &QtPDF::PDFDocumentView::searchResultHighlighted);
+  view.previousSearchResult();
+  view.nextSearchResult();
+  QCOMPARE(highlightSpy.size(), 2);
+  QVERIFY(materializedIdxs().contains(highlightSpy.last().at(0).toInt()));
+  QCOMPARE(highlightedPages(), materializedIdxs());
+
+  view.clearSearchResults();
+  QCOMPARE(highlightedPages(), QList<int>());
+}
+
+void TestQtPDF::documentView_pyramidLevel_data()
+{
+  QTest::addColumn<qreal>("zoomLevel");
+  QTest::addColumn<qreal>("level");
+
+  const qreal sqrt2 = std::sqrt(2.);
+  // Levels are powers of sqrt(2); the boundaries between them lie halfway in
+  // between on a logarithmic scale
+  const qreal up = std::pow(2., 0.25);
+  const qreal down = std::pow(2., -0.25);
+  const qreal high = std::pow(2., 1.75);
+
+  QTest::newRow("1") << qreal(1) << qreal(1);
+  QTest::newRow("sqrt(2)") << sqrt2 << sqrt2;
+  QTest::newRow("2") << qreal(2) << qreal(2);
+  QTest::newRow("1/2") << qreal(0.5) << qreal(0.5);
+  QTest::newRow("below 1 -> sqrt(2)") << 0.99 * up << qreal(1);
+  QTest::newRow("above 1 -> sqrt(2)") << 1.01 * up << sqrt2;
+  QTest::newRow("above 1 -> 1/sqrt(2)") << 1.01 * down << qreal(1);
+  QTest::newRow("below 1 -> 1/sqrt(2)") << 0.99 * down << 1. / sqrt2;
+  QTest::newRow("below 2*sqrt(2) -> 4") << 0.99 * high << 2 * sqrt2;
+  QTest::newRow("above 2*sqrt(2) -> 4") << 1.01 * high << qreal(4);
+  QTest::newRow("0") << qreal(0) << qreal(0);
+  QTest::newRow("negative") << qreal(-1) << qreal(-1);
+}
+
+void TestQtPDF::documentView_pyramidLevel()
+{
+  QFETCH(qreal, zoomLevel);
+  QFETCH(qreal, level);
+
+  QCOMPARE(QtPDF::PDFDocumentView::pyramidLevel(zoomLevel), level);
+}
+
+void TestQtPDF::documentView_isCurrentResolution()
+{
+  using QtPDF::PDFDocumentView;
+
+  // Tiles of the current zoom level are displayed at their actual size
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, 100, 1.5, false), true);
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, 100.5, 1.5, false), true);
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, 100, 1.5, true), true);
+
+  // Tiles of the pyramid level (sqrt(2) for 1.5) are stretched; they are only
+  // current during a zoom gesture
+  const qreal pyramidWidth = 100 * 1.5 / std::sqrt(2.);
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, pyramidWidth, 1.5, true), true);
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, pyramidWidth, 1.5, false), false);
+  // Likewise when zooming out (the pyramid level of 0.6 is 1/sqrt(2))
+  const qreal pyramidWidthOut = 100 * 0.6 * std::sqrt(2.);
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, pyramidWidthOut, 0.6, true), true);
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, pyramidWidthOut, 0.6, false), false);
+
+  // Tiles requested at 100% before zooming in or out are superseded either way
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, 150, 1.5, false), false);
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, 150, 1.5, true), false);
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, 100 / 1.5, 1 / 1.5, false), false);
+  QCOMPARE(PDFDocumentView::isCurrentResolution(100, 100 / 1.5, 1 / 1.5, true), false);
+
+  QCOMPARE(PDFDocumentView::isCurrentResolution(0, 0, 1, false), false);
+}
+
+void TestQtPDF::documentView_zoomGesture()
+{
+  QtPDF::PDFDocumentView view;
+  QCOMPARE(view.isZooming(), false);
+
+  // A single zoom step is no gesture
+  view.zoomIn();
+  QCOMPARE(view.isZooming(), false);
+
+  // Quick successive steps are, no matter how the zoom level is changed; the
+  // gesture ends once the zoom level has not changed for a while
+  view.setZoomLevel(2);
+  QCOMPARE(view.isZooming(), true);
+  QTRY_COMPARE(view.isZooming(), false);
+  QCOMPARE(view.zoomLevel(), 2.);
+
+  view.zoomToRect(QRectF(0, 0, 100, 100));
+  QCOMPARE(view.isZooming(), false);
+  view.zoom100();
+  QCOMPARE(view.isZooming(), true);
+  QCOMPARE(view.zoomLevel(), 1.);
+  QTRY_COMPARE(view.isZooming(), false);
+}
+
+void TestQtPDF::pageOverlay()
+{
+  using namespace QtPDF::Annotation;
+
+  // A link with a note (with popup) overlapping its lower right corner, and a
+  // note without popup inside its upper left corner
+  QSharedPointer<Link> link(new Link());
+  link->setRect(QRectF(0, 0, 100, 100));
+  link->setActionOnActivation(new QtPDF::PDFURIAction(QUrl(QStringLiteral("http://www.tug.org/texworks/"))));
+  QSharedPointer<Text> note(new Text());
+  note->setRect(QRectF(50, 50, 100, 100));
+  note->setContents(QStringLiteral("note"));
+  note->setPopup(new Popup());
+  QSharedPointer<Text> plainNote(new Text());
+  plainNote->setRect(QRectF(0, 0, 40, 40));
+  plainNote->setContents(QStringLiteral("plain note"));
+
+  ActionRecordingScene scene;
+  QtPDF::PDFPageOverlayGraphicsItem * overlay = new QtPDF::PDFPageOverlayGraphicsItem();
+  scene.addItem(overlay);
+  overlay->addLinksAndAnnotations(QList< QSharedPointer<Link> >() << link, QList< QSharedPointer<AbstractAnnotation> >() << note << plainNote);
+  QCOMPARE(overlay->numLinks(), 1);
+  QCOMPARE(overlay->numAnnotations(), 2);
+
+  // Annotations take precedence over links
+  QVERIFY(overlay->annotationAt(QPointF(75, 75)) == note);
+  QVERIFY(overlay->annotationAt(QPointF(20, 20)) == plainNote);
+  QVERIFY(overlay->annotationAt(QPointF(10, 60)) == link);
+  QVERIFY(overlay->annotationAt(QPointF(120, 20)).isNull());
+
+  // Only the links and annotations are hit, not the rest of the bounding rect
+  QVERIFY(overlay->boundingRect().contains(QPointF(120, 20)));
+  QVERIFY(!overlay->shape().contains(QPointF(120, 20)));
+  QVERIFY(!overlay->contains(QPointF(120, 20)));
+  QVERIFY(overlay->shape().contains(QPointF(75, 75)));
+  QVERIFY(overlay->contains(QPointF(75, 75)));
+  QVERIFY(overlay->shape().contains(QPointF(20, 20)));
+  QCOMPARE(scene.items(QPointF(120, 20)).size(), 0);
+  QCOMPARE(scene.items(QPointF(20, 20)).size(), 1);
+
+  // Hovering shows the tooltip of the topmost entry, but the cursor of the
+  // topmost clickable one
+  auto hover = [&](const QPointF & pos) {
+    QGraphicsSceneHoverEvent event(QEvent::GraphicsSceneHoverMove);
+    event.setPos(pos);
+    event.setScenePos(pos);
+    scene.sendEvent(overlay, &event);
+  };
+  hover(QPointF(10, 60));
+  QCOMPARE(overlay->toolTip(), QStringLiteral("<p>http://www.tug.org/texworks/</p>"));
+  QVERIFY(overlay->hasCursor());
+  hover(QPointF(75, 75));
+  QCOMPARE(overlay->toolTip(), QStringLiteral("<p>note</p>"));
+  QVERIFY(overlay->hasCursor());
+  hover(QPointF(20, 20));
+  QCOMPARE(overlay->toolTip(), QStringLiteral("<p>plain note</p>"));
+  QVERIFY(overlay->hasCursor());
+  hover(QPointF(120, 20));
+  QCOMPARE(overlay->toolTip(), QString());
+  QVERIFY(!overlay->hasCursor());
+
+  // Clicks activate the topmost clickable entry, i.e., the link below the
+  // note without popup
+  auto click = [&](const QPointF & pos, const Qt::KeyboardModifiers modifiers) {
+    QGraphicsSceneMouseEvent press(QEvent::GraphicsSceneMousePress);
+    press.setPos(pos);
+    press.setScenePos(pos);
+    press.setButton(Qt::LeftButton);
+    press.setButtons(Qt::LeftButton);
+    press.setModifiers(modifiers);
+    scene.sendEvent(overlay, &press);
+    QGraphicsSceneMouseEvent release(QEvent::GraphicsSceneMouseRelease);
+    release.setPos(pos);
+    release.setScenePos(pos);
+    release.setButton(Qt::LeftButton);
+    release.setModifiers(modifiers);
+    scene.sendEvent(overlay, &release);
+    QCoreApplication::processEvents();
+  };
+  click(QPointF(20, 20), Qt::NoModifier);
+  QCOMPARE(scene.actions.size(), 1);
+  QVERIFY(scene.actions.first() == link->actionOnActivation());
+  // The note (with popup) covers the link at this point, so the link is not
+  // activated
+  click(QPointF(75, 75), Qt::NoModifier);
+  QCOMPARE(scene.actions.size(), 1);
+  // Clicks with modifiers are left to the tools
+  click(QPointF(10, 60), Qt::ControlModifier);
+  QCOMPARE(scene.actions.size(), 1);
+  click(QPointF(10, 60), Qt::NoModifier);
+  QCOMPARE(scene.actions.size(), 2);
+}
+
 void TestQtPDF::physicalLength()
 {
   using namespace QtPDF::Physical;
@@ -20,6 +20,10 @@
 */
 
 #include "PDFBackend.h"
+#include "PDFDocumentView.h"
+#include "PDFGrayScale.h"
+#include "PDFRTree.h"
+#include "PDFSearchIndex.h"
 #include "PDFTransitions.h"
 
 #include <QObject>
@@ -64,6 +68,9 @@ private slots:
   void isLocked_data();
   void isLocked();
 
+  void isCompleteFile_data();
+  void isCompleteFile();
+
   void unlock_data();
   void unlock();
 
@@ -145,22 +152,36 @@ private slots:
 
   void page_renderToImage_data();
   void page_renderToImage();
+  void page_renderToImageConcurrently();
+  void page_getTileImageGrayScale();
+  void page_prefetchTileImage();
+  void page_prefetchTakeOver();
 
   void page_loadLinks_data();
   void page_loadLinks();
 
   void page_loadAnnotations_data();
   void page_loadAnnotations();
+  void page_loadLinksAndAnnotations();
+  void page_asyncLoadAnnotations();
 
   void page_boxes_data();
   void page_boxes();
 
+  void page_textLayer();
+  void page_textLayerCache();
+
   void page_selectedText_data();
   void page_selectedText();
 
   void page_search_data();
   void page_search();
 
+  void searchIndex_data();
+  void searchIndex();
+  void searchIndex_update();
+  void searchIndex_reload();
+
   void paperSize_data();
   void paperSize();
 
@@ -169,6 +190,32 @@ private slots:
 
   void pageTile();
 
+  void pageCache();
+  void pageCache_eviction();
+  void pageCache_index();
+  void tileRenderBoxes();
+  void renderTiles_data();
+  void renderTiles();
+  void convertToGrayScale_data();
+  void convertToGrayScale();
+  void processingThread();
+  void rtree();
+  void pageLayout();
+  void documentScene_materializePages();
+  void document_reloadUnchangedPages();
+  void document_loadPageSizes();
+  void document_prepareReload();
+  void document_reloadLocked();
+  void documentScene_reloadDuringPreparation();
+  void documentScene_reloadWhenStable();
+  void documentView_incrementalSearch();
+  void documentView_searchHighlights();
+  void documentView_pyramidLevel_data();
+  void documentView_pyramidLevel();
+  void documentView_isCurrentResolution();
+  void documentView_zoomGesture();
+  void pageOverlay();
+
   void physicalLength();
 };
 
@@ -502,20 +502,13 @@ QTextCursor CompletingEdit::wordSelectionForPos(const QPoint& mousePos)
 		// don't test because the rect will be zero width (see above)!
 		//		r = cursorRect(cursor);
 		//		if (r.contains(pos)) {
-		const QString plainText = toPlainText();
-		QChar curChr = plainText[cursorPos];
-		QChar c;
-		if (!(c = TWUtils::closerMatching(curChr)).isNull()) {
-			int balancePos = TWUtils::balanceDelim(plainText, cursorPos + 1, c, 1);
+		const Tw::Document::DelimiterIndex * delimiters = getDelimiterIndex();
+		if (delimiters && (delimiters->isOpening(cursorPos) || delimiters->isClosing(cursorPos))) {
+			int balancePos = delimiters->match(cursorPos);
 			if (balancePos < 0)
 				QApplication::beep();
-			else
+			else if (balancePos > cursorPos)
 				cursor.setPosition(balancePos + 1, QTextCursor::KeepAnchor);
-		}
-		else if (!(c = TWUtils::openerMatching(curChr)).isNull()) {
-			int balancePos = TWUtils::balanceDelim(plainText, cursorPos - 1, c, -1);
-			if (balancePos < 0)
-				QApplication::beep();
 			else {
 				cursor.setPosition(balancePos);
 				cursor.setPosition(cursorPos + 1, QTextCursor::KeepAnchor);
@@ -697,13 +690,8 @@ void CompletingEdit::handleOtherKey(QKeyEvent *e)
 			if (cursor.selectionStart() == pos + 1 || cursor.selectionStart() == pos - 1) {
 				if (cursor.selectionStart() == pos - 1) // we moved backward, set pos to look at the char we just passed over
 					--pos;
-				const QString text = document()->toPlainText();
-				int match = -2;
-				QChar c;
-				if (pos > 0 && pos < text.length() && !(c = TWUtils::openerMatching(text[pos])).isNull())
-					match = TWUtils::balanceDelim(text, pos - 1, c, -1);
-				else if (pos < text.length() - 1 && !(c = TWUtils::closerMatching(text[pos])).isNull())
-					match = TWUtils::balanceDelim(text, pos + 1, c, 1);
+				const Tw::Document::DelimiterIndex * delimiters = getDelimiterIndex();
+				const int match = (delimiters ? delimiters->match(pos) : -1);
 				if (match >= 0) {
 					QList<ExtraSelection> selList = extraSelections();
 					ExtraSelection	sel;
@@ -1433,6 +1421,14 @@ void CompletingEdit::scrollContentsBy(int dx, int dy)
 	QTextEdit::scrollContentsBy(dx, dy);
 }
 
+const Tw::Document::DelimiterIndex * CompletingEdit::getDelimiterIndex() const
+{
+	Tw::Document::TextDocument * doc = qobject_cast<Tw::Document::TextDocument *>(document());
+	if (doc == nullptr)
+		return nullptr;
+	return &doc->delimiterIndex();
+}
+
 Tw::Document::SpellChecker::Dictionary * CompletingEdit::getSpellChecker() const
 {
 	Tw::Document::TeXDocument * doc = qobject_cast<Tw::Document::TeXDocument *>(document());
@@ -22,6 +22,7 @@
 #ifndef COMPLETING_EDIT_H
 #define COMPLETING_EDIT_H
 
+#include "document/DelimiterIndex.h"
 #include "document/SpellChecker.h"
 #include "ui/LineNumberWidget.h"
 #include "ui_CompletingEdit.h"
@@ -112,6 +113,7 @@ protected:
 	void scrollContentsBy(int dx, int dy) override;
 
 	Tw::Document::SpellChecker::Dictionary * getSpellChecker() const;
+	const Tw::Document::DelimiterIndex * getDelimiterIndex() const;
 
 private slots:
 	void cursorPositionChangedSlot();
@@ -24,7 +24,10 @@
 #include "Settings.h"
 #include "TWApp.h"
 #include "TeXDocumentWindow.h"
+#include "document/TeXDocument.h"
 
+#include <QDir>
+#include <QFile>
 #include <QFileInfo>
 #include <QHeaderView>
 #include <QKeyEvent>
@@ -34,8 +37,13 @@
 #include <QTableWidget>
 #include <QTextBlock>
 #include <QTextBoundaryFinder>
+#include <QTimer>
+#include <QtConcurrent>
+#include <limits>
 
 const int kMaxRecentStrings = 10;
+// Number of bytes that are checked for a "%!TEX encoding" modeline
+const int kPeekLength = 1024;
 
 FindDialog::FindDialog(QTextEdit *parent)
 	: QDialog(parent)
@@ -95,6 +103,7 @@ void FindDialog::init(QTextEdit *document)
 	buttonBox->button(QDialogButtonBox::Ok)->setText(tr("Find"));
 
 	connect(checkBox_allFiles, &QCheckBox::toggled, this, &FindDialog::toggledAllFilesOption);
+	connect(checkBox_projectFiles, &QCheckBox::toggled, this, &FindDialog::toggledProjectFilesOption);
 	connect(checkBox_findAll, &QCheckBox::toggled, this, &FindDialog::toggledFindAllOption);
 	connect(checkBox_regex, &QCheckBox::toggled, this, &FindDialog::toggledRegexOption);
 	connect(checkBox_selection, &QCheckBox::toggled, this, &FindDialog::toggledSelectionOption);
@@ -130,6 +139,13 @@ void FindDialog::init(QTextEdit *document)
 	checkBox_backwards->setChecked((flags & QTextDocument::FindBackward) != 0);
 	checkBox_backwards->setEnabled(!findAll);
 
+	// The project is discovered from the root file, so the document must
+	// have been saved
+	bool projectFiles = settings.value(QString::fromLatin1("searchProjectFiles")).toBool();
+	TeXDocumentWindow * window = qobject_cast<TeXDocumentWindow*>(document->window());
+	checkBox_projectFiles->setEnabled(window && !window->untitled());
+	checkBox_projectFiles->setChecked(projectFiles && checkBox_projectFiles->isEnabled());
+
 	QMenu *recentItemsMenu = new QMenu(this);
 	QStringList recentStrings = settings.value(QString::fromLatin1("recentSearchStrings")).toStringList();
 	if (recentStrings.empty())
@@ -160,6 +176,13 @@ void FindDialog::toggledAllFilesOption(bool checked)
 	checkBox_findAll->setEnabled(!checked);
 }
 
+void FindDialog::toggledProjectFilesOption(bool checked)
+{
+	// The open files of the project are searched anyway
+	checkBox_allFiles->setEnabled(!checked && TeXDocumentWindow::documentList().count() > 1);
+	toggledAllFilesOption(checked || (checkBox_allFiles->isEnabled() && checkBox_allFiles->isChecked()));
+}
+
 void FindDialog::toggledFindAllOption(bool checked)
 {
 	QTextEdit* document = qobject_cast<QTextEdit*>(parent());
@@ -226,6 +249,7 @@ QDialog::DialogCode FindDialog::doFindDialog(QTextEdit *document)
 		settings.setValue(QString::fromLatin1("searchSelection"), dlg.checkBox_selection->isChecked());
 		settings.setValue(QString::fromLatin1("searchFindAll"), dlg.checkBox_findAll->isChecked());
 		settings.setValue(QString::fromLatin1("searchAllFiles"), dlg.checkBox_allFiles->isChecked());
+		settings.setValue(QString::fromLatin1("searchProjectFiles"), dlg.checkBox_projectFiles->isChecked());
 	}
 
 	return result;
@@ -422,12 +446,26 @@ SearchResults::SearchResults(QWidget* parent)
 {
 	setupUi(this);
 	setFocusProxy(parent);
+	searchStatus->hide();
 	connect(table, &QTableWidget::itemSelectionChanged, this, &SearchResults::showSelectedEntry);
 	connect(table, &QTableWidget::itemPressed, this, &SearchResults::showEntry);
 	connect(table, &QTableWidget::itemActivated, this, &SearchResults::goToSource);
 	QShortcut * sc = new QShortcut(Qt::Key_Escape, table);
 	sc->setContext(Qt::WidgetShortcut);
 	connect(sc, &QShortcut::activated, this, &SearchResults::goToSourceAndClose);
+
+	connect(&_watcher, &QFutureWatcher<Response>::resultsReadyAt, this, &SearchResults::resultsReadyAt);
+	connect(&_watcher, &QFutureWatcher<Response>::finished, this, &SearchResults::searchFinished);
+	connect(&_watcher, &QFutureWatcher<Response>::progressRangeChanged, progressBar, &QProgressBar::setRange);
+	connect(&_watcher, &QFutureWatcher<Response>::progressValueChanged, progressBar, &QProgressBar::setValue);
+	connect(stopButton, &QPushButton::clicked, this, &SearchResults::stopSearch);
+}
+
+SearchResults::~SearchResults()
+{
+	// Don't wait for the search to finish; the requests hold everything they
+	// need, and their results are simply discarded
+	_watcher.cancel();
 }
 
 void SearchResults::goToSource()
@@ -449,9 +487,8 @@ void SearchResults::goToSourceAndClose()
 #define MAXIMUM_CHARACTERS_BEFORE_SEARCH_RESULT 40
 #define MAXIMUM_CHARACTERS_AFTER_SEARCH_RESULT 80
 
-void SearchResults::presentResults(const QString& searchText,
-								   const QList<SearchResult>& results,
-								   QMainWindow* parent, bool singleFile)
+// static
+SearchResults * SearchResults::create(QMainWindow * parent, bool singleFile)
 {
 	if (singleFile) {
 		// remove any existing results dock from this parent window
@@ -463,32 +500,174 @@ void SearchResults::presentResults(const QString& searchText,
 	}
 
 	SearchResults* resultsWindow = new SearchResults(parent);
-	resultsWindow->setWindowTitle(tr("Search Results - %1 (%2 found)").arg(searchText).arg(results.count()));
 
-	resultsWindow->table->setRowCount(results.count());
-	int i = 0;
+	resultsWindow->table->setHorizontalHeaderLabels(QStringList() << tr("File") << tr("Line") << tr("Start") << tr("End") << tr("Text"));
+	resultsWindow->table->horizontalHeader()->setSectionResizeMode(4, QHeaderView::Stretch);
+	resultsWindow->table->verticalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+	resultsWindow->table->verticalHeader()->hide();
+	resultsWindow->table->setColumnHidden(2, true);
+	resultsWindow->table->setColumnHidden(3, true);
+
+	if (singleFile) {
+		resultsWindow->setAllowedAreas(Qt::TopDockWidgetArea|Qt::BottomDockWidgetArea);
+		resultsWindow->setFloating(false);
+		parent->addDockWidget(Qt::TopDockWidgetArea, resultsWindow);
+	}
+	else {
+		resultsWindow->setAllowedAreas(Qt::NoDockWidgetArea);
+		resultsWindow->setFeatures(QDockWidget::NoDockWidgetFeatures);
+		resultsWindow->setParent(nullptr);
+		resultsWindow->setWindowFlags(Qt::Window | Qt::WindowStaysOnTopHint);
+	}
+	return resultsWindow;
+}
+
+// static
+SearchResults * SearchResults::startSearch(const QString& searchText,
+										   const QList<Request>& requests,
+										   QMainWindow* parent, bool singleFile)
+{
+	SearchResults* resultsWindow = create(parent, singleFile);
+	resultsWindow->_searchText = searchText;
+	resultsWindow->updateTitle();
+	resultsWindow->searchStatus->show();
+	resultsWindow->_watcher.setFuture(QtConcurrent::mapped(requests, &SearchResults::executeSearch));
+	resultsWindow->show();
+	return resultsWindow;
+}
+
+// static
+SearchResults * SearchResults::startProjectSearch(const QString& searchText,
+												  const Tw::Document::TextSearch& search,
+												  const QString& rootFilePath,
+												  QTextCodec* codec, QMainWindow* parent)
+{
+	SearchResults* resultsWindow = create(parent, false);
+	resultsWindow->_searchText = searchText;
+	resultsWindow->_projectSearch.reset(new Tw::Document::TextSearch(search));
+	resultsWindow->_projectDir = QFileInfo(rootFilePath).absolutePath();
+	resultsWindow->_codec = codec;
+	resultsWindow->updateTitle();
+	resultsWindow->searchStatus->show();
+	// The included files are only known once the root file has been
+	// searched, so the search proceeds level by level (see searchFinished())
+	if (!resultsWindow->searchProjectFiles(QStringList(rootFilePath)))
+		QTimer::singleShot(0, resultsWindow, &SearchResults::searchFinished);
+	resultsWindow->show();
+	return resultsWindow;
+}
+
+bool SearchResults::searchProjectFiles(const QStringList & fileNames)
+{
+	QList<Request> requests;
+	foreach (const QString & fileName, fileNames) {
+		// Files can be included several times (and under different names);
+		// files that don't exist (e.g., that are found by kpathsea) are skipped
+		const QString canonicalFilePath = QFileInfo(fileName).canonicalFilePath();
+		if (canonicalFilePath.isEmpty() || _projectFiles.contains(canonicalFilePath))
+			continue;
+		_projectFiles.insert(canonicalFilePath);
+
+		// Search open files as they are shown (including unsaved changes)
+		TeXDocumentWindow * doc = TeXDocumentWindow::findDocument(canonicalFilePath);
+		Request request = (doc ? Request(doc, doc->editor()->text(), *_projectSearch) : Request(canonicalFilePath, _codec, *_projectSearch));
+		request.fileName = canonicalFilePath;
+		// Bibliographies don't include anything
+		if (!canonicalFilePath.endsWith(QLatin1String(".bib"), Qt::CaseInsensitive))
+			request.projectDir = _projectDir;
+		requests.append(request);
+	}
+	if (requests.isEmpty())
+		return false;
+	_watcher.setFuture(QtConcurrent::mapped(requests, &SearchResults::executeSearch));
+	return true;
+}
+
+// static
+QString SearchResults::readFile(const QString & fileName, QTextCodec * codec)
+{
+	QFile file(fileName);
+	if (!file.open(QFile::ReadOnly))
+		return QString();
+	const qint64 size = file.size();
+	if (size > std::numeric_limits<int>::max())
+		return QString();
+
+	// Decode the text directly from the mapped file rather than copying it
+	// into a buffer first; fall back to reading if the file cannot be mapped
+	// (e.g., because it is empty)
+	uchar * data = (size > 0 ? file.map(0, size) : nullptr);
+	const QByteArray bytes = (data ? QByteArray::fromRawData(reinterpret_cast<const char*>(data), static_cast<int>(size)) : file.readAll());
+
+	// Honor "%!TEX encoding" modelines like TeXDocumentWindow::readFile()
+	bool hasMetadata{false};
+	QString reqName;
+	QTextCodec * reqCodec = TeXDocumentWindow::scanForEncoding(QString::fromUtf8(bytes.left(kPeekLength)), hasMetadata, reqName);
+	if (reqCodec)
+		codec = reqCodec;
+	QString text = (codec ? codec->toUnicode(bytes) : QString::fromUtf8(bytes));
+	if (data)
+		file.unmap(data);
+
+	// Normalize the line endings like TeXDocumentWindow::readFile() so that
+	// the positions of the results match the text in the editor
+	text.replace(QLatin1String("\r\n"), QChar::fromLatin1('\n'));
+	text.replace(QChar::fromLatin1('\r'), QChar::fromLatin1('\n'));
+	return text;
+}
+
+// static
+SearchResults::Response SearchResults::executeSearch(const Request & request)
+{
+	// NB: This runs in a worker thread, so it must only use the snapshot of
+	// the text (or the file) and not touch request.doc
+	Response response;
+	QList<SearchResult> & results = response.results;
+	const QString text = (request.text.isNull() ? readFile(request.fileName, request.codec) : request.text);
+	if (!request.projectDir.isEmpty())
+		response.inclusions = Tw::Document::TeXDocument::findInclusions(text, QDir(request.projectDir));
+	foreach (const Tw::Document::TextSearch::LineMatch & m, request.search.findAllLines(text))
+		results.append(SearchResult(request.doc, m.lineNo, m.start, m.end, m.lineText, request.fileName));
+	return response;
+}
+
+void SearchResults::addResults(const QList<SearchResult>& results)
+{
+	const bool wasEmpty = (table->rowCount() == 0);
+	int i = table->rowCount();
+	table->setRowCount(i + results.count());
 	foreach (const SearchResult &result, results) {
+		// The window may have been closed in the meantime (which only matters
+		// if there is no file to reopen)
+		if (!result.doc && result.fileName.isEmpty())
+			continue;
+		const QString fileName = (result.doc ? result.doc->fileName() : result.fileName);
 		QTableWidgetItem * item = new QTableWidgetItem();
-		if (result.doc->untitled()) {
-			item->setText(QFileInfo(result.doc->fileName()).fileName() + QStringLiteral("*"));
+		if (result.doc && result.doc->untitled()) {
+			item->setText(QFileInfo(fileName).fileName() + QStringLiteral("*"));
 			QFont f = item->font();
 			f.setItalic(true);
 			item->setFont(f);
 		}
+		else if (!_projectDir.isEmpty()) {
+			// Project files may have the same name in different directories
+			item->setText(QDir(_projectDir).relativeFilePath(fileName));
+		}
 		else {
-			item->setText(QFileInfo(result.doc->fileName()).fileName());
+			item->setText(QFileInfo(fileName).fileName());
 		}
-		item->setToolTip(result.doc->fileName());
-		item->setData(Qt::UserRole, QVariant::fromValue(QPointer<TeXDocumentWindow>(result.doc)));
-		resultsWindow->table->setItem(i, 0, item);
-		resultsWindow->table->setItem(i, 1, new QTableWidgetItem(QString::number(result.lineNo)));
-		resultsWindow->table->setItem(i, 2, new QTableWidgetItem(QString::number(result.selStart)));
-		resultsWindow->table->setItem(i, 3, new QTableWidgetItem(QString::number(result.selEnd)));
+		// NB: showEntry() opens the file if it is not open (anymore)
+		item->setToolTip(fileName);
+		item->setData(Qt::UserRole, QVariant::fromValue(result.doc));
+		table->setItem(i, 0, item);
+		table->setItem(i, 1, new QTableWidgetItem(QString::number(result.lineNo)));
+		table->setItem(i, 2, new QTableWidgetItem(QString::number(result.selStart)));
+		table->setItem(i, 3, new QTableWidgetItem(QString::number(result.selEnd)));
 
 		// Only show a limited number of characters before and after the
 		// specified search string to keep the results clear
 		bool truncateStart = true, truncateEnd = true;
-		QString text = result.doc->getLineText(result.lineNo);
+		QString text = (result.lineText.isNull() ? result.doc->getLineText(result.lineNo) : result.lineText);
 		int iStart = result.selStart - MAXIMUM_CHARACTERS_BEFORE_SEARCH_RESULT;
 		int iEnd = result.selEnd + MAXIMUM_CHARACTERS_AFTER_SEARCH_RESULT;
 		if (iStart < 0) {
@@ -522,34 +701,58 @@ void SearchResults::presentResults(const QString& searchText,
 			text.prepend(tr("..."));
 		if (truncateEnd)
 			text.append(tr("..."));
-		resultsWindow->table->setItem(i, 4, new QTableWidgetItem(text));
+		table->setItem(i, 4, new QTableWidgetItem(text));
 
 		++i;
 	}
+	// Drop the rows of skipped results
+	table->setRowCount(i);
+
+	// Resizing is expensive for large tables, so only do it for the first
+	// results (and once more when a search is finished)
+	if (wasEmpty) {
+		table->resizeColumnsToContents();
+		table->resizeRowsToContents();
+	}
+}
 
-	resultsWindow->table->setHorizontalHeaderLabels(QStringList() << tr("File") << tr("Line") << tr("Start") << tr("End") << tr("Text"));
-	resultsWindow->table->horizontalHeader()->setSectionResizeMode(4, QHeaderView::Stretch);
-	resultsWindow->table->verticalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
-	resultsWindow->table->verticalHeader()->hide();
-	resultsWindow->table->setColumnHidden(2, true);
-	resultsWindow->table->setColumnHidden(3, true);
+void SearchResults::updateTitle()
+{
+	setWindowTitle(tr("Search Results - %1 (%2 found)").arg(_searchText).arg(table->rowCount()));
+}
 
-	resultsWindow->table->resizeColumnsToContents();
-	resultsWindow->table->resizeRowsToContents();
+void SearchResults::resultsReadyAt(int beginIndex, int endIndex)
+{
+	for (int i = beginIndex; i < endIndex; ++i)
+		addResults(_watcher.resultAt(i).results);
+	updateTitle();
+}
 
-	if (singleFile) {
-		resultsWindow->setAllowedAreas(Qt::TopDockWidgetArea|Qt::BottomDockWidgetArea);
-		resultsWindow->setFloating(false);
-		parent->addDockWidget(Qt::TopDockWidgetArea, resultsWindow);
+void SearchResults::searchFinished()
+{
+	if (_projectSearch && !_watcher.isCanceled()) {
+		QStringList inclusions;
+		for (int i = 0; i < _watcher.future().resultCount(); ++i)
+			inclusions << _watcher.resultAt(i).inclusions;
+		if (searchProjectFiles(inclusions))
+			return;
 	}
-	else {
-		resultsWindow->setAllowedAreas(Qt::NoDockWidgetArea);
-		resultsWindow->setFeatures(QDockWidget::NoDockWidgetFeatures);
-		resultsWindow->setParent(nullptr);
-		resultsWindow->setWindowFlags(Qt::Window | Qt::WindowStaysOnTopHint);
+	searchStatus->hide();
+	table->resizeColumnsToContents();
+	table->resizeRowsToContents();
+	updateTitle();
+	emit finished(table->rowCount());
+	// There is nothing to show if nothing was found (the caller reports that
+	// instead)
+	if (table->rowCount() == 0) {
+		hide();
+		deleteLater();
 	}
+}
 
-	resultsWindow->show();
+void SearchResults::stopSearch()
+{
+	_watcher.cancel();
 }
 
 TeXDocumentWindow * SearchResults::showEntry(QTableWidgetItem * item)
@@ -629,7 +832,7 @@ void PDFFindDialog::init(PDFDocumentWindow *document)
 
 	QTextDocument::FindFlags flags = static_cast<QTextDocument::FindFlags>(settings.value(QString::fromLatin1("searchFlags")).toInt());
 	checkBox_case->setChecked((flags & QTextDocument::FindCaseSensitively) != 0);
-//	checkBox_words->setChecked((flags & QTextDocument::FindWholeWords) != 0);
+	checkBox_words->setChecked((flags & QTextDocument::FindWholeWords) != 0);
 //	checkBox_backwards->setChecked((flags & QTextDocument::FindBackward) != 0);
 //	checkBox_backwards->setEnabled(!findAll);
 
@@ -675,8 +878,8 @@ QDialog::DialogCode PDFFindDialog::doFindDialog(PDFDocumentWindow *document)
 		int flags = 0;
 		if (dlg.checkBox_case->isChecked())
 			flags |= QTextDocument::FindCaseSensitively;
-
-		flags |= (oldFlags & QTextDocument::FindWholeWords);
+		if (dlg.checkBox_words->isChecked())
+			flags |= QTextDocument::FindWholeWords;
 
 //		if (dlg.checkBox_backwards->isChecked())
 //			flags |= QTextDocument::FindBackward;
@@ -22,9 +22,16 @@
 #ifndef FindDialog_H
 #define FindDialog_H
 
+#include "document/TextSearch.h"
+
 #include <QDialog>
 #include <QDockWidget>
+#include <QFutureWatcher>
 #include <QList>
+#include <QPointer>
+#include <QScopedPointer>
+#include <QSet>
+#include <QStringList>
 
 #include "ui_Find.h"
 #include "ui_PDFFind.h"
@@ -32,6 +39,7 @@
 #include "ui_SearchResults.h"
 
 class TeXDocumentWindow;
+class QTextCodec;
 class QTextEdit;
 class PDFDocumentWindow;
 
@@ -64,6 +72,7 @@ public:
 
 private slots:
 	void toggledAllFilesOption(bool checked);
+	void toggledProjectFilesOption(bool checked);
 	void toggledFindAllOption(bool checked);
 	void toggledRegexOption(bool checked);
 	void toggledSelectionOption(bool checked);
@@ -124,15 +133,20 @@ private:
 
 class SearchResult {
 public:
-	SearchResult(TeXDocumentWindow * texdoc, int line, int start, int end)
-		: doc(texdoc), lineNo(line), selStart(start), selEnd(end)
+	SearchResult(const QPointer<TeXDocumentWindow> & texdoc, int line, int start, int end, const QString & text = QString(), const QString & file = QString())
+		: doc(texdoc), lineNo(line), selStart(start), selEnd(end), lineText(text), fileName(file)
 		{ }
 
-	// NB: doc cannot be a const * as we need to store it in a QVariant<QPointer>
-	TeXDocumentWindow* doc;
+	// NB: The window may be closed while the results are still being
+	// collected or shown
+	QPointer<TeXDocumentWindow> doc;
 	int lineNo;
 	int selStart;
 	int selEnd;
+	// The text of the line (if it was taken from a snapshot when searching)
+	QString lineText;
+	// The file that was searched (for files that need not be open in a window)
+	QString fileName;
 };
 
 class PDFSearchResult {
@@ -151,16 +165,82 @@ class SearchResults : public QDockWidget, private Ui::SearchResults
 	Q_OBJECT
 
 public:
-	static void presentResults(const QString& searchText, const QList<SearchResult>& results,
-							   QMainWindow* parent, bool singleFile);
+	// Snapshot of a document (or a file that is not open) to search in the
+	// background
+	struct Request {
+		Request(const QPointer<TeXDocumentWindow> & d, const QString & t, const Tw::Document::TextSearch & s)
+			: doc(d), text(t), search(s), codec(nullptr)
+			{ }
+		// The file is read in the background (with `c` unless it specifies
+		// its encoding in a modeline)
+		Request(const QString & file, QTextCodec * c, const Tw::Document::TextSearch & s)
+			: search(s), fileName(file), codec(c)
+			{ }
+
+		QPointer<TeXDocumentWindow> doc;
+		QString text;
+		Tw::Document::TextSearch search;
+		QString fileName;
+		QTextCodec * codec;
+		// If not empty, the files included by this one are collected, and
+		// relative names are resolved against this directory
+		QString projectDir;
+	};
+
+	struct Response {
+		QList<SearchResult> results;
+		QStringList inclusions;
+	};
+
+	// Searches all `requests` concurrently on the global thread pool; the
+	// results are shown as they come in, and the search can be stopped from
+	// the results window
+	static SearchResults * startSearch(const QString& searchText, const QList<Request>& requests,
+									   QMainWindow* parent, bool singleFile);
+	// Searches the project of `rootFilePath`, i.e., the root file and all
+	// files it (directly or indirectly) includes, whether they are open or
+	// not. Files are searched concurrently as they are discovered; files that
+	// are not open are read (using `codec` by default) in the background.
+	static SearchResults * startProjectSearch(const QString& searchText, const Tw::Document::TextSearch& search,
+											  const QString& rootFilePath, QTextCodec* codec, QMainWindow* parent);
 
 	explicit SearchResults(QWidget * parent);
+	~SearchResults() override;
+
+	static Response executeSearch(const Request & request);
+
+signals:
+	// Emitted when a search is done (or stopped); if nothing was found, the
+	// results window is closed afterwards
+	void finished(int numResults);
 
 private slots:
 	TeXDocumentWindow * showSelectedEntry();
 	TeXDocumentWindow * showEntry(QTableWidgetItem * item);
 	void goToSource();
 	void goToSourceAndClose();
+	void resultsReadyAt(int beginIndex, int endIndex);
+	void searchFinished();
+	void stopSearch();
+
+private:
+	static SearchResults * create(QMainWindow * parent, bool singleFile);
+	// Reads a file that is not open through a memory mapping (if possible)
+	static QString readFile(const QString & fileName, QTextCodec * codec);
+	// Starts searching those of `fileNames` that were not searched before;
+	// returns false if there are none
+	bool searchProjectFiles(const QStringList & fileNames);
+	void addResults(const QList<SearchResult>& results);
+	void updateTitle();
+
+	QString _searchText;
+	QFutureWatcher<Response> _watcher;
+
+	// Only used for project searches
+	QScopedPointer<Tw::Document::TextSearch> _projectSearch;
+	QString _projectDir;
+	QTextCodec * _codec{nullptr};
+	QSet<QString> _projectFiles;
 };
 
 #endif
@@ -313,6 +313,9 @@ void PDFDocumentWindow::init()
 
 	resetMagnifier();
 
+	// The tile cache is shared by all previews; its size is given in MB
+	QtPDF::Backend::PDFPageCache::globalCache().setMaxSize(qMax<qint64>(kMinPreviewTileCacheSize, settings.value(QStringLiteral("previewTileCacheSize"), kDefault_PreviewTileCacheSize).toLongLong()) * 1024 * 1024);
+
 	if (settings.contains(QString::fromLatin1("previewResolution"))) {
 #if QT_VERSION < QT_VERSION_CHECK(5, 14, 0)
 		pdfWidget->setResolution(settings.value(QString::fromLatin1("previewResolution"), QApplication::desktop()->logicalDpiX()).toInt());
@@ -966,6 +969,8 @@ void PDFDocumentWindow::doFindAgain(bool newSearch /* = false */)
 		searchFlags |= QtPDF::Backend::Search_CaseInsensitive;
 	if ((flags & QTextDocument::FindBackward) != 0)
 		searchFlags |= QtPDF::Backend::Search_Backwards;
+	if ((flags & QTextDocument::FindWholeWords) != 0)
+		searchFlags |= QtPDF::Backend::Search_WholeWords;
 
 	widget()->search(searchText, searchFlags);
 }
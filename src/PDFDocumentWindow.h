@@ -46,6 +46,10 @@ const int kDefault_PreviewScale = 200;
 const QtPDF::PDFDocumentView::PageMode kDefault_PDFPageMode = QtPDF::PDFDocumentView::PageMode_OneColumnContinuous;
 const bool kDefault_PreviewRulerShow = false;
 const int kDefault_PreviewRulerUnits = QtPDF::Physical::Length::Centimeters;
+// Size of the tile cache shared by all previews (in MB). There is no upper
+// limit; sizes beyond the physical memory only make the system swap.
+const int kDefault_PreviewTileCacheSize = 1024;
+const int kMinPreviewTileCacheSize = 64;
 
 const int kPDFWindowStateVersion = 1;
 
@@ -369,6 +369,7 @@ void PrefsDialog::restoreDefaults()
 			pdfRulerShow->setChecked(kDefault_PreviewRulerShow);
 
 			resolution->setDpi(QApplication::screens().first()->physicalDotsPerInch());
+			tileCacheSize->setValue(kDefault_PreviewTileCacheSize);
 
 			switch (TWSynchronizer::kDefault_Resolution_ToTeX) {
 				case TWSynchronizer::CharacterResolution:
@@ -637,6 +638,9 @@ QDialog::DialogCode PrefsDialog::doPrefsDialog(QWidget *parent)
 	double oldResolution = settings.value(QString::fromLatin1("previewResolution"), QApplication::screens().first()->physicalDotsPerInch()).toDouble();
 	dlg.resolution->setDpi(oldResolution);
 
+	dlg.tileCacheSize->setMinimum(kMinPreviewTileCacheSize);
+	dlg.tileCacheSize->setValue(settings.value(QStringLiteral("previewTileCacheSize"), kDefault_PreviewTileCacheSize).toInt());
+
 	int oldSyncToTeX = settings.value(QString::fromLatin1("syncResolutionToTeX"), TWSynchronizer::kDefault_Resolution_ToTeX).toInt();
 	dlg.cbSyncToTeX->setCurrentIndex(oldSyncToTeX);
 
@@ -823,6 +827,11 @@ QDialog::DialogCode PrefsDialog::doPrefsDialog(QWidget *parent)
 			}
 		}
 
+		// The tile cache is shared by all previews, so the new size applies
+		// right away
+		settings.setValue(QStringLiteral("previewTileCacheSize"), dlg.tileCacheSize->value());
+		QtPDF::Backend::PDFPageCache::globalCache().setMaxSize(static_cast<qint64>(dlg.tileCacheSize->value()) * 1024 * 1024);
+
 		int syncToTeX = dlg.cbSyncToTeX->currentIndex();
 		if (syncToTeX != oldSyncToTeX)
 			settings.setValue(QString::fromLatin1("syncResolutionToTeX"), syncToTeX);
@@ -26,6 +26,7 @@
 #include "Settings.h"
 #include "TWApp.h"
 #include "TeXDocumentWindow.h"
+#include "document/DelimiterIndex.h"
 #include "utils/FileVersionDatabase.h"
 #include "utils/ResourcesLibrary.h"
 #include "utils/VersionInfo.h"
@@ -698,6 +699,7 @@ void TWUtils::readConfig()
 			}
 		}
 	}
+	Tw::Document::DelimiterIndex::setDefaultPairs(pairClosers);
 
 	// defaults in case config file not found
 	sIncludeTextCommand			= QString::fromLatin1("\\include{%1}\n");
@@ -764,35 +766,6 @@ void TWUtils::readConfig()
 		setDefaultFilters();
 }
 
-int TWUtils::balanceDelim(const QString& text, int pos, QChar delim, int direction)
-{
-	int len = text.length();
-	QChar c;
-	while ((c = text[pos]) != delim) {
-		if (!openerMatching(c).isNull())
-			pos = (direction < 0) ? balanceDelim(text, pos - 1, openerMatching(c), -1) : -1;
-		else if (!closerMatching(c).isNull())
-			pos = (direction > 0) ? balanceDelim(text, pos + 1, closerMatching(c), 1) : -1;
-		if (pos < 0)
-			return -1;
-		pos += direction;
-		if (pos < 0 || pos >= len)
-			return -1;
-	}
-	return pos;
-}
-
-int TWUtils::findOpeningDelim(const QString& text, int pos)
-	// find the first opening delimiter before offset /pos/
-{
-	while (--pos >= 0) {
-		QChar c = text[pos];
-		if (!closerMatching(c).isNull())
-			return pos;
-	}
-	return -1;
-}
-
 void TWUtils::installCustomShortcuts(QWidget * widget, bool recursive /* = true */, QSettings * map /* = nullptr */)
 {
 	bool deleteMap = false;
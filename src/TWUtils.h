@@ -79,9 +79,6 @@ public:
 	static QChar openerMatching(QChar c);
 	static void readConfig();
 
-	static int balanceDelim(const QString& text, int pos, QChar delim, int direction);
-	static int findOpeningDelim(const QString& text, int pos);
-
 	static const QString& includeTextCommand();
 	static const QString& includePdfCommand();
 	static const QString& includeImageCommand();
@@ -33,6 +33,7 @@
 #include "TeXDocks.h"
 #include "TeXHighlighter.h"
 #include "TemplateDialog.h"
+#include "document/TextSearch.h"
 #include "scripting/ScriptAPI.h"
 #include "ui/ClickableLabel.h"
 #include "ui/RemoveAuxFilesDialog.h"
@@ -937,7 +938,7 @@ static const char* texshopSynonyms[] = {
 	nullptr
 };
 
-QTextCodec *TeXDocumentWindow::scanForEncoding(const QString &peekStr, bool &hasMetadata, QString &reqName)
+QTextCodec *TeXDocumentWindow::scanForEncoding(const QString &peekStr, bool &hasMetadata, QString &reqName) // static
 {
 	// peek at the file for %!TEX encoding = ....
 	QRegularExpression re(QStringLiteral(u"% *!TEX +encoding *= *([^\r\n\x2029]+)[\r\n\x2029]"), QRegularExpression::CaseInsensitiveOption);
@@ -948,14 +949,15 @@ QTextCodec *TeXDocumentWindow::scanForEncoding(const QString &peekStr, bool &has
 		reqName = m.captured(1).trimmed();
 		reqCodec = QTextCodec::codecForName(reqName.toLatin1());
 		if (!reqCodec) {
-			static QHash<QString,QString> *synonyms = nullptr;
-			if (!synonyms) {
-				synonyms = new QHash<QString,QString>;
+			// NB: Initializing a local static is thread-safe
+			static const QHash<QString,QString> synonyms = []() -> QHash<QString,QString> {
+				QHash<QString,QString> retVal;
 				for (int i = 0; texshopSynonyms[i]; i += 2)
-					synonyms->insert(QString::fromLatin1(texshopSynonyms[i]).toLower(), QString::fromLatin1(texshopSynonyms[i+1]));
-			}
-			if (synonyms->contains(reqName.toLower()))
-				reqCodec = QTextCodec::codecForName(synonyms->value(reqName.toLower()).toLatin1());
+					retVal.insert(QString::fromLatin1(texshopSynonyms[i]).toLower(), QString::fromLatin1(texshopSynonyms[i+1]));
+				return retVal;
+			}();
+			if (synonyms.contains(reqName.toLower()))
+				reqCodec = QTextCodec::codecForName(synonyms.value(reqName.toLower()).toLatin1());
 		}
 	}
 	else
@@ -1948,25 +1950,20 @@ void TeXDocumentWindow::setWindowModified(bool modified)
 
 void TeXDocumentWindow::balanceDelimiters()
 {
-	const QString text = textEdit->text();
+	const Tw::Document::DelimiterIndex & delimiters = textDoc()->delimiterIndex();
 	QTextCursor cursor = textEdit->textCursor();
-	int openPos = TWUtils::findOpeningDelim(text, cursor.selectionStart());
-	if (openPos >= 0 && openPos < text.length() - 1) {
-		do {
-			int closePos = TWUtils::balanceDelim(text, openPos + 1, TWUtils::closerMatching(text[openPos]), 1);
-			if (closePos < 0)
-				break;
-			if (closePos >= cursor.selectionEnd()) {
-				cursor.setPosition(openPos);
-				cursor.setPosition(closePos + 1, QTextCursor::KeepAnchor);
-				textEdit->setTextCursor(cursor);
-				return;
-			}
-			if (openPos > 0)
-				openPos = TWUtils::findOpeningDelim(text, openPos - 1);
-			else
-				break;
-		} while (openPos >= 0);
+	int openPos = delimiters.previousOpening(cursor.selectionStart());
+	while (openPos >= 0) {
+		int closePos = delimiters.match(openPos);
+		if (closePos < 0)
+			break;
+		if (closePos >= cursor.selectionEnd()) {
+			cursor.setPosition(openPos);
+			cursor.setPosition(closePos + 1, QTextCursor::KeepAnchor);
+			textEdit->setTextCursor(cursor);
+			return;
+		}
+		openPos = delimiters.previousOpening(openPos);
 	}
 	QApplication::beep();
 }
@@ -2307,52 +2304,37 @@ void TeXDocumentWindow::doFindAgain(bool fromDialog)
 		}
 	}
 
-	if (fromDialog && (settings.value(QString::fromLatin1("searchFindAll")).toBool() || settings.value(QString::fromLatin1("searchAllFiles")).toBool())) {
-		bool singleFile = true;
-		QList<SearchResult> results;
+	const bool projectFiles = (settings.value(QString::fromLatin1("searchProjectFiles")).toBool() && !untitled());
+	if (fromDialog && (settings.value(QString::fromLatin1("searchFindAll")).toBool() || settings.value(QString::fromLatin1("searchAllFiles")).toBool() || projectFiles)) {
 		flags &= ~QTextDocument::FindBackward;
-		int docListIndex = 0;
-		TeXDocumentWindow* theDoc = this;
-		while (true) {
-			QTextCursor curs(theDoc->textDoc());
-			curs.movePosition(QTextCursor::End);
-			int rangeStart = 0;
-			int rangeEnd = curs.position();
-			while (true) {
-				curs = theDoc->doSearch(searchText, regex, flags, rangeStart, rangeEnd);
-				if (curs.isNull())
-					break;
-				int blockStart = curs.block().position();
-				results.append(SearchResult(theDoc, curs.blockNumber() + 1,
-								curs.selectionStart() - blockStart, curs.selectionEnd() - blockStart));
-				if ((flags & QTextDocument::FindBackward) != 0)
-					rangeEnd = curs.selectionStart();
-				else
-					rangeStart = curs.selectionEnd();
-			}
-
-			if (!settings.value(QString::fromLatin1("searchAllFiles")).toBool())
-				break;
-			// go to next document
-		next_doc:
-			if (docList[docListIndex] == theDoc)
-				docListIndex++;
-			if (docListIndex == docList.count())
-				break;
-			theDoc = docList[docListIndex];
-			if (theDoc == this)
-				goto next_doc;
-			singleFile = false;
-		}
-
-		if (results.count() == 0) {
-			qApp->beep();
-			statusBar()->showMessage(tr("Not found"), kStatusMessageDuration);
+		const Tw::Document::TextSearch search(searchText, regex, flags);
+		SearchResults * resultsWindow = nullptr;
+		if (projectFiles) {
+			// The files (including those that are not open) are discovered
+			// from the root file and read and searched in the background
+			resultsWindow = SearchResults::startProjectSearch(searchText, search, getRootFilePath(), TWApp::instance()->getDefaultCodec(), this);
 		}
 		else {
-			SearchResults::presentResults(searchText, results, this, singleFile);
-			statusBar()->showMessage(tr("Found %n occurrence(s)", "", results.count()), kStatusMessageDuration);
+			// Snapshot the texts here, and search them concurrently in the
+			// background (the results are shown as they come in)
+			QList<SearchResults::Request> requests;
+			requests.append({this, textEdit->text(), search});
+			if (settings.value(QString::fromLatin1("searchAllFiles")).toBool()) {
+				foreach (TeXDocumentWindow * theDoc, docList) {
+					if (theDoc != this)
+						requests.append({theDoc, theDoc->textEdit->text(), search});
+				}
+			}
+			resultsWindow = SearchResults::startSearch(searchText, requests, this, requests.count() == 1);
 		}
+		connect(resultsWindow, &SearchResults::finished, this, [this](int numResults) {
+			if (numResults == 0) {
+				qApp->beep();
+				statusBar()->showMessage(tr("Not found"), kStatusMessageDuration);
+			}
+			else
+				statusBar()->showMessage(tr("Found %n occurrence(s)", "", numResults), kStatusMessageDuration);
+		});
 	}
 	else {
 		QTextCursor	curs = textEdit->textCursor();
@@ -2543,49 +2525,36 @@ void TeXDocumentWindow::doReplace(ReplaceDialog::DialogCode mode)
 int TeXDocumentWindow::doReplaceAll(const QString& searchText, QRegularExpression * regex, const QString& replacement,
 								QTextDocument::FindFlags flags, int rangeStart, int rangeEnd)
 {
-	QTextCursor searchRange = textCursor();
-	searchRange.select(QTextCursor::Document);
-	if (rangeStart < 0)
-		rangeStart = searchRange.selectionStart();
-	if (rangeEnd < 0)
-		rangeEnd = searchRange.selectionEnd();
-
-	int replacements = 0;
-	bool first = true;
-	while (true) {
-		QTextCursor curs = doSearch(searchText, regex, flags, rangeStart, rangeEnd);
-		if (curs.isNull()) {
-			if (!first)
-				searchRange.endEditBlock();
-			break;
-		}
-		if (first) {
-			searchRange.beginEditBlock();
-			first = false;
-		}
-		QString target;
-		int oldLen = curs.selectionEnd() - curs.selectionStart();
-		if (regex)
-			target = textEdit->text().mid(curs.selectionStart(), oldLen).replace(*regex, replacement);
-		else
-			target = replacement;
-		int newLen = target.length();
-		if ((flags & QTextDocument::FindBackward) != 0)
-			rangeEnd = curs.selectionStart();
-		else {
-			rangeStart = curs.selectionEnd() - oldLen + newLen;
-			rangeEnd += newLen - oldLen;
-		}
-		searchRange.setPosition(curs.selectionStart());
-		searchRange.setPosition(curs.selectionEnd(), QTextCursor::KeepAnchor);
-		searchRange.insertText(target);
-		++replacements;
+	// Compute all replacements on a snapshot of the text in one pass and apply
+	// them in a single edit block (so the whole operation can be undone in one
+	// step). Only the matches themselves are replaced (so the text in between
+	// and the tags in it are left alone), going backwards so the positions of
+	// the remaining ones stay valid.
+	const Tw::Document::TextSearch search(searchText, regex, flags);
+	const QVector<Tw::Document::TextSearch::Replacement> result = search.replaceAll(textEdit->text(), replacement, qMax(0, rangeStart), rangeEnd);
+	if (result.isEmpty())
+		return 0;
+
+	QTextCursor curs(textEdit->document());
+	curs.beginEditBlock();
+	for (int i = result.size() - 1; i >= 0; --i) {
+		curs.setPosition(result[i].start);
+		curs.setPosition(result[i].end, QTextCursor::KeepAnchor);
+		curs.insertText(result[i].text);
 	}
-	if (!first) {
-		searchRange.setPosition(rangeStart);
-		textEdit->setTextCursor(searchRange);
+	curs.endEditBlock();
+	// Put the cursor at the end of the last replacement (or at the start of
+	// the first one when searching backwards)
+	if ((flags & QTextDocument::FindBackward) != 0)
+		curs.setPosition(result.first().start);
+	else {
+		int end = result.last().end;
+		foreach (const Tw::Document::TextSearch::Replacement & r, result)
+			end += r.text.length() - (r.end - r.start);
+		curs.setPosition(end);
 	}
-	return replacements;
+	textEdit->setTextCursor(curs);
+	return result.size();
 }
 
 QTextCursor TeXDocumentWindow::doSearch(const QString& searchText, const QRegularExpression * regex, QTextDocument::FindFlags flags, int s, int e)
@@ -81,6 +81,9 @@ public:
 		}
 	static TeXDocumentWindow *openDocument(const QString &fileName, bool activate = true, bool raiseWindow = true,
 									 int lineNo = 0, int selStart = -1, int selEnd = -1);
+	// Returns the codec requested by a "%!TEX encoding" modeline in `peekStr`
+	// (if any); this is safe to use from any thread
+	static QTextCodec *scanForEncoding(const QString &peekStr, bool &hasMetadata, QString &reqName);
 
 	TeXDocumentWindow *open(const QString &fileName);
 	void makeUntitled();
@@ -233,7 +236,6 @@ private:
 	void detachPdf();
 	bool saveFilesHavingRoot(const QString& aRootFile);
 	void clearFileWatcher();
-	QTextCodec *scanForEncoding(const QString &peekStr, bool &hasMetadata, QString &reqName);
 	QString readFile(const QFileInfo & fileInfo, QTextCodec **codecUsed, int *lineEndings = nullptr, QTextCodec * forceCodec = nullptr);
 	void loadFile(const QFileInfo & fileInfo, bool asTemplate = false, bool inBackground = false, bool reload = false, QTextCodec * forceCodec = nullptr);
 	bool saveFile(const QFileInfo & fileInfo);
@@ -475,8 +475,13 @@ void NonblockingSyntaxHighlighter::pushDirtyRange(const int from, const int leng
 
 void NonblockingSyntaxHighlighter::markDirtyContent()
 {
-	for (auto& r : _dirtyRanges)
-		document()->markContentsDirty(r.from, r.to - r.from);
+	Tw::Document::TextDocument * textDoc = qobject_cast<Tw::Document::TextDocument*>(document());
+	for (auto& r : _dirtyRanges) {
+		if (textDoc)
+			textDoc->markFormatsDirty(r.from, r.to - r.from);
+		else
+			document()->markContentsDirty(r.from, r.to - r.from);
+	}
 	_dirtyRanges.clear();
 }
 
@@ -0,0 +1,551 @@
+/*
+	This is part of TeXworks, an environment for working with TeX documents
+	Copyright (C) 2022  Stefan Löffler
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	For links to further information, or to contact the authors,
+	see <http://www.tug.org/texworks/>.
+*/
+
+#include "document/DelimiterIndex.h"
+
+namespace Tw {
+namespace Document {
+
+namespace {
+
+QMap<QChar, QChar> & defaultPairsStorage()
+{
+	static QMap<QChar, QChar> pairs{
+		{QChar::fromLatin1('('), QChar::fromLatin1(')')},
+		{QChar::fromLatin1('['), QChar::fromLatin1(']')},
+		{QChar::fromLatin1('{'), QChar::fromLatin1('}')}
+	};
+	return pairs;
+}
+
+unsigned int & defaultPairsGenerationStorage()
+{
+	static unsigned int generation = 0;
+	return generation;
+}
+
+} // anonymous namespace
+
+DelimiterIndex::DelimiterIndex(const QMap<QChar, QChar> & pairs /* = defaultPairs() */)
+{
+	setPairs(pairs);
+}
+
+void DelimiterIndex::setPairs(const QMap<QChar, QChar> & pairs)
+{
+	clear();
+	_pairs = pairs;
+	_openingTypes.clear();
+	_closingTypes.clear();
+	int type = 0;
+	for (QMap<QChar, QChar>::const_iterator it = _pairs.constBegin(); it != _pairs.constEnd(); ++it, ++type) {
+		_openingTypes[it.key()] = type;
+		_closingTypes[it.value()] = type;
+	}
+}
+
+// static
+const QMap<QChar, QChar> & DelimiterIndex::defaultPairs()
+{
+	return defaultPairsStorage();
+}
+
+// static
+void DelimiterIndex::setDefaultPairs(const QMap<QChar, QChar> & pairs)
+{
+	defaultPairsStorage() = pairs;
+	++defaultPairsGenerationStorage();
+}
+
+// static
+unsigned int DelimiterIndex::defaultPairsGeneration()
+{
+	return defaultPairsGenerationStorage();
+}
+
+void DelimiterIndex::clear()
+{
+	_nodes.clear();
+	_freeNodes.clear();
+	_root = -1;
+}
+
+void DelimiterIndex::update(const int position, const int charsRemoved, const QString & addedText)
+{
+	const int begin = countBefore(position);
+	const int end = countBefore(position + qMax(0, charsRemoved));
+	int left{-1}, removed{-1}, right{-1}, first{-1};
+	split(_root, end, removed, right);
+	split(removed, begin, left, removed);
+	split(right, 1, first, right);
+
+	// Position of the first delimiter after the edit, before it was made
+	const int firstPos = (first < 0 ? 0 : span(left) + span(removed) + _nodes[static_cast<size_t>(first)].gap);
+	freeSubtree(removed);
+
+	int lastPos = span(left);
+	for (int i = 0; i < addedText.length(); ++i) {
+		int type{0}, direction{0};
+		if (!classify(addedText[i], type, direction))
+			continue;
+		left = merge(left, createNode(position + i - lastPos, type, direction));
+		lastPos = position + i;
+	}
+	const int added = size(left) - begin;
+
+	if (first >= 0) {
+		_nodes[static_cast<size_t>(first)].gap = firstPos - qMax(0, charsRemoved) + addedText.length() - lastPos;
+		pull(first);
+		left = merge(left, first);
+	}
+	_root = merge(left, right);
+
+	// Pair up the new delimiters
+	for (int i = begin; i < begin + added; ++i)
+		updatePairing(i);
+	// Later closing delimiters keep their partners unless those lie before the
+	// end of the edit. The ones that do are exactly those that take the
+	// nesting depth below all depths since the end of the edit.
+	int from = begin + added;
+	int level = depthAfter(from);
+	for (;;) {
+		const int index = firstDepthAtMost(_root, from, level - 1, 0, 0);
+		if (index < 0)
+			break;
+		updatePairing(index);
+		from = index + 1;
+		--level;
+	}
+}
+
+void DelimiterIndex::replace(const int position, const QString & text)
+{
+	// Find the range in which the delimiters in `text` differ from the
+	// indexed ones
+	int first{-1}, last{-1};
+	int index = countBefore(position);
+	int pos{0};
+	int n = nodeAt(index, pos);
+	for (int i = 0; i < text.length(); ++i) {
+		int type{0}, direction{0};
+		const bool isDelimiter = classify(text[i], type, direction);
+		const bool isIndexed = (n >= 0 && pos == position + i);
+		bool same = (isDelimiter == isIndexed);
+		if (isIndexed) {
+			const Node & node = _nodes[static_cast<size_t>(n)];
+			same = same && node.type == type && node.direction == direction;
+			n = nodeAt(++index, pos);
+		}
+		if (!same) {
+			if (first < 0)
+				first = i;
+			last = i;
+		}
+	}
+	if (first >= 0)
+		update(position + first, last - first + 1, text.mid(first, last - first + 1));
+}
+
+bool DelimiterIndex::isOpening(const int position) const
+{
+	int pos{0};
+	const int index = indexAt(position);
+	return (index >= 0 && _nodes[static_cast<size_t>(nodeAt(index, pos))].direction > 0);
+}
+
+bool DelimiterIndex::isClosing(const int position) const
+{
+	int pos{0};
+	const int index = indexAt(position);
+	return (index >= 0 && _nodes[static_cast<size_t>(nodeAt(index, pos))].direction < 0);
+}
+
+int DelimiterIndex::match(const int position) const
+{
+	const int index = indexAt(position);
+	if (index < 0)
+		return -1;
+
+	int pos{0};
+	const int after = depthAfter(index + 1);
+	if (_nodes[static_cast<size_t>(nodeAt(index, pos))].direction > 0) {
+		// The matching closing delimiter is the first one to go back below
+		// the nesting depth of the opening one
+		const int other = firstDepthAtMost(_root, index + 1, after - 1, 0, 0);
+		if (other < 0 || !typesMatch(index, other))
+			return -1;
+		return positionOf(other);
+	}
+	// The matching opening delimiter is the last one to start from the nesting
+	// depth after the closing one
+	const int other = lastDepthBeforeAtMost(_root, index, after, 0, 0);
+	if (other < 0 || !typesMatch(other, index))
+		return -1;
+	return positionOf(other);
+}
+
+int DelimiterIndex::previousOpening(const int position) const
+{
+	const int k = openingsBefore(countBefore(position));
+	if (k == 0)
+		return -1;
+	return positionOf(selectOpening(k - 1));
+}
+
+bool DelimiterIndex::classify(const QChar c, int & type, int & direction) const
+{
+	// Give precedence to closing delimiters (in case a character is used for
+	// both)
+	QMap<QChar, int>::const_iterator it = _closingTypes.constFind(c);
+	if (it != _closingTypes.constEnd()) {
+		type = it.value();
+		direction = -1;
+		return true;
+	}
+	it = _openingTypes.constFind(c);
+	if (it != _openingTypes.constEnd()) {
+		type = it.value();
+		direction = 1;
+		return true;
+	}
+	return false;
+}
+
+int DelimiterIndex::createNode(const int gap, const int type, const int direction)
+{
+	// xorshift32; the priorities only need to be "random enough" to keep the
+	// tree balanced
+	_seed ^= _seed << 13;
+	_seed ^= _seed >> 17;
+	_seed ^= _seed << 5;
+
+	Node node;
+	node.left = -1;
+	node.right = -1;
+	node.priority = _seed;
+	node.gap = gap;
+	node.type = type;
+	node.direction = direction;
+	node.mismatched = false;
+
+	int n{-1};
+	if (_freeNodes.empty()) {
+		n = static_cast<int>(_nodes.size());
+		_nodes.push_back(node);
+	}
+	else {
+		n = _freeNodes.back();
+		_freeNodes.pop_back();
+		_nodes[static_cast<size_t>(n)] = node;
+	}
+	pull(n);
+	return n;
+}
+
+void DelimiterIndex::freeSubtree(const int n)
+{
+	if (n < 0)
+		return;
+	freeSubtree(_nodes[static_cast<size_t>(n)].left);
+	freeSubtree(_nodes[static_cast<size_t>(n)].right);
+	_freeNodes.push_back(n);
+}
+
+void DelimiterIndex::pull(const int n)
+{
+	Node & node = _nodes[static_cast<size_t>(n)];
+	const int l = node.left;
+	const int r = node.right;
+	const int before = depth(l);
+	const int after = before + node.direction;
+
+	node.size = size(l) + 1 + size(r);
+	node.span = span(l) + node.gap + span(r);
+	node.depth = after + depth(r);
+	node.openings = openings(l) + (node.direction > 0 ? 1 : 0) + openings(r);
+	node.mismatches = mismatches(l) + (node.mismatched ? 1 : 0) + mismatches(r);
+	node.minDepth = after;
+	node.minDepthBefore = before;
+	if (l >= 0) {
+		node.minDepth = qMin(node.minDepth, _nodes[static_cast<size_t>(l)].minDepth);
+		node.minDepthBefore = qMin(node.minDepthBefore, _nodes[static_cast<size_t>(l)].minDepthBefore);
+	}
+	if (r >= 0) {
+		node.minDepth = qMin(node.minDepth, after + _nodes[static_cast<size_t>(r)].minDepth);
+		node.minDepthBefore = qMin(node.minDepthBefore, after + _nodes[static_cast<size_t>(r)].minDepthBefore);
+	}
+}
+
+int DelimiterIndex::merge(const int a, const int b)
+{
+	if (a < 0)
+		return b;
+	if (b < 0)
+		return a;
+	if (_nodes[static_cast<size_t>(a)].priority > _nodes[static_cast<size_t>(b)].priority) {
+		const int r = merge(_nodes[static_cast<size_t>(a)].right, b);
+		_nodes[static_cast<size_t>(a)].right = r;
+		pull(a);
+		return a;
+	}
+	const int l = merge(a, _nodes[static_cast<size_t>(b)].left);
+	_nodes[static_cast<size_t>(b)].left = l;
+	pull(b);
+	return b;
+}
+
+void DelimiterIndex::split(const int n, const int k, int & left, int & right)
+{
+	if (n < 0) {
+		left = right = -1;
+		return;
+	}
+	const int l = _nodes[static_cast<size_t>(n)].left;
+	if (k <= size(l)) {
+		int rest{-1};
+		split(l, k, left, rest);
+		_nodes[static_cast<size_t>(n)].left = rest;
+		pull(n);
+		right = n;
+	}
+	else {
+		int rest{-1};
+		split(_nodes[static_cast<size_t>(n)].right, k - size(l) - 1, rest, right);
+		_nodes[static_cast<size_t>(n)].right = rest;
+		pull(n);
+		left = n;
+	}
+}
+
+int DelimiterIndex::countBefore(const int position) const
+{
+	int count{0}, base{0};
+	int n = _root;
+	while (n >= 0) {
+		const Node & node = _nodes[static_cast<size_t>(n)];
+		const int pos = base + span(node.left) + node.gap;
+		if (pos < position) {
+			count += size(node.left) + 1;
+			base = pos;
+			n = node.right;
+		}
+		else
+			n = node.left;
+	}
+	return count;
+}
+
+int DelimiterIndex::indexAt(const int position) const
+{
+	int count{0}, base{0};
+	int n = _root;
+	while (n >= 0) {
+		const Node & node = _nodes[static_cast<size_t>(n)];
+		const int pos = base + span(node.left) + node.gap;
+		if (pos == position)
+			return count + size(node.left);
+		if (pos < position) {
+			count += size(node.left) + 1;
+			base = pos;
+			n = node.right;
+		}
+		else
+			n = node.left;
+	}
+	return -1;
+}
+
+int DelimiterIndex::nodeAt(int index, int & position) const
+{
+	int base{0};
+	int n = _root;
+	while (n >= 0) {
+		const Node & node = _nodes[static_cast<size_t>(n)];
+		const int leftSize = size(node.left);
+		if (index < leftSize)
+			n = node.left;
+		else {
+			base += span(node.left) + node.gap;
+			if (index == leftSize) {
+				position = base;
+				return n;
+			}
+			index -= leftSize + 1;
+			n = node.right;
+		}
+	}
+	return -1;
+}
+
+int DelimiterIndex::positionOf(const int index) const
+{
+	int position{-1};
+	nodeAt(index, position);
+	return position;
+}
+
+int DelimiterIndex::depthAfter(const int k) const
+{
+	int remaining = k, retVal{0};
+	int n = _root;
+	while (n >= 0 && remaining > 0) {
+		const Node & node = _nodes[static_cast<size_t>(n)];
+		if (remaining <= size(node.left))
+			n = node.left;
+		else {
+			retVal += depth(node.left) + node.direction;
+			remaining -= size(node.left) + 1;
+			n = node.right;
+		}
+	}
+	return retVal;
+}
+
+int DelimiterIndex::firstDepthAtMost(const int n, const int from, const int target, const int indexBase, const int depthBase) const
+{
+	if (n < 0 || indexBase + size(n) <= from)
+		return -1;
+	const Node & node = _nodes[static_cast<size_t>(n)];
+	// Skip subtrees that lie entirely in the search range but never get
+	// deep enough
+	if (indexBase >= from && depthBase + node.minDepth > target)
+		return -1;
+
+	const int retVal = firstDepthAtMost(node.left, from, target, indexBase, depthBase);
+	if (retVal >= 0)
+		return retVal;
+	const int index = indexBase + size(node.left);
+	const int after = depthBase + depth(node.left) + node.direction;
+	if (index >= from && after <= target)
+		return index;
+	return firstDepthAtMost(node.right, from, target, index + 1, after);
+}
+
+int DelimiterIndex::lastDepthBeforeAtMost(const int n, const int to, const int target, const int indexBase, const int depthBase) const
+{
+	if (n < 0 || indexBase >= to)
+		return -1;
+	const Node & node = _nodes[static_cast<size_t>(n)];
+	if (indexBase + size(n) <= to && depthBase + node.minDepthBefore > target)
+		return -1;
+
+	const int index = indexBase + size(node.left);
+	const int before = depthBase + depth(node.left);
+	const int retVal = lastDepthBeforeAtMost(node.right, to, target, index + 1, before + node.direction);
+	if (retVal >= 0)
+		return retVal;
+	if (index < to && before <= target)
+		return index;
+	return lastDepthBeforeAtMost(node.left, to, target, indexBase, depthBase);
+}
+
+int DelimiterIndex::selectOpening(int k) const
+{
+	int index{0};
+	int n = _root;
+	while (n >= 0) {
+		const Node & node = _nodes[static_cast<size_t>(n)];
+		const int leftOpenings = openings(node.left);
+		if (k < leftOpenings)
+			n = node.left;
+		else {
+			if (node.direction > 0 && k == leftOpenings)
+				return index + size(node.left);
+			k -= leftOpenings + (node.direction > 0 ? 1 : 0);
+			index += size(node.left) + 1;
+			n = node.right;
+		}
+	}
+	return -1;
+}
+
+int DelimiterIndex::openingsBefore(int k) const
+{
+	int retVal{0};
+	int n = _root;
+	while (n >= 0 && k > 0) {
+		const Node & node = _nodes[static_cast<size_t>(n)];
+		if (k <= size(node.left))
+			n = node.left;
+		else {
+			retVal += openings(node.left) + (node.direction > 0 ? 1 : 0);
+			k -= size(node.left) + 1;
+			n = node.right;
+		}
+	}
+	return retVal;
+}
+
+int DelimiterIndex::mismatchesBefore(int k) const
+{
+	int retVal{0};
+	int n = _root;
+	while (n >= 0 && k > 0) {
+		const Node & node = _nodes[static_cast<size_t>(n)];
+		if (k <= size(node.left))
+			n = node.left;
+		else {
+			retVal += mismatches(node.left) + (node.mismatched ? 1 : 0);
+			k -= size(node.left) + 1;
+			n = node.right;
+		}
+	}
+	return retVal;
+}
+
+bool DelimiterIndex::typesMatch(const int first, const int last) const
+{
+	// By construction, the delimiters first..last are balanced as far as
+	// their nesting depth is concerned, so every closing delimiter among them
+	// is paired with an opening one among them, too
+	return mismatchesBefore(last + 1) == mismatchesBefore(first);
+}
+
+void DelimiterIndex::updatePairing(const int index)
+{
+	int pos{0};
+	const Node & node = _nodes[static_cast<size_t>(nodeAt(index, pos))];
+	bool mismatched{false};
+	if (node.direction < 0) {
+		// The partner is the last delimiter to start from the nesting depth
+		// after this one (cf. match())
+		const int other = lastDepthBeforeAtMost(_root, index, depthAfter(index + 1), 0, 0);
+		mismatched = (other < 0 || _nodes[static_cast<size_t>(nodeAt(other, pos))].type != node.type);
+	}
+	if (mismatched != node.mismatched)
+		setMismatched(_root, index, mismatched);
+}
+
+void DelimiterIndex::setMismatched(const int n, const int index, const bool mismatched)
+{
+	Node & node = _nodes[static_cast<size_t>(n)];
+	const int leftSize = size(node.left);
+	if (index < leftSize)
+		setMismatched(node.left, index, mismatched);
+	else if (index > leftSize)
+		setMismatched(node.right, index - leftSize - 1, mismatched);
+	else
+		node.mismatched = mismatched;
+	pull(n);
+}
+
+} // namespace Document
+} // namespace Tw
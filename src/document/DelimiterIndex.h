@@ -0,0 +1,168 @@
+/*
+	This is part of TeXworks, an environment for working with TeX documents
+	Copyright (C) 2022  Stefan Löffler
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	For links to further information, or to contact the authors,
+	see <http://www.tug.org/texworks/>.
+*/
+#ifndef Document_DelimiterIndex_H
+#define Document_DelimiterIndex_H
+
+#include <QChar>
+#include <QMap>
+#include <QString>
+
+#include <vector>
+
+namespace Tw {
+namespace Document {
+
+// Index of the positions of all delimiters (e.g., braces) in a text, which can
+// be updated incrementally as the text is edited (see update()). The
+// delimiters are kept in a balanced search tree (a treap) that is ordered by
+// position and that aggregates the nesting depth, so matching delimiters can
+// be located without scanning (or even copying) the text.
+//
+// Delimiters are matched strictly, i.e., every delimiter in between must be
+// properly paired with one of its own kind. If it is not, there is no match. To check this without visiting the delimiters in
+// between, every closing delimiter records whether it is paired with an
+// opening one of a different kind, and the tree aggregates these records.
+class DelimiterIndex
+{
+public:
+	// `pairs` maps opening delimiters to their closing counterparts
+	explicit DelimiterIndex(const QMap<QChar, QChar> & pairs = defaultPairs());
+
+	const QMap<QChar, QChar> & pairs() const { return _pairs; }
+	// Changes the delimiters to look for; as the index cannot know the text,
+	// it is cleared and must be rebuilt with update()
+	void setPairs(const QMap<QChar, QChar> & pairs);
+
+	// The pairs used by TextDocument (and new indices by default); they
+	// are taken from the configuration by TWUtils::readConfig()
+	static const QMap<QChar, QChar> & defaultPairs();
+	static void setDefaultPairs(const QMap<QChar, QChar> & pairs);
+	// Incremented by every call to setDefaultPairs() so users can tell
+	// cheaply whether an index built from defaultPairs() is outdated
+	static unsigned int defaultPairsGeneration();
+
+	void clear();
+	// Updates the index after `charsRemoved` characters were replaced by
+	// `addedText` at `position` (cf. QTextDocument::contentsChange()). Only
+	// `addedText` is scanned, so the cost is independent of the text length
+	// (apart from a logarithmic factor).
+	// The pairing of the closing delimiters after the edit is rechecked only
+	// for those paired with an opening delimiter before the edit, so the cost
+	// also grows with the number of pairs enclosing the edit.
+	void update(const int position, const int charsRemoved, const QString & addedText);
+	// Updates the index after the characters starting at `position` were
+	// replaced by `text` of the same length (e.g., if only their formatting
+	// changed). Only the range in which the delimiters actually differ is
+	// updated.
+	void replace(const int position, const QString & text);
+
+	int count() const { return size(_root); }
+	bool isOpening(const int position) const;
+	bool isClosing(const int position) const;
+
+	// Returns the position of the delimiter matching the one at `position`,
+	// or -1 if there is no delimiter at `position` or it is unbalanced
+	int match(const int position) const;
+	// Returns the position of the last opening delimiter before `position`,
+	// or -1 if there is none
+	int previousOpening(const int position) const;
+
+private:
+	struct Node {
+		int left;
+		int right;
+		quint32 priority;
+		// Distance to the previous delimiter (or to the start of the text for
+		// the first one)
+		int gap;
+		int type;
+		// +1 for opening delimiters, -1 for closing delimiters
+		int direction;
+		// Whether this (closing) delimiter is unopened or paired with an
+		// opening delimiter of a different kind
+		bool mismatched;
+
+		// Aggregates of the subtree rooted in this node
+		int size;
+		int span; // sum of all gaps
+		int depth; // sum of all directions
+		int minDepth; // minimum nesting depth after any delimiter
+		int minDepthBefore; // minimum nesting depth before any delimiter
+		int openings;
+		int mismatches;
+	};
+
+	int size(const int n) const { return (n < 0 ? 0 : _nodes[static_cast<size_t>(n)].size); }
+	int span(const int n) const { return (n < 0 ? 0 : _nodes[static_cast<size_t>(n)].span); }
+	int depth(const int n) const { return (n < 0 ? 0 : _nodes[static_cast<size_t>(n)].depth); }
+	int openings(const int n) const { return (n < 0 ? 0 : _nodes[static_cast<size_t>(n)].openings); }
+	int mismatches(const int n) const { return (n < 0 ? 0 : _nodes[static_cast<size_t>(n)].mismatches); }
+
+	// Looks up the kind of delimiter `c` is (if any)
+	bool classify(const QChar c, int & type, int & direction) const;
+
+	int createNode(const int gap, const int type, const int direction);
+	void freeSubtree(const int n);
+	void pull(const int n);
+	int merge(const int a, const int b);
+	// Splits the subtree rooted in `n` into its first `k` delimiters and the rest
+	void split(const int n, const int k, int & left, int & right);
+
+	// Number of delimiters before `position`
+	int countBefore(const int position) const;
+	// Returns the index of the delimiter at `position` (or -1)
+	int indexAt(const int position) const;
+	// Returns the node of the `index`-th delimiter along with its position
+	int nodeAt(int index, int & position) const;
+	int positionOf(const int index) const;
+	// Nesting depth after the first `k` delimiters
+	int depthAfter(const int k) const;
+	// Index of the first delimiter at or after index `from` after which the
+	// nesting depth is at most `target` (or -1)
+	int firstDepthAtMost(const int n, const int from, const int target, const int indexBase, const int depthBase) const;
+	// Index of the last delimiter before index `to` before which the nesting
+	// depth is at most `target` (or -1)
+	int lastDepthBeforeAtMost(const int n, const int to, const int target, const int indexBase, const int depthBase) const;
+	// Index of the `k`-th (0-based) opening delimiter
+	int selectOpening(int k) const;
+	int openingsBefore(int k) const;
+	// Number of mismatched delimiters among the first `k` ones
+	int mismatchesBefore(int k) const;
+	// Checks that the delimiters with indices first..last are properly paired
+	bool typesMatch(const int first, const int last) const;
+	// Rechecks whether the `index`-th delimiter is mismatched
+	void updatePairing(const int index);
+	void setMismatched(const int n, const int index, const bool mismatched);
+
+	QMap<QChar, QChar> _pairs;
+	QMap<QChar, int> _openingTypes;
+	QMap<QChar, int> _closingTypes;
+
+	std::vector<Node> _nodes;
+	std::vector<int> _freeNodes;
+	int _root{-1};
+	quint32 _seed{0x9e3779b9};
+};
+
+} // namespace Document
+} // namespace Tw
+
+#endif // !defined(Document_DelimiterIndex_H)
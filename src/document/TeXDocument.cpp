@@ -22,9 +22,29 @@
 #include "document/TeXDocument.h"
 #include "TeXHighlighter.h"
 
+#include <QFileInfo>
+#include <QRegularExpression>
+
 namespace Tw {
 namespace Document {
 
+namespace {
+
+// Returns whether `pos` is preceded by an unescaped % on the same line
+bool isInComment(const QString & text, const int pos)
+{
+	int i = (pos > 0 ? text.lastIndexOf(QChar::fromLatin1('\n'), pos - 1) + 1 : 0);
+	for (; i < pos; ++i) {
+		if (text[i] == QChar::fromLatin1('\\'))
+			++i;
+		else if (text[i] == QChar::fromLatin1('%'))
+			return true;
+	}
+	return false;
+}
+
+} // anonymous namespace
+
 TeXDocument::TeXDocument(QObject * parent) : TextDocument(parent)
 {
 	connect(this, &TeXDocument::contentsChange, this, &TeXDocument::maybeUpdateModeLines);
@@ -229,5 +249,47 @@ bool TeXDocument::findNextWord(const QString & text, int index, int & start, int
 	return false;
 }
 
+QStringList TeXDocument::findInclusions(const QString & text, const QDir & baseDir)
+{
+	// NB: This is used from worker threads, so the regular expression is not
+	// shared (e.g., as a static variable)
+	const QRegularExpression re(QStringLiteral("\\\\(input|include|subfile|bibliography|addbibresource)\\s*(?:\\[[^\\]]*\\]\\s*)?\\{([^{}]*)\\}|\\\\input\\s+([^\\s{}%\\\\]+)"));
+	const QLatin1String bibliography("bibliography");
+
+	QStringList retVal;
+	QRegularExpressionMatchIterator it = re.globalMatch(text);
+	while (it.hasNext()) {
+		const QRegularExpressionMatch m = it.next();
+		if (isInComment(text, m.capturedStart()))
+			continue;
+		// An empty command corresponds to the plain TeX syntax \input file
+		const QString command = m.captured(1);
+		QStringList names;
+		if (command == bibliography)
+			names = m.captured(2).split(QChar::fromLatin1(','));
+		else
+			names << (command.isEmpty() ? m.captured(3) : m.captured(2));
+
+		foreach (QString name, names) {
+			name = name.trimmed();
+			if (name.length() >= 2 && name.startsWith(QChar::fromLatin1('"')) && name.endsWith(QChar::fromLatin1('"')))
+				name = name.mid(1, name.length() - 2);
+			if (name.isEmpty())
+				continue;
+			if (command == bibliography) {
+				// BibTeX always appends .bib, but a few users specify it anyway
+				if (!name.endsWith(QLatin1String(".bib"), Qt::CaseInsensitive))
+					name += QStringLiteral(".bib");
+			}
+			else if (command == QLatin1String("include"))
+				name += QStringLiteral(".tex");
+			else if (command != QLatin1String("addbibresource") && QFileInfo(name).suffix().isEmpty())
+				name += QStringLiteral(".tex");
+			retVal.append(QDir::cleanPath(baseDir.absoluteFilePath(name)));
+		}
+	}
+	return retVal;
+}
+
 } // namespace Document
 } // namespace Tw
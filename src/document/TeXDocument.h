@@ -23,7 +23,9 @@
 
 #include "document/TextDocument.h"
 
+#include <QDir>
 #include <QMap>
+#include <QStringList>
 
 class TeXHighlighter;
 
@@ -47,6 +49,14 @@ public:
 	// find a "word", in TeX terms, returning whether it's a natural-language word or a control seq, punctuation, etc
 	static bool findNextWord(const QString & text, int index, int & start, int & end);
 
+	// Returns the (absolute) paths of the files that `text` pulls in via
+	// \input, \include, \subfile, \bibliography, or \addbibresource (in order
+	// of appearance, skipping comments). Like TeX, relative names are
+	// resolved against `baseDir` (i.e., the directory of the root file), and
+	// the default extension (.tex or .bib) is appended if it is missing. The
+	// files are not required to exist.
+	static QStringList findInclusions(const QString & text, const QDir & baseDir);
+
 signals:
 	void modelinesChanged(QStringList changedKeys, QStringList removedKeys);
 
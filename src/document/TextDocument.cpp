@@ -21,12 +21,20 @@
 
 #include "document/TextDocument.h"
 
+#include <QTextBlock>
+
 namespace Tw {
 namespace Document {
 
-TextDocument::TextDocument(QObject * parent) : QTextDocument(parent) { }
+TextDocument::TextDocument(QObject * parent) : QTextDocument(parent)
+{
+	connect(this, &TextDocument::contentsChange, this, &TextDocument::updateDelimiterIndex);
+}
 
-TextDocument::TextDocument(const QString & text, QObject * parent) : QTextDocument(text, parent) { }
+TextDocument::TextDocument(const QString & text, QObject * parent) : QTextDocument(text, parent)
+{
+	connect(this, &TextDocument::contentsChange, this, &TextDocument::updateDelimiterIndex);
+}
 
 void TextDocument::addTag(const QTextCursor & cursor, const unsigned int level, const QString & text)
 {
@@ -62,5 +70,45 @@ unsigned int TextDocument::removeTags(int offset, int len)
 	return removed;
 }
 
+void TextDocument::ensureDelimiterIndex()
+{
+	const unsigned int generation = DelimiterIndex::defaultPairsGeneration();
+	if (_delimiterIndexValid && _delimiterIndexGeneration == generation)
+		return;
+	_delimiterIndex.setPairs(DelimiterIndex::defaultPairs());
+	// Go block by block to avoid copying the whole text at once
+	for (QTextBlock block = firstBlock(); block.isValid(); block = block.next())
+		_delimiterIndex.update(block.position(), 0, block.text());
+	_delimiterIndexValid = true;
+	_delimiterIndexGeneration = generation;
+}
+
+void TextDocument::markFormatsDirty(int from, int length)
+{
+	_markingFormatsDirty = true;
+	markContentsDirty(from, length);
+	_markingFormatsDirty = false;
+}
+
+void TextDocument::updateDelimiterIndex(int position, int charsRemoved, int charsAdded)
+{
+	// Nothing to do until the index is used for the first time (or if the
+	// text did not change at all)
+	if (!_delimiterIndexValid || _markingFormatsDirty)
+		return;
+	// NB: The change reported by Qt can extend into the (implicit) paragraph
+	// separator at the end of the document, which cannot be selected
+	const int end = characterCount() - 1;
+	QTextCursor cursor(this);
+	cursor.setPosition(qBound(0, position, end));
+	cursor.setPosition(qBound(0, position + charsAdded, end), QTextCursor::KeepAnchor);
+	// Changes of the formatting are reported as replacements of the same
+	// length, so only reindex the characters that actually changed
+	if (charsRemoved == charsAdded)
+		_delimiterIndex.replace(position, cursor.selectedText());
+	else
+		_delimiterIndex.update(position, charsRemoved, cursor.selectedText());
+}
+
 } // namespace Document
 } // namespace Tw
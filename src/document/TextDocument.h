@@ -21,6 +21,7 @@
 #ifndef Document_TextDocument_H
 #define Document_TextDocument_H
 
+#include "document/DelimiterIndex.h"
 #include "document/Document.h"
 
 #include <QTextCursor>
@@ -46,11 +47,30 @@ public:
 	void addTag(const QTextCursor & cursor, const unsigned int level, const QString & text);
 	unsigned int removeTags(int offset, int len);
 
+	// Index of the delimiters (with DelimiterIndex::defaultPairs()) in the
+	// document; it is (re)built by ensureDelimiterIndex() on first use and
+	// whenever the default pairs change, and kept up to date afterwards
+	const DelimiterIndex & delimiterIndex() { ensureDelimiterIndex(); return _delimiterIndex; }
+	void ensureDelimiterIndex();
+
+	// Like markContentsDirty(), but for changes that only affect the
+	// formatting (e.g., by the syntax highlighter), so the text need not be
+	// reindexed
+	void markFormatsDirty(int from, int length);
+
 signals:
 	void tagsChanged() const;
 
+protected slots:
+	void updateDelimiterIndex(int position, int charsRemoved, int charsAdded);
+
 protected:
 	QList<Tag> _tags;
+	DelimiterIndex _delimiterIndex;
+	bool _delimiterIndexValid{false};
+	// DelimiterIndex::defaultPairsGeneration() the index was built for
+	unsigned int _delimiterIndexGeneration{0};
+	bool _markingFormatsDirty{false};
 };
 
 } // namespace Document
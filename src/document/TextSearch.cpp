@@ -0,0 +1,180 @@
+/*
+	This is part of TeXworks, an environment for working with TeX documents
+	Copyright (C) 2022  Stefan Löffler
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	For links to further information, or to contact the authors,
+	see <http://www.tug.org/texworks/>.
+*/
+
+#include "document/TextSearch.h"
+
+namespace Tw {
+namespace Document {
+
+namespace {
+
+// Part of a replacement text: either a literal string or a reference to a
+// capture (if capture > 0)
+struct ReplacementPart {
+	QString literal;
+	int capture;
+};
+
+// Splits `replacement` at the back-references (\1 ... \99) following the
+// rules of QString::replace(const QRegularExpression &, const QString &)
+QVector<ReplacementPart> parseReplacement(const QString & replacement, const int numCaptures)
+{
+	QVector<ReplacementPart> parts;
+	int literalStart = 0;
+	for (int i = 0; i < replacement.length() - 1; ++i) {
+		if (replacement[i] != QChar::fromLatin1('\\'))
+			continue;
+		int no = replacement[i + 1].digitValue();
+		if (no <= 0 || no > numCaptures)
+			continue;
+		int len = 2;
+		if (i + 2 < replacement.length()) {
+			const int secondDigit = replacement[i + 2].digitValue();
+			if (secondDigit != -1 && no * 10 + secondDigit <= numCaptures) {
+				no = no * 10 + secondDigit;
+				++len;
+			}
+		}
+		if (i > literalStart)
+			parts.append({replacement.mid(literalStart, i - literalStart), 0});
+		parts.append({QString(), no});
+		literalStart = i + len;
+		i += len - 1;
+	}
+	if (literalStart < replacement.length())
+		parts.append({replacement.mid(literalStart), 0});
+	return parts;
+}
+
+} // anonymous namespace
+
+TextSearch::TextSearch(const QString & searchText, const QRegularExpression * regex, QTextDocument::FindFlags flags)
+	: _searchText(searchText)
+	, _isRegex(regex != nullptr)
+	, _flags(flags)
+{
+	if (regex)
+		_regex = *regex;
+}
+
+bool TextSearch::isValid() const
+{
+	if (_isRegex)
+		return _regex.isValid() && !_regex.pattern().isEmpty();
+	return !_searchText.isEmpty();
+}
+
+template<typename Callback>
+void TextSearch::forEachMatch(const QString & text, const int rangeStart, const int rangeEnd, Callback callback) const
+{
+	if (!isValid())
+		return;
+	const int end = (rangeEnd < 0 ? text.length() : qMin(rangeEnd, text.length()));
+	const int start = qMax(0, rangeStart);
+
+	if (_isRegex) {
+		// NB: Like in TeXDocumentWindow::doSearch(), the whole text is passed
+		// so anchors and lookbehinds work at the start of the range
+		QRegularExpressionMatchIterator it = _regex.globalMatch(text, start);
+		while (it.hasNext()) {
+			const QRegularExpressionMatch m = it.next();
+			if (m.capturedEnd() > end || !callback(m.capturedStart(), m.capturedEnd(), &m))
+				break;
+		}
+		return;
+	}
+
+	const Qt::CaseSensitivity cs = ((_flags & QTextDocument::FindCaseSensitively) != 0 ? Qt::CaseSensitive : Qt::CaseInsensitive);
+	const bool wholeWords = ((_flags & QTextDocument::FindWholeWords) != 0);
+	int from = start;
+	while (true) {
+		const int idx = text.indexOf(_searchText, from, cs);
+		if (idx < 0 || idx + _searchText.length() > end)
+			break;
+		const int matchEnd = idx + _searchText.length();
+		// Same criterion as QTextDocument::find()
+		if (wholeWords && ((idx > 0 && text[idx - 1].isLetterOrNumber()) || (matchEnd < text.length() && text[matchEnd].isLetterOrNumber()))) {
+			from = idx + 1;
+			continue;
+		}
+		if (!callback(idx, matchEnd, nullptr))
+			break;
+		from = matchEnd;
+	}
+}
+
+QVector<TextSearch::Match> TextSearch::findAll(const QString & text, const int rangeStart /* = 0 */, const int rangeEnd /* = -1 */) const
+{
+	QVector<Match> retVal;
+	forEachMatch(text, rangeStart, rangeEnd, [&retVal](const int start, const int end, const QRegularExpressionMatch *) -> bool {
+		retVal.append({start, end});
+		return true;
+	});
+	return retVal;
+}
+
+QVector<TextSearch::LineMatch> TextSearch::findAllLines(const QString & text) const
+{
+	QVector<LineMatch> retVal;
+	int lineNo = 1, lineStart = 0, scanned = 0;
+	// Several matches on the same line share the line text
+	int lineTextStart = -1;
+	QString lineText;
+	foreach (const Match & m, findAll(text)) {
+		for (; scanned < m.start; ++scanned) {
+			if (text[scanned] == QChar::fromLatin1('\n')) {
+				++lineNo;
+				lineStart = scanned + 1;
+			}
+		}
+		if (lineStart != lineTextStart) {
+			int lineEnd = text.indexOf(QChar::fromLatin1('\n'), lineStart);
+			if (lineEnd < 0)
+				lineEnd = text.length();
+			lineText = text.mid(lineStart, lineEnd - lineStart);
+			lineTextStart = lineStart;
+		}
+		retVal.append({lineNo, m.start - lineStart, m.end - lineStart, lineText});
+	}
+	return retVal;
+}
+
+QVector<TextSearch::Replacement> TextSearch::replaceAll(const QString & text, const QString & replacement, const int rangeStart /* = 0 */, const int rangeEnd /* = -1 */) const
+{
+	QVector<Replacement> retVal;
+	const QVector<ReplacementPart> parts = parseReplacement(replacement, (_isRegex ? _regex.captureCount() : 0));
+
+	forEachMatch(text, rangeStart, rangeEnd, [&](const int start, const int end, const QRegularExpressionMatch * m) -> bool {
+		QString target;
+		foreach (const ReplacementPart & part, parts) {
+			if (part.capture > 0 && m)
+				target.append(m->captured(part.capture));
+			else
+				target.append(part.literal);
+		}
+		retVal.append({start, end, target});
+		return true;
+	});
+	return retVal;
+}
+
+} // namespace Document
+} // namespace Tw
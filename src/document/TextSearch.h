@@ -0,0 +1,95 @@
+/*
+	This is part of TeXworks, an environment for working with TeX documents
+	Copyright (C) 2022  Stefan Löffler
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+	For links to further information, or to contact the authors,
+	see <http://www.tug.org/texworks/>.
+*/
+#ifndef Document_TextSearch_H
+#define Document_TextSearch_H
+
+#include <QRegularExpression>
+#include <QString>
+#include <QTextDocument>
+#include <QVector>
+
+namespace Tw {
+namespace Document {
+
+// Finds (and replaces) all occurrences of a literal string or a regular
+// expression in a plain text snapshot of a document (e.g., from
+// QTextDocument::toPlainText()) in a single pass. The text is never modified
+// in place, so a TextSearch can safely be used from several threads at once.
+class TextSearch
+{
+public:
+	struct Match {
+		int start;
+		int end;
+	};
+
+	struct LineMatch {
+		// 1-based number of the line the match starts in
+		int lineNo;
+		// Start and end of the match relative to the start of that line
+		int start;
+		int end;
+		QString lineText;
+	};
+
+	struct Replacement {
+		// The span of the original text that is matched and its new content
+		int start;
+		int end;
+		QString text;
+	};
+
+	// If `regex` is nullptr, `searchText` is searched for literally. Only
+	// QTextDocument::FindCaseSensitively and (for literal searches)
+	// QTextDocument::FindWholeWords are taken from `flags`.
+	TextSearch(const QString & searchText, const QRegularExpression * regex, QTextDocument::FindFlags flags);
+
+	bool isValid() const;
+
+	// Returns all (non-overlapping) matches that lie within
+	// [rangeStart, rangeEnd] in order; a negative rangeEnd means the end of
+	// `text`
+	QVector<Match> findAll(const QString & text, const int rangeStart = 0, const int rangeEnd = -1) const;
+	// Returns all matches in `text` along with the lines (separated by '\n')
+	// they are in; the text is only scanned once
+	QVector<LineMatch> findAllLines(const QString & text) const;
+
+	// Computes the replacements of all matches within [rangeStart, rangeEnd]
+	// by `replacement` in order; the text itself is left alone. For regular
+	// expressions, \1 ... \99 are substituted by the respective captures
+	// (like in QString::replace()).
+	QVector<Replacement> replaceAll(const QString & text, const QString & replacement, const int rangeStart = 0, const int rangeEnd = -1) const;
+
+private:
+	// Calls `callback` for every match in order until it returns false
+	template<typename Callback>
+	void forEachMatch(const QString & text, const int rangeStart, const int rangeEnd, Callback callback) const;
+
+	QString _searchText;
+	QRegularExpression _regex;
+	bool _isRegex;
+	QTextDocument::FindFlags _flags;
+};
+
+} // namespace Document
+} // namespace Tw
+
+#endif // !defined(Document_TextSearch_H)
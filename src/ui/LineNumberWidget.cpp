@@ -65,8 +65,10 @@ void LineNumberWidget::paintEvent(QPaintEvent * event)
 	if (!_editor)
 		return;
 
-	QTextBlock block = _editor->document()->begin();
-	int blockNumber = 1;
+	// Only the visible blocks are considered, so the cost of painting does not
+	// depend on the size of the document
+	QTextBlock block = blockAt(event->rect().top());
+	int blockNumber = block.blockNumber() + 1;
 
 	QAbstractTextDocumentLayout *layout = _editor->document()->documentLayout();
 	int top = static_cast<int>(layout->blockBoundingRect(block).top() - _editor->verticalScrollBar()->value());
@@ -94,9 +96,42 @@ void LineNumberWidget::changeEvent(QEvent * event)
 {
 	if (event->type() == QEvent::ParentChange) {
 		_editor = qobject_cast<QTextEdit*>(parentWidget());
+		_cachedBlockNumber = 0;
 	}
 	QWidget::changeEvent(event);
 }
 
+QTextBlock LineNumberWidget::blockAt(const int y)
+{
+	// Walking more blocks than fit on a typical screen is not worth it; the
+	// layout can find blocks by position without going through the whole
+	// document, too
+	constexpr int maxBlocksToWalk = 100;
+
+	QTextDocument * doc = _editor->document();
+	QAbstractTextDocumentLayout * layout = doc->documentLayout();
+	const qreal docY = y + _editor->verticalScrollBar()->value();
+
+	QTextBlock block = doc->findBlockByNumber(_cachedBlockNumber);
+	for (int attempt = 0; attempt < 2; ++attempt) {
+		for (int i = 0; block.isValid() && i < maxBlocksToWalk; ++i) {
+			// NB: The top of a block may not coincide with the bottom of the
+			// previous block in case the line spacing is not 100%
+			const QTextBlock next = block.next();
+			if (docY < layout->blockBoundingRect(block).top() && block.previous().isValid())
+				block = block.previous();
+			else if (next.isValid() && docY >= layout->blockBoundingRect(next).top())
+				block = next;
+			else {
+				_cachedBlockNumber = block.blockNumber();
+				return block;
+			}
+		}
+		block = _editor->cursorForPosition(QPoint(0, y)).block();
+	}
+	_cachedBlockNumber = qMax(0, block.blockNumber());
+	return block;
+}
+
 } // namespace UI
 } // namespace Tw
@@ -22,6 +22,7 @@
 #define LineNumberWidget_H
 
 #include <QPaintEvent>
+#include <QTextBlock>
 #include <QTextEdit>
 
 namespace Tw {
@@ -42,9 +43,18 @@ protected:
 	void paintEvent(QPaintEvent * event) override;
 	void changeEvent(QEvent * event) override;
 
+	// Returns the block shown at the vertical position y (in viewport
+	// coordinates) of the editor (or the last block if y is below the end of
+	// the document)
+	QTextBlock blockAt(const int y);
+
 private:
 	QTextEdit * _editor;
 	QColor _bgColor;
+
+	// Number of the block found by the last call to blockAt(); repaints (e.g.,
+	// while scrolling) mostly start in the same or a nearby block
+	int _cachedBlockNumber{0};
 };
 
 } // namespace UI
@@ -24,13 +24,16 @@
 #include "../modules/QtPDF/src/PDFBackend.h"
 #include "TWSynchronizer.h"
 #include "TeXHighlighter.h"
+#include "document/DelimiterIndex.h"
 #include "document/Document.h"
 #include "document/SpellChecker.h"
 #include "document/TeXDocument.h"
 #include "document/TextDocument.h"
+#include "document/TextSearch.h"
 #include "utils/ResourcesLibrary.h"
 
 #include <QSignalSpy>
+#include <QTextCharFormat>
 #include <limits>
 
 #if WITH_POPPLERQT
@@ -406,6 +409,323 @@ void TestDocument::findNextWord()
 	}
 }
 
+void TestDocument::findInclusions_data()
+{
+	QTest::addColumn<QString>("text");
+	QTest::addColumn<QStringList>("expected");
+
+	QTest::newRow("empty") << QString() << QStringList();
+	QTest::newRow("input") << QStringLiteral("\\input{intro}\\input {chap.tex}") << (QStringList() << QStringLiteral("intro.tex") << QStringLiteral("chap.tex"));
+	QTest::newRow("input-plain") << QStringLiteral("\\input intro \\input\tmacros.sty ") << (QStringList() << QStringLiteral("intro.tex") << QStringLiteral("macros.sty"));
+	QTest::newRow("include") << QStringLiteral("\\include{chapters/one}\n\\include{../two}") << (QStringList() << QStringLiteral("chapters/one.tex") << QStringLiteral("../two.tex"));
+	QTest::newRow("subfile") << QStringLiteral("\\subfile{ parts/a }\\subfile{\"my part\"}") << (QStringList() << QStringLiteral("parts/a.tex") << QStringLiteral("my part.tex"));
+	QTest::newRow("bibliography") << QStringLiteral("\\bibliographystyle{plain}\\bibliography{refs, more.bib,,}") << (QStringList() << QStringLiteral("refs.bib") << QStringLiteral("more.bib"));
+	QTest::newRow("addbibresource") << QStringLiteral("\\addbibresource[datatype=bibtex]{lit.bib}\\addbibresource{/abs/lit.json}") << (QStringList() << QStringLiteral("lit.bib") << QStringLiteral("/abs/lit.json"));
+	QTest::newRow("similar-commands") << QStringLiteral("\\inputencoding{utf8}\\includegraphics{fig}\\includeonly{one}\\inputlineno") << QStringList();
+	QTest::newRow("comments") << QStringLiteral("% \\input{a}\n50\\% \\input{b} % \\input{c}\n\\\\% \\input{d}") << (QStringList() << QStringLiteral("b.tex"));
+}
+
+void TestDocument::findInclusions()
+{
+	QFETCH(QString, text);
+	QFETCH(QStringList, expected);
+
+	// NB: The expected paths are relative to base (to be platform independent)
+	const QDir base(QStringLiteral("/base"));
+	for (QString & path : expected)
+		path = QDir::cleanPath(base.absoluteFilePath(path));
+
+	QCOMPARE(Tw::Document::TeXDocument::findInclusions(text, base), expected);
+}
+
+void TestDocument::DelimiterIndex_match_data()
+{
+	QTest::addColumn<QString>("text");
+	QTest::addColumn<int>("position");
+	QTest::addColumn<int>("expected");
+
+	QTest::newRow("empty") << QString() << 0 << -1;
+	QTest::newRow("no-delimiter") << QStringLiteral("a{b}") << 0 << -1;
+	QTest::newRow("forward") << QStringLiteral("a{b}") << 1 << 3;
+	QTest::newRow("backward") << QStringLiteral("a{b}") << 3 << 1;
+	QTest::newRow("nested-outer") << QStringLiteral("(a[b]{c}d)") << 0 << 9;
+	QTest::newRow("nested-inner") << QStringLiteral("(a[b]{c}d)") << 5 << 7;
+	QTest::newRow("nested-backward") << QStringLiteral("(a[b]{c}d)") << 9 << 0;
+	QTest::newRow("mismatch-inside") << QStringLiteral("(a[b)c]") << 0 << -1;
+	QTest::newRow("mismatch-outer") << QStringLiteral("(a]") << 0 << -1;
+	QTest::newRow("unclosed") << QStringLiteral("((a)") << 0 << -1;
+	QTest::newRow("unclosed-inner") << QStringLiteral("((a)") << 1 << 3;
+	QTest::newRow("unopened") << QStringLiteral("{a}}") << 3 << -1;
+}
+
+void TestDocument::DelimiterIndex_match()
+{
+	QFETCH(QString, text);
+	QFETCH(int, position);
+	QFETCH(int, expected);
+
+	Tw::Document::DelimiterIndex index;
+	index.update(0, 0, text);
+	QCOMPARE(index.match(position), expected);
+	if (expected >= 0)
+		QCOMPARE(index.match(expected), position);
+}
+
+void TestDocument::DelimiterIndex_update()
+{
+	Tw::Document::DelimiterIndex index;
+	index.update(0, 0, QStringLiteral("{(}) x [a]"));
+	QCOMPARE(index.match(0), -1);
+	QCOMPARE(index.match(1), -1);
+	QCOMPARE(index.match(7), 9);
+
+	// Fixing the order of the closing delimiters pairs them up
+	index.update(2, 2, QStringLiteral(")}"));
+	QCOMPARE(index.match(0), 3);
+	QCOMPARE(index.match(1), 2);
+	QCOMPARE(index.match(3), 0);
+
+	// Edits elsewhere leave the pairs alone
+	index.update(5, 0, QStringLiteral("(("));
+	QCOMPARE(index.match(0), 3);
+	QCOMPARE(index.match(5), -1);
+	QCOMPARE(index.match(9), 11);
+	QCOMPARE(index.match(11), 9);
+
+	// Removing (or replacing) an opening delimiter affects the later closing
+	// ones
+	index.update(0, 1, QString());
+	QCOMPARE(index.match(0), 1);
+	QCOMPARE(index.match(2), -1);
+	index.update(0, 0, QStringLiteral("["));
+	QCOMPARE(index.match(0), -1);
+	QCOMPARE(index.match(3), -1);
+	QCOMPARE(index.match(1), 2);
+
+	// Same-length replacements only update what actually changed
+	index.replace(3, QStringLiteral("]"));
+	QCOMPARE(index.match(0), 3);
+	QCOMPARE(index.match(3), 0);
+	index.replace(0, QStringLiteral("[()] ((x"));
+	QCOMPARE(index.count(), 8);
+	QCOMPARE(index.match(0), 3);
+	QCOMPARE(index.match(1), 2);
+	QCOMPARE(index.match(9), 11);
+	index.replace(4, QStringLiteral(")"));
+	QCOMPARE(index.count(), 9);
+	QCOMPARE(index.match(0), 3);
+	QCOMPARE(index.match(4), -1);
+	QCOMPARE(index.isClosing(4), true);
+	QCOMPARE(index.isOpening(5), true);
+	index.replace(2, QStringLiteral("]"));
+	QCOMPARE(index.count(), 9);
+	QCOMPARE(index.match(0), -1);
+	QCOMPARE(index.match(1), -1);
+	QCOMPARE(index.match(3), -1);
+}
+
+void TestDocument::TextDocument_delimiterIndex()
+{
+	const QString openers = QStringLiteral("([{");
+	const QString closers = QStringLiteral(")]}");
+	const QString alphabet = QStringLiteral("([{}])a\n");
+
+	// Straightforward stack-based matching as reference
+	auto reference = [&](const QString & text, int pos) -> int {
+		const int direction = (openers.contains(text[pos]) ? 1 : -1);
+		QString stack;
+		for (int i = pos; i >= 0 && i < text.length(); i += direction) {
+			const int open = (direction > 0 ? openers : closers).indexOf(text[i]);
+			const int close = (direction > 0 ? closers : openers).indexOf(text[i]);
+			if (open >= 0)
+				stack.append(text[i]);
+			else if (close >= 0) {
+				if (stack.isEmpty() || (direction > 0 ? openers : closers).indexOf(stack.at(stack.length() - 1)) != close)
+					return -1;
+				stack.chop(1);
+			}
+			if (stack.isEmpty())
+				return i;
+		}
+		return -1;
+	};
+
+	Tw::Document::TextDocument doc(QStringLiteral("{a}\n(b[c]d)"));
+	const Tw::Document::DelimiterIndex & index = doc.delimiterIndex();
+	auto verify = [&]() {
+		const QString text = doc.toPlainText();
+		int count = 0;
+		for (int pos = 0; pos < text.length(); ++pos) {
+			const bool isDelimiter = openers.contains(text[pos]) || closers.contains(text[pos]);
+			if (isDelimiter)
+				++count;
+			QCOMPARE(index.isOpening(pos), openers.contains(text[pos]));
+			QCOMPARE(index.isClosing(pos), closers.contains(text[pos]));
+			QCOMPARE(index.match(pos), isDelimiter ? reference(text, pos) : -1);
+		}
+		QCOMPARE(index.count(), count);
+	};
+	QCOMPARE(index.count(), 6);
+	QCOMPARE(index.match(0), 2);
+	QCOMPARE(index.previousOpening(0), -1);
+	QCOMPARE(index.previousOpening(5), 4);
+
+	// Edit the document randomly (but reproducibly) and check that the index
+	// is kept up to date
+	quint32 seed = 42;
+	auto random = [&seed](const int max) -> int {
+		seed = seed * 1664525u + 1013904223u;
+		return static_cast<int>((seed >> 8) % static_cast<quint32>(max));
+	};
+	for (int i = 0; i < 200; ++i) {
+		QTextCursor cursor(&doc);
+		cursor.setPosition(random(doc.characterCount()));
+		cursor.setPosition(qMin(cursor.position() + random(4), doc.characterCount() - 1), QTextCursor::KeepAnchor);
+		QString s;
+		for (int j = random(6); j > 0; --j)
+			s.append(alphabet[random(alphabet.length())]);
+		cursor.insertText(s);
+		verify();
+		if (QTest::currentTestFailed())
+			return;
+	}
+
+	// Changes of the formatting leave the index intact
+	QTextCursor cursor(&doc);
+	cursor.select(QTextCursor::Document);
+	QTextCharFormat format;
+	format.setFontWeight(QFont::Bold);
+	cursor.mergeCharFormat(format);
+	verify();
+	doc.markFormatsDirty(0, doc.characterCount());
+	verify();
+
+	// Changing the default pairs rebuilds the index on the next use
+	const QMap<QChar, QChar> defaultPairs = Tw::Document::DelimiterIndex::defaultPairs();
+	Tw::Document::DelimiterIndex::setDefaultPairs({{QChar::fromLatin1('('), QChar::fromLatin1(')')}});
+	const QString text = doc.toPlainText();
+	QCOMPARE(doc.delimiterIndex().count(), text.count(QChar::fromLatin1('(')) + text.count(QChar::fromLatin1(')')));
+	Tw::Document::DelimiterIndex::setDefaultPairs(defaultPairs);
+	doc.ensureDelimiterIndex();
+	verify();
+}
+
+void TestDocument::TextSearch_findAll_data()
+{
+	QTest::addColumn<QString>("text");
+	QTest::addColumn<QString>("searchText");
+	QTest::addColumn<bool>("isRegex");
+	QTest::addColumn<int>("flags");
+	QTest::addColumn<int>("rangeStart");
+	QTest::addColumn<int>("rangeEnd");
+	QTest::addColumn< QList<int> >("starts");
+
+	const int caseSensitive = static_cast<int>(QTextDocument::FindCaseSensitively);
+	const int wholeWords = static_cast<int>(QTextDocument::FindWholeWords);
+
+	QTest::newRow("empty") << QStringLiteral("foo") << QString() << false << 0 << 0 << -1 << QList<int>();
+	QTest::newRow("case-insensitive") << QStringLiteral("Foo foo fOO") << QStringLiteral("foo") << false << 0 << 0 << -1 << QList<int>({0, 4, 8});
+	QTest::newRow("case-sensitive") << QStringLiteral("Foo foo fOO") << QStringLiteral("foo") << false << caseSensitive << 0 << -1 << QList<int>({4});
+	QTest::newRow("whole-words") << QStringLiteral("foo food xfoo foo") << QStringLiteral("foo") << false << wholeWords << 0 << -1 << QList<int>({0, 14});
+	QTest::newRow("non-overlapping") << QStringLiteral("aaaaa") << QStringLiteral("aa") << false << 0 << 0 << -1 << QList<int>({0, 2});
+	QTest::newRow("range") << QStringLiteral("foo foo foo") << QStringLiteral("foo") << false << 0 << 1 << 10 << QList<int>({4});
+	QTest::newRow("regex") << QStringLiteral("a1 b22 c333") << QStringLiteral("[a-z](\\d+)") << true << 0 << 0 << -1 << QList<int>({0, 3, 7});
+	QTest::newRow("regex-range") << QStringLiteral("a1 b22 c333") << QStringLiteral("[a-z](\\d+)") << true << 0 << 1 << 6 << QList<int>({3});
+	QTest::newRow("regex-empty-matches") << QStringLiteral("ab") << QStringLiteral("x*") << true << 0 << 0 << -1 << QList<int>({0, 1, 2});
+}
+
+void TestDocument::TextSearch_findAll()
+{
+	QFETCH(QString, text);
+	QFETCH(QString, searchText);
+	QFETCH(bool, isRegex);
+	QFETCH(int, flags);
+	QFETCH(int, rangeStart);
+	QFETCH(int, rangeEnd);
+	QFETCH(QList<int>, starts);
+
+	const QRegularExpression regex(searchText);
+	const Tw::Document::TextSearch search(searchText, (isRegex ? &regex : nullptr), static_cast<QTextDocument::FindFlags>(flags));
+	QList<int> actual;
+	foreach (const Tw::Document::TextSearch::Match & m, search.findAll(text, rangeStart, rangeEnd)) {
+		QVERIFY(m.start >= rangeStart);
+		QVERIFY(rangeEnd < 0 || m.end <= rangeEnd);
+		actual << m.start;
+	}
+	QCOMPARE(actual, starts);
+}
+
+void TestDocument::TextSearch_findAllLines()
+{
+	auto describe = [](const QVector<Tw::Document::TextSearch::LineMatch> & matches) {
+		QStringList retVal;
+		foreach (const Tw::Document::TextSearch::LineMatch & m, matches)
+			retVal << QStringLiteral("%1:%2-%3:%4").arg(m.lineNo).arg(m.start).arg(m.end).arg(m.lineText);
+		return retVal;
+	};
+
+	// Like the "Find All" results for several documents, every document is
+	// searched (and its lines are counted) separately
+	const QStringList texts{
+		QStringLiteral("foo\nbar foo foo\n\nfoo"),
+		QStringLiteral("bar"),
+		QString(),
+		QStringLiteral("\n\nxfoo\n")
+	};
+	const QList<QStringList> expected{
+		{QStringLiteral("1:0-3:foo"), QStringLiteral("2:4-7:bar foo foo"), QStringLiteral("2:8-11:bar foo foo"), QStringLiteral("4:0-3:foo")},
+		{},
+		{},
+		{QStringLiteral("3:1-4:xfoo")}
+	};
+	const Tw::Document::TextSearch search(QStringLiteral("foo"), nullptr, QTextDocument::FindCaseSensitively);
+	for (int i = 0; i < texts.size(); ++i)
+		QCOMPARE(describe(search.findAllLines(texts[i])), expected[i]);
+
+	// Matches spanning several lines are reported for the line they start in
+	const QRegularExpression regex(QStringLiteral("o\\nb"));
+	const Tw::Document::TextSearch regexSearch(regex.pattern(), &regex, QTextDocument::FindCaseSensitively);
+	QCOMPARE(describe(regexSearch.findAllLines(texts[0])), QStringList{QStringLiteral("1:2-5:foo")});
+}
+
+void TestDocument::TextSearch_replaceAll_data()
+{
+	QTest::addColumn<QString>("text");
+	QTest::addColumn<QString>("searchText");
+	QTest::addColumn<bool>("isRegex");
+	QTest::addColumn<QString>("replacement");
+	QTest::addColumn<QString>("expected");
+	QTest::addColumn<int>("count");
+
+	QTest::newRow("no-match") << QStringLiteral("abc") << QStringLiteral("x") << false << QStringLiteral("y") << QStringLiteral("abc") << 0;
+	QTest::newRow("literal") << QStringLiteral("foo bar foo") << QStringLiteral("foo") << false << QStringLiteral("\\1") << QStringLiteral("\\1 bar \\1") << 2;
+	QTest::newRow("back-references") << QStringLiteral("a1 b22") << QStringLiteral("([a-z])(\\d+)") << true << QStringLiteral("\\2\\1") << QStringLiteral("1a 22b") << 2;
+	QTest::newRow("single-digit-reference") << QStringLiteral("aXa") << QStringLiteral("(a)") << true << QStringLiteral("\\10") << QStringLiteral("a0Xa0") << 2;
+	QTest::newRow("invalid-reference") << QStringLiteral("a") << QStringLiteral("(a)") << true << QStringLiteral("\\2") << QStringLiteral("\\2") << 1;
+	QTest::newRow("empty-matches") << QStringLiteral("ab") << QStringLiteral("x*") << true << QStringLiteral("-") << QStringLiteral("-a-b-") << 3;
+	QTest::newRow("multi-line") << QStringLiteral("a\nb\nc") << QStringLiteral("\\n") << true << QStringLiteral(" ") << QStringLiteral("a b c") << 2;
+}
+
+void TestDocument::TextSearch_replaceAll()
+{
+	QFETCH(QString, text);
+	QFETCH(QString, searchText);
+	QFETCH(bool, isRegex);
+	QFETCH(QString, replacement);
+	QFETCH(QString, expected);
+	QFETCH(int, count);
+
+	const QRegularExpression regex(searchText);
+	const Tw::Document::TextSearch search(searchText, (isRegex ? &regex : nullptr), QTextDocument::FindCaseSensitively);
+	const QVector<Tw::Document::TextSearch::Replacement> result = search.replaceAll(text, replacement);
+	QCOMPARE(result.size(), count);
+	// Apply the replacements from last to first so the positions of the
+	// remaining ones stay valid
+	for (int i = result.size() - 1; i >= 0; --i)
+		text.replace(result[i].start, result[i].end - result[i].start, result[i].text);
+	QCOMPARE(text, expected);
+}
+
 void TestDocument::SpellChecker_getDictionaryList()
 {
 	auto * sc = Tw::Document::SpellChecker::instance();
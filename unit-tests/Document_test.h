@@ -44,6 +44,17 @@ private slots:
 	void modelines();
 	void findNextWord_data();
 	void findNextWord();
+	void findInclusions_data();
+	void findInclusions();
+	void DelimiterIndex_match_data();
+	void DelimiterIndex_match();
+	void DelimiterIndex_update();
+	void TextDocument_delimiterIndex();
+	void TextSearch_findAll_data();
+	void TextSearch_findAll();
+	void TextSearch_findAllLines();
+	void TextSearch_replaceAll_data();
+	void TextSearch_replaceAll();
 
 	void SpellChecker_getDictionaryList();
 	void SpellChecker_getDictionary();
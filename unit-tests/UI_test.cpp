@@ -26,7 +26,9 @@
 #include "ui/LineNumberWidget.h"
 #include "ui/ScreenCalibrationWidget.h"
 
+#include <QAbstractTextDocumentLayout>
 #include <QDoubleSpinBox>
+#include <QScrollBar>
 #include <QTabBar>
 
 namespace UnitTest {
@@ -41,6 +43,13 @@ public:
 	QMenu & contextMenu() { return _contextMenu; }
 };
 
+class LineNumberWidget : public Tw::UI::LineNumberWidget
+{
+public:
+	explicit LineNumberWidget(QTextEdit * parent) : Tw::UI::LineNumberWidget(parent) { }
+	using Tw::UI::LineNumberWidget::blockAt;
+};
+
 class ClosableTabWidget : public Tw::UI::ClosableTabWidget
 {
 public:
@@ -121,6 +130,76 @@ void TestUI::LineNumberWidget_setParent()
 #endif
 }
 
+void TestUI::LineNumberWidget_blockAt()
+{
+	QTextEdit e;
+	e.resize(300, 200);
+	LineNumberWidget w(&e);
+	QStringList lines;
+	for (int i = 0; i < 2000; ++i)
+		lines << QStringLiteral("Line %1").arg(i + 1);
+	e.setPlainText(lines.join(QChar::fromLatin1('\n')));
+	// Lay out the whole document so the scroll range is known
+	e.document()->documentLayout()->documentSize();
+
+	// Reference: the first block that ends below y
+	auto expectedBlockAt = [&e](const int y) -> int {
+		const qreal docY = y + e.verticalScrollBar()->value();
+		QTextBlock block = e.document()->begin();
+		while (block.next().isValid() && e.document()->documentLayout()->blockBoundingRect(block.next()).top() <= docY)
+			block = block.next();
+		return block.blockNumber();
+	};
+
+	QScrollBar * scrollBar = e.verticalScrollBar();
+	QVERIFY(scrollBar->maximum() > 0);
+	// Jump far (not using the cache) and scroll in small steps (using it)
+	foreach(const int value, QList<int>({0, scrollBar->maximum(), scrollBar->maximum() / 2, scrollBar->maximum() / 2 + 7, scrollBar->maximum() / 2 - 50, scrollBar->maximum() / 3})) {
+		scrollBar->setValue(value);
+		foreach(const int y, QList<int>({0, 1, 50, 199}))
+			QCOMPARE(w.blockAt(y).blockNumber(), expectedBlockAt(y));
+	}
+
+	// Removing lines invalidates the cached block number
+	scrollBar->setValue(scrollBar->maximum());
+	QCOMPARE(w.blockAt(0).blockNumber(), expectedBlockAt(0));
+	e.setPlainText(QStringLiteral("a\nb\nc"));
+	QCOMPARE(w.blockAt(0).blockNumber(), 0);
+	QCOMPARE(w.blockAt(1000).blockNumber(), 2);
+}
+
+void TestUI::LineNumberWidget_paintBenchmark_data()
+{
+	QTest::addColumn<qreal>("position");
+
+	QTest::newRow("begin") << 0.;
+	QTest::newRow("middle") << .5;
+	QTest::newRow("end") << 1.;
+}
+
+void TestUI::LineNumberWidget_paintBenchmark()
+{
+	QFETCH(qreal, position);
+
+	QTextEdit e;
+	e.resize(400, 600);
+	Tw::UI::LineNumberWidget w(&e);
+	w.setGeometry(0, 0, 50, 600);
+
+	QStringList lines;
+	for (int i = 0; i < 60000; ++i)
+		lines << QStringLiteral("\\item Generated line %1").arg(i + 1);
+	e.setPlainText(lines.join(QChar::fromLatin1('\n')));
+	e.document()->documentLayout()->documentSize();
+	e.verticalScrollBar()->setValue(static_cast<int>(position * e.verticalScrollBar()->maximum()));
+
+	// Painting should only depend on the number of visible lines, i.e., take
+	// the same time regardless of the position in the document
+	QBENCHMARK {
+		w.grab();
+	}
+}
+
 void TestUI::ScreenCalibrationWidget_dpi()
 {
 	Tw::UI::ScreenCalibrationWidget w;
@@ -30,6 +30,9 @@ private slots:
 	void LineNumberWidget_sizeHint();
 	void LineNumberWidget_paint();
 	void LineNumberWidget_setParent();
+	void LineNumberWidget_blockAt();
+	void LineNumberWidget_paintBenchmark_data();
+	void LineNumberWidget_paintBenchmark();
 
 	void ScreenCalibrationWidget_dpi();
 	void ScreenCalibrationWidget_drag();